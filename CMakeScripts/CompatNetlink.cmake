@@ -0,0 +1,30 @@
+IF (DEFINED HAVE_NETLINK)
+    RETURN()
+ENDIF ()
+
+INCLUDE(CheckIncludeFile)
+
+MESSAGE(STATUS "Looking for rtnetlink")
+
+SET(CMAKE_REQUIRED_QUIET TRUE)
+CHECK_INCLUDE_FILE("linux/rtnetlink.h" HAVE_NETLINK)
+UNSET(CMAKE_REQUIRED_QUIET)
+IF (HAVE_NETLINK)
+    MESSAGE(STATUS "Looking for rtnetlink - found")
+    SET(
+        HAVE_NETLINK 1
+        CACHE INTERNAL
+        "rtnetlink found on the system"
+    )
+ELSE ()
+    MESSAGE(
+        STATUS
+        "Looking for rtnetlink - not found, the network interfaces will be "
+        "listed periodically"
+    )
+    SET(
+        HAVE_NETLINK 0
+        CACHE INTERNAL
+        "rtnetlink not found, listing the network interfaces periodically"
+    )
+ENDIF ()
@@ -0,0 +1,27 @@
+IF (DEFINED HAVE_RECVMMSG)
+    RETURN()
+ENDIF ()
+
+MESSAGE(STATUS "Looking for recvmmsg")
+
+SET(CMAKE_REQUIRED_QUIET TRUE)
+CHECK_FUNCTION_EXISTS("recvmmsg" HAVE_RECVMMSG)
+UNSET(CMAKE_REQUIRED_QUIET)
+IF (HAVE_RECVMMSG)
+    MESSAGE(STATUS "Looking for recvmmsg - found")
+    SET(
+        HAVE_RECVMMSG 1
+        CACHE INTERNAL
+        "recvmmsg found on the system"
+    )
+ELSE ()
+    MESSAGE(
+        STATUS
+        "Looking for recvmmsg - not found, falling back on recvfrom"
+    )
+    SET(
+        HAVE_RECVMMSG 0
+        CACHE INTERNAL
+        "recvmmsg not found, using recvfrom"
+    )
+ENDIF ()
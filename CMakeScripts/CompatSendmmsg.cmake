@@ -0,0 +1,27 @@
+IF (DEFINED HAVE_SENDMMSG)
+    RETURN()
+ENDIF ()
+
+MESSAGE(STATUS "Looking for sendmmsg")
+
+SET(CMAKE_REQUIRED_QUIET TRUE)
+CHECK_FUNCTION_EXISTS("sendmmsg" HAVE_SENDMMSG)
+UNSET(CMAKE_REQUIRED_QUIET)
+IF (HAVE_SENDMMSG)
+    MESSAGE(STATUS "Looking for sendmmsg - found")
+    SET(
+        HAVE_SENDMMSG 1
+        CACHE INTERNAL
+        "sendmmsg found on the system"
+    )
+ELSE ()
+    MESSAGE(
+        STATUS
+        "Looking for sendmmsg - not found, falling back on evbuffer_write_atmost"
+    )
+    SET(
+        HAVE_SENDMMSG 0
+        CACHE INTERNAL
+        "sendmmsg not found, using evbuffer_write_atmost"
+    )
+ENDIF ()
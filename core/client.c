@@ -30,10 +30,12 @@
 #include <event2/event.h>
 
 #include "lifx/wire_proto.h"
+#include "time_monotonic.h"
 #include "jsmn.h"
 #include "jsonrpc.h"
 #include "client.h"
 #include "proto.h"
+#include "subscription.h"
 #include "stats.h"
 #include "daemon.h"
 #include "lightsd.h"
@@ -49,6 +51,7 @@ lgtd_client_close(struct lgtd_client *client)
     LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(clients, -1);
 
     LIST_REMOVE(client, link);
+    lgtd_subscription_remove(client);
     if (client->io) { // XXX: see ugly hack in lgtd_jsonrpc_dispatch_one
         bufferevent_free(client->io);
     }
@@ -77,64 +80,22 @@ lgtd_client_read_callback(struct bufferevent *bev, void *ctx)
     LGTD_SOCKADDRTOA(client->addr, addr);
 
     struct evbuffer *input = bufferevent_get_input(bev);
-    size_t nbytes = evbuffer_get_contiguous_space(input);
+    int nbytes = evbuffer_get_length(input);
     // Get the actual pointer to the beginning of the evbuf:
-    const char *buf = (char *)evbuffer_pullup(input, nbytes);
-
-    jsmntok_t *tokens = NULL;
-    int ntokens = 0;
-    do {
-        jsmn_parser jsmn_ctx;
-    parse_after_realloc:
-        jsmn_init(&jsmn_ctx);
-        int rv = jsmn_parse(&jsmn_ctx, buf, nbytes, tokens, ntokens);
-        switch (rv) {
-        case JSMN_ERROR_NOMEM:
-        case JSMN_ERROR_INVAL:
-            lgtd_warnx("client %s: request too big or invalid", addr);
-            evbuffer_drain(input, nbytes);
-            break;
-        case JSMN_ERROR_PART:
-        case 0:
-            (void)0;
-            size_t buflen = evbuffer_get_length(input);
-            if (buflen > LGTD_CLIENT_MAX_REQUEST_BUF_SIZE) {
-                lgtd_warnx("client %s: request too big or invalid", addr);
-                evbuffer_drain(input, buflen);
-            } else if (nbytes == buflen) {
-                return; // We pulled up everything already, wait for more data
-            }
-            break;
-        default:
-            ntokens = rv;
-            if (tokens) {
-                client->json = buf;
-                lgtd_jsonrpc_dispatch_request(client, ntokens);
-                client->json = NULL;
-                size_t request_size = tokens[0].end;
-                tokens = NULL;
-                evbuffer_drain(input, request_size);
-                if (request_size < nbytes) {
-                    buf += request_size;
-                    nbytes -= request_size;
-                    // FIXME: instead of calling jsmn_parse again, return the
-                    // number of tokens consumed from jsonrpc and make this
-                    // case a loop.
-                    continue;
-                }
-                break;
-            } else {
-                client->jsmn_tokens = reallocarray(
-                    client->jsmn_tokens, ntokens, sizeof(*tokens)
-                );
-                tokens = client->jsmn_tokens;
-                goto parse_after_realloc;
-            }
-        }
-        // pullup and resume parsing:
-        buf = (char *)evbuffer_pullup(input, -1);
-        nbytes = evbuffer_get_contiguous_space(input);
-    } while (nbytes);
+    const char *buf = (char *)evbuffer_pullup(input, -1);
+
+    int consumed = lgtd_client_input_parse(client, buf, nbytes);
+    if (consumed == -1 || nbytes - consumed > LGTD_CLIENT_MAX_REQUEST_BUF_SIZE) {
+        lgtd_warnx("client %s: request too big or invalid", addr);
+        lgtd_client_input_reset(client);
+        consumed = nbytes;
+    }
+    if (consumed) {
+        evbuffer_drain(input, consumed);
+    }
+
+    // the changes held while the response to a batch was being written:
+    lgtd_subscription_send_pending(client);
 }
 
 static void
@@ -17,7 +17,9 @@
 
 #pragma once
 
+// Maximum size of a request or of an element of a batch:
 enum { LGTD_CLIENT_MAX_REQUEST_BUF_SIZE = 4096 };
+enum { LGTD_CLIENT_MIN_JSMN_TOKENS = 32 };
 
 enum lgtd_client_error_code {
     LGTD_CLIENT_SUCCESS = LGTD_JSONRPC_SUCCESS,
@@ -34,14 +36,29 @@ struct lgtd_client {
     struct bufferevent          *io;
     struct sockaddr             *addr;
     jsmntok_t                   *jsmn_tokens;
+    int                         jsmn_tokens_size;
+    // kept across reads so each byte of input is only tokenized once, see
+    // lgtd_client_input_parse:
+    jsmn_parser                 jsmn_ctx;
     const char                  *json;
     struct lgtd_jsonrpc_request *current_request;
+    // set by the synchronize method for the rest of the request or batch,
+    // see lgtd_proto_synchronize:
+    lgtd_time_mono_t            sync_at;
+    // responses written for the batch being dispatched, its elements are
+    // dispatched one by one as they are received, see lgtd_client_input_parse:
+    int                         batch_sent;
+    // set by the subscribe method, see lgtd_subscription_add:
+    struct lgtd_subscription    *subscription;
 };
 LIST_HEAD(lgtd_client_list, lgtd_client);
 
 struct lgtd_client *lgtd_client_open(evutil_socket_t, const struct sockaddr *, int);
 void lgtd_client_close_all(void);
 
+int lgtd_client_input_parse(struct lgtd_client *, const char *, int);
+void lgtd_client_input_reset(struct lgtd_client *);
+
 void lgtd_client_write_string(struct lgtd_client *, const char *);
 void lgtd_client_write_buf(struct lgtd_client *, const char *, int);
 void lgtd_client_send_response(struct lgtd_client *, const char *);
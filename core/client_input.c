@@ -0,0 +1,207 @@
+// Copyright (c) 2015, Louis Opter <kalessin@kalessin.fr>
+//
+// This file is part of lighstd.
+//
+// lighstd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// lighstd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with lighstd.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <sys/queue.h>
+#include <sys/tree.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <event2/util.h>
+
+#include "lifx/wire_proto.h"
+#include "time_monotonic.h"
+#include "jsmn.h"
+#include "jsonrpc.h"
+#include "client.h"
+#include "lightsd.h"
+
+void
+lgtd_client_input_reset(struct lgtd_client *client)
+{
+    assert(client);
+
+    jsmn_init(&client->jsmn_ctx);
+    // the beginning of a batch might have been dispatched already:
+    if (client->batch_sent) {
+        lgtd_jsonrpc_end_batch(client);
+    }
+}
+
+static bool
+lgtd_client_input_grow_tokens(struct lgtd_client *client)
+{
+    int size = client->jsmn_tokens_size ?
+        client->jsmn_tokens_size * 2 : LGTD_CLIENT_MIN_JSMN_TOKENS;
+    jsmntok_t *tokens = reallocarray(client->jsmn_tokens, size, sizeof(*tokens));
+    if (!tokens) {
+        return false;
+    }
+
+    client->jsmn_tokens = tokens;
+    client->jsmn_tokens_size = size;
+    return true;
+}
+
+// Forget about the tokens in [from, to), they must hold complete values:
+static void
+lgtd_client_input_remove_tokens(struct lgtd_client *client, int from, int to)
+{
+    jsmntok_t *tokens = client->jsmn_tokens;
+    int ntokens = client->jsmn_ctx.toknext;
+    int count = to - from;
+
+    memmove(&tokens[from], &tokens[to], (ntokens - to) * sizeof(*tokens));
+    ntokens -= count;
+    for (int i = from; i != ntokens; i++) {
+        if (tokens[i].parent >= to) {
+            tokens[i].parent -= count;
+        }
+    }
+    client->jsmn_ctx.toknext = ntokens;
+    if (client->jsmn_ctx.toksuper >= to) {
+        client->jsmn_ctx.toksuper -= count;
+    }
+}
+
+// Dispatch everything that has been completely tokenized so far: requests and
+// the elements of a batch, a batch is executed as it's received so its size
+// isn't limited by LGTD_CLIENT_MAX_REQUEST_BUF_SIZE.
+//
+// Return the offset in buf up to which the input has been consumed.
+static int
+lgtd_client_input_dispatch(struct lgtd_client *client,
+                           const char *buf,
+                           int consumed)
+{
+    jsmntok_t *tokens = client->jsmn_tokens;
+
+    client->json = buf;
+    while (client->jsmn_ctx.toknext) {
+        int ntokens = client->jsmn_ctx.toknext;
+        if (tokens[0].type == JSMN_ARRAY) {
+            // The elements have 0 as parent and are followed by their own
+            // children, containers are only closed once all their children
+            // are:
+            while (ntokens != 1
+                   && tokens[1].parent == 0 && tokens[1].end != -1) {
+                int next = 2;
+                while (next != ntokens && tokens[next].parent > 0) {
+                    next++;
+                }
+                lgtd_jsonrpc_dispatch_batch_part(client, &tokens[1], next - 1);
+                consumed = tokens[1].end;
+                lgtd_client_input_remove_tokens(client, 1, next);
+                ntokens = client->jsmn_ctx.toknext;
+            }
+            if (tokens[0].end == -1) {
+                break; // wait for the rest of the batch
+            }
+            if (tokens[0].size) {
+                lgtd_jsonrpc_end_batch(client);
+            } else {
+                lgtd_jsonrpc_dispatch_request(client, 1); // empty batch
+            }
+            consumed = tokens[0].end;
+            lgtd_client_input_remove_tokens(client, 0, 1);
+            continue;
+        }
+
+        if (tokens[0].end == -1) {
+            break;
+        }
+        int next = 1;
+        while (next != ntokens && tokens[next].parent != -1) {
+            next++;
+        }
+        lgtd_jsonrpc_dispatch_request(client, next);
+        consumed = tokens[0].end;
+        lgtd_client_input_remove_tokens(client, 0, next);
+    }
+    client->json = NULL;
+
+    if (!client->jsmn_ctx.toknext) { // nothing pending, skip whitespaces too
+        consumed = client->jsmn_ctx.pos;
+    }
+    return consumed;
+}
+
+// Tokenize what's new in buf (which must start with the bytes left over by the
+// previous call) and dispatch each complete request, or element of a batch,
+// found in it.
+//
+// Return the number of bytes that can be drained from the beginning of the
+// buffer, or -1 if the input is invalid in which case the caller must drain
+// everything and call lgtd_client_input_reset.
+int
+lgtd_client_input_parse(struct lgtd_client *client, const char *buf, int bufsz)
+{
+    assert(client);
+    assert(buf);
+    assert(bufsz >= 0);
+
+    if (!client->jsmn_tokens) {
+        lgtd_client_input_reset(client);
+        if (!lgtd_client_input_grow_tokens(client)) {
+            return -1;
+        }
+    }
+
+    int consumed = 0;
+    int rv;
+    while (true) {
+        rv = jsmn_parse(
+            &client->jsmn_ctx,
+            buf,
+            bufsz,
+            client->jsmn_tokens,
+            client->jsmn_tokens_size
+        );
+        if (rv != JSMN_ERROR_NOMEM) {
+            break;
+        }
+        // make some room by dispatching what's ready before growing the
+        // tokens array, this keeps it small with large batches:
+        int ntokens = client->jsmn_ctx.toknext;
+        consumed = lgtd_client_input_dispatch(client, buf, consumed);
+        if ((int)client->jsmn_ctx.toknext == ntokens
+            && !lgtd_client_input_grow_tokens(client)) {
+            return -1;
+        }
+    }
+    if (rv == JSMN_ERROR_INVAL) {
+        return -1;
+    }
+
+    consumed = lgtd_client_input_dispatch(client, buf, consumed);
+
+    // Rebase what's pending on the beginning of the buffer once consumed has
+    // been drained, a batch being received can start before that:
+    jsmntok_t *tokens = client->jsmn_tokens;
+    for (int i = 0; i != (int)client->jsmn_ctx.toknext; i++) {
+        tokens[i].start = LGTD_MAX(tokens[i].start - consumed, 0);
+        if (tokens[i].end != -1) {
+            tokens[i].end -= consumed;
+        }
+    }
+    client->jsmn_ctx.pos -= consumed;
+
+    return consumed;
+}
@@ -181,6 +181,16 @@ lgtd_daemon_update_proctitle(void)
 
     if (!LIST_EMPTY(&lgtd_lifx_gateways)) {
         PREFIX("lifx_gateways(found=%d)", LGTD_STATS_GET(gateways));
+        int refresh_command = LGTD_STATS_GET(gateways_refresh_command),
+            refresh_client = LGTD_STATS_GET(gateways_refresh_client),
+            refresh_churn = LGTD_STATS_GET(gateways_refresh_churn),
+            refresh_idle = LGTD_STATS_GET(gateways_refresh_idle);
+        if (refresh_command || refresh_client || refresh_churn || refresh_idle) {
+            PREFIX(
+                "lifx_refresh(command=%d, client=%d, churn=%d, idle=%d)",
+                refresh_command, refresh_client, refresh_churn, refresh_idle
+            );
+        }
     }
 
     PREFIX(
@@ -33,6 +33,8 @@
 #include <event2/util.h>
 
 #include "lifx/wire_proto.h"
+#include "time_monotonic.h"
+#include "lifx/bulb.h"
 #include "jsmn.h"
 #include "jsonrpc.h"
 #include "client.h"
@@ -52,6 +54,21 @@ lgtd_jsonrpc_type_integer(const jsmntok_t *t, const char *json)
     return endptr == json + t->end && errno != ERANGE;
 }
 
+// Like lgtd_jsonrpc_type_integer but for the sequence numbers of
+// get_light_state, which don't fit in a long on 32 bits platforms:
+static bool
+lgtd_jsonrpc_type_uint64(const jsmntok_t *t, const char *json)
+{
+    if (t->type != JSMN_PRIMITIVE || json[t->start] == '-') {
+        return false;
+    }
+
+    const char *endptr = NULL;
+    errno = 0;
+    strtoull(&json[t->start], (char **)&endptr, 10);
+    return endptr == json + t->end && errno != ERANGE;
+}
+
 static bool
 lgtd_jsonrpc_type_float_between_0_and_1(const jsmntok_t *t,
                                         const char *json)
@@ -321,63 +338,139 @@ lgtd_jsonrpc_consume_object_or_array(const jsmntok_t *tokens,
     return ti;
 }
 
+static uint32_t
+lgtd_jsonrpc_hash(uint32_t seed, const char *key, int keylen)
+{
+    // over the whole key, so that any set of keys can be told apart,
+    // starting from the seed picked by lgtd_jsonrpc_hash_table_build:
+    uint32_t hash = lgtd_fnv1a(key, keylen, seed);
+    // the slot is taken from the low bits, which the multiplications leave
+    // out of the higher bits of each character:
+    return hash ^ (hash >> 16);
+}
+
+static void
+lgtd_jsonrpc_hash_table_build(struct lgtd_jsonrpc_hash_table *table,
+                              const char *(*get_key)(const void *, int, int *),
+                              const void *keys,
+                              int nkeys)
+{
+    assert(table);
+    assert(get_key);
+    assert(nkeys < LGTD_JSONRPC_HASH_TABLE_SIZE);
+
+    enum { MAX_SEED = 1 << 16 };
+    for (uint32_t seed = 0; seed != MAX_SEED; seed++) {
+        memset(table->slots, 0, sizeof(table->slots));
+        int i;
+        for (i = 0; i != nkeys; i++) {
+            int keylen;
+            const char *key = get_key(keys, i, &keylen);
+            uint32_t slot = lgtd_jsonrpc_hash(seed, key, keylen)
+                          & (LGTD_JSONRPC_HASH_TABLE_SIZE - 1);
+            if (table->slots[slot]) {
+                break;
+            }
+            table->slots[slot] = i + 1;
+        }
+        if (i == nkeys) {
+            table->seed = seed;
+            table->ready = true;
+            return;
+        }
+    }
+
+    lgtd_errx(1, "can't build a perfect hash table for %d keys", nkeys);
+}
+
+// Return the index of key in keys or -1:
+static int
+lgtd_jsonrpc_hash_table_get(const struct lgtd_jsonrpc_hash_table *table,
+                            const char *(*get_key)(const void *, int, int *),
+                            const void *keys,
+                            const char *key,
+                            int keylen)
+{
+    assert(table);
+    assert(table->ready);
+
+    uint32_t slot = lgtd_jsonrpc_hash(table->seed, key, keylen)
+                  & (LGTD_JSONRPC_HASH_TABLE_SIZE - 1);
+    int i = table->slots[slot] - 1;
+    if (i != -1) {
+        int candidate_len;
+        const char *candidate = get_key(keys, i, &candidate_len);
+        if (candidate_len == keylen && !memcmp(candidate, key, keylen)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char *
+lgtd_jsonrpc_node_key(const void *nodes, int i, int *keylen)
+{
+    const struct lgtd_jsonrpc_node *node = nodes;
+    *keylen = node[i].keylen;
+    return node[i].key;
+}
+
 static bool
 lgtd_jsonrpc_extract_values_from_schema_and_dict(void *output,
-                                                 const struct lgtd_jsonrpc_node *schema,
-                                                 int schema_size,
+                                                 struct lgtd_jsonrpc_schema *schema,
                                                  const jsmntok_t *tokens,
                                                  int ntokens,
                                                  const char *json)
 {
+    const struct lgtd_jsonrpc_node *nodes = schema->nodes;
+    int schema_size = schema->size;
+
     if (!ntokens || tokens[0].type != JSMN_OBJECT) {
         return false;
     }
 
+    if (!schema->keys.ready) {
+        lgtd_jsonrpc_hash_table_build(
+            &schema->keys, lgtd_jsonrpc_node_key, nodes, schema_size
+        );
+    }
+
     for (int ti = 1; ti < ntokens;) {
         // make sure it's a key, otherwise we reached the end of the object:
         if (tokens[ti].type != JSMN_STRING) {
             break;
         }
 
-        int si = 0;
-        for (;; si++) {
-            if (si == schema_size) {
-                ti++; // nothing matched, skip the key
-                break;
-            }
-
-            int tokenlen = LGTD_JSONRPC_TOKEN_LEN(&tokens[ti]);
-            if (schema[si].keylen != tokenlen) {
-                continue;
+        int si = lgtd_jsonrpc_hash_table_get(
+            &schema->keys,
+            lgtd_jsonrpc_node_key,
+            nodes,
+            &json[tokens[ti].start],
+            LGTD_JSONRPC_TOKEN_LEN(&tokens[ti])
+        );
+        ti++; // move to the value, skip it if nothing matched
+        if (si != -1) {
+            if (!nodes[si].type_cmp(&tokens[ti], json)) {
+                lgtd_debug(
+                    "jsonrpc client sent an invalid value for %s",
+                    nodes[si].key
+                );
+                return false;
             }
-            int diff = memcmp(
-                schema[si].key, &json[tokens[ti].start], tokenlen
-            );
-            if (!diff) {
-                ti++; // keys looks good, move to the value
-                if (!schema[si].type_cmp(&tokens[ti], json)) {
+            if (nodes[si].value_offset != -1) {
+                const jsmntok_t *seen = LGTD_JSONRPC_GET_JSMNTOK(
+                    output, nodes[si].value_offset
+                );
+                if (seen) { // duplicate key
                     lgtd_debug(
-                        "jsonrpc client sent an invalid value for %s",
-                        schema[si].key
+                        "jsonrpc client sent duplicate parameter %s",
+                        nodes[si].key
                     );
                     return false;
                 }
-                if (schema[si].value_offset != -1) {
-                    const jsmntok_t *seen = LGTD_JSONRPC_GET_JSMNTOK(
-                        output, schema[si].value_offset
-                    );
-                    if (seen) { // duplicate key
-                        lgtd_debug(
-                            "jsonrpc client sent duplicate parameter %s",
-                            schema[si].key
-                        );
-                        return false;
-                    }
-                    LGTD_JSONRPC_SET_JSMNTOK(
-                        output, schema[si].value_offset, &tokens[ti]
-                    );
-                }
-                break;
+                LGTD_JSONRPC_SET_JSMNTOK(
+                    output, nodes[si].value_offset, &tokens[ti]
+                );
             }
         }
 
@@ -392,23 +485,23 @@ lgtd_jsonrpc_extract_values_from_schema_and_dict(void *output,
             ti++;
         }
         value_ntokens = ti - value_ntokens;
-        if (si < schema_size && schema[si].ntokens_offset != -1) {
+        if (si != -1 && nodes[si].ntokens_offset != -1) {
             LGTD_JSONRPC_SET_NTOKENS(
-                output, schema[si].ntokens_offset, value_ntokens
+                output, nodes[si].ntokens_offset, value_ntokens
             );
         }
     }
 
     for (int si = 0; si != schema_size; si++) {
-        if (!schema[si].optional && schema[si].value_offset != -1) {
+        if (!nodes[si].optional && nodes[si].value_offset != -1) {
             const jsmntok_t *seen = LGTD_JSONRPC_GET_JSMNTOK(
-                output, schema[si].value_offset
+                output, nodes[si].value_offset
             );
             if (!seen) {
-                lgtd_debug("missing jsonrpc parameter %s", schema[si].key);
+                lgtd_debug("missing jsonrpc parameter %s", nodes[si].key);
                 return false;
             }
-            lgtd_debug("got jsonrpc parameter %s", schema[si].key);
+            lgtd_debug("got jsonrpc parameter %s", nodes[si].key);
         }
     }
 
@@ -417,28 +510,30 @@ lgtd_jsonrpc_extract_values_from_schema_and_dict(void *output,
 
 static bool
 lgtd_jsonrpc_extract_values_from_schema_and_array(void *output,
-                                                  const struct lgtd_jsonrpc_node *schema,
-                                                  int schema_size,
+                                                  struct lgtd_jsonrpc_schema *schema,
                                                   const jsmntok_t *tokens,
                                                   int ntokens,
                                                   const char *json)
 {
+    const struct lgtd_jsonrpc_node *nodes = schema->nodes;
+    int schema_size = schema->size;
+
     if (!ntokens || tokens[0].type != JSMN_ARRAY) {
         return false;
     }
 
     int si, ti, objsize = tokens[0].size;
     for (si = 0, ti = 1; si < schema_size && ti < ntokens && objsize--; si++) {
-        if (!schema[si].type_cmp(&tokens[ti], json)) {
+        if (!nodes[si].type_cmp(&tokens[ti], json)) {
             lgtd_debug(
                 "jsonrpc client sent an invalid value for %s",
-                schema[si].key
+                nodes[si].key
             );
             return false;
         }
-        if (schema[si].value_offset != -1) {
+        if (nodes[si].value_offset != -1) {
             LGTD_JSONRPC_SET_JSMNTOK(
-                output, schema[si].value_offset, &tokens[ti]
+                output, nodes[si].value_offset, &tokens[ti]
             );
         }
         // skip the value, if it's an object or an array we need to
@@ -452,29 +547,31 @@ lgtd_jsonrpc_extract_values_from_schema_and_array(void *output,
             ti++;
         }
         value_ntokens = ti - value_ntokens;
-        if (schema[si].ntokens_offset != -1) {
+        if (nodes[si].ntokens_offset != -1) {
             LGTD_JSONRPC_SET_NTOKENS(
-                output, schema[si].ntokens_offset, value_ntokens
+                output, nodes[si].ntokens_offset, value_ntokens
             );
         }
     }
 
-    return !objsize || (si < schema_size && schema[si].optional);
+    return !objsize || (si < schema_size && nodes[si].optional);
 }
 
 static bool
 lgtd_jsonrpc_extract_and_validate_params_against_schema(void *output,
-                                                        const struct lgtd_jsonrpc_node *schema,
-                                                        int schema_size,
+                                                        struct lgtd_jsonrpc_schema *schema,
                                                         const jsmntok_t *tokens,
                                                         int ntokens,
                                                         const char *json)
 {
+    const struct lgtd_jsonrpc_node *nodes = schema->nodes;
+    int schema_size = schema->size;
+
     if (!ntokens) {
         // "params" were omitted, make sure no args were required or that they
         // are all optional:
         while (schema_size--) {
-            if (!schema[schema_size].optional) {
+            if (!nodes[schema_size].optional) {
                 return false;
             }
         }
@@ -484,11 +581,11 @@ lgtd_jsonrpc_extract_and_validate_params_against_schema(void *output,
     switch (tokens[0].type) {
     case JSMN_OBJECT:
         return lgtd_jsonrpc_extract_values_from_schema_and_dict(
-            output, schema, schema_size, tokens, ntokens, json
+            output, schema, tokens, ntokens, json
         );
     case JSMN_ARRAY:
         return lgtd_jsonrpc_extract_values_from_schema_and_array(
-            output, schema, schema_size, tokens, ntokens, json
+            output, schema, tokens, ntokens, json
         );
     default:
         return false;
@@ -569,7 +666,7 @@ lgtd_jsonrpc_check_and_extract_request(struct lgtd_jsonrpc_request *request,
                                        int ntokens,
                                        const char *json)
 {
-    static const struct lgtd_jsonrpc_node request_schema[] = {
+    static const struct lgtd_jsonrpc_node request_schema_nodes[] = {
         LGTD_JSONRPC_NODE(
             "jsonrpc", -1, -1, lgtd_jsonrpc_type_string, false
         ),
@@ -596,10 +693,13 @@ lgtd_jsonrpc_check_and_extract_request(struct lgtd_jsonrpc_request *request,
         )
     };
 
+    static struct lgtd_jsonrpc_schema request_schema = LGTD_JSONRPC_SCHEMA(
+        request_schema_nodes
+    );
+
     bool ok = lgtd_jsonrpc_extract_values_from_schema_and_dict(
         request,
-        request_schema,
-        LGTD_ARRAY_SIZE(request_schema),
+        &request_schema,
         tokens,
         ntokens,
         json
@@ -686,7 +786,7 @@ lgtd_jsonrpc_check_and_call_set_light_from_hsbk(struct lgtd_client *client)
         const jsmntok_t *k;
         const jsmntok_t *t;
     } params = { NULL, 0, NULL, NULL, NULL, NULL, NULL };
-    static const struct lgtd_jsonrpc_node schema[] = {
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
         LGTD_JSONRPC_NODE(
             "target",
             offsetof(struct lgtd_jsonrpc_set_light_from_hsbk_args, target),
@@ -730,11 +830,13 @@ lgtd_jsonrpc_check_and_call_set_light_from_hsbk(struct lgtd_client *client)
             true
         ),
     };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
 
     bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
         &params,
-        schema,
-        LGTD_ARRAY_SIZE(schema),
+        &schema,
         client->current_request->params,
         client->current_request->params_ntokens,
         client->json
@@ -799,7 +901,7 @@ lgtd_jsonrpc_check_and_call_set_waveform(struct lgtd_client *client)
         const jsmntok_t *skew_ratio;
         const jsmntok_t *transient;
     } params = { NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
-    static const struct lgtd_jsonrpc_node schema[] = {
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
         LGTD_JSONRPC_NODE(
             "target",
             offsetof(struct lgtd_jsonrpc_set_waveform_args, target),
@@ -871,11 +973,13 @@ lgtd_jsonrpc_check_and_call_set_waveform(struct lgtd_client *client)
             true
         ),
     };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
 
     bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
         &params,
-        schema,
-        LGTD_ARRAY_SIZE(schema),
+        &schema,
         client->current_request->params,
         client->current_request->params_ntokens,
         client->json
@@ -953,7 +1057,7 @@ lgtd_jsonrpc_extract_target_list(struct lgtd_proto_target_list *targets,
         const jsmntok_t *target;
         int             target_ntokens;
     } params = { NULL, 0 };
-    static const struct lgtd_jsonrpc_node schema[] = {
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
         LGTD_JSONRPC_NODE(
             "target",
             offsetof(struct lgtd_jsonrpc_target_args, target),
@@ -962,10 +1066,13 @@ lgtd_jsonrpc_extract_target_list(struct lgtd_proto_target_list *targets,
             false
         )
     };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
 
     struct lgtd_jsonrpc_request *req = client->current_request;
     bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
-        &params, schema, 1, req->params, req->params_ntokens, client->json
+        &params, &schema, req->params, req->params_ntokens, client->json
     );
     if (!ok) {
         lgtd_jsonrpc_send_error(
@@ -996,7 +1103,69 @@ lgtd_jsonrpc_check_and_call_##proto_method(struct lgtd_client *client)         \
 CHECK_AND_CALL_TARGETS_ONLY_METHOD(power_on);
 CHECK_AND_CALL_TARGETS_ONLY_METHOD(power_off);
 CHECK_AND_CALL_TARGETS_ONLY_METHOD(power_toggle);
-CHECK_AND_CALL_TARGETS_ONLY_METHOD(get_light_state);
+
+static void
+lgtd_jsonrpc_check_and_call_get_light_state(struct lgtd_client *client)
+{
+    struct lgtd_jsonrpc_light_state_args {
+        const jsmntok_t *target;
+        int             target_ntokens;
+        const jsmntok_t *since;
+    } params = { NULL, 0, NULL };
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
+        LGTD_JSONRPC_NODE(
+            "target",
+            offsetof(struct lgtd_jsonrpc_light_state_args, target),
+            offsetof(struct lgtd_jsonrpc_light_state_args, target_ntokens),
+            lgtd_jsonrpc_type_string_number_or_array,
+            false
+        ),
+        LGTD_JSONRPC_NODE(
+            "since",
+            offsetof(struct lgtd_jsonrpc_light_state_args, since),
+            -1,
+            lgtd_jsonrpc_type_uint64,
+            true
+        )
+    };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
+
+    struct lgtd_jsonrpc_request *req = client->current_request;
+    bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
+        &params, &schema, req->params, req->params_ntokens, client->json
+    );
+    if (!ok) {
+        goto error_invalid_params;
+    }
+
+    uint64_t since = 0;
+    if (params.since) {
+        since = strtoull(&client->json[params.since->start], NULL, 10);
+    }
+
+    struct lgtd_proto_target_list targets = SLIST_HEAD_INITIALIZER(&targets);
+    ok = lgtd_jsonrpc_build_target_list(
+        &targets, client, params.target, params.target_ntokens
+    );
+    if (!ok) {
+        return;
+    }
+
+    if (params.since) {
+        lgtd_proto_get_light_state_since(client, &targets, since);
+    } else {
+        lgtd_proto_get_light_state(client, &targets);
+    }
+    lgtd_proto_target_list_clear(&targets);
+    return;
+
+error_invalid_params:
+    lgtd_jsonrpc_send_error(
+        client, LGTD_JSONRPC_INVALID_PARAMS, "Invalid parameters"
+    );
+}
 
 static void
 lgtd_jsonrpc_check_and_call_proto_tag_or_untag_or_set_label(
@@ -1011,7 +1180,7 @@ lgtd_jsonrpc_check_and_call_proto_tag_or_untag_or_set_label(
         int             target_ntokens;
         const jsmntok_t *label;
     } params = { NULL, 0, NULL };
-    static const struct lgtd_jsonrpc_node schema[] = {
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
         LGTD_JSONRPC_NODE(
             "target",
             offsetof(struct lgtd_jsonrpc_target_args, target),
@@ -1027,12 +1196,14 @@ lgtd_jsonrpc_check_and_call_proto_tag_or_untag_or_set_label(
             false
         )
     };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
 
     struct lgtd_jsonrpc_request *req = client->current_request;
     bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
         &params,
-        schema,
-        LGTD_ARRAY_SIZE(schema),
+        &schema,
         req->params,
         req->params_ntokens,
         client->json
@@ -1095,6 +1266,167 @@ lgtd_jsonrpc_check_and_call_set_label(struct lgtd_client *client)
     );
 }
 
+static void
+lgtd_jsonrpc_check_and_call_synchronize(struct lgtd_client *client)
+{
+    struct lgtd_jsonrpc_synchronize_args {
+        const jsmntok_t *delay;
+    } params = { NULL };
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
+        LGTD_JSONRPC_NODE(
+            "delay",
+            offsetof(struct lgtd_jsonrpc_synchronize_args, delay),
+            -1,
+            lgtd_jsonrpc_type_integer,
+            true
+        )
+    };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
+
+    struct lgtd_jsonrpc_request *req = client->current_request;
+    bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
+        &params, &schema, req->params, req->params_ntokens, client->json
+    );
+    if (!ok) {
+        goto error_invalid_params;
+    }
+
+    int delay = 0;
+    if (params.delay) {
+        errno = 0;
+        delay = strtol(&client->json[params.delay->start], NULL, 10);
+        if (delay < 0 || errno == ERANGE) {
+            goto error_invalid_params;
+        }
+    }
+
+    lgtd_proto_synchronize(client, delay);
+    return;
+
+error_invalid_params:
+    lgtd_jsonrpc_send_error(
+        client, LGTD_JSONRPC_INVALID_PARAMS, "Invalid parameters"
+    );
+}
+
+// The changes are pushed on the connection of the client, there is nothing to
+// push them to from the command pipe (or a notification, which doesn't get a
+// response either):
+static bool
+lgtd_jsonrpc_check_can_subscribe(struct lgtd_client *client)
+{
+    if (client->io) {
+        return true;
+    }
+
+    lgtd_jsonrpc_send_error(
+        client, LGTD_JSONRPC_INVALID_REQUEST,
+        "Subscriptions need a request over a socket"
+    );
+    return false;
+}
+
+static void
+lgtd_jsonrpc_check_and_call_subscribe(struct lgtd_client *client)
+{
+    if (!lgtd_jsonrpc_check_can_subscribe(client)) {
+        return;
+    }
+
+    struct lgtd_jsonrpc_subscribe_args {
+        const jsmntok_t *target;
+        int             target_ntokens;
+        const jsmntok_t *fields;
+        int             fields_ntokens;
+    } params = { NULL, 0, NULL, 0 };
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
+        LGTD_JSONRPC_NODE(
+            "target",
+            offsetof(struct lgtd_jsonrpc_subscribe_args, target),
+            offsetof(struct lgtd_jsonrpc_subscribe_args, target_ntokens),
+            lgtd_jsonrpc_type_string_number_or_array,
+            false
+        ),
+        LGTD_JSONRPC_NODE(
+            "fields",
+            offsetof(struct lgtd_jsonrpc_subscribe_args, fields),
+            offsetof(struct lgtd_jsonrpc_subscribe_args, fields_ntokens),
+            lgtd_jsonrpc_type_array,
+            true
+        )
+    };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
+    // keyed with the bits of enum lgtd_lifx_bulb_changes:
+    static const char *field_names[] = { "hsbk", "power", "label", "tags" };
+
+    struct lgtd_jsonrpc_request *req = client->current_request;
+    bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
+        &params, &schema, req->params, req->params_ntokens, client->json
+    );
+    if (!ok) {
+        goto error_invalid_params;
+    }
+
+    int fields = LGTD_LIFX_BULB_ALL_CHANGED;
+    if (params.fields) {
+        fields = 0;
+        // the array itself then only strings (no nested values):
+        for (int ti = 1; ti < params.fields_ntokens; ti++) {
+            const jsmntok_t *field = &params.fields[ti];
+            if (!lgtd_jsonrpc_type_string(field, client->json)) {
+                goto error_invalid_params;
+            }
+            int i = LGTD_ARRAY_SIZE(field_names);
+            while (i--) {
+                const char *name = field_names[i];
+                int len = LGTD_JSONRPC_TOKEN_LEN(field);
+                if ((int)strlen(name) == len
+                    && !memcmp(&client->json[field->start], name, len)) {
+                    fields |= 1 << i;
+                    break;
+                }
+            }
+            if (i == -1) {
+                goto error_invalid_params;
+            }
+        }
+        if (!fields) {
+            goto error_invalid_params;
+        }
+    }
+
+    struct lgtd_proto_target_list targets = SLIST_HEAD_INITIALIZER(&targets);
+    ok = lgtd_jsonrpc_build_target_list(
+        &targets, client, params.target, params.target_ntokens
+    );
+    if (!ok) {
+        return;
+    }
+
+    lgtd_proto_subscribe(client, &targets, fields);
+    lgtd_proto_target_list_clear(&targets);
+    return;
+
+error_invalid_params:
+    lgtd_jsonrpc_send_error(
+        client, LGTD_JSONRPC_INVALID_PARAMS, "Invalid parameters"
+    );
+}
+
+static void
+lgtd_jsonrpc_check_and_call_unsubscribe(struct lgtd_client *client)
+{
+    if (!lgtd_jsonrpc_check_can_subscribe(client)) {
+        return;
+    }
+
+    lgtd_proto_unsubscribe(client);
+}
+
 static void
 lgtd_jsonrpc_batch_prepare_next_part(struct lgtd_client *client,
                                      const int *batch_sent)
@@ -1110,33 +1442,50 @@ lgtd_jsonrpc_batch_prepare_next_part(struct lgtd_client *client,
     }
 }
 
+static const struct lgtd_jsonrpc_method lgtd_jsonrpc_methods[] = {
+    LGTD_JSONRPC_METHOD("power_on", lgtd_jsonrpc_check_and_call_power_on),
+    LGTD_JSONRPC_METHOD("power_off", lgtd_jsonrpc_check_and_call_power_off),
+    LGTD_JSONRPC_METHOD(
+        "power_toggle", lgtd_jsonrpc_check_and_call_power_toggle
+    ),
+    LGTD_JSONRPC_METHOD(
+        "set_light_from_hsbk",
+        lgtd_jsonrpc_check_and_call_set_light_from_hsbk
+    ),
+    LGTD_JSONRPC_METHOD(
+        "set_waveform", lgtd_jsonrpc_check_and_call_set_waveform
+    ),
+    LGTD_JSONRPC_METHOD(
+        "get_light_state", lgtd_jsonrpc_check_and_call_get_light_state
+    ),
+    LGTD_JSONRPC_METHOD("tag", lgtd_jsonrpc_check_and_call_tag),
+    LGTD_JSONRPC_METHOD("untag", lgtd_jsonrpc_check_and_call_untag),
+    LGTD_JSONRPC_METHOD("set_label", lgtd_jsonrpc_check_and_call_set_label),
+    LGTD_JSONRPC_METHOD(
+        "synchronize", lgtd_jsonrpc_check_and_call_synchronize
+    ),
+    LGTD_JSONRPC_METHOD("subscribe", lgtd_jsonrpc_check_and_call_subscribe),
+    LGTD_JSONRPC_METHOD(
+        "unsubscribe", lgtd_jsonrpc_check_and_call_unsubscribe
+    )
+};
+
+static struct lgtd_jsonrpc_hash_table lgtd_jsonrpc_methods_table;
+
+static const char *
+lgtd_jsonrpc_method_name(const void *methods, int i, int *namelen)
+{
+    const struct lgtd_jsonrpc_method *method = methods;
+    *namelen = method[i].namelen;
+    return method[i].name;
+}
+
 static int
 lgtd_jsonrpc_dispatch_one(struct lgtd_client *client,
                           const jsmntok_t *tokens,
                           int ntokens,
                           int *batch_sent)
 {
-    static const struct lgtd_jsonrpc_method methods[] = {
-        LGTD_JSONRPC_METHOD("power_on", lgtd_jsonrpc_check_and_call_power_on),
-        LGTD_JSONRPC_METHOD("power_off", lgtd_jsonrpc_check_and_call_power_off),
-        LGTD_JSONRPC_METHOD(
-            "power_toggle", lgtd_jsonrpc_check_and_call_power_toggle
-        ),
-        LGTD_JSONRPC_METHOD(
-            "set_light_from_hsbk",
-            lgtd_jsonrpc_check_and_call_set_light_from_hsbk
-        ),
-        LGTD_JSONRPC_METHOD(
-            "set_waveform", lgtd_jsonrpc_check_and_call_set_waveform
-        ),
-        LGTD_JSONRPC_METHOD(
-            "get_light_state", lgtd_jsonrpc_check_and_call_get_light_state
-        ),
-        LGTD_JSONRPC_METHOD("tag", lgtd_jsonrpc_check_and_call_tag),
-        LGTD_JSONRPC_METHOD("untag", lgtd_jsonrpc_check_and_call_untag),
-        LGTD_JSONRPC_METHOD("set_label", lgtd_jsonrpc_check_and_call_set_label)
-    };
-
     if (batch_sent) {
         ++*batch_sent;
     }
@@ -1162,39 +1511,43 @@ lgtd_jsonrpc_dispatch_one(struct lgtd_client *client,
     assert(request.method);
     assert(request.request_ntokens);
 
-    for (int i = 0; i != LGTD_ARRAY_SIZE(methods); i++) {
-        int parsed_method_namelen = LGTD_JSONRPC_TOKEN_LEN(request.method);
-        if (parsed_method_namelen != methods[i].namelen) {
-            continue;
-        }
-        int diff = memcmp(
-            methods[i].name,
-            &client->json[request.method->start],
-            methods[i].namelen
+    if (!lgtd_jsonrpc_methods_table.ready) {
+        lgtd_jsonrpc_hash_table_build(
+            &lgtd_jsonrpc_methods_table,
+            lgtd_jsonrpc_method_name,
+            lgtd_jsonrpc_methods,
+            LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods)
         );
-        if (!diff) {
-            struct bufferevent *client_io = NULL; // keep compilers happy...
-            if (!request.id) {
-                // Ugly hack to behave correctly on jsonrpc notifications, it's
-                // not worth doing it properly right now. It is especially ugly
-                // since we can't properly close that client now (but we don't
-                // do that in lgtd_proto and signals are deferred with the
-                // event loop).
-                client_io = client->io;
-                client->io = NULL;
-                if (batch_sent) {
-                    --*batch_sent;
-                }
-            } else {
-                lgtd_jsonrpc_batch_prepare_next_part(client, batch_sent);
-            }
-            methods[i].method(client);
-            if (!request.id) {
-                client->io = client_io;
+    }
+    int mi = lgtd_jsonrpc_hash_table_get(
+        &lgtd_jsonrpc_methods_table,
+        lgtd_jsonrpc_method_name,
+        lgtd_jsonrpc_methods,
+        &client->json[request.method->start],
+        LGTD_JSONRPC_TOKEN_LEN(request.method)
+    );
+    if (mi != -1) {
+        struct bufferevent *client_io = NULL; // keep compilers happy...
+        if (!request.id) {
+            // Ugly hack to behave correctly on jsonrpc notifications, it's
+            // not worth doing it properly right now. It is especially ugly
+            // since we can't properly close that client now (but we don't
+            // do that in lgtd_proto and signals are deferred with the
+            // event loop).
+            client_io = client->io;
+            client->io = NULL;
+            if (batch_sent) {
+                --*batch_sent;
             }
-            client->current_request = NULL;
-            return request.request_ntokens;
+        } else {
+            lgtd_jsonrpc_batch_prepare_next_part(client, batch_sent);
+        }
+        lgtd_jsonrpc_methods[mi].method(client);
+        if (!request.id) {
+            client->io = client_io;
         }
+        client->current_request = NULL;
+        return request.request_ntokens;
     }
 
     error_code = LGTD_JSONRPC_METHOD_NOT_FOUND;
@@ -1207,6 +1560,48 @@ error:
     return request.request_ntokens;
 }
 
+int
+lgtd_jsonrpc_dispatch_batch_part(struct lgtd_client *client,
+                                 const jsmntok_t *tokens,
+                                 int ntokens)
+{
+    assert(client);
+    assert(tokens);
+    assert(ntokens > 0);
+
+    if (lgtd_jsonrpc_type_object(tokens, client->json)) {
+        return lgtd_jsonrpc_dispatch_one(
+            client, tokens, ntokens, &client->batch_sent
+        );
+    }
+
+    client->batch_sent++;
+    lgtd_jsonrpc_batch_prepare_next_part(client, &client->batch_sent);
+    lgtd_jsonrpc_send_error(
+        client, LGTD_JSONRPC_INVALID_REQUEST, "Invalid request"
+    );
+    if (lgtd_jsonrpc_type_array(tokens, client->json)) {
+        return lgtd_jsonrpc_consume_object_or_array(
+            tokens, 0, ntokens, client->json
+        );
+    }
+    return 1;
+}
+
+void
+lgtd_jsonrpc_end_batch(struct lgtd_client *client)
+{
+    assert(client);
+
+    if (client->batch_sent) {
+        lgtd_client_write_string(client, "]");
+        client->batch_sent = 0;
+    }
+
+    // synchronize only applies to the batch it's part of:
+    client->sync_at = 0;
+}
+
 void
 lgtd_jsonrpc_dispatch_request(struct lgtd_client *client, int parsed)
 {
@@ -1222,34 +1617,15 @@ lgtd_jsonrpc_dispatch_request(struct lgtd_client *client, int parsed)
 
     if (!lgtd_jsonrpc_type_array(client->jsmn_tokens, client->json)) {
         lgtd_jsonrpc_dispatch_one(client, client->jsmn_tokens, parsed, NULL);
+        client->sync_at = 0;
         return;
     }
 
-    int batch_sent = 0;
     for (int ti = 1; ti < parsed;) {
-        const jsmntok_t *tok = &client->jsmn_tokens[ti];
-
-        if (lgtd_jsonrpc_type_object(tok, client->json)) {
-            ti += lgtd_jsonrpc_dispatch_one(
-                client, tok, parsed - ti, &batch_sent
-            );
-        } else {
-            batch_sent++;
-            lgtd_jsonrpc_batch_prepare_next_part(client, &batch_sent);
-            lgtd_jsonrpc_send_error(
-                client, LGTD_JSONRPC_INVALID_REQUEST, "Invalid request"
-            );
-            if (lgtd_jsonrpc_type_array(tok, client->json)) {
-                ti = lgtd_jsonrpc_consume_object_or_array(
-                    client->jsmn_tokens, ti, parsed, client->json
-                );
-            } else {
-                ti++;
-            }
-        }
+        ti += lgtd_jsonrpc_dispatch_batch_part(
+            client, &client->jsmn_tokens[ti], parsed - ti
+        );
     }
 
-    if (batch_sent) {
-        lgtd_client_write_string(client, "]");
-    }
+    lgtd_jsonrpc_end_batch(client);
 }
@@ -60,6 +60,28 @@ struct lgtd_jsonrpc_node {
 
 #define LGTD_JSONRPC_TOKEN_LEN(t) ((t)->end - (t)->start)
 
+enum { LGTD_JSONRPC_HASH_TABLE_SIZE = 64 }; // must be a power of two
+
+// Perfect hash table over a small set of keys (method names or the keys of a
+// schema): the seed is picked, once, so that no two keys share a slot and a
+// lookup is a hash and a single string compare.
+struct lgtd_jsonrpc_hash_table {
+    bool        ready;
+    uint32_t    seed;
+    int8_t      slots[LGTD_JSONRPC_HASH_TABLE_SIZE]; // key index + 1
+};
+
+struct lgtd_jsonrpc_schema {
+    const struct lgtd_jsonrpc_node  *nodes;
+    int                             size;
+    struct lgtd_jsonrpc_hash_table  keys;
+};
+
+#define LGTD_JSONRPC_SCHEMA(nodes_) {               \
+    .nodes = (nodes_),                              \
+    .size = sizeof((nodes_)) / sizeof((nodes_)[0])  \
+}
+
 struct lgtd_jsonrpc_method {
     const char  *name;
     int         namelen;
@@ -83,6 +105,8 @@ enum lgtd_jsonrpc_error_code {
 };
 
 void lgtd_jsonrpc_dispatch_request(struct lgtd_client *, int);
+int lgtd_jsonrpc_dispatch_batch_part(struct lgtd_client *, const jsmntok_t *, int);
+void lgtd_jsonrpc_end_batch(struct lgtd_client *);
 
 void lgtd_jsonrpc_send_error(struct lgtd_client *,
                              enum lgtd_jsonrpc_error_code,
@@ -23,6 +23,7 @@
 #include <err.h>
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -43,11 +44,14 @@
 #include "lifx/gateway.h"
 #include "lifx/broadcast.h"
 #include "lifx/discovery.h"
+#include "lifx/cache.h"
 #include "version.h"
 #include "jsmn.h"
 #include "jsonrpc.h"
 #include "client.h"
 #include "pipe.h"
+#include "proto.h"
+#include "subscription.h"
 #include "timer.h"
 #include "listen.h"
 #include "daemon.h"
@@ -66,8 +70,14 @@ struct lgtd_opts lgtd_opts = {
     .syslog = false,
     .syslog_facility = LOG_DAEMON,
     .syslog_ident = "lightsd",
-    .pidfile = NULL
-}; 
+    .pidfile = NULL,
+    .lifx_shared_socket = false,
+    .lifx_queue_max_bytes = LGTD_LIFX_GATEWAY_DEFAULT_QUEUE_MAX_BYTES,
+    .lifx_refresh_min_msecs = LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS,
+    .lifx_refresh_max_msecs = LGTD_LIFX_GATEWAY_MAX_REFRESH_INTERVAL_MSECS,
+    .lifx_acked_delivery = false,
+    .lifx_state_file = NULL
+};
 
 struct event_base *lgtd_ev_base = NULL;
 
@@ -168,6 +178,20 @@ lgtd_usage(const char *progname)
 "  [-I,--syslog-ident]                  Identifier to use with syslog (defaults to\n"
 "                                       lightsd).\n"
 "  [-t,--no-timestamps]                 Disable timestamps in the console logs.\n"
+"  [--lifx-shared-socket]               Talk to all the LIFX gateways through a\n"
+"                                       single UDP socket.\n"
+"  [--lifx-queue-max-bytes bytes]       Maximum size of the packets waiting to be\n"
+"                                       sent to a LIFX gateway (defaults to\n"
+"                                       65536 bytes).\n"
+"  [--lifx-refresh-interval min:max]    Bounds, in milliseconds, of the interval\n"
+"                                       at which the state of the bulbs is\n"
+"                                       refreshed (defaults to 800:10000, max\n"
+"                                       can't be more than 10000).\n"
+"  [--lifx-acked-delivery]              Ask the bulbs to acknowledge every\n"
+"                                       command and retransmit the commands\n"
+"                                       that aren't.\n"
+"  [--lifx-state-file /path/to/file]    Save the known gateways and bulbs in this\n"
+"                                       file and use them to start faster.\n"
 "  [-h,--help]                          Display this.\n"
 "  [-V,--version]                       Display version and build information.\n"
 "  [-v,--verbosity debug|info|warning|error]\n"
@@ -185,9 +209,11 @@ void
 lgtd_cleanup(void)
 {
     lgtd_lifx_discovery_close();
+    lgtd_lifx_cache_close();
     lgtd_listen_close_all();
     lgtd_command_pipe_close_all();
     lgtd_client_close_all();
+    lgtd_subscription_close_all();
     lgtd_lifx_broadcast_close();
     lgtd_lifx_gateway_close_all();
     lgtd_timer_stop_all();
@@ -225,6 +251,11 @@ main(int argc, char *argv[], char *envp[])
         {"syslog-facility", required_argument, NULL, 'F'},
         {"syslog-ident",    required_argument, NULL, 'I'},
         {"no-timestamps",   no_argument,       NULL, 't'},
+        {"lifx-shared-socket", no_argument,    NULL, 'L'},
+        {"lifx-queue-max-bytes", required_argument, NULL, 'Q'},
+        {"lifx-refresh-interval", required_argument, NULL, 'R'},
+        {"lifx-acked-delivery", no_argument,  NULL, 'A'},
+        {"lifx-state-file", required_argument, NULL, 'C'},
         {"help",            no_argument,       NULL, 'h'},
         {"verbosity",       required_argument, NULL, 'v'},
         {"version",         no_argument,       NULL, 'V'},
@@ -290,6 +321,40 @@ main(int argc, char *argv[], char *envp[])
         case 't':
             lgtd_opts.log_timestamps = false;
             break;
+        case 'L':
+            lgtd_opts.lifx_shared_socket = true;
+            break;
+        case 'Q':
+            (void)0;
+            char *end;
+            long max_bytes = strtol(optarg, &end, 10);
+            if (*end || max_bytes <= 0 || max_bytes > INT_MAX) {
+                lgtd_errx(1, "Invalid packet queue size: %s", optarg);
+            }
+            lgtd_opts.lifx_queue_max_bytes = (int)max_bytes;
+            break;
+        case 'R':
+            (void)0;
+            int min_msecs, max_msecs, nchars = 0;
+            if (sscanf(optarg, "%d:%d%n", &min_msecs, &max_msecs, &nchars) != 2
+                || optarg[nchars] || min_msecs <= 0 || max_msecs < min_msecs) {
+                lgtd_errx(1, "Invalid refresh interval: %s", optarg);
+            }
+            if (max_msecs > LGTD_LIFX_DISCOVERY_DEVICE_MAX_REFRESH_INTERVAL_MSECS) {
+                lgtd_errx(
+                    1, "The refresh interval can't be longer than %dms",
+                    LGTD_LIFX_DISCOVERY_DEVICE_MAX_REFRESH_INTERVAL_MSECS
+                );
+            }
+            lgtd_opts.lifx_refresh_min_msecs = min_msecs;
+            lgtd_opts.lifx_refresh_max_msecs = max_msecs;
+            break;
+        case 'A':
+            lgtd_opts.lifx_acked_delivery = true;
+            break;
+        case 'C':
+            lgtd_opts.lifx_state_file = optarg;
+            break;
         case 'h':
             lgtd_usage(progname);
         case 'v':
@@ -352,6 +417,7 @@ main(int argc, char *argv[], char *envp[])
     lgtd_daemon_die_if_running_as_root_unless_requested(lgtd_opts.user);
 
     lgtd_lifx_wire_setup();
+    lgtd_lifx_bulb_journal_setup();
     if (!lgtd_lifx_discovery_setup() || !lgtd_lifx_broadcast_setup()) {
         lgtd_err(1, "can't setup lightsd");
     }
@@ -368,6 +434,14 @@ main(int argc, char *argv[], char *envp[])
         lgtd_warn("couldn't write pidfile at %s", lgtd_opts.pidfile);
     }
 
+    // restore the gateways we knew about before discovering new ones:
+    if (lgtd_opts.lifx_state_file) {
+        lgtd_lifx_cache_load(lgtd_opts.lifx_state_file);
+        if (!lgtd_lifx_cache_start()) {
+            lgtd_err(1, "can't setup lightsd");
+        }
+    }
+
     lgtd_lifx_discovery_start();
 
     // update at least once: so that if no bulbs are discovered we still get a
@@ -49,6 +49,8 @@
     .tv_sec = (v) / 1000,           \
     .tv_usec = ((v) % 1000) * 1000  \
 }
+#define LGTD_TIMEVAL_TO_MSECS(tv) \
+    ((tv)->tv_sec * 1000 + (tv)->tv_usec / 1000)
 #define LGTD_MSECS_TO_TIMESPEC(v) {     \
     .tv_sec = (v) / 1000,               \
     .tv_nsec = ((v) % 1000) * 1000000   \
@@ -83,6 +85,79 @@
     (i) = LGTD_MIN((i) + n, bufsz);                         \
 } while (0)
 
+// Like RB_GENERATE_STATIC, for a hash table of LIST_HEAD buckets indexed by
+// the low bits of the hash kept in each element. table is a struct with the
+// buckets, nbuckets and count fields:
+//
+// - prefix##_bucket returns the bucket for a hash, the table can't be empty;
+// - prefix##_insert allocates min_buckets on the first insert and doubles the
+//   buckets each time the table has as many elements, it only fails if the
+//   first buckets can't be allocated (lookups are just slower if the table
+//   can't grow);
+// - prefix##_remove frees the buckets once the table is empty.
+#define LGTD_LIST_HASH_TABLE_GENERATE_STATIC(prefix, table, headname,   \
+                                             type, field, min_buckets) \
+__attribute__((unused)) static struct headname *                        \
+prefix##_bucket(uint32_t hash)                                          \
+{                                                                       \
+    assert((table).nbuckets);                                           \
+                                                                        \
+    return &(table).buckets[hash & ((table).nbuckets - 1)];             \
+}                                                                       \
+                                                                        \
+static bool                                                             \
+prefix##_resize(int nbuckets)                                           \
+{                                                                       \
+    struct headname *buckets = calloc(nbuckets, sizeof(*buckets));      \
+    if (!buckets) {                                                     \
+        return false;                                                   \
+    }                                                                   \
+                                                                        \
+    struct headname *old_buckets = (table).buckets;                     \
+    int old_nbuckets = (table).nbuckets;                                \
+    (table).buckets = buckets;                                          \
+    (table).nbuckets = nbuckets;                                        \
+    for (int i = 0; i != old_nbuckets; i++) {                           \
+        while (!LIST_EMPTY(&old_buckets[i])) {                          \
+            struct type *elm = LIST_FIRST(&old_buckets[i]);             \
+            LIST_REMOVE(elm, field);                                    \
+            LIST_INSERT_HEAD(prefix##_bucket(elm->hash), elm, field);   \
+        }                                                               \
+    }                                                                   \
+    free(old_buckets);                                                  \
+                                                                        \
+    return true;                                                        \
+}                                                                       \
+                                                                        \
+__attribute__((unused)) static bool                                     \
+prefix##_insert(struct type *elm)                                       \
+{                                                                       \
+    if (!(table).nbuckets) {                                            \
+        if (!prefix##_resize((min_buckets))) {                          \
+            return false;                                               \
+        }                                                               \
+    } else if ((table).count == (table).nbuckets) {                     \
+        prefix##_resize((table).nbuckets * 2);                          \
+    }                                                                   \
+                                                                        \
+    LIST_INSERT_HEAD(prefix##_bucket(elm->hash), elm, field);           \
+    (table).count++;                                                    \
+    return true;                                                        \
+}                                                                       \
+                                                                        \
+__attribute__((unused)) static void                                     \
+prefix##_remove(struct type *elm)                                       \
+{                                                                       \
+    assert((table).count > 0);                                          \
+                                                                        \
+    LIST_REMOVE(elm, field);                                            \
+    if (!--(table).count) {                                             \
+        free((table).buckets);                                          \
+        (table).buckets = NULL;                                         \
+        (table).nbuckets = 0;                                           \
+    }                                                                   \
+}
+
 #if LGTD_BIG_ENDIAN_SYSTEM
 # define LGTD_STATIC_HTONS(s) (s)
 # define LGTD_STATIC_HTONL(l) (l)
@@ -136,6 +211,12 @@ struct lgtd_opts {
     int                 syslog_facility;
     const char          *syslog_ident;
     const char          *pidfile;
+    bool                lifx_shared_socket;
+    int                 lifx_queue_max_bytes;
+    int                 lifx_refresh_min_msecs;
+    int                 lifx_refresh_max_msecs;
+    bool                lifx_acked_delivery;
+    const char          *lifx_state_file;
 };
 
 extern struct lgtd_opts lgtd_opts;
@@ -156,6 +237,8 @@ char* lgtd_print_nsec_timestamp(uint64_t, char *, int);
 #define LGTD_LIFX_WIRE_PRINT_NSEC_TIMESTAMP(ts, arr) \
     lgtd_print_nsec_timestamp((ts), (arr), sizeof((arr)))
 
+uint32_t lgtd_fnv1a(const void *, int, uint32_t);
+
 void lgtd_log_setup(void);
 
 void lgtd_err(int, const char *, ...)
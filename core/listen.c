@@ -31,6 +31,7 @@
 #include <event2/listener.h>
 #include <event2/util.h>
 
+#include "time_monotonic.h"
 #include "jsmn.h"
 #include "jsonrpc.h"
 #include "client.h"
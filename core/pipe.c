@@ -32,6 +32,7 @@
 #include <event2/event.h>
 
 #include "daemon.h"
+#include "time_monotonic.h"
 #include "jsmn.h"
 #include "jsonrpc.h"
 #include "client.h"
@@ -95,56 +96,31 @@ lgtd_command_pipe_read_callback(evutil_socket_t socket, short events, void *ctx)
         }
 
         if (!drain) {
-            jsmntok_t *tokens = NULL;
-            int ntokens = 0;
-            jsmn_parser jsmn_ctx;
-        next_request:
-            (void)0;
             const char *buf = (char *)evbuffer_pullup(pipe->read_buf, -1);
-            ssize_t bufsz = evbuffer_get_length(pipe->read_buf);
-        parse_after_realloc:
-            jsmn_init(&jsmn_ctx);
-            int rv = jsmn_parse(&jsmn_ctx, buf, bufsz, tokens, ntokens);
-            switch (rv) {
-            case JSMN_ERROR_NOMEM:
-            case JSMN_ERROR_INVAL:
-                lgtd_warnx("pipe %s: request too big or invalid: %s", pipe->path, buf);
+            int bufsz = evbuffer_get_length(pipe->read_buf);
+            int consumed = lgtd_client_input_parse(&pipe->client, buf, bufsz);
+            if (consumed == -1) {
+                lgtd_warnx(
+                    "pipe %s: request too big or invalid: %.*s",
+                    pipe->path, bufsz, buf
+                );
                 // ignore what's left
                 drain = true;
-                break;
-            case JSMN_ERROR_PART:
-            case 0:
-                if (bufsz >= LGTD_CLIENT_MAX_REQUEST_BUF_SIZE) {
+            } else {
+                if (consumed) {
+                    evbuffer_drain(pipe->read_buf, consumed);
+                }
+                if (bufsz - consumed >= LGTD_CLIENT_MAX_REQUEST_BUF_SIZE) {
                     lgtd_warnx("pipe %s: request too big", pipe->path);
                     drain = true;
                 }
-                break;
-            default:
-                ntokens = rv;
-                if (tokens) {
-                    pipe->client.json = buf;
-                    lgtd_jsonrpc_dispatch_request(&pipe->client, ntokens);
-                    pipe->client.json = NULL;
-                    int request_size = tokens[0].end;
-                    tokens = NULL;
-                    evbuffer_drain(pipe->read_buf, request_size);
-                    if (request_size >= bufsz) {
-                        break;
-                    }
-                } else {
-                    pipe->client.jsmn_tokens = reallocarray(
-                        pipe->client.jsmn_tokens, ntokens, sizeof(*tokens)
-                    );
-                    tokens = pipe->client.jsmn_tokens;
-                    goto parse_after_realloc;
-                }
-                goto next_request;
             }
         }
 
         if (drain) {
             ssize_t bufsz = evbuffer_get_length(pipe->read_buf);
             evbuffer_drain(pipe->read_buf, bufsz);
+            lgtd_client_input_reset(&pipe->client);
             drain = false;
         }
     }
@@ -40,12 +40,41 @@
 #include "lifx/gateway.h"
 #include "proto.h"
 #include "router.h"
+#include "subscription.h"
 #include "lightsd.h"
 
 #define SEND_RESULT(client, ok) do {                                \
     lgtd_client_send_response((client), (ok) ? "true" : "false");   \
 } while(0)
 
+// Commands are run right away unless the client started a synchronized batch
+// (see lgtd_proto_synchronize):
+static bool
+lgtd_proto_send(const struct lgtd_client *client,
+                const struct lgtd_proto_target_list *targets,
+                enum lgtd_lifx_packet_type pkt_type,
+                void *pkt)
+{
+    if (client && client->sync_at) {
+        return lgtd_router_send_at(targets, pkt_type, pkt, client->sync_at);
+    }
+    return lgtd_router_send(targets, pkt_type, pkt);
+}
+
+static bool
+lgtd_proto_send_to_device(const struct lgtd_client *client,
+                          struct lgtd_lifx_bulb *bulb,
+                          enum lgtd_lifx_packet_type pkt_type,
+                          void *pkt)
+{
+    if (client && client->sync_at) {
+        return lgtd_router_send_to_device_at(
+            bulb, pkt_type, pkt, client->sync_at
+        );
+    }
+    return lgtd_router_send_to_device(bulb, pkt_type, pkt);
+}
+
 void
 lgtd_proto_target_list_clear(struct lgtd_proto_target_list *targets)
 {
@@ -58,6 +87,22 @@ lgtd_proto_target_list_clear(struct lgtd_proto_target_list *targets)
     }
 }
 
+void
+lgtd_proto_synchronize(struct lgtd_client *client, int delay_msecs)
+{
+    assert(client);
+    assert(delay_msecs >= 0);
+
+    lgtd_time_mono_t delay = LGTD_MAX(
+        (lgtd_time_mono_t)delay_msecs, lgtd_lifx_gateway_sync_lead_time()
+    );
+    client->sync_at = lgtd_time_monotonic_msecs() + delay;
+
+    char response[32];
+    snprintf(response, sizeof(response), "%ju", (uintmax_t)delay);
+    lgtd_client_send_response(client, response);
+}
+
 void
 lgtd_proto_power_on(struct lgtd_client *client,
                     const struct lgtd_proto_target_list *targets)
@@ -65,9 +110,8 @@ lgtd_proto_power_on(struct lgtd_client *client,
     assert(targets);
 
     struct lgtd_lifx_packet_power_state pkt = { .power = LGTD_LIFX_POWER_ON };
-    SEND_RESULT(
-        client, lgtd_router_send(targets, LGTD_LIFX_SET_POWER_STATE, &pkt)
-    );
+    bool ok = lgtd_proto_send(client, targets, LGTD_LIFX_SET_POWER_STATE, &pkt);
+    SEND_RESULT(client, ok);
 }
 
 void
@@ -85,16 +129,19 @@ lgtd_proto_power_toggle(struct lgtd_client *client,
         return;
     }
 
-    struct lgtd_router_device *device;
-    SLIST_FOREACH(device, devices, link) {
-        struct lgtd_lifx_bulb *bulb = device->device;
+    bool ok = true;
+    struct lgtd_lifx_bulb **device;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        struct lgtd_lifx_bulb *bulb = *device;
         struct lgtd_lifx_packet_power_state pkt = {
             .power = ~bulb->state.power
         };
-        lgtd_router_send_to_device(bulb, LGTD_LIFX_SET_POWER_STATE, &pkt);
+        ok = lgtd_proto_send_to_device(
+            client, bulb, LGTD_LIFX_SET_POWER_STATE, &pkt
+        ) && ok;
     }
 
-    SEND_RESULT(client, true);
+    SEND_RESULT(client, ok);
 
     lgtd_router_device_list_free(devices);
 }
@@ -106,9 +153,8 @@ lgtd_proto_power_off(struct lgtd_client *client,
     assert(targets);
 
     struct lgtd_lifx_packet_power_state pkt = { .power = LGTD_LIFX_POWER_OFF };
-    SEND_RESULT(
-        client, lgtd_router_send(targets, LGTD_LIFX_SET_POWER_STATE, &pkt)
-    );
+    bool ok = lgtd_proto_send(client, targets, LGTD_LIFX_SET_POWER_STATE, &pkt);
+    SEND_RESULT(client, ok);
 }
 
 void
@@ -137,9 +183,8 @@ lgtd_proto_set_light_from_hsbk(struct lgtd_client *client,
     };
 
     lgtd_lifx_wire_encode_light_color(&pkt);
-    SEND_RESULT(
-        client, lgtd_router_send(targets, LGTD_LIFX_SET_LIGHT_COLOR, &pkt)
-    );
+    bool ok = lgtd_proto_send(client, targets, LGTD_LIFX_SET_LIGHT_COLOR, &pkt);
+    SEND_RESULT(client, ok);
 }
 
 void
@@ -175,56 +220,42 @@ lgtd_proto_set_waveform(struct lgtd_client *client,
     };
 
     lgtd_lifx_wire_encode_waveform(&pkt);
-    SEND_RESULT(
-        client, lgtd_router_send(targets, LGTD_LIFX_SET_WAVEFORM, &pkt)
-    );
+    bool ok = lgtd_proto_send(client, targets, LGTD_LIFX_SET_WAVEFORM, &pkt);
+    SEND_RESULT(client, ok);
 }
 
-void
-lgtd_proto_get_light_state(struct lgtd_client *client,
-                           const struct lgtd_proto_target_list *targets)
+// Format the address of the bulb and of its gateway, up to the latency:
+static int
+lgtd_proto_format_bulb_json_head(const struct lgtd_lifx_bulb *bulb,
+                                 char *buf,
+                                 int bufsz)
 {
-    assert(targets);
-
-    struct lgtd_router_device_list *devices;
-    devices = lgtd_router_targets_to_devices(targets);
-    if (!devices) {
-        lgtd_client_send_error(
-            client, LGTD_CLIENT_INTERNAL_ERROR, "couldn't allocate device list"
-        );
-        return;
-    }
-
-    char client_ip_addr[LGTD_SOCKADDR_STRLEN];
-    LGTD_SOCKADDRTOA(client->addr, client_ip_addr);
-
-    lgtd_client_start_send_response(client);
-    lgtd_client_write_string(client, "[");
-    struct lgtd_router_device *device;
-    SLIST_FOREACH(device, devices, link) {
-        struct lgtd_lifx_bulb *bulb = device->device;
-
-        char buf[2048],
-             site_addr[LGTD_LIFX_ADDR_STRLEN],
-             bulb_addr[LGTD_LIFX_ADDR_STRLEN];
-        int i = 0;
-
-        LGTD_IEEE8023MACTOA(bulb->addr, bulb_addr);
-        LGTD_IEEE8023MACTOA(bulb->gw->site.as_array, site_addr);
+    char site_addr[LGTD_LIFX_ADDR_STRLEN], bulb_addr[LGTD_LIFX_ADDR_STRLEN];
+    LGTD_IEEE8023MACTOA(bulb->addr, bulb_addr);
+    LGTD_IEEE8023MACTOA(bulb->gw->site.as_array, site_addr);
+
+    int i = 0;
+    LGTD_SNPRINTF_APPEND(
+        buf, i, bufsz,
+        "{"
+            "\"_lifx\":{"
+                "\"addr\":\"%s\","
+                "\"gateway\":{"
+                    "\"site\":\"%s\","
+                    "\"url\":\"tcp://%s\","
+                    "\"latency\":",
+        bulb_addr, site_addr, bulb->gw->peeraddr
+    );
+    return i;
+}
 
-        LGTD_SNPRINTF_APPEND(
-            buf, i, (int)sizeof(buf),
-            "{"
-                "\"_lifx\":{"
-                    "\"addr\":\"%s\","
-                    "\"gateway\":{"
-                        "\"site\":\"%s\","
-                        "\"url\":\"tcp://%s\","
-                        "\"latency\":%ju"
-                    "}",
-            bulb_addr, site_addr, bulb->gw->peeraddr,
-            (uintmax_t)lgtd_lifx_gateway_latency(bulb->gw)
-        );
+// Format everything that comes after the gateway, up to the list of tags:
+static int
+lgtd_proto_format_bulb_json_state(const struct lgtd_lifx_bulb *bulb,
+                                  char *buf,
+                                  int bufsz)
+{
+    int i = 0;
 
 #define PRINT_LIFX_FW_TIMESTAMPS(fw_info, built_at_buf, installed_at_buf)       \
     LGTD_LIFX_WIRE_PRINT_NSEC_TIMESTAMP((fw_info)->built_at, (built_at_buf));   \
@@ -232,75 +263,75 @@ lgtd_proto_get_light_state(struct lgtd_client *client,
         (fw_info)->installed_at, (installed_at_buf)                             \
     )
 
-        for (int ip = 0; ip != LGTD_LIFX_BULB_IP_COUNT; ip++) {
-            if (lgtd_opts.verbosity == LGTD_DEBUG) {
-                char fw_built_at[64], fw_installed_at[64];
-                PRINT_LIFX_FW_TIMESTAMPS(
-                    &bulb->ips[ip].fw_info, fw_built_at, fw_installed_at
-                );
-
-                LGTD_SNPRINTF_APPEND(
-                    buf, i, (int)sizeof(buf),
-                    ",\"%s\":{"
-                        "\"firmware_built_at\":\"%s\","
-                        "\"firmware_installed_at\":\"%s\","
-                        "\"firmware_version\":\"%u.%u\","
-                        "\"signal_strength\":%f,"
-                        "\"tx_bytes\":%u,"
-                        "\"rx_bytes\":%u,"
-                        "\"temperature\":%u"
-                    "}",
-                    lgtd_lifx_bulb_ip_names[ip],
-                    fw_built_at, fw_installed_at,
-                    (bulb->ips[ip].fw_info.version & 0xffff0000) >> 16,
-                    bulb->ips[ip].fw_info.version & 0xffff,
-                    bulb->ips[ip].state.signal_strength,
-                    bulb->ips[ip].state.tx_bytes,
-                    bulb->ips[ip].state.rx_bytes,
-                    bulb->ips[ip].state.temperature
-                );
-            } else {
-                LGTD_SNPRINTF_APPEND(
-                    buf, i, (int)sizeof(buf),
-                    ",\"%s\":{\"firmware_version\":\"%u.%u\"}",
-                    lgtd_lifx_bulb_ip_names[ip],
-                    (bulb->ips[ip].fw_info.version & 0xffff0000) >> 16,
-                    bulb->ips[ip].fw_info.version & 0xffff
-                );
-            }
-        }
-
+    for (int ip = 0; ip != LGTD_LIFX_BULB_IP_COUNT; ip++) {
         if (lgtd_opts.verbosity == LGTD_DEBUG) {
-            LGTD_SNPRINTF_APPEND(
-                buf, i, (int)sizeof(buf),
-                    ",\"product_info\":{"
-                        "\"vendor_id\":\"%x\","
-                        "\"product_id\":\"%x\","
-                        "\"version\":%u"
-                    "}",
-                bulb->product_info.vendor_id,
-                bulb->product_info.product_id,
-                bulb->product_info.version
+            char fw_built_at[64], fw_installed_at[64];
+            PRINT_LIFX_FW_TIMESTAMPS(
+                &bulb->ips[ip].fw_info, fw_built_at, fw_installed_at
             );
 
-            char bulb_time[64];
             LGTD_SNPRINTF_APPEND(
-                buf, i, (int)sizeof(buf),
-                    ",\"runtime_info\":{"
-                        "\"time\":\"%s\","
-                        "\"uptime\":%ju,"
-                        "\"downtime\":%ju"
-                    "}"
+                buf, i, bufsz,
+                ",\"%s\":{"
+                    "\"firmware_built_at\":\"%s\","
+                    "\"firmware_installed_at\":\"%s\","
+                    "\"firmware_version\":\"%u.%u\","
+                    "\"signal_strength\":%f,"
+                    "\"tx_bytes\":%u,"
+                    "\"rx_bytes\":%u,"
+                    "\"temperature\":%u"
                 "}",
-                LGTD_LIFX_WIRE_PRINT_NSEC_TIMESTAMP(
-                    bulb->runtime_info.time, bulb_time
-                ),
-                (uintmax_t)LGTD_NSECS_TO_SECS(bulb->runtime_info.uptime),
-                (uintmax_t)LGTD_NSECS_TO_SECS(bulb->runtime_info.downtime)
+                lgtd_lifx_bulb_ip_names[ip],
+                fw_built_at, fw_installed_at,
+                (bulb->ips[ip].fw_info.version & 0xffff0000) >> 16,
+                bulb->ips[ip].fw_info.version & 0xffff,
+                bulb->ips[ip].state.signal_strength,
+                bulb->ips[ip].state.tx_bytes,
+                bulb->ips[ip].state.rx_bytes,
+                bulb->ips[ip].state.temperature
             );
         } else {
-            LGTD_SNPRINTF_APPEND(buf, i, (int)sizeof(buf), "}");
+            LGTD_SNPRINTF_APPEND(
+                buf, i, bufsz,
+                ",\"%s\":{\"firmware_version\":\"%u.%u\"}",
+                lgtd_lifx_bulb_ip_names[ip],
+                (bulb->ips[ip].fw_info.version & 0xffff0000) >> 16,
+                bulb->ips[ip].fw_info.version & 0xffff
+            );
         }
+    }
+
+    if (lgtd_opts.verbosity == LGTD_DEBUG) {
+        LGTD_SNPRINTF_APPEND(
+            buf, i, bufsz,
+                ",\"product_info\":{"
+                    "\"vendor_id\":\"%x\","
+                    "\"product_id\":\"%x\","
+                    "\"version\":%u"
+                "}",
+            bulb->product_info.vendor_id,
+            bulb->product_info.product_id,
+            bulb->product_info.version
+        );
+
+        char bulb_time[64];
+        LGTD_SNPRINTF_APPEND(
+            buf, i, bufsz,
+                ",\"runtime_info\":{"
+                    "\"time\":\"%s\","
+                    "\"uptime\":%ju,"
+                    "\"downtime\":%ju"
+                "}"
+            "}",
+            LGTD_LIFX_WIRE_PRINT_NSEC_TIMESTAMP(
+                bulb->runtime_info.time, bulb_time
+            ),
+            (uintmax_t)LGTD_NSECS_TO_SECS(bulb->runtime_info.uptime),
+            (uintmax_t)LGTD_NSECS_TO_SECS(bulb->runtime_info.downtime)
+        );
+    } else {
+        LGTD_SNPRINTF_APPEND(buf, i, bufsz, "}");
+    }
 
 #define PRINT_STRING_OR_NULL(buf, i, bufsz, v) do {                 \
     if ((v)) {                                                      \
@@ -310,86 +341,322 @@ lgtd_proto_get_light_state(struct lgtd_client *client,
     }                                                               \
 } while (0)
 
-    LGTD_SNPRINTF_APPEND(buf, i, (int)sizeof(buf), ",\"_model\":");
-    PRINT_STRING_OR_NULL(buf, i, (int)sizeof(buf), bulb->model);
-    LGTD_SNPRINTF_APPEND(buf, i, (int)sizeof(buf), ",\"_vendor\":");
-    PRINT_STRING_OR_NULL(buf, i, (int)sizeof(buf), bulb->vendor);
+    LGTD_SNPRINTF_APPEND(buf, i, bufsz, ",\"_model\":");
+    PRINT_STRING_OR_NULL(buf, i, bufsz, bulb->model);
+    LGTD_SNPRINTF_APPEND(buf, i, bufsz, ",\"_vendor\":");
+    PRINT_STRING_OR_NULL(buf, i, bufsz, bulb->vendor);
 
 #define PRINT_COMPONENT(src, dst, start, stop)          \
     lgtd_jsonrpc_uint16_range_to_float_string(          \
         (src), (start), (stop), (dst), sizeof((dst))    \
     )
 
-        char h[16], s[16], b[16], bulb_id[16];
-        PRINT_COMPONENT(bulb->state.hue, h, 0, 360);
-        PRINT_COMPONENT(bulb->state.saturation, s, 0, 1);
-        PRINT_COMPONENT(bulb->state.brightness, b, 0, 1);
+    char h[16], s[16], b[16], bulb_id[16];
+    PRINT_COMPONENT(bulb->state.hue, h, 0, 360);
+    PRINT_COMPONENT(bulb->state.saturation, s, 0, 1);
+    PRINT_COMPONENT(bulb->state.brightness, b, 0, 1);
+
+    const char *label;
+    int label_size;
+    if (bulb->state.label[0]) {
+        label = bulb->state.label;
+        label_size = (int)sizeof(bulb->state.label);
+    } else {
+        label = bulb_id;
+        label_size = LGTD_ARRAY_SIZE(bulb_id);
+        snprintf(
+            bulb_id, label_size,
+            "%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx",
+            bulb->addr[0], bulb->addr[1], bulb->addr[2],
+            bulb->addr[3], bulb->addr[4], bulb->addr[5]
+        );
+    }
 
-        const char *label;
-        int label_size;
-        if (bulb->state.label[0]) {
-            label = bulb->state.label;
-            label_size = (int)sizeof(bulb->state.label);
-        } else {
-            label = bulb_id;
-            label_size = LGTD_ARRAY_SIZE(bulb_id);
-            snprintf(
-                bulb_id, label_size,
-                "%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx",
-                bulb->addr[0], bulb->addr[1], bulb->addr[2],
-                bulb->addr[3], bulb->addr[4], bulb->addr[5]
-            );
+    LGTD_SNPRINTF_APPEND(
+        buf, i, bufsz,
+        ",\"hsbk\":[%s,%s,%s,%hu],"
+        "\"power\":%s,"
+        "\"label\":\"%.*s\","
+        "\"tags\":[",
+        h, s, b, bulb->state.kelvin,
+        bulb->state.power == LGTD_LIFX_POWER_ON ? "true" : "false",
+        label_size, label
+    );
+
+    return i;
+}
+
+// Return the cached piece of JSON for the bulb, or format it in buf (and
+// keep a copy in the cache) if the bulb changed since it was formatted:
+static const char *
+lgtd_proto_get_bulb_json(const struct lgtd_lifx_bulb *bulb,
+                         struct lgtd_lifx_bulb_json *json,
+                         int (*format)(const struct lgtd_lifx_bulb *, char *, int),
+                         char *buf,
+                         int bufsz,
+                         int *len)
+{
+    bool debug = lgtd_opts.verbosity == LGTD_DEBUG;
+    if (json->len && json->debug == debug) {
+        *len = json->len;
+        return json->buf;
+    }
+
+    *len = format(bulb, buf, bufsz);
+    if (*len >= bufsz) {
+        return NULL;
+    }
+
+    if (json->size < *len) {
+        char *cache = realloc(json->buf, *len);
+        if (!cache) {
+            lgtd_warn("can't cache the state of a bulb");
+            json->len = 0;
+            return buf;
         }
+        json->buf = cache;
+        json->size = *len;
+    }
+    memcpy(json->buf, buf, *len);
+    json->len = *len;
+    json->debug = debug;
+    return buf;
+}
+
+// Write the state of the bulb as a JSON object (prefixed with a comma if
+// it's not the first one in the list), return false if it couldn't be
+// formatted:
+static bool
+lgtd_proto_write_bulb_state(struct lgtd_client *client,
+                            struct lgtd_lifx_bulb *bulb,
+                            bool comma)
+{
+    lgtd_lifx_gateway_mark_client_read(bulb->gw);
+
+    // Most of the JSON only changes with the bulb and is cached in it,
+    // only the latency, the delivery and the tags are formatted here:
+    char head_buf[256], state_buf[2048], bulb_addr[LGTD_LIFX_ADDR_STRLEN];
+    int head_len, state_len;
+    const char *head = lgtd_proto_get_bulb_json(
+        bulb, &bulb->json_head, lgtd_proto_format_bulb_json_head,
+        head_buf, (int)sizeof(head_buf), &head_len
+    );
+    const char *state = lgtd_proto_get_bulb_json(
+        bulb, &bulb->json_state, lgtd_proto_format_bulb_json_state,
+        state_buf, (int)sizeof(state_buf), &state_len
+    );
+    if (!head || !state) {
+        char client_ip_addr[LGTD_SOCKADDR_STRLEN];
+        LGTD_SOCKADDRTOA(client->addr, client_ip_addr);
+        lgtd_warnx(
+            "can't send state of bulb %s (%s) to client "
+            "%s: output buffer to small",
+            bulb->state.label, LGTD_IEEE8023MACTOA(bulb->addr, bulb_addr),
+            client_ip_addr
+        );
+        return false;
+    }
+
+    char buf[128];
+    int i = 0;
+    LGTD_SNPRINTF_APPEND(
+        buf, i, (int)sizeof(buf),
+        "%ju}", (uintmax_t)lgtd_lifx_gateway_latency(bulb->gw)
+    );
 
+    // What happened to the last command sent to the bulb:
+    if (lgtd_opts.lifx_acked_delivery) {
+        static const char *deliveries[] = {
+            [LGTD_LIFX_BULB_DELIVERY_NONE] = "none",
+            [LGTD_LIFX_BULB_DELIVERY_PENDING] = "pending",
+            [LGTD_LIFX_BULB_DELIVERY_ACKED] = "acked",
+            [LGTD_LIFX_BULB_DELIVERY_FAILED] = "failed"
+        };
         LGTD_SNPRINTF_APPEND(
             buf, i, (int)sizeof(buf),
-            ",\"hsbk\":[%s,%s,%s,%hu],"
-            "\"power\":%s,"
-            "\"label\":\"%.*s\","
-            "\"tags\":[",
-            h, s, b, bulb->state.kelvin,
-            bulb->state.power == LGTD_LIFX_POWER_ON ? "true" : "false",
-            label_size, label
+            ",\"delivery\":\"%s\"", deliveries[bulb->delivery]
         );
+    }
 
-        if (i >= (int)sizeof(buf)) {
+    // Restored from --lifx-state-file, the state hasn't been confirmed:
+    if (bulb->stale) {
+        LGTD_SNPRINTF_APPEND(buf, i, (int)sizeof(buf), ",\"stale\":true");
+    }
+
+    if (comma) {
+        lgtd_client_write_string(client, ",");
+    }
+    lgtd_client_write_buf(client, head, head_len);
+    lgtd_client_write_buf(client, buf, i);
+    lgtd_client_write_buf(client, state, state_len);
+
+    bool tags_comma = false;
+    int tag_id;
+    LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, bulb->state.tags) {
+        if (LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(tag_id) & bulb->gw->tag_ids) {
+            lgtd_client_write_string(client, tags_comma ? ",\"" : "\"");
+            lgtd_client_write_string(client, bulb->gw->tags[tag_id]->label);
+            lgtd_client_write_string(client, "\"");
+            tags_comma = true;
+        } else {
+            char site_addr[LGTD_LIFX_ADDR_STRLEN];
             lgtd_warnx(
-                "can't send state of bulb %s (%s) to client "
-                "%s: output buffer to small",
-                bulb->state.label, bulb_addr, client_ip_addr
+                "tag_id %d on bulb %.*s (%s) doesn't "
+                "exist on gw %s (site %s)",
+                tag_id, (int)sizeof(bulb->state.label), bulb->state.label,
+                LGTD_IEEE8023MACTOA(bulb->addr, bulb_addr),
+                bulb->gw->peeraddr,
+                LGTD_IEEE8023MACTOA(bulb->gw->site.as_array, site_addr)
             );
-            continue;
         }
-        lgtd_client_write_string(client, buf);
+    }
 
-        bool comma = false;
-        int tag_id;
-        LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, bulb->state.tags) {
-            if (LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(tag_id) & bulb->gw->tag_ids) {
-                lgtd_client_write_string(client, comma ? ",\"" : "\"");
-                lgtd_client_write_string(client, bulb->gw->tags[tag_id]->label);
-                lgtd_client_write_string(client, "\"");
-                comma = true;
-            } else {
-                lgtd_warnx(
-                    "tag_id %d on bulb %.*s (%s) doesn't "
-                    "exist on gw %s (site %s)",
-                    tag_id, (int)sizeof(bulb->state.label), bulb->state.label,
-                    bulb_addr, bulb->gw->peeraddr, site_addr
-                );
-            }
-        }
+    lgtd_client_write_string(client, "]}");
+    return true;
+}
 
-        lgtd_client_write_string(
-            client, SLIST_NEXT(device, link) ?  "]}," : "]}"
+static struct lgtd_router_device_list *
+lgtd_proto_get_light_state_devices(struct lgtd_client *client,
+                                   const struct lgtd_proto_target_list *targets)
+{
+    assert(targets);
+
+    struct lgtd_router_device_list *devices;
+    devices = lgtd_router_targets_to_devices(targets);
+    if (!devices) {
+        lgtd_client_send_error(
+            client, LGTD_CLIENT_INTERNAL_ERROR, "couldn't allocate device list"
         );
     }
+    return devices;
+}
+
+void
+lgtd_proto_get_light_state(struct lgtd_client *client,
+                           const struct lgtd_proto_target_list *targets)
+{
+    struct lgtd_router_device_list *devices;
+    devices = lgtd_proto_get_light_state_devices(client, targets);
+    if (!devices) {
+        return;
+    }
+
+    lgtd_client_start_send_response(client);
+    lgtd_client_write_string(client, "[");
+    bool comma = false;
+    struct lgtd_lifx_bulb **device;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        comma |= lgtd_proto_write_bulb_state(client, *device, comma);
+    }
     lgtd_client_write_string(client, "]");
     lgtd_client_end_send_response(client);
 
     lgtd_router_device_list_free(devices);
 }
 
+// Addresses of the bulbs seen while lgtd_proto_get_light_state_since walks
+// the journal back. Each slot holds the generation it was set in, above the
+// 48 bits of the address, so the set is emptied by bumping the generation:
+static struct {
+    uint16_t    gen;
+    uint64_t    slots[2 * LGTD_LIFX_BULB_JOURNAL_SIZE]; // at most half full
+} lgtd_proto_journal_seen = { .gen = 0 };
+
+enum { LGTD_PROTO_JOURNAL_SEEN_GEN_SHIFT = LGTD_LIFX_ADDR_LENGTH * 8 };
+
+static void
+lgtd_proto_journal_seen_clear(void)
+{
+    if (++lgtd_proto_journal_seen.gen == 0) {
+        // wrapped around, make sure no slot looks set:
+        memset(
+            lgtd_proto_journal_seen.slots,
+            0,
+            sizeof(lgtd_proto_journal_seen.slots)
+        );
+        lgtd_proto_journal_seen.gen = 1;
+    }
+}
+
+// Add addr to the set, return false if it was already in it:
+static bool
+lgtd_proto_journal_seen_add(const uint8_t *addr)
+{
+    uint64_t *slots = lgtd_proto_journal_seen.slots;
+    uint64_t gen = lgtd_proto_journal_seen.gen;
+    uint64_t key = lgtd_lifx_bulb_addr_to_key(addr);
+    uint64_t slot = gen << LGTD_PROTO_JOURNAL_SEEN_GEN_SHIFT | key;
+
+    int mask = LGTD_ARRAY_SIZE(lgtd_proto_journal_seen.slots) - 1;
+    int idx = (key * UINT64_C(0x9e3779b97f4a7c15)) >> 32 & mask;
+    while (slots[idx] >> LGTD_PROTO_JOURNAL_SEEN_GEN_SHIFT == gen) {
+        if (slots[idx] == slot) {
+            return false;
+        }
+        idx = (idx + 1) & mask;
+    }
+    slots[idx] = slot;
+    return true;
+}
+
+void
+lgtd_proto_get_light_state_since(struct lgtd_client *client,
+                                 const struct lgtd_proto_target_list *targets,
+                                 uint64_t since)
+{
+    struct lgtd_router_device_list *devices;
+    devices = lgtd_proto_get_light_state_devices(client, targets);
+    if (!devices) {
+        return;
+    }
+
+    // The changes the client missed aren't all in the journal anymore (or
+    // lightsd restarted), send everything and let it start over:
+    bool resync = !lgtd_lifx_bulb_journal_has(since);
+    uint64_t seqn = lgtd_lifx_bulb_journal.seqn;
+
+    char buf[128];
+    snprintf(
+        buf, sizeof(buf), "{\"seq\":%ju,\"resync\":%s,\"bulbs\":[",
+        (uintmax_t)seqn, resync ? "true" : "false"
+    );
+    lgtd_client_start_send_response(client);
+    lgtd_client_write_string(client, buf);
+    bool comma = false;
+    struct lgtd_lifx_bulb **device;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        if (resync || (*device)->journal_seqn > since) {
+            comma |= lgtd_proto_write_bulb_state(client, *device, comma);
+        }
+    }
+    lgtd_client_write_string(client, "],\"closed\":[");
+    // The closed bulbs can't be matched against the targets anymore, they
+    // are all listed (once, and only if they haven't come back since): walk
+    // the journal back and only look at the last entry of each bulb:
+    comma = false;
+    lgtd_proto_journal_seen_clear();
+    for (uint64_t i = seqn; !resync && i > since; i--) {
+        const struct lgtd_lifx_bulb_journal_entry *entry;
+        entry = LGTD_LIFX_BULB_JOURNAL_ENTRY(i);
+        if (!lgtd_proto_journal_seen_add(entry->addr)
+            || !entry->closed
+            || lgtd_lifx_bulb_get(entry->addr)) {
+            continue;
+        }
+        char bulb_addr[LGTD_LIFX_ADDR_STRLEN];
+        snprintf(
+            buf, sizeof(buf), "%s\"%s\"",
+            comma ? "," : "", LGTD_IEEE8023MACTOA(entry->addr, bulb_addr)
+        );
+        lgtd_client_write_string(client, buf);
+        comma = true;
+    }
+    lgtd_client_write_string(client, "]}");
+    lgtd_client_end_send_response(client);
+
+    lgtd_router_device_list_free(devices);
+}
+
 void
 lgtd_proto_tag(struct lgtd_client *client,
                const struct lgtd_proto_target_list *targets,
@@ -414,14 +681,14 @@ lgtd_proto_tag(struct lgtd_client *client,
         lgtd_info("created tag [%s]", tag_label);
     }
 
-    struct lgtd_router_device *device;
+    struct lgtd_lifx_bulb **device;
     struct lgtd_lifx_site *site;
 
     // Loop over the devices and do allocations first, this makes error
     // handling easier (since you can't rollback enqueued packets) and build
     // the list of affected gateways so we can do SET_TAG_LABELS:
-    SLIST_FOREACH(device, devices, link) {
-        struct lgtd_lifx_gateway *gw = device->device->gw;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        struct lgtd_lifx_gateway *gw = (*device)->gw;
         int tag_id = lgtd_lifx_gateway_get_tag_id(gw, tag);
         if (tag_id == -1) {
             tag_id = lgtd_lifx_gateway_allocate_tag_id(gw, -1, tag_label);
@@ -433,7 +700,7 @@ lgtd_proto_tag(struct lgtd_client *client,
 
     // SET_TAG_LABELS, this is idempotent, do it everytime so we can recover
     // from any bad state:
-    LIST_FOREACH(site, &tag->sites, link) {
+    LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
         int tag_id = site->tag_id;
         assert(tag_id > -1 && tag_id < LGTD_LIFX_GATEWAY_MAX_TAGS);
         struct lgtd_lifx_packet_tag_labels pkt = { .tags = 0 };
@@ -453,8 +720,9 @@ lgtd_proto_tag(struct lgtd_client *client,
     }
 
     // Finally SET_TAGS on the devices:
-    SLIST_FOREACH(device, devices, link) {
-        struct lgtd_lifx_bulb *bulb = device->device;
+    bool ok = true;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        struct lgtd_lifx_bulb *bulb = *device;
         int tag_id = lgtd_lifx_gateway_get_tag_id(bulb->gw, tag);
         assert(tag_id > -1 && tag_id < LGTD_LIFX_GATEWAY_MAX_TAGS);
         int tag_value = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(tag_id);
@@ -462,19 +730,23 @@ lgtd_proto_tag(struct lgtd_client *client,
             struct lgtd_lifx_packet_tags pkt;
             pkt.tags = bulb->state.tags | tag_value;
             lgtd_lifx_wire_encode_tags(&pkt);
-            lgtd_router_send_to_device(bulb, LGTD_LIFX_SET_TAGS, &pkt);
+            ok = lgtd_router_send_to_device(
+                bulb, LGTD_LIFX_SET_TAGS, &pkt
+            ) && ok;
         }
     }
 
-    SEND_RESULT(client, true);
+    SEND_RESULT(client, ok);
     goto fini;
 
 error_site_alloc:
-    if (LIST_EMPTY(&tag->sites)) {
+    if (!tag->nsites) {
         lgtd_lifx_tagging_deallocate_tag(tag);
     } else { // tagging_decref will deallocate the tag for us:
-        struct lgtd_lifx_site *next_site;
-        LIST_FOREACH_SAFE(site, &tag->sites, link, next_site) {
+        // walk the sites backward, each call removes the last site from the
+        // array and the tag itself is freed along with its first site:
+        for (int i = tag->nsites - 1; i >= 0; i--) {
+            site = &tag->sites[i];
             lgtd_lifx_gateway_deallocate_tag_id(site->gw, site->tag_id);
         }
     }
@@ -510,9 +782,10 @@ lgtd_proto_untag(struct lgtd_client *client,
         return;
     }
 
-    struct lgtd_router_device *device;
-    SLIST_FOREACH(device, devices, link) {
-        struct lgtd_lifx_bulb *bulb = device->device;
+    bool ok = true;
+    struct lgtd_lifx_bulb **device;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        struct lgtd_lifx_bulb *bulb = *device;
         struct lgtd_lifx_gateway *gw = bulb->gw;
         int tag_id = lgtd_lifx_gateway_get_tag_id(gw, tag);
         if (tag_id != -1) {
@@ -521,12 +794,14 @@ lgtd_proto_untag(struct lgtd_client *client,
                 struct lgtd_lifx_packet_tags pkt;
                 pkt.tags = bulb->state.tags & ~tag_value;
                 lgtd_lifx_wire_encode_tags(&pkt);
-                lgtd_router_send_to_device(bulb, LGTD_LIFX_SET_TAGS, &pkt);
+                ok = lgtd_router_send_to_device(
+                    bulb, LGTD_LIFX_SET_TAGS, &pkt
+                ) && ok;
             }
         }
     }
 
-    SEND_RESULT(client, true);
+    SEND_RESULT(client, ok);
 
     lgtd_router_device_list_free(devices);
 }
@@ -551,3 +826,22 @@ lgtd_proto_set_label(struct lgtd_client *client,
         client, lgtd_router_send(targets, LGTD_LIFX_SET_BULB_LABEL, &pkt)
     );
 }
+
+void
+lgtd_proto_subscribe(struct lgtd_client *client,
+                     const struct lgtd_proto_target_list *targets,
+                     int fields)
+{
+    assert(client);
+    assert(targets);
+
+    SEND_RESULT(client, lgtd_subscription_add(client, targets, fields));
+}
+
+void
+lgtd_proto_unsubscribe(struct lgtd_client *client)
+{
+    assert(client);
+
+    SEND_RESULT(client, lgtd_subscription_remove(client));
+}
@@ -36,10 +36,15 @@ void lgtd_proto_set_waveform(struct lgtd_client *,
                              enum lgtd_lifx_waveform_type,
                              int, int, int, int,
                              int, float, int, bool);
+void lgtd_proto_synchronize(struct lgtd_client *, int);
 void lgtd_proto_power_on(struct lgtd_client *, const struct lgtd_proto_target_list *);
 void lgtd_proto_power_off(struct lgtd_client *, const struct lgtd_proto_target_list *);
 void lgtd_proto_power_toggle(struct lgtd_client *, const struct lgtd_proto_target_list *);
 void lgtd_proto_get_light_state(struct lgtd_client *, const struct lgtd_proto_target_list *);
+void lgtd_proto_get_light_state_since(struct lgtd_client *, const struct lgtd_proto_target_list *, uint64_t);
 void lgtd_proto_tag(struct lgtd_client *, const struct lgtd_proto_target_list *, const char *);
 void lgtd_proto_untag(struct lgtd_client *, const struct lgtd_proto_target_list *, const char *);
 void lgtd_proto_set_label(struct lgtd_client *, const struct lgtd_proto_target_list *, const char *);
+// fields is a mask of enum lgtd_lifx_bulb_changes:
+void lgtd_proto_subscribe(struct lgtd_client *, const struct lgtd_proto_target_list *, int);
+void lgtd_proto_unsubscribe(struct lgtd_client *);
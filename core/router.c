@@ -43,12 +43,13 @@
 #include "router.h"
 #include "lightsd.h"
 
-void
+bool
 lgtd_router_broadcast(enum lgtd_lifx_packet_type pkt_type, void *pkt)
 {
     struct lgtd_lifx_packet_header hdr;
     union lgtd_lifx_target target = { .tags = 0 };
 
+    bool rv = true;
     const struct lgtd_lifx_packet_info *pkt_info = NULL;
     struct lgtd_lifx_gateway *gw;
     LIST_FOREACH(gw, &lgtd_lifx_gateways, link) {
@@ -61,7 +62,10 @@ lgtd_router_broadcast(enum lgtd_lifx_packet_type pkt_type, void *pkt)
         );
         assert(pkt_info);
 
-        lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt);
+        if (!lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt)) {
+            rv = false;
+            continue;
+        }
 
         if (pkt_type == LGTD_LIFX_SET_POWER_STATE) {
             struct lgtd_lifx_bulb *bulb;
@@ -77,12 +81,17 @@ lgtd_router_broadcast(enum lgtd_lifx_packet_type pkt_type, void *pkt)
     if (pkt_info) {
         lgtd_info("broadcasting %s", pkt_info->name);
     }
+
+    return rv;
 }
 
-void
-lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
-                           enum lgtd_lifx_packet_type pkt_type,
-                           void *pkt)
+// at is a time on our monotonic clock translated to the bulb clock, the packet
+// is run right away if the bulb clock isn't known yet:
+bool
+lgtd_router_send_to_device_at(struct lgtd_lifx_bulb *bulb,
+                              enum lgtd_lifx_packet_type pkt_type,
+                              void *pkt,
+                              lgtd_time_mono_t at)
 {
     assert(bulb);
 
@@ -98,7 +107,14 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     );
     assert(pkt_info);
 
-    lgtd_lifx_gateway_enqueue_packet(bulb->gw, &hdr, pkt_info, pkt);
+    if (at && bulb->clock_offset_updated_at) {
+        int64_t bulb_at = (int64_t)at + bulb->clock_offset;
+        hdr.at_time = htole64((uint64_t)bulb_at * 1000 * 1000);
+    }
+
+    if (!lgtd_lifx_gateway_enqueue_packet(bulb->gw, &hdr, pkt_info, pkt)) {
+        return false;
+    }
 
     if (pkt_type == LGTD_LIFX_SET_POWER_STATE) {
         bulb->dirty_at = lgtd_time_monotonic_msecs();
@@ -112,17 +128,28 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
         "sending %s to %s (%.*s)",
         pkt_info->name, addr, LGTD_LIFX_LABEL_SIZE, bulb->state.label
     );
+
+    return true;
 }
 
-void
+bool
+lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
+                           enum lgtd_lifx_packet_type pkt_type,
+                           void *pkt)
+{
+    return lgtd_router_send_to_device_at(bulb, pkt_type, pkt, 0);
+}
+
+bool
 lgtd_router_send_to_tag(const struct lgtd_lifx_tag *tag,
                         enum lgtd_lifx_packet_type pkt_type,
                         void *pkt)
 {
+    bool rv = true;
     const struct lgtd_lifx_packet_info *pkt_info = NULL;
 
-    struct lgtd_lifx_site *site;
-    LIST_FOREACH(site, &tag->sites, link) {
+    const struct lgtd_lifx_site *site;
+    LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
         struct lgtd_lifx_gateway *gw = site->gw;
         int tag_id = site->tag_id;
 
@@ -139,7 +166,10 @@ lgtd_router_send_to_tag(const struct lgtd_lifx_tag *tag,
         );
         assert(pkt_info);
 
-        lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt);
+        if (!lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt)) {
+            rv = false;
+            continue;
+        }
 
         if (pkt_type == LGTD_LIFX_SET_POWER_STATE) {
             struct lgtd_lifx_bulb *bulb;
@@ -157,42 +187,55 @@ lgtd_router_send_to_tag(const struct lgtd_lifx_tag *tag,
     if (pkt_info) {
         lgtd_info("sending %s to #%s", pkt_info->name, tag->label);
     }
+
+    return rv;
 }
 
-void
+bool
 lgtd_router_send_to_label(const char *label,
                           enum lgtd_lifx_packet_type pkt_type,
                           void *pkt)
 {
+    bool rv = true;
     const struct lgtd_lifx_packet_info *pkt_info = NULL;
 
+    const struct lgtd_lifx_bulb_label *bulb_label;
+    bulb_label = lgtd_lifx_bulb_find_label(label);
+    if (!bulb_label) {
+        lgtd_debug("no bulb with label %s", label);
+        return rv;
+    }
+
     struct lgtd_lifx_bulb *bulb;
-    RB_FOREACH(bulb, lgtd_lifx_bulb_map, &lgtd_lifx_bulbs_table) {
-        if (lgtd_lifx_bulb_has_label(bulb, label)) {
-            struct lgtd_lifx_packet_header hdr;
-            union lgtd_lifx_target target = { .addr = bulb->addr };
-            pkt_info = lgtd_lifx_wire_setup_header(
-                &hdr,
-                LGTD_LIFX_TARGET_DEVICE,
-                target,
-                bulb->gw->site.as_array,
-                pkt_type
-            );
-            assert(pkt_info);
+    LGTD_LIFX_BULB_FOREACH_WITH_LABEL(bulb, bulb_label) {
+        struct lgtd_lifx_packet_header hdr;
+        union lgtd_lifx_target target = { .addr = bulb->addr };
+        pkt_info = lgtd_lifx_wire_setup_header(
+            &hdr,
+            LGTD_LIFX_TARGET_DEVICE,
+            target,
+            bulb->gw->site.as_array,
+            pkt_type
+        );
+        assert(pkt_info);
 
-            lgtd_lifx_gateway_enqueue_packet(bulb->gw, &hdr, pkt_info, pkt);
+        if (!lgtd_lifx_gateway_enqueue_packet(bulb->gw, &hdr, pkt_info, pkt)) {
+            rv = false;
+            continue;
+        }
 
-            if (pkt_type == LGTD_LIFX_SET_POWER_STATE) {
-                bulb->dirty_at = lgtd_time_monotonic_msecs();
-                struct lgtd_lifx_packet_power_state *payload = pkt;
-                bulb->expected_power_on = payload->power;
-            }
+        if (pkt_type == LGTD_LIFX_SET_POWER_STATE) {
+            bulb->dirty_at = lgtd_time_monotonic_msecs();
+            struct lgtd_lifx_packet_power_state *payload = pkt;
+            bulb->expected_power_on = payload->power;
         }
     }
 
     if (pkt_info) {
         lgtd_info("sending %s to %s", pkt_info->name, label);
     }
+
+    return rv;
 }
 
 static struct lgtd_lifx_bulb *
@@ -211,6 +254,235 @@ lgtd_router_device_addr_to_device(const char *device_addr)
     return NULL;
 }
 
+static struct lgtd_router_device_list lgtd_router_devices = {
+    .devices = NULL, .count = 0, .capacity = 0
+};
+
+// Bumped each time a list of targets is resolved, a bulb is already in
+// lgtd_router_devices if its resolved_gen matches:
+static uint32_t lgtd_router_devices_gen = 0;
+
+static bool
+lgtd_router_reserve_devices(int capacity)
+{
+    if (capacity <= lgtd_router_devices.capacity) {
+        return true;
+    }
+
+    capacity = LGTD_MAX(capacity, lgtd_router_devices.capacity * 2);
+    struct lgtd_lifx_bulb **devices = reallocarray(
+        lgtd_router_devices.devices, capacity, sizeof(*devices)
+    );
+    if (!devices) {
+        return false;
+    }
+    lgtd_router_devices.devices = devices;
+    lgtd_router_devices.capacity = capacity;
+    return true;
+}
+
+static void
+lgtd_router_start_devices_generation(void)
+{
+    lgtd_router_devices.count = 0;
+
+    if (++lgtd_router_devices_gen == 0) {
+        // wrapped around, make sure no bulb looks already inserted:
+        struct lgtd_lifx_bulb *bulb;
+        LGTD_LIFX_BULB_FOREACH(bulb) {
+            bulb->resolved_gen = 0;
+        }
+        lgtd_router_devices_gen = 1;
+    }
+}
+
+static bool
+lgtd_router_insert_device_if_not_in_list(struct lgtd_lifx_bulb *device)
+{
+    if (device->resolved_gen == lgtd_router_devices_gen) {
+        return true;
+    }
+
+    if (!lgtd_router_reserve_devices(lgtd_router_devices.count + 1)) {
+        return false;
+    }
+
+    lgtd_router_devices.devices[lgtd_router_devices.count++] = device;
+    device->resolved_gen = lgtd_router_devices_gen;
+    return true;
+}
+
+// Resolve a target that isn't a tag or "*" (i.e: a device address or a label)
+// and add the matching bulbs to lgtd_router_devices:
+static bool
+lgtd_router_insert_device_target(const char *target)
+{
+    struct lgtd_lifx_bulb *bulb = NULL;
+    if (isxdigit(target[0])) {
+        bulb = lgtd_router_device_addr_to_device(target);
+        if (bulb) {
+            return lgtd_router_insert_device_if_not_in_list(bulb);
+        }
+        lgtd_debug(
+            "%s looked like a device address but didn't "
+            "yield any device, trying as a label", target
+        );
+    }
+    const struct lgtd_lifx_bulb_label *bulb_label;
+    bulb_label = lgtd_lifx_bulb_find_label(target);
+    if (!bulb_label) {
+        lgtd_debug("no bulb with label %s", target);
+        return true;
+    }
+    LGTD_LIFX_BULB_FOREACH_WITH_LABEL(bulb, bulb_label) {
+        if (!lgtd_router_insert_device_if_not_in_list(bulb)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool
+lgtd_router_send_to_gateway(struct lgtd_lifx_gateway *gw,
+                            enum lgtd_lifx_target_type target_type,
+                            union lgtd_lifx_target target,
+                            enum lgtd_lifx_packet_type pkt_type,
+                            void *pkt)
+{
+    struct lgtd_lifx_packet_header hdr;
+    const struct lgtd_lifx_packet_info *pkt_info = lgtd_lifx_wire_setup_header(
+        &hdr, target_type, target, gw->site.as_array, pkt_type
+    );
+    assert(pkt_info);
+
+    if (!lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt)) {
+        return false;
+    }
+
+    if (target_type == LGTD_LIFX_TARGET_ALL_DEVICES) {
+        lgtd_info(
+            "sending %s to all devices on gw %s", pkt_info->name, gw->peeraddr
+        );
+    } else {
+        lgtd_info(
+            "sending %s to tags %#jx on gw %s",
+            pkt_info->name, (uintmax_t)target.tags, gw->peeraddr
+        );
+    }
+
+    return true;
+}
+
+static int
+lgtd_router_cmp_device_gw(const void *a, const void *b)
+{
+    uintptr_t gw_a = (uintptr_t)(*(struct lgtd_lifx_bulb * const *)a)->gw;
+    uintptr_t gw_b = (uintptr_t)(*(struct lgtd_lifx_bulb * const *)b)->gw;
+    return gw_a < gw_b ? -1 : gw_a > gw_b;
+}
+
+// Pick the tags of gw whose bulbs are all part of the resolved devices and
+// not covered by the tags already picked, biggest tags first. Every bulb
+// is sent to once at most since a tag is picked only if none of its bulbs
+// have a tag that was already picked:
+static uint64_t
+lgtd_router_plan_gateway_tags(const struct lgtd_lifx_gateway *gw)
+{
+    uint64_t picked = 0;
+
+    while (true) {
+        uint64_t candidates = gw->tag_ids & ~picked;
+        int in_devices[LGTD_LIFX_GATEWAY_MAX_TAGS] = { 0 };
+        int in_gw[LGTD_LIFX_GATEWAY_MAX_TAGS] = { 0 };
+
+        const struct lgtd_lifx_bulb *bulb;
+        SLIST_FOREACH(bulb, &gw->bulbs, link_by_gw) {
+            bool available = bulb->resolved_gen == lgtd_router_devices_gen
+                && !(bulb->state.tags & picked);
+            int tag_id;
+            LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, bulb->state.tags & candidates) {
+                in_gw[tag_id]++;
+                in_devices[tag_id] += available;
+            }
+        }
+
+        int best = -1;
+        int tag_id;
+        LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, candidates) {
+            // a tag with a single bulb doesn't save anything:
+            if (in_devices[tag_id] > 1 && in_devices[tag_id] == in_gw[tag_id]
+                && (best == -1 || in_devices[tag_id] > in_devices[best])) {
+                best = tag_id;
+            }
+        }
+        if (best == -1) {
+            return picked;
+        }
+        picked |= LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(best);
+    }
+}
+
+// Send to the devices in lgtd_router_devices using as few packets as possible:
+// one site-wide packet if the devices are all the bulbs behind a gateway, one
+// tagged packet for the tags they exactly cover and a packet per device for
+// the remainder:
+static bool
+lgtd_router_send_to_devices(enum lgtd_lifx_packet_type pkt_type, void *pkt)
+{
+    struct lgtd_lifx_bulb **devices = lgtd_router_devices.devices;
+    int count = lgtd_router_devices.count;
+
+    qsort(devices, count, sizeof(*devices), lgtd_router_cmp_device_gw);
+
+    bool rv = true;
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    for (int start = 0, end; start != count; start = end) {
+        struct lgtd_lifx_gateway *gw = devices[start]->gw;
+        for (end = start + 1; end != count && devices[end]->gw == gw; end++);
+
+        if (end - start == 1) {
+            rv = lgtd_router_send_to_device(devices[start], pkt_type, pkt) && rv;
+            continue;
+        }
+
+        int gw_bulbs_count = 0;
+        struct lgtd_lifx_bulb *bulb;
+        SLIST_FOREACH(bulb, &gw->bulbs, link_by_gw) {
+            gw_bulbs_count++;
+        }
+
+        // if the grouped packet can't be queued, fall back on sending to each
+        // device individually:
+        union lgtd_lifx_target target = { .tags = 0 };
+        bool site_wide = gw_bulbs_count == end - start;
+        if (site_wide) {
+            site_wide = lgtd_router_send_to_gateway(
+                gw, LGTD_LIFX_TARGET_ALL_DEVICES, target, pkt_type, pkt
+            );
+        } else {
+            target.tags = lgtd_router_plan_gateway_tags(gw);
+            if (target.tags && !lgtd_router_send_to_gateway(
+                gw, LGTD_LIFX_TARGET_TAGS, target, pkt_type, pkt
+            )) {
+                target.tags = 0;
+            }
+        }
+
+        for (int i = start; i != end; i++) {
+            bulb = devices[i];
+            if (!site_wide && !(bulb->state.tags & target.tags)) {
+                rv = lgtd_router_send_to_device(bulb, pkt_type, pkt) && rv;
+            } else if (pkt_type == LGTD_LIFX_SET_POWER_STATE) {
+                bulb->dirty_at = now;
+                struct lgtd_lifx_packet_power_state *payload = pkt;
+                bulb->expected_power_on = payload->power;
+            }
+        }
+    }
+
+    return rv;
+}
+
 bool
 lgtd_router_send(const struct lgtd_proto_target_list *targets,
                  enum lgtd_lifx_packet_type pkt_type,
@@ -219,75 +491,74 @@ lgtd_router_send(const struct lgtd_proto_target_list *targets,
     assert(targets);
 
     bool rv = true;
+    bool broadcasted = false;
+
+    // Tags and "*" are sent right away, devices and labels are accumulated
+    // in lgtd_router_devices so we can group them per gateway:
+    lgtd_router_start_devices_generation();
 
     const struct lgtd_proto_target *target;
     SLIST_FOREACH(target, targets, link) {
         if (!strcmp(target->target, "*")) {
-            lgtd_router_broadcast(pkt_type, pkt);
+            rv = lgtd_router_broadcast(pkt_type, pkt) && rv;
+            broadcasted = true;
             continue;
         } else if (target->target[0] == '#') {
             const struct lgtd_lifx_tag *tag;
             tag = lgtd_lifx_tagging_find_tag(&target->target[1]);
             if (tag) {
-                lgtd_router_send_to_tag(tag, pkt_type, pkt);
+                rv = lgtd_router_send_to_tag(tag, pkt_type, pkt) && rv;
                 continue;
             }
             lgtd_debug("invalid target tag %s", target->target);
         } else if (target->target[0]) {
             // NOTE: labels and hardware addresses are ambiguous target types,
             // we can't really solve this since json doesn't have hexadecimal.
-            if (isxdigit(target->target[0])) {
-                struct lgtd_lifx_bulb *bulb =
-                    lgtd_router_device_addr_to_device(target->target);
-                if (bulb) {
-                    lgtd_router_send_to_device(bulb, pkt_type, pkt);
-                    continue;
-                }
-                lgtd_debug(
-                    "%s looked like a device address but didn't "
-                    "yield any device, trying as a label", target->target
-                );
+            if (broadcasted) {
+                continue;
             }
-            // Fallback as label:
-            lgtd_router_send_to_label(target->target, pkt_type, pkt);
-            continue;
+            if (lgtd_router_insert_device_target(target->target)) {
+                continue;
+            }
+            lgtd_warn("can't allocate the list of devices to send to");
         }
         rv = false;
     }
 
+    if (!broadcasted) {
+        rv = lgtd_router_send_to_devices(pkt_type, pkt) && rv;
+    }
+    lgtd_router_devices.count = 0;
+
     return rv;
 }
 
-static void
-lgtd_router_clear_device_list(struct lgtd_router_device_list *devices)
+// Schedule the packet to be run by the targeted bulbs at the same instant:
+// each bulb has its own clock, so the packet can't be grouped per tag or site
+// like lgtd_router_send does:
+bool
+lgtd_router_send_at(const struct lgtd_proto_target_list *targets,
+                    enum lgtd_lifx_packet_type pkt_type,
+                    void *pkt,
+                    lgtd_time_mono_t at)
 {
-    assert(devices);
-
-    while (!SLIST_EMPTY(devices)) {
-        struct lgtd_router_device *device = SLIST_FIRST(devices);
-        SLIST_REMOVE_HEAD(devices, link);
-        free(device);
-    }
-}
+    assert(targets);
 
-static struct lgtd_router_device *
-lgtd_router_insert_device_if_not_in_list(struct lgtd_router_device_list *devices,
-                                         struct lgtd_lifx_bulb *device)
-{
-    struct lgtd_router_device *it;
-    SLIST_FOREACH(it, devices, link) {
-        if (it->device == device) {
-            return it;
-        }
+    struct lgtd_router_device_list *devices;
+    devices = lgtd_router_targets_to_devices(targets);
+    if (!devices) {
+        lgtd_warn("can't allocate the list of devices to send to");
+        return false;
     }
 
-    struct lgtd_router_device *new = calloc(1, sizeof(*new));
-    if (new) {
-        new->device = device;
-        SLIST_INSERT_HEAD(devices, new, link);
+    bool rv = true;
+    struct lgtd_lifx_bulb **device;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+        rv = lgtd_router_send_to_device_at(*device, pkt_type, pkt, at) && rv;
     }
+    lgtd_router_device_list_free(devices);
 
-    return new;
+    return rv;
 }
 
 struct lgtd_router_device_list *
@@ -295,42 +566,34 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
 {
     assert(targets);
 
-    struct lgtd_router_device_list *devices = calloc(1, sizeof(*devices));
-    if (!devices) {
-        return NULL;
-    }
-
-    SLIST_INIT(devices);
+    lgtd_router_start_devices_generation();
 
     struct lgtd_proto_target *target;
     SLIST_FOREACH(target, targets, link) {
         if (!strcmp(target->target, "*")) {
-            lgtd_router_clear_device_list(devices);
+            lgtd_router_devices.count = 0;
+            if (!lgtd_router_reserve_devices(lgtd_lifx_bulbs_table.count)) {
+                goto device_alloc_error;
+            }
             struct lgtd_lifx_bulb *bulb;
-            RB_FOREACH(bulb, lgtd_lifx_bulb_map, &lgtd_lifx_bulbs_table) {
-                struct lgtd_router_device *device = calloc(1, sizeof(*device));
-                if (!device) {
-                    goto device_alloc_error;
-                }
-                device->device = bulb;
-                SLIST_INSERT_HEAD(devices, device, link);
+            LGTD_LIFX_BULB_FOREACH(bulb) {
+                lgtd_router_devices.devices[lgtd_router_devices.count++] = bulb;
             }
-            return devices;
+            return &lgtd_router_devices;
         } else if (target->target[0] == '#') {
             const struct lgtd_lifx_tag *tag;
             tag = lgtd_lifx_tagging_find_tag(&target->target[1]);
             if (tag) {
-                struct lgtd_lifx_site *site;
-                LIST_FOREACH(site, &tag->sites, link) {
+                const struct lgtd_lifx_site *site;
+                LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
                     struct lgtd_lifx_bulb *bulb;
                     uint64_t tag = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(site->tag_id);
                     SLIST_FOREACH(bulb, &site->gw->bulbs, link_by_gw) {
                         if (bulb->state.tags & tag) {
-                            struct lgtd_router_device *device;
-                            device = lgtd_router_insert_device_if_not_in_list(
-                                devices, bulb
+                            bool ok = lgtd_router_insert_device_if_not_in_list(
+                                bulb
                             );
-                            if (!device) {
+                            if (!ok) {
                                 goto device_alloc_error;
                             }
                         }
@@ -338,44 +601,81 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
                 }
             }
         } else if (target->target[0]) {
-            struct lgtd_lifx_bulb *bulb = NULL;
-            if (isxdigit(target->target[0])) {
-                bulb = lgtd_router_device_addr_to_device(target->target);
-                if (bulb) {
-                    bool ok = lgtd_router_insert_device_if_not_in_list(
-                        devices, bulb
-                    );
-                    if (!ok) {
-                        goto device_alloc_error;
-                    }
-                    continue;
-                }
-            }
-            RB_FOREACH(bulb, lgtd_lifx_bulb_map, &lgtd_lifx_bulbs_table) {
-                if (lgtd_lifx_bulb_has_label(bulb, target->target)) {
-                    bool ok = lgtd_router_insert_device_if_not_in_list(
-                        devices, bulb
-                    );
-                    if (!ok) {
-                        goto device_alloc_error;
-                    }
-                }
+            if (!lgtd_router_insert_device_target(target->target)) {
+                goto device_alloc_error;
             }
         }
     }
 
-    return devices;
+    return &lgtd_router_devices;
 
 device_alloc_error:
-    lgtd_router_device_list_free(devices);
+    lgtd_router_devices.count = 0;
     return NULL;
 }
 
+// Resolve a single target like lgtd_router_targets_to_devices does, but only
+// for the given device:
+static bool
+lgtd_router_device_matches_target(const struct lgtd_lifx_bulb *device,
+                                  const char *target)
+{
+    if (!strcmp(target, "*")) {
+        return true;
+    } else if (target[0] == '#') {
+        const struct lgtd_lifx_tag *tag = lgtd_lifx_tagging_find_tag(&target[1]);
+        if (!tag) {
+            return false;
+        }
+        const struct lgtd_lifx_site *site;
+        LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
+            if (site->gw == device->gw) {
+                uint64_t tag_value = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(
+                    site->tag_id
+                );
+                return (device->state.tags & tag_value) != 0;
+            }
+        }
+        return false;
+    } else if (!target[0]) {
+        return false;
+    }
+
+    // like lgtd_router_insert_device_target: a label is only tried if the
+    // target doesn't yield a device as an address:
+    if (isxdigit(target[0])) {
+        const struct lgtd_lifx_bulb *bulb;
+        bulb = lgtd_router_device_addr_to_device(target);
+        if (bulb) {
+            return bulb == device;
+        }
+    }
+    return lgtd_lifx_bulb_has_label(device, target);
+}
+
+bool
+lgtd_router_device_matches_targets(const struct lgtd_lifx_bulb *device,
+                                   const struct lgtd_proto_target_list *targets)
+{
+    assert(device);
+    assert(targets);
+
+    const struct lgtd_proto_target *target;
+    SLIST_FOREACH(target, targets, link) {
+        if (lgtd_router_device_matches_target(device, target->target)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void
 lgtd_router_device_list_free(struct lgtd_router_device_list *devices)
 {
     if (devices) {
-        lgtd_router_clear_device_list(devices);
-        free(devices);
+        assert(devices == &lgtd_router_devices);
+        // keep the vector around for the next request:
+        devices->count = 0;
     }
 }
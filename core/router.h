@@ -23,16 +23,27 @@ enum lgtd_router_error {
     LGTD_ROUTER_CANNOT_ENQUEUE_PACKET_ERROR
 };
 
-struct lgtd_router_device {
-    SLIST_ENTRY(lgtd_router_device) link;
-    struct lgtd_lifx_bulb           *device;
+// The devices a list of targets resolves to, without duplicates. The vector
+// is owned by the router and reused from one request to the next, so only one
+// list can be in use at a time:
+struct lgtd_router_device_list {
+    struct lgtd_lifx_bulb   **devices;
+    int                     count;
+    int                     capacity;
 };
-SLIST_HEAD(lgtd_router_device_list, lgtd_router_device);
+
+#define LGTD_ROUTER_DEVICE_LIST_FOREACH(device, list)               \
+    for ((device) = (list)->devices;                                \
+         (device) != (list)->devices + (list)->count;               \
+         (device)++)
 
 bool lgtd_router_send(const struct lgtd_proto_target_list *, enum lgtd_lifx_packet_type, void *);
-void lgtd_router_send_to_device(struct lgtd_lifx_bulb *, enum lgtd_lifx_packet_type, void *);
-void lgtd_router_send_to_tag(const struct lgtd_lifx_tag *, enum lgtd_lifx_packet_type, void *);
-void lgtd_router_send_to_label(const char *, enum lgtd_lifx_packet_type, void *);
-void lgtd_router_broadcast(enum lgtd_lifx_packet_type, void *);
+bool lgtd_router_send_at(const struct lgtd_proto_target_list *, enum lgtd_lifx_packet_type, void *, lgtd_time_mono_t);
+bool lgtd_router_send_to_device(struct lgtd_lifx_bulb *, enum lgtd_lifx_packet_type, void *);
+bool lgtd_router_send_to_device_at(struct lgtd_lifx_bulb *, enum lgtd_lifx_packet_type, void *, lgtd_time_mono_t);
+bool lgtd_router_send_to_tag(const struct lgtd_lifx_tag *, enum lgtd_lifx_packet_type, void *);
+bool lgtd_router_send_to_label(const char *, enum lgtd_lifx_packet_type, void *);
+bool lgtd_router_broadcast(enum lgtd_lifx_packet_type, void *);
 struct lgtd_router_device_list *lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *);
 void lgtd_router_device_list_free(struct lgtd_router_device_list *);
+bool lgtd_router_device_matches_targets(const struct lgtd_lifx_bulb *, const struct lgtd_proto_target_list *);
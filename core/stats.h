@@ -22,6 +22,11 @@ struct lgtd_stats {
     int bulbs;
     int bulbs_powered_on;
     int clients;
+    // number of gateways per lgtd_lifx_gateway_refresh_reason:
+    int gateways_refresh_command;
+    int gateways_refresh_client;
+    int gateways_refresh_churn;
+    int gateways_refresh_idle;
 };
 
 void lgtd_stats_add(int, int);
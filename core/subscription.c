@@ -0,0 +1,362 @@
+// Copyright (c) 2015, Louis Opter <kalessin@kalessin.fr>
+//
+// This file is part of lighstd.
+//
+// lighstd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// lighstd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with lighstd.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <sys/queue.h>
+#include <sys/tree.h>
+#include <assert.h>
+#include <endian.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include "lifx/wire_proto.h"
+#include "time_monotonic.h"
+#include "lifx/bulb.h"
+#include "lifx/gateway.h"
+#include "lifx/tagging.h"
+#include "jsmn.h"
+#include "jsonrpc.h"
+#include "client.h"
+#include "proto.h"
+#include "router.h"
+#include "subscription.h"
+#include "lightsd.h"
+
+static struct lgtd_subscription_list lgtd_subscriptions =
+    LIST_HEAD_INITIALIZER(&lgtd_subscriptions);
+
+// The bulbs with changes, flushed to the subscriptions by
+// lgtd_subscription_flush_callback once per iteration of the event loop:
+static LIST_HEAD(lgtd_subscription_bulb_list, lgtd_lifx_bulb)
+    lgtd_subscription_changed_bulbs =
+        LIST_HEAD_INITIALIZER(&lgtd_subscription_changed_bulbs);
+
+static struct event *lgtd_subscription_flush_ev = NULL;
+
+static void
+lgtd_subscription_drop_changes(void)
+{
+    while (!LIST_EMPTY(&lgtd_subscription_changed_bulbs)) {
+        struct lgtd_lifx_bulb *bulb;
+        bulb = LIST_FIRST(&lgtd_subscription_changed_bulbs);
+        LIST_REMOVE(bulb, link_by_changes);
+        bulb->changes = 0;
+    }
+}
+
+static bool
+lgtd_subscription_append(struct lgtd_subscription *sub,
+                         const char *buf,
+                         int len)
+{
+    if (sub->pending_len + len > sub->pending_size) {
+        int size = LGTD_MAX(sub->pending_size * 2, sub->pending_len + len);
+        if (size > LGTD_SUBSCRIPTION_MAX_PENDING_SIZE) {
+            lgtd_warnx(
+                "dropping the changes pending for a client in the middle "
+                "of a batch for too long"
+            );
+            sub->pending_len = 0;
+            return false;
+        }
+        char *pending = realloc(sub->pending, size);
+        if (!pending) {
+            lgtd_warn("can't push the changes of a bulb to a client");
+            return false;
+        }
+        sub->pending = pending;
+        sub->pending_size = size;
+    }
+
+    memcpy(&sub->pending[sub->pending_len], buf, len);
+    sub->pending_len += len;
+    return true;
+}
+
+// Format the fields that changed in the notification pending for sub:
+static void
+lgtd_subscription_format_bulb(struct lgtd_subscription *sub,
+                              const struct lgtd_lifx_bulb *bulb,
+                              int fields)
+{
+    char buf[256], bulb_addr[LGTD_LIFX_ADDR_STRLEN];
+    int i = 0;
+
+    LGTD_SNPRINTF_APPEND(
+        buf, i, (int)sizeof(buf), "%s{\"_lifx\":{\"addr\":\"%s\"}",
+        sub->pending_len ? "," : "", LGTD_IEEE8023MACTOA(bulb->addr, bulb_addr)
+    );
+
+    if (fields & LGTD_LIFX_BULB_HSBK_CHANGED) {
+        char h[16], s[16], b[16];
+        lgtd_jsonrpc_uint16_range_to_float_string(
+            bulb->state.hue, 0, 360, h, sizeof(h)
+        );
+        lgtd_jsonrpc_uint16_range_to_float_string(
+            bulb->state.saturation, 0, 1, s, sizeof(s)
+        );
+        lgtd_jsonrpc_uint16_range_to_float_string(
+            bulb->state.brightness, 0, 1, b, sizeof(b)
+        );
+        LGTD_SNPRINTF_APPEND(
+            buf, i, (int)sizeof(buf), ",\"hsbk\":[%s,%s,%s,%hu]",
+            h, s, b, bulb->state.kelvin
+        );
+    }
+
+    if (fields & LGTD_LIFX_BULB_POWER_CHANGED) {
+        LGTD_SNPRINTF_APPEND(
+            buf, i, (int)sizeof(buf), ",\"power\":%s",
+            bulb->state.power == LGTD_LIFX_POWER_ON ? "true" : "false"
+        );
+    }
+
+    if (fields & LGTD_LIFX_BULB_LABEL_CHANGED) {
+        // like in get_light_state, the address stands for an empty label:
+        if (bulb->state.label[0]) {
+            LGTD_SNPRINTF_APPEND(
+                buf, i, (int)sizeof(buf), ",\"label\":\"%.*s\"",
+                LGTD_LIFX_LABEL_SIZE, bulb->state.label
+            );
+        } else {
+            LGTD_SNPRINTF_APPEND(
+                buf, i, (int)sizeof(buf),
+                ",\"label\":\"%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx\"",
+                bulb->addr[0], bulb->addr[1], bulb->addr[2],
+                bulb->addr[3], bulb->addr[4], bulb->addr[5]
+            );
+        }
+    }
+
+    if (fields & LGTD_LIFX_BULB_TAGS_CHANGED) {
+        LGTD_SNPRINTF_APPEND(buf, i, (int)sizeof(buf), ",\"tags\":[");
+    }
+
+    int pending_len = sub->pending_len;
+    if (i >= (int)sizeof(buf) || !lgtd_subscription_append(sub, buf, i)) {
+        return;
+    }
+
+    if (fields & LGTD_LIFX_BULB_TAGS_CHANGED) {
+        bool comma = false;
+        int tag_id;
+        uint64_t tags = bulb->state.tags & bulb->gw->tag_ids;
+        LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, tags) {
+            const char *label = bulb->gw->tags[tag_id]->label;
+            i = snprintf(
+                buf, sizeof(buf), "%s\"%.*s\"",
+                comma ? "," : "", LGTD_LIFX_LABEL_SIZE, label
+            );
+            if (!lgtd_subscription_append(sub, buf, i)) {
+                goto error;
+            }
+            comma = true;
+        }
+        if (!lgtd_subscription_append(sub, "]", 1)) {
+            goto error;
+        }
+    }
+
+    if (lgtd_subscription_append(sub, "}", 1)) {
+        return;
+    }
+
+error:
+    // don't leave half of the bulb in the notification:
+    sub->pending_len = LGTD_MIN(pending_len, sub->pending_len);
+}
+
+static void
+lgtd_subscription_flush_callback(evutil_socket_t fd, short events, void *ctx)
+{
+    (void)fd;
+    (void)events;
+    (void)ctx;
+
+    struct lgtd_subscription *sub;
+    LIST_FOREACH(sub, &lgtd_subscriptions, link) {
+        // The targets are matched when the bulbs change, so a bulb tagged
+        // or labeled after the subscription is picked up:
+        struct lgtd_lifx_bulb *bulb;
+        LIST_FOREACH(bulb, &lgtd_subscription_changed_bulbs, link_by_changes) {
+            int fields = bulb->changes & sub->fields;
+            if (fields
+                && lgtd_router_device_matches_targets(bulb, &sub->targets)) {
+                lgtd_subscription_format_bulb(sub, bulb, fields);
+            }
+        }
+        lgtd_subscription_send_pending(sub->client);
+    }
+
+    lgtd_subscription_drop_changes();
+}
+
+void
+lgtd_subscription_send_pending(struct lgtd_client *client)
+{
+    assert(client);
+
+    struct lgtd_subscription *sub = client->subscription;
+    // Wait for the end of the batch the client is getting a response for,
+    // the notification can't be written in the middle of it:
+    if (!sub || !sub->pending_len || client->batch_sent) {
+        return;
+    }
+
+    lgtd_client_write_string(
+        client,
+        "{\"jsonrpc\": \"2.0\", "
+        "\"method\": \"light_state_changed\", "
+        "\"params\": ["
+    );
+    lgtd_client_write_buf(client, sub->pending, sub->pending_len);
+    lgtd_client_write_string(client, "]}");
+    sub->pending_len = 0;
+}
+
+bool
+lgtd_subscription_add(struct lgtd_client *client,
+                      const struct lgtd_proto_target_list *targets,
+                      int fields)
+{
+    assert(client);
+    assert(targets);
+    assert(fields && !(fields & ~LGTD_LIFX_BULB_ALL_CHANGED));
+
+    // there is no connection to push the changes to from the command pipe:
+    if (!client->io) {
+        return false;
+    }
+
+    if (!lgtd_subscription_flush_ev) {
+        lgtd_subscription_flush_ev = event_new(
+            lgtd_ev_base, -1, 0, lgtd_subscription_flush_callback, NULL
+        );
+        if (!lgtd_subscription_flush_ev) {
+            lgtd_warn("can't setup the subscriptions");
+            return false;
+        }
+    }
+
+    struct lgtd_proto_target_list copy = SLIST_HEAD_INITIALIZER(&copy);
+    const struct lgtd_proto_target *target;
+    SLIST_FOREACH(target, targets, link) {
+        int len = strlen(target->target);
+        struct lgtd_proto_target *t = malloc(sizeof(*t) + len + 1);
+        if (!t) {
+            goto error_alloc;
+        }
+        memcpy(t->target, target->target, len + 1);
+        SLIST_INSERT_HEAD(&copy, t, link);
+    }
+
+    struct lgtd_subscription *sub = client->subscription;
+    if (!sub) {
+        sub = calloc(1, sizeof(*sub));
+        if (!sub) {
+            goto error_alloc;
+        }
+        sub->client = client;
+        LIST_INSERT_HEAD(&lgtd_subscriptions, sub, link);
+        client->subscription = sub;
+    } else {
+        lgtd_proto_target_list_clear(&sub->targets);
+    }
+    sub->targets = copy;
+    sub->fields = fields;
+
+    return true;
+
+error_alloc:
+    lgtd_warn("can't allocate a new subscription");
+    lgtd_proto_target_list_clear(&copy);
+    return false;
+}
+
+bool
+lgtd_subscription_remove(struct lgtd_client *client)
+{
+    assert(client);
+
+    struct lgtd_subscription *sub = client->subscription;
+    if (!sub) {
+        return false;
+    }
+
+    LIST_REMOVE(sub, link);
+    lgtd_proto_target_list_clear(&sub->targets);
+    free(sub->pending);
+    free(sub);
+    client->subscription = NULL;
+
+    if (LIST_EMPTY(&lgtd_subscriptions)) {
+        lgtd_subscription_drop_changes();
+    }
+
+    return true;
+}
+
+void
+lgtd_subscription_close_all(void)
+{
+    while (!LIST_EMPTY(&lgtd_subscriptions)) {
+        lgtd_subscription_remove(LIST_FIRST(&lgtd_subscriptions)->client);
+    }
+
+    if (lgtd_subscription_flush_ev) {
+        event_free(lgtd_subscription_flush_ev);
+        lgtd_subscription_flush_ev = NULL;
+    }
+}
+
+void
+lgtd_subscription_bulb_changed(struct lgtd_lifx_bulb *bulb, int changes)
+{
+    assert(bulb);
+    assert(changes);
+
+    if (LIST_EMPTY(&lgtd_subscriptions)) {
+        return;
+    }
+
+    if (!bulb->changes) {
+        if (LIST_EMPTY(&lgtd_subscription_changed_bulbs)) {
+            event_active(lgtd_subscription_flush_ev, 0, 0);
+        }
+        LIST_INSERT_HEAD(
+            &lgtd_subscription_changed_bulbs, bulb, link_by_changes
+        );
+    }
+    bulb->changes |= changes;
+}
+
+void
+lgtd_subscription_bulb_closed(struct lgtd_lifx_bulb *bulb)
+{
+    assert(bulb);
+
+    if (bulb->changes) {
+        LIST_REMOVE(bulb, link_by_changes);
+        bulb->changes = 0;
+    }
+}
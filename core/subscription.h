@@ -0,0 +1,49 @@
+// Copyright (c) 2015, Louis Opter <kalessin@kalessin.fr>
+//
+// This file is part of lighstd.
+//
+// lighstd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// lighstd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with lighstd.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+struct lgtd_lifx_bulb;
+
+// A client subscribed to the changes of some bulbs: the changes are pushed to
+// it in a light_state_changed notification, at most once per iteration of the
+// event loop with everything that changed during that iteration.
+struct lgtd_subscription {
+    LIST_ENTRY(lgtd_subscription)   link;
+    struct lgtd_client              *client;
+    struct lgtd_proto_target_list   targets;
+    int                             fields; // enum lgtd_lifx_bulb_changes
+    // The bulbs that changed, formatted but not sent yet because the client
+    // is in the middle of a batch (its response is being written):
+    char                            *pending;
+    int                             pending_len;
+    int                             pending_size;
+};
+LIST_HEAD(lgtd_subscription_list, lgtd_subscription);
+
+// Past that the pending notification is dropped, the client has been in the
+// middle of a batch for too long:
+enum { LGTD_SUBSCRIPTION_MAX_PENDING_SIZE = 256 * 1024 };
+
+bool lgtd_subscription_add(struct lgtd_client *, const struct lgtd_proto_target_list *, int);
+bool lgtd_subscription_remove(struct lgtd_client *);
+void lgtd_subscription_send_pending(struct lgtd_client *);
+void lgtd_subscription_close_all(void);
+
+void lgtd_subscription_bulb_changed(struct lgtd_lifx_bulb *, int);
+void lgtd_subscription_bulb_closed(struct lgtd_lifx_bulb *);
@@ -25,21 +25,328 @@
 #include <event2/event.h>
 #include <event2/util.h>
 
+#include "time_monotonic.h"
 #include "timer.h"
 #include "lightsd.h"
 
 static struct lgtd_timer_list lgtd_timers = LIST_HEAD_INITIALIZER(&lgtd_timers);
 
+enum { LGTD_TIMER_WHEEL_SLOT_MASK = LGTD_TIMER_WHEEL_SLOTS - 1 };
+
+static struct {
+    struct lgtd_timer_list  slots[LGTD_TIMER_WHEEL_LEVELS][LGTD_TIMER_WHEEL_SLOTS];
+    int                     counts[LGTD_TIMER_WHEEL_LEVELS];
+    int                     count;
+    // last tick processed, the timers of the slots are relative to it:
+    uint64_t                now;
+    struct lgtd_timer_queue activated;
+    // the activated timers being run, see lgtd_timer_run_activated:
+    struct lgtd_timer_queue batch;
+    struct event            *tick_ev;
+    // tick the event will fire at, 0 when it isn't armed:
+    uint64_t                armed_at;
+    bool                    running;
+} lgtd_timer_wheel = {
+    .activated = TAILQ_HEAD_INITIALIZER(lgtd_timer_wheel.activated),
+    .batch = TAILQ_HEAD_INITIALIZER(lgtd_timer_wheel.batch)
+};
+
+static uint64_t
+lgtd_timer_wheel_level_span(int level)
+{
+    return UINT64_C(1) << (level * LGTD_TIMER_WHEEL_LEVEL_BITS);
+}
+
 static void
-lgtd_timer_callback(evutil_socket_t socket, short events, void *ctx)
+lgtd_timer_wheel_insert(struct lgtd_timer *timer)
+{
+    assert(timer);
+    assert(!timer->scheduled);
+    assert(timer->expires_at >= lgtd_timer_wheel.now);
+
+    uint64_t expires_at = timer->expires_at;
+    uint64_t delta = expires_at - lgtd_timer_wheel.now;
+    int level = 0;
+    while (level != LGTD_TIMER_WHEEL_LEVELS - 1
+           && delta >= lgtd_timer_wheel_level_span(level + 1)) {
+        level++;
+    }
+    // further than the wheel can see: park the timer in the last slot, it
+    // will be inserted again when that slot is cascaded:
+    uint64_t horizon = lgtd_timer_wheel_level_span(LGTD_TIMER_WHEEL_LEVELS);
+    if (delta >= horizon) {
+        expires_at = lgtd_timer_wheel.now + horizon - 1;
+    }
+
+    int shift = level * LGTD_TIMER_WHEEL_LEVEL_BITS;
+    int slot = (expires_at >> shift) & LGTD_TIMER_WHEEL_SLOT_MASK;
+    LIST_INSERT_HEAD(
+        &lgtd_timer_wheel.slots[level][slot], timer, link_by_slot
+    );
+    timer->level = level;
+    timer->scheduled = true;
+    lgtd_timer_wheel.counts[level]++;
+    lgtd_timer_wheel.count++;
+}
+
+static void
+lgtd_timer_wheel_remove(struct lgtd_timer *timer)
+{
+    assert(timer);
+    assert(timer->scheduled);
+
+    LIST_REMOVE(timer, link_by_slot);
+    timer->scheduled = false;
+    lgtd_timer_wheel.counts[timer->level]--;
+    lgtd_timer_wheel.count--;
+}
+
+static void
+lgtd_timer_wheel_cascade(int level)
+{
+    int shift = level * LGTD_TIMER_WHEEL_LEVEL_BITS;
+    int slot = (lgtd_timer_wheel.now >> shift) & LGTD_TIMER_WHEEL_SLOT_MASK;
+    struct lgtd_timer_list *timers = &lgtd_timer_wheel.slots[level][slot];
+
+    // detach the slot first, a timer parked beyond the horizon can end up in
+    // the same slot again:
+    struct lgtd_timer_list cascaded = LIST_HEAD_INITIALIZER(&cascaded);
+    while (!LIST_EMPTY(timers)) {
+        struct lgtd_timer *timer = LIST_FIRST(timers);
+        lgtd_timer_wheel_remove(timer);
+        LIST_INSERT_HEAD(&cascaded, timer, link_by_slot);
+    }
+    while (!LIST_EMPTY(&cascaded)) {
+        struct lgtd_timer *timer = LIST_FIRST(&cascaded);
+        LIST_REMOVE(timer, link_by_slot);
+        lgtd_timer_wheel_insert(timer);
+    }
+}
+
+static uint64_t
+lgtd_timer_msecs_to_tick(lgtd_time_mono_t msecs)
+{
+    // round up, so a timer never fires early:
+    return (msecs + LGTD_TIMER_WHEEL_TICK_MSECS - 1) / LGTD_TIMER_WHEEL_TICK_MSECS;
+}
+
+static void
+lgtd_timer_schedule(struct lgtd_timer *timer, lgtd_time_mono_t now, int ms)
+{
+    assert(timer);
+    assert(ms >= 0);
+
+    if (timer->scheduled) {
+        lgtd_timer_wheel_remove(timer);
+    }
+    // the wheel doesn't move while it's empty, catch up:
+    if (!lgtd_timer_wheel.count && !lgtd_timer_wheel.running) {
+        lgtd_timer_wheel.now = now / LGTD_TIMER_WHEEL_TICK_MSECS;
+    }
+
+    timer->expires_at = LGTD_MAX(
+        lgtd_timer_msecs_to_tick(now + ms), lgtd_timer_wheel.now + 1
+    );
+    lgtd_timer_wheel_insert(timer);
+}
+
+// The tick at which the tick event must fire next, 0 if there is nothing to
+// wait for:
+static uint64_t
+lgtd_timer_wheel_next_tick(void)
+{
+    if (!lgtd_timer_wheel.count) {
+        return 0;
+    }
+
+    uint64_t next = UINT64_MAX;
+    if (lgtd_timer_wheel.counts[0]) {
+        for (int i = 1; i <= LGTD_TIMER_WHEEL_SLOTS; i++) {
+            uint64_t tick = lgtd_timer_wheel.now + i;
+            int slot = tick & LGTD_TIMER_WHEEL_SLOT_MASK;
+            if (!LIST_EMPTY(&lgtd_timer_wheel.slots[0][slot])) {
+                next = tick;
+                break;
+            }
+        }
+    }
+    // wake up when the first level wraps around to cascade the next one:
+    if (lgtd_timer_wheel.count != lgtd_timer_wheel.counts[0]) {
+        next = LGTD_MIN(
+            next, (lgtd_timer_wheel.now | LGTD_TIMER_WHEEL_SLOT_MASK) + 1
+        );
+    }
+
+    return next;
+}
+
+static bool
+lgtd_timer_wheel_arm_at(uint64_t tick, lgtd_time_mono_t now)
+{
+    if (tick == lgtd_timer_wheel.armed_at) {
+        return true;
+    }
+    if (!tick) {
+        event_del(lgtd_timer_wheel.tick_ev);
+        lgtd_timer_wheel.armed_at = 0;
+        return true;
+    }
+
+    lgtd_time_mono_t at = tick * LGTD_TIMER_WHEEL_TICK_MSECS;
+    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(at > now ? at - now : 0);
+    if (evtimer_add(lgtd_timer_wheel.tick_ev, &tv)) {
+        lgtd_timer_wheel.armed_at = 0;
+        return false;
+    }
+    lgtd_timer_wheel.armed_at = tick;
+    return true;
+}
+
+// Make sure the tick event fires before the given timer expires, the event
+// firing too early is harmless so this doesn't need to look at the wheel:
+static bool
+lgtd_timer_wheel_arm_for(const struct lgtd_timer *timer, lgtd_time_mono_t now)
+{
+    assert(timer);
+
+    if (lgtd_timer_wheel.running
+        || (lgtd_timer_wheel.armed_at
+            && lgtd_timer_wheel.armed_at <= timer->expires_at)) {
+        return true;
+    }
+    return lgtd_timer_wheel_arm_at(timer->expires_at, now);
+}
+
+static void
+lgtd_timer_run_slot(int slot)
+{
+    struct lgtd_timer_list *timers = &lgtd_timer_wheel.slots[0][slot];
+
+    // the callbacks can stop or reschedule any timer, including the ones left
+    // in this slot, so don't hold on to the next timer:
+    while (!LIST_EMPTY(timers)) {
+        struct lgtd_timer *timer = LIST_FIRST(timers);
+        assert(timer->expires_at == lgtd_timer_wheel.now);
+        lgtd_timer_wheel_remove(timer);
+        if (timer->flags & LGTD_TIMER_PERSISTENT) {
+            lgtd_timer_schedule(
+                timer, lgtd_timer_wheel.now * LGTD_TIMER_WHEEL_TICK_MSECS,
+                timer->interval
+            );
+        }
+        timer->callback(timer, timer->ctx);
+    }
+}
+
+static void
+lgtd_timer_wheel_advance(uint64_t target)
 {
-    assert(ctx);
+    while (lgtd_timer_wheel.now < target) {
+        if (!lgtd_timer_wheel.count) {
+            lgtd_timer_wheel.now = target;
+            return;
+        }
+        // nothing to run or cascade until the first level wraps around:
+        if (!lgtd_timer_wheel.counts[0]) {
+            uint64_t lap_end = lgtd_timer_wheel.now | LGTD_TIMER_WHEEL_SLOT_MASK;
+            if (lap_end >= target) {
+                lgtd_timer_wheel.now = target;
+                return;
+            }
+            lgtd_timer_wheel.now = lap_end;
+        }
+
+        lgtd_timer_wheel.now++;
+        for (int level = 1; level != LGTD_TIMER_WHEEL_LEVELS; level++) {
+            uint64_t mask = lgtd_timer_wheel_level_span(level) - 1;
+            if (lgtd_timer_wheel.now & mask) {
+                break;
+            }
+            lgtd_timer_wheel_cascade(level);
+        }
+        lgtd_timer_run_slot(lgtd_timer_wheel.now & LGTD_TIMER_WHEEL_SLOT_MASK);
+    }
+}
 
+static void
+lgtd_timer_run_activated(void)
+{
+    // timers activated from the callbacks will run on the next loop iteration
+    // like libevent does, the callbacks can stop any timer of the batch:
+    while (!TAILQ_EMPTY(&lgtd_timer_wheel.activated)) {
+        struct lgtd_timer *timer = TAILQ_FIRST(&lgtd_timer_wheel.activated);
+        TAILQ_REMOVE(&lgtd_timer_wheel.activated, timer, link_by_activation);
+        timer->activated = false;
+        TAILQ_INSERT_TAIL(&lgtd_timer_wheel.batch, timer, link_by_activation);
+        timer->batched = true;
+    }
+
+    while (!TAILQ_EMPTY(&lgtd_timer_wheel.batch)) {
+        struct lgtd_timer *timer = TAILQ_FIRST(&lgtd_timer_wheel.batch);
+        TAILQ_REMOVE(&lgtd_timer_wheel.batch, timer, link_by_activation);
+        timer->batched = false;
+        if (timer->scheduled && !(timer->flags & LGTD_TIMER_PERSISTENT)) {
+            lgtd_timer_wheel_remove(timer);
+        }
+        timer->callback(timer, timer->ctx);
+    }
+}
+
+static void
+lgtd_timer_callback(evutil_socket_t socket, short events, void *ctx)
+{
     (void)socket;
     (void)events;
+    (void)ctx;
+
+    lgtd_timer_wheel.armed_at = 0;
+    lgtd_timer_wheel.running = true;
+
+    lgtd_timer_run_activated();
+
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    lgtd_timer_wheel_advance(now / LGTD_TIMER_WHEEL_TICK_MSECS);
+
+    lgtd_timer_wheel.running = false;
 
-    struct lgtd_timer *timer = ctx;
-    timer->callback(timer, timer->ctx);
+    if (!lgtd_timer_wheel_arm_at(lgtd_timer_wheel_next_tick(), now)) {
+        lgtd_warn("can't schedule the timers");
+    }
+}
+
+void
+lgtd_timer_activate(struct lgtd_timer *timer)
+{
+    assert(timer);
+
+    // a batched timer is about to run anyway:
+    if (!timer->activated && !timer->batched) {
+        TAILQ_INSERT_TAIL(
+            &lgtd_timer_wheel.activated, timer, link_by_activation
+        );
+        timer->activated = true;
+    }
+    event_active(lgtd_timer_wheel.tick_ev, 0, 0);
+}
+
+bool
+lgtd_timer_reschedule(struct lgtd_timer *timer, const struct timeval *tv)
+{
+    assert(timer);
+    assert(tv);
+
+    timer->interval = LGTD_TIMEVAL_TO_MSECS(tv);
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    lgtd_timer_schedule(timer, now, timer->interval);
+    return lgtd_timer_wheel_arm_for(timer, now);
+}
+
+bool
+lgtd_timer_ispending(const struct lgtd_timer *timer)
+{
+    assert(timer);
+
+    return timer->scheduled || timer->activated || timer->batched;
 }
 
 struct lgtd_timer *
@@ -52,30 +359,32 @@ lgtd_timer_start(int flags,
     assert(ms > 0);
     assert(cb);
 
+    if (!lgtd_timer_wheel.tick_ev) {
+        lgtd_timer_wheel.tick_ev = event_new(
+            lgtd_ev_base, -1, 0, lgtd_timer_callback, NULL
+        );
+        if (!lgtd_timer_wheel.tick_ev) {
+            return NULL;
+        }
+    }
+
     struct lgtd_timer *timer = calloc(1, sizeof(*timer));
     if (!timer) {
-        return false;
+        return NULL;
     }
     timer->callback = cb;
     timer->ctx = ctx;
-    LIST_INSERT_HEAD(&lgtd_timers, timer, link);
+    timer->flags = flags;
+    timer->interval = ms;
 
-    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(ms);
-    timer->event = event_new(
-        lgtd_ev_base,
-        -1,
-        flags & LGTD_TIMER_PERSISTENT ? EV_PERSIST : 0,
-        lgtd_timer_callback,
-        timer
-    );
-    if (!timer->event || evtimer_add(timer->event, &tv)) {
-        LIST_REMOVE(timer, link);
-        if (timer->event) {
-            event_free(timer->event);
-        }
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    lgtd_timer_schedule(timer, now, ms);
+    if (!lgtd_timer_wheel_arm_for(timer, now)) {
+        lgtd_timer_wheel_remove(timer);
         free(timer);
         return NULL;
     }
+    LIST_INSERT_HEAD(&lgtd_timers, timer, link);
 
     if (flags & LGTD_TIMER_ACTIVATE_NOW) {
         lgtd_timer_activate(timer);
@@ -89,8 +398,16 @@ lgtd_timer_stop(struct lgtd_timer *timer)
     assert(timer);
 
     LIST_REMOVE(timer, link);
-    event_del(timer->event);
-    event_free(timer->event);
+    if (timer->scheduled) {
+        lgtd_timer_wheel_remove(timer);
+    }
+    if (timer->activated) {
+        TAILQ_REMOVE(
+            &lgtd_timer_wheel.activated, timer, link_by_activation
+        );
+    } else if (timer->batched) {
+        TAILQ_REMOVE(&lgtd_timer_wheel.batch, timer, link_by_activation);
+    }
     free(timer);
 }
 
@@ -101,4 +418,11 @@ lgtd_timer_stop_all(void)
     LIST_FOREACH_SAFE(timer, &lgtd_timers, link, next_timer) {
         lgtd_timer_stop(timer);
     }
+
+    if (lgtd_timer_wheel.tick_ev) {
+        event_del(lgtd_timer_wheel.tick_ev);
+        event_free(lgtd_timer_wheel.tick_ev);
+        lgtd_timer_wheel.tick_ev = NULL;
+    }
+    lgtd_timer_wheel.armed_at = 0;
 }
@@ -24,14 +24,36 @@ union lgtd_timer_ctx {
     void        *as_ptr;
 };
 
+// The timers are kept in a hierarchical timing wheel driven by a single
+// libevent event (instead of one event per timer): each level has
+// LGTD_TIMER_WHEEL_SLOTS slots, a slot of level n covers SLOTS^n ticks and
+// the timers of a slot are moved down a level when the lower levels wrap
+// around. Timers are rounded up to the tick:
+enum { LGTD_TIMER_WHEEL_TICK_MSECS = 10 };
+enum { LGTD_TIMER_WHEEL_LEVEL_BITS = 6 };
+enum { LGTD_TIMER_WHEEL_SLOTS = 1 << LGTD_TIMER_WHEEL_LEVEL_BITS };
+enum { LGTD_TIMER_WHEEL_LEVELS = 4 };
+
 struct lgtd_timer {
-    LIST_ENTRY(lgtd_timer) link;
-    void                   (*callback)(struct lgtd_timer *,
-                                       union lgtd_timer_ctx);
-    union lgtd_timer_ctx   ctx;
-    struct event           *event;
+    LIST_ENTRY(lgtd_timer)  link;
+    // in a slot of the wheel while scheduled:
+    LIST_ENTRY(lgtd_timer)  link_by_slot;
+    // in the queue of timers to run right away while activated, then in
+    // the batch of lgtd_timer_run_activated while it runs them:
+    TAILQ_ENTRY(lgtd_timer) link_by_activation;
+    void                    (*callback)(struct lgtd_timer *,
+                                        union lgtd_timer_ctx);
+    union lgtd_timer_ctx    ctx;
+    int                     flags;
+    int                     interval; // ms
+    uint64_t                expires_at; // tick
+    int                     level;
+    bool                    scheduled;
+    bool                    activated;
+    bool                    batched;
 };
 LIST_HEAD(lgtd_timer_list, lgtd_timer);
+TAILQ_HEAD(lgtd_timer_queue, lgtd_timer);
 
 enum lgtd_timer_flags {
     LGTD_TIMER_DEFAULT_FLAGS = 0,
@@ -40,31 +62,10 @@ enum lgtd_timer_flags {
 };
 
 // Activate the timer now, in other words make the callback pending:
-static inline void
-lgtd_timer_activate(struct lgtd_timer *timer)
-{
-    assert(timer);
-
-    event_active(timer->event, 0, 0);
-}
-
+void lgtd_timer_activate(struct lgtd_timer *);
 // Re-schedule a non-persistent timer with the given timeout:
-static inline bool
-lgtd_timer_reschedule(struct lgtd_timer *timer, const struct timeval *tv)
-{
-    assert(timer);
-    assert(tv);
-
-    return !evtimer_add(timer->event, tv);
-}
-
-static inline bool
-lgtd_timer_ispending(const struct lgtd_timer *timer)
-{
-    assert(timer);
-
-    return evtimer_pending(timer->event, NULL);
-}
+bool lgtd_timer_reschedule(struct lgtd_timer *, const struct timeval *);
+bool lgtd_timer_ispending(const struct lgtd_timer *);
 
 void lgtd_timer_stop(struct lgtd_timer *);
 void lgtd_timer_stop_all(void);
@@ -137,3 +137,18 @@ lgtd_print_nsec_timestamp(uint64_t nsec_ts, char *buf, int bufsz)
 
     return buf;
 }
+
+// FNV-1a, the offset basis is xor'ed with the seed (0 gives the usual hash):
+uint32_t
+lgtd_fnv1a(const void *buf, int len, uint32_t seed)
+{
+    assert(buf || !len);
+    assert(len >= 0);
+
+    uint32_t hash = 2166136261u ^ seed;
+    for (int i = 0; i != len; i++) {
+        hash ^= ((const uint8_t *)buf)[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
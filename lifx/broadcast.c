@@ -31,6 +31,12 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#if LGTD_HAVE_NETLINK
+# include <linux/netlink.h>
+# include <linux/rtnetlink.h>
+#endif
 
 #include <event2/event.h>
 #include <event2/buffer.h>
@@ -48,10 +54,34 @@ static struct {
     evutil_socket_t socket;
     struct event    *read_ev;
     struct event    *write_ev;
+    // notifies us when the network interfaces change, see
+    // lgtd_lifx_broadcast_netlink_callback:
+    evutil_socket_t netlink_socket;
+    struct event    *netlink_ev;
 } lgtd_lifx_broadcast_endpoint = {
     .socket = -1,
     .read_ev = NULL,
     .write_ev = NULL,
+    .netlink_socket = -1,
+    .netlink_ev = NULL
+};
+
+// The broadcast addresses of the network interfaces and the discovery packet
+// are kept between discovery rounds, the addresses are listed again when the
+// interfaces change (or, without netlink, when they get too old):
+static struct {
+    struct sockaddr_in              *addrs;
+    int                             count;
+    bool                            valid;
+    lgtd_time_mono_t                listed_at;
+    bool                            pkt_ready;
+    struct lgtd_lifx_packet_header  pkt;
+} lgtd_lifx_broadcast_targets = {
+    .addrs = NULL,
+    .count = 0,
+    .valid = false,
+    .listed_at = 0,
+    .pkt_ready = false
 };
 
 static bool
@@ -79,29 +109,41 @@ lgtd_lifx_broadcast_send_packet(const void *pkt,
     return true;
 }
 
+static void
+lgtd_lifx_broadcast_invalidate_targets(void)
+{
+    lgtd_lifx_broadcast_targets.valid = false;
+}
+
 static bool
-lgtd_lifx_broadcast_handle_write(void)
+lgtd_lifx_broadcast_add_target(const struct sockaddr_in *addr)
 {
-    assert(lgtd_lifx_broadcast_endpoint.socket != -1);
+    struct sockaddr_in *addrs = lgtd_lifx_broadcast_targets.addrs;
+    int count = lgtd_lifx_broadcast_targets.count;
+    addrs = reallocarray(addrs, count + 1, sizeof(*addrs));
+    if (!addrs) {
+        return false;
+    }
 
-    const uint16_t lifx_port = htons(LGTD_LIFX_PROTOCOL_PORT);
+    addrs[count] = *addr;
+    addrs[count].sin_port = htons(LGTD_LIFX_PROTOCOL_PORT);
+    lgtd_lifx_broadcast_targets.addrs = addrs;
+    lgtd_lifx_broadcast_targets.count++;
+    return true;
+}
 
-    struct lgtd_lifx_packet_header get_pan_gateway;
-    lgtd_lifx_wire_setup_header(
-        &get_pan_gateway,
-        LGTD_LIFX_TARGET_ALL_DEVICES,
-        LGTD_LIFX_UNSPEC_TARGET,
-        NULL,
-        LGTD_LIFX_GET_PAN_GATEWAY
-    );
+static void
+lgtd_lifx_broadcast_list_targets(void)
+{
+    lgtd_lifx_broadcast_targets.count = 0;
+    lgtd_lifx_broadcast_targets.listed_at = lgtd_time_monotonic_msecs();
 
-    bool ok = false;
     struct ifaddrs *ifaddrs = NULL;
     if (getifaddrs(&ifaddrs)) {
         struct sockaddr_in lifx_bcast_addr = {
             .sin_family = AF_INET,
             .sin_addr = { INADDR_BROADCAST },
-            .sin_port = lifx_port,
+            .sin_port = htons(LGTD_LIFX_PROTOCOL_PORT),
             .sin_zero = { 0 }
         };
         char addr_str[INET6_ADDRSTRLEN];
@@ -109,29 +151,71 @@ lgtd_lifx_broadcast_handle_write(void)
             "can't fetch the list of network interfaces, falling back on %s",
             LGTD_SOCKADDRTOA((struct sockaddr *)&lifx_bcast_addr, addr_str)
         );
-        ok = lgtd_lifx_broadcast_send_packet(
-            &get_pan_gateway,
-            sizeof(get_pan_gateway),
-            (struct sockaddr *)&lifx_bcast_addr,
-            sizeof(lifx_bcast_addr)
+        // Stay invalid to try again on the next discovery round:
+        lgtd_lifx_broadcast_add_target(&lifx_bcast_addr);
+        return;
+    }
+
+    bool ok = true;
+    for (struct ifaddrs *ifa = ifaddrs; ifa && ok; ifa = ifa->ifa_next) {
+        // NOTE: IPv6 doesn't implement broadcast
+        if (ifa->ifa_broadaddr != NULL
+            && (ifa->ifa_flags & IFF_BROADCAST)
+            && ifa->ifa_broadaddr->sa_family == AF_INET
+            && ifa->ifa_netmask != NULL) {
+            ok = lgtd_lifx_broadcast_add_target(
+                (struct sockaddr_in *)ifa->ifa_broadaddr
+            );
+        }
+    }
+    freeifaddrs(ifaddrs);
+
+    if (!ok) {
+        lgtd_warn("can't list the broadcast addresses");
+    }
+    lgtd_lifx_broadcast_targets.valid = ok;
+}
+
+static bool
+lgtd_lifx_broadcast_handle_write(void)
+{
+    assert(lgtd_lifx_broadcast_endpoint.socket != -1);
+
+    if (!lgtd_lifx_broadcast_targets.pkt_ready) {
+        lgtd_lifx_wire_setup_header(
+            &lgtd_lifx_broadcast_targets.pkt,
+            LGTD_LIFX_TARGET_ALL_DEVICES,
+            LGTD_LIFX_UNSPEC_TARGET,
+            NULL,
+            LGTD_LIFX_GET_PAN_GATEWAY
         );
-    } else {
-        for (struct ifaddrs *ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
-            // NOTE: IPv6 doesn't implement broadcast
-            if (ifa->ifa_broadaddr != NULL
-                && (ifa->ifa_flags & IFF_BROADCAST)
-                && ifa->ifa_broadaddr->sa_family == AF_INET
-                && ifa->ifa_netmask != NULL) {
-                struct sockaddr *addr = ifa->ifa_broadaddr;
-                ((struct sockaddr_in *)addr)->sin_port = lifx_port;
-                ev_socklen_t addrlen = sizeof(struct sockaddr_in);
-                bool sent = lgtd_lifx_broadcast_send_packet(
-                    &get_pan_gateway, sizeof(get_pan_gateway), addr, addrlen
-                );
-                ok = sent || ok;
-            }
+        lgtd_lifx_broadcast_targets.pkt_ready = true;
+    }
+
+    // Without netlink we can't tell when the interfaces change:
+    lgtd_time_mono_t age = lgtd_time_monotonic_msecs()
+        - lgtd_lifx_broadcast_targets.listed_at;
+    if (!lgtd_lifx_broadcast_endpoint.netlink_ev
+        && age >= LGTD_LIFX_BROADCAST_TARGETS_TTL_MSECS) {
+        lgtd_lifx_broadcast_invalidate_targets();
+    }
+    if (!lgtd_lifx_broadcast_targets.valid) {
+        lgtd_lifx_broadcast_list_targets();
+    }
+
+    bool ok = false;
+    for (int i = 0; i != lgtd_lifx_broadcast_targets.count; i++) {
+        bool sent = lgtd_lifx_broadcast_send_packet(
+            &lgtd_lifx_broadcast_targets.pkt,
+            sizeof(lgtd_lifx_broadcast_targets.pkt),
+            (struct sockaddr *)&lgtd_lifx_broadcast_targets.addrs[i],
+            sizeof(lgtd_lifx_broadcast_targets.addrs[i])
+        );
+        if (!sent) {
+            // the interface is probably gone, list them again next time:
+            lgtd_lifx_broadcast_invalidate_targets();
         }
-        freeifaddrs(ifaddrs);
+        ok = sent || ok;
     }
 
     if (ok && event_del(lgtd_lifx_broadcast_endpoint.write_ev)) {
@@ -141,6 +225,101 @@ lgtd_lifx_broadcast_handle_write(void)
     return ok;
 }
 
+#if LGTD_HAVE_NETLINK
+static void
+lgtd_lifx_broadcast_netlink_callback(evutil_socket_t socket,
+                                     short events,
+                                     void *ctx)
+{
+    (void)events;
+    (void)ctx;
+
+    bool changed = false;
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (true) {
+        ssize_t nbytes = recv(socket, buf, sizeof(buf), 0);
+        if (nbytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // ENOBUFS means that we missed some messages, assume the worst:
+            changed = changed || errno == ENOBUFS;
+            break;
+        }
+        if (nbytes == 0) {
+            break;
+        }
+        const struct nlmsghdr *msg = (const struct nlmsghdr *)buf;
+        for (; NLMSG_OK(msg, (size_t)nbytes); msg = NLMSG_NEXT(msg, nbytes)) {
+            switch (msg->nlmsg_type) {
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                changed = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    if (changed) {
+        lgtd_debug("the network interfaces changed, starting a discovery");
+        lgtd_lifx_broadcast_invalidate_targets();
+        if (lgtd_lifx_broadcast_endpoint.write_ev) {
+            lgtd_lifx_broadcast_discovery();
+        }
+    }
+}
+
+static void
+lgtd_lifx_broadcast_netlink_setup(void)
+{
+    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd == -1) {
+        goto error;
+    }
+
+    struct sockaddr_nl addr = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = RTMGRP_LINK|RTMGRP_IPV4_IFADDR
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))
+        || evutil_make_socket_nonblocking(fd) == -1) {
+        goto error;
+    }
+
+    lgtd_lifx_broadcast_endpoint.netlink_ev = event_new(
+        lgtd_ev_base,
+        fd,
+        EV_READ|EV_PERSIST,
+        lgtd_lifx_broadcast_netlink_callback,
+        NULL
+    );
+    if (!lgtd_lifx_broadcast_endpoint.netlink_ev) {
+        goto error;
+    }
+    if (event_add(lgtd_lifx_broadcast_endpoint.netlink_ev, NULL)) {
+        event_free(lgtd_lifx_broadcast_endpoint.netlink_ev);
+        lgtd_lifx_broadcast_endpoint.netlink_ev = NULL;
+        goto error;
+    }
+    lgtd_lifx_broadcast_endpoint.netlink_socket = fd;
+
+    return;
+
+error:
+    lgtd_warn(
+        "can't watch the network interfaces, they will be listed "
+        "every %ds", LGTD_LIFX_BROADCAST_TARGETS_TTL_MSECS / 1000
+    );
+    if (fd != -1) {
+        close(fd);
+    }
+}
+#endif
+
 static void
 lgtd_lifx_broadcast_event_callback(evutil_socket_t socket,
                                    short events,
@@ -185,6 +364,19 @@ lgtd_lifx_broadcast_close(void)
         evutil_closesocket(lgtd_lifx_broadcast_endpoint.socket);
         lgtd_lifx_broadcast_endpoint.socket = -1;
     }
+    if (lgtd_lifx_broadcast_endpoint.netlink_ev) {
+        event_del(lgtd_lifx_broadcast_endpoint.netlink_ev);
+        event_free(lgtd_lifx_broadcast_endpoint.netlink_ev);
+        lgtd_lifx_broadcast_endpoint.netlink_ev = NULL;
+    }
+    if (lgtd_lifx_broadcast_endpoint.netlink_socket != -1) {
+        evutil_closesocket(lgtd_lifx_broadcast_endpoint.netlink_socket);
+        lgtd_lifx_broadcast_endpoint.netlink_socket = -1;
+    }
+    free(lgtd_lifx_broadcast_targets.addrs);
+    lgtd_lifx_broadcast_targets.addrs = NULL;
+    lgtd_lifx_broadcast_targets.count = 0;
+    lgtd_lifx_broadcast_targets.valid = false;
 }
 
 bool
@@ -260,6 +452,9 @@ lgtd_lifx_broadcast_setup(void)
     }
 
     if (!event_add(lgtd_lifx_broadcast_endpoint.read_ev, NULL)) {
+#if LGTD_HAVE_NETLINK
+        lgtd_lifx_broadcast_netlink_setup();
+#endif
         return true;
     }
 
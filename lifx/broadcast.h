@@ -17,6 +17,10 @@
 
 #pragma once
 
+// How long the list of broadcast addresses is used when the network
+// interfaces can't be watched with netlink:
+enum { LGTD_LIFX_BROADCAST_TARGETS_TTL_MSECS = 60 * 1000 };
+
 bool lgtd_lifx_broadcast_setup(void);
 void lgtd_lifx_broadcast_close(void);
 bool lgtd_lifx_broadcast_discovery(void);
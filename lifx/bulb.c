@@ -16,6 +16,7 @@
 // along with lighstd.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <sys/queue.h>
+#include <sys/time.h>
 #include <sys/tree.h>
 #include <assert.h>
 #include <endian.h>
@@ -41,10 +42,38 @@
 #include "core/client.h"
 #include "core/proto.h"
 #include "core/router.h"
+#include "core/subscription.h"
 #include "core/lightsd.h"
 
-struct lgtd_lifx_bulb_map lgtd_lifx_bulbs_table =
-    RB_INITIALIZER(&lgtd_lifx_bulbs_table);
+struct lgtd_lifx_bulb_table lgtd_lifx_bulbs_table = {
+    .slots = NULL,
+    .nslots = 0,
+    .sorted = NULL,
+    .count = 0,
+    .capacity = 0
+};
+
+struct lgtd_lifx_bulb_queue lgtd_lifx_bulbs_by_light_state_age =
+    TAILQ_HEAD_INITIALIZER(lgtd_lifx_bulbs_by_light_state_age);
+
+struct lgtd_lifx_bulb_journal lgtd_lifx_bulb_journal = {
+    .first_seqn = 0, .seqn = 0
+};
+
+static struct {
+    struct lgtd_lifx_bulb_label_list    *buckets;
+    int                                 nbuckets;
+    int                                 count;
+} lgtd_lifx_bulb_labels = { NULL, 0, 0 };
+
+// The test suite builds with this so the label index is verified after each
+// change, you can also do that to debug things:
+#if LGTD_LIFX_BULB_CHECK_LABEL_INDEX
+# define LGTD_LIFX_BULB_CHECK_LABEL_INDEX_IF_ENABLED() \
+    lgtd_lifx_bulb_check_label_index()
+#else
+# define LGTD_LIFX_BULB_CHECK_LABEL_INDEX_IF_ENABLED() do { } while (0)
+#endif
 
 const char * const lgtd_lifx_bulb_ip_names[] = { "mcu", "wifi" };
 
@@ -139,14 +168,391 @@ lgtd_lifx_bulb_fetch_hardware_info(struct lgtd_timer *timer,
     }
 }
 
+static int
+lgtd_lifx_bulb_table_home_slot(uint64_t key, int nslots)
+{
+    // Fibonacci hashing, the low bits of the address are the ones that vary
+    // the most between bulbs but we don't want to rely on that:
+    return (key * UINT64_C(0x9e3779b97f4a7c15)) >> 32 & (nslots - 1);
+}
+
+static int
+lgtd_lifx_bulb_table_find_slot(uint64_t key)
+{
+    struct lgtd_lifx_bulb_table *table = &lgtd_lifx_bulbs_table;
+
+    int mask = table->nslots - 1;
+    int idx = lgtd_lifx_bulb_table_home_slot(key, table->nslots);
+    while (table->slots[idx].bulb) {
+        if (table->slots[idx].key == key) {
+            return idx;
+        }
+        idx = (idx + 1) & mask;
+    }
+    return -1;
+}
+
+static void
+lgtd_lifx_bulb_table_insert_slot(struct lgtd_lifx_bulb_slot *slots,
+                                 int nslots,
+                                 uint64_t key,
+                                 struct lgtd_lifx_bulb *bulb)
+{
+    int mask = nslots - 1;
+    int idx = lgtd_lifx_bulb_table_home_slot(key, nslots);
+    while (slots[idx].bulb) {
+        assert(slots[idx].key != key);
+        idx = (idx + 1) & mask;
+    }
+    slots[idx].key = key;
+    slots[idx].bulb = bulb;
+}
+
+static bool
+lgtd_lifx_bulb_table_resize(int nslots)
+{
+    struct lgtd_lifx_bulb_table *table = &lgtd_lifx_bulbs_table;
+
+    struct lgtd_lifx_bulb_slot *slots = calloc(nslots, sizeof(*slots));
+    if (!slots) {
+        return false;
+    }
+    for (int i = 0; i != table->nslots; i++) {
+        if (table->slots[i].bulb) {
+            lgtd_lifx_bulb_table_insert_slot(
+                slots, nslots, table->slots[i].key, table->slots[i].bulb
+            );
+        }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->nslots = nslots;
+    return true;
+}
+
+// Return the index of the first bulb in the sorted array with an address
+// greater or equal to key:
+static int
+lgtd_lifx_bulb_table_bsearch(uint64_t key)
+{
+    struct lgtd_lifx_bulb_table *table = &lgtd_lifx_bulbs_table;
+
+    int lo = 0, hi = table->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (lgtd_lifx_bulb_addr_to_key(table->sorted[mid]->addr) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool
+lgtd_lifx_bulb_table_insert(struct lgtd_lifx_bulb *bulb)
+{
+    struct lgtd_lifx_bulb_table *table = &lgtd_lifx_bulbs_table;
+
+    // keep the load factor under 1/2:
+    if (table->count >= table->nslots / 2) {
+        int nslots = LGTD_MAX(
+            table->nslots * 2, LGTD_LIFX_BULB_TABLE_MIN_SLOTS
+        );
+        if (!lgtd_lifx_bulb_table_resize(nslots)) {
+            return false;
+        }
+    }
+    if (table->count == table->capacity) {
+        int capacity = LGTD_MAX(
+            table->capacity * 2, LGTD_LIFX_BULB_TABLE_MIN_SLOTS / 2
+        );
+        struct lgtd_lifx_bulb **sorted = reallocarray(
+            table->sorted, capacity, sizeof(*sorted)
+        );
+        if (!sorted) {
+            return false;
+        }
+        table->sorted = sorted;
+        table->capacity = capacity;
+    }
+
+    uint64_t key = lgtd_lifx_bulb_addr_to_key(bulb->addr);
+    lgtd_lifx_bulb_table_insert_slot(table->slots, table->nslots, key, bulb);
+
+    int idx = lgtd_lifx_bulb_table_bsearch(key);
+    memmove(
+        &table->sorted[idx + 1],
+        &table->sorted[idx],
+        (table->count - idx) * sizeof(*table->sorted)
+    );
+    table->sorted[idx] = bulb;
+    table->count++;
+
+    TAILQ_INSERT_TAIL(
+        &lgtd_lifx_bulbs_by_light_state_age, bulb, link_by_light_state_age
+    );
+
+    return true;
+}
+
+static void
+lgtd_lifx_bulb_table_remove(struct lgtd_lifx_bulb *bulb)
+{
+    struct lgtd_lifx_bulb_table *table = &lgtd_lifx_bulbs_table;
+
+    uint64_t key = lgtd_lifx_bulb_addr_to_key(bulb->addr);
+    int idx = lgtd_lifx_bulb_table_find_slot(key);
+    assert(idx != -1);
+    assert(table->slots[idx].bulb == bulb);
+
+    // Backward shift deletion: pull back the following entries of the
+    // cluster that would become unreachable because of the hole:
+    int mask = table->nslots - 1;
+    int hole = idx;
+    for (int next = (hole + 1) & mask;
+         table->slots[next].bulb;
+         next = (next + 1) & mask) {
+        int home = lgtd_lifx_bulb_table_home_slot(
+            table->slots[next].key, table->nslots
+        );
+        // is home cyclically outside of ]hole, next]?
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            table->slots[hole] = table->slots[next];
+            hole = next;
+        }
+    }
+    table->slots[hole].key = 0;
+    table->slots[hole].bulb = NULL;
+
+    idx = lgtd_lifx_bulb_table_bsearch(key);
+    assert(idx < table->count && table->sorted[idx] == bulb);
+    table->count--;
+    memmove(
+        &table->sorted[idx],
+        &table->sorted[idx + 1],
+        (table->count - idx) * sizeof(*table->sorted)
+    );
+
+    TAILQ_REMOVE(
+        &lgtd_lifx_bulbs_by_light_state_age, bulb, link_by_light_state_age
+    );
+
+    if (!table->count) {
+        free(table->slots);
+        free(table->sorted);
+        memset(table, 0, sizeof(*table));
+    }
+}
+
+LGTD_LIST_HASH_TABLE_GENERATE_STATIC(
+    lgtd_lifx_bulb_labels, lgtd_lifx_bulb_labels, lgtd_lifx_bulb_label_list,
+    lgtd_lifx_bulb_label, link, LGTD_LIFX_BULB_LABELS_MIN_BUCKETS
+)
+
+static struct lgtd_lifx_bulb_label *
+lgtd_lifx_bulb_lookup_label(const char *label, int len, uint32_t hash)
+{
+    if (!lgtd_lifx_bulb_labels.nbuckets) {
+        return NULL;
+    }
+
+    struct lgtd_lifx_bulb_label *bulb_label;
+    LIST_FOREACH(bulb_label, lgtd_lifx_bulb_labels_bucket(hash), link) {
+        if (bulb_label->hash == hash
+            && bulb_label->len == len
+            && !memcmp(bulb_label->label, label, len)) {
+            return bulb_label;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+lgtd_lifx_bulb_index_label(struct lgtd_lifx_bulb *bulb)
+{
+    assert(bulb);
+    assert(!bulb->label);
+
+    const char *label = bulb->state.label;
+    const char *endp = memchr(label, 0, LGTD_LIFX_LABEL_SIZE);
+    int len = endp ? endp - label : LGTD_LIFX_LABEL_SIZE;
+    uint32_t hash = lgtd_fnv1a(label, len, 0);
+
+    struct lgtd_lifx_bulb_label *bulb_label;
+    bulb_label = lgtd_lifx_bulb_lookup_label(label, len, hash);
+    if (!bulb_label) {
+        bulb_label = calloc(1, sizeof(*bulb_label));
+        if (!bulb_label) {
+            goto error_allocate;
+        }
+        LIST_INIT(&bulb_label->bulbs);
+        bulb_label->hash = hash;
+        bulb_label->len = len;
+        memcpy(bulb_label->label, label, len);
+        if (!lgtd_lifx_bulb_labels_insert(bulb_label)) {
+            free(bulb_label);
+            goto error_allocate;
+        }
+    }
+
+    LIST_INSERT_HEAD(&bulb_label->bulbs, bulb, link_by_label);
+    bulb->label = bulb_label;
+    return;
+
+error_allocate:
+    lgtd_warn(
+        "can't index bulb label %.*s, it won't be reachable by label",
+        len, label
+    );
+}
+
+static void
+lgtd_lifx_bulb_unindex_label(struct lgtd_lifx_bulb *bulb)
+{
+    assert(bulb);
+
+    struct lgtd_lifx_bulb_label *bulb_label = bulb->label;
+    if (!bulb_label) {
+        return;
+    }
+
+    LIST_REMOVE(bulb, link_by_label);
+    bulb->label = NULL;
+    if (LIST_EMPTY(&bulb_label->bulbs)) {
+        lgtd_lifx_bulb_labels_remove(bulb_label);
+        free(bulb_label);
+    }
+}
+
+const struct lgtd_lifx_bulb_label *
+lgtd_lifx_bulb_find_label(const char *label)
+{
+    assert(label);
+
+    // clipping the label at 32 chars seems like the desired default behavior:
+    int len = LGTD_MIN(strlen(label), LGTD_LIFX_LABEL_SIZE);
+    uint32_t hash = lgtd_fnv1a(label, len, 0);
+    return lgtd_lifx_bulb_lookup_label(label, len, hash);
+}
+
+void
+lgtd_lifx_bulb_check_label_index(void)
+{
+    int nbulbs = 0;
+    for (int i = 0; i != lgtd_lifx_bulb_labels.nbuckets; i++) {
+        struct lgtd_lifx_bulb_label *bulb_label;
+        LIST_FOREACH(bulb_label, &lgtd_lifx_bulb_labels.buckets[i], link) {
+            if (lgtd_lifx_bulb_labels_bucket(bulb_label->hash)
+                != &lgtd_lifx_bulb_labels.buckets[i]) {
+                lgtd_errx(
+                    1, "label %.*s is in the wrong bucket",
+                    bulb_label->len, bulb_label->label
+                );
+            }
+            if (LIST_EMPTY(&bulb_label->bulbs)) {
+                lgtd_errx(
+                    1, "label %.*s doesn't have any bulb",
+                    bulb_label->len, bulb_label->label
+                );
+            }
+            struct lgtd_lifx_bulb *bulb;
+            LGTD_LIFX_BULB_FOREACH_WITH_LABEL(bulb, bulb_label) {
+                if (bulb->label != bulb_label
+                    || !lgtd_lifx_bulb_has_label(bulb, bulb_label->label)
+                    || lgtd_lifx_bulb_get(bulb->addr) != bulb) {
+                    char addr[LGTD_LIFX_ADDR_STRLEN];
+                    lgtd_errx(
+                        1, "bulb %s is indexed under the wrong label %.*s",
+                        LGTD_IEEE8023MACTOA(bulb->addr, addr),
+                        bulb_label->len, bulb_label->label
+                    );
+                }
+                nbulbs++;
+            }
+        }
+    }
+
+    if (nbulbs != lgtd_lifx_bulbs_table.count) {
+        lgtd_errx(
+            1, "%d bulbs are indexed by label (expected %d)",
+            nbulbs, lgtd_lifx_bulbs_table.count
+        );
+    }
+}
+
+// The state changed, get_light_state will have to format it again:
+static void
+lgtd_lifx_bulb_drop_json_state(struct lgtd_lifx_bulb *bulb)
+{
+    bulb->json_state.len = 0;
+}
+
+static uint64_t
+lgtd_lifx_bulb_journal_append(const uint8_t *addr, bool closed)
+{
+    struct lgtd_lifx_bulb_journal_entry *entry;
+    entry = LGTD_LIFX_BULB_JOURNAL_ENTRY(++lgtd_lifx_bulb_journal.seqn);
+    entry->seqn = lgtd_lifx_bulb_journal.seqn;
+    memcpy(entry->addr, addr, sizeof(entry->addr));
+    entry->closed = closed;
+    return entry->seqn;
+}
+
+// Something get_light_state reports changed, log it so the clients that
+// poll with since get the bulb again:
+static void
+lgtd_lifx_bulb_journal_changed(struct lgtd_lifx_bulb *bulb)
+{
+    bulb->journal_seqn = lgtd_lifx_bulb_journal_append(bulb->addr, false);
+}
+
+// The light state changed, push it to the subscriptions and log it:
+static void
+lgtd_lifx_bulb_changed(struct lgtd_lifx_bulb *bulb, int changes)
+{
+    lgtd_lifx_bulb_journal_changed(bulb);
+    lgtd_subscription_bulb_changed(bulb, changes);
+}
+
+void
+lgtd_lifx_bulb_journal_setup(void)
+{
+    assert(lgtd_lifx_bulb_journal.seqn == lgtd_lifx_bulb_journal.first_seqn);
+
+    // A sequence number from a previous run is then lower than first_seqn,
+    // unless that run made more than one change per millisecond on average:
+    struct timeval now;
+    if (gettimeofday(&now, NULL) == -1) {
+        lgtd_warn("can't get the time, restarts will go unnoticed");
+        return;
+    }
+    lgtd_lifx_bulb_journal.first_seqn =
+        (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_usec / 1000;
+    lgtd_lifx_bulb_journal.seqn = lgtd_lifx_bulb_journal.first_seqn;
+}
+
+// Return true if every change after since is still in the journal:
+bool
+lgtd_lifx_bulb_journal_has(uint64_t since)
+{
+    return since >= lgtd_lifx_bulb_journal.first_seqn
+        && since <= lgtd_lifx_bulb_journal.seqn
+        && lgtd_lifx_bulb_journal.seqn - since <= LGTD_LIFX_BULB_JOURNAL_SIZE;
+}
+
 struct lgtd_lifx_bulb *
 lgtd_lifx_bulb_get(const uint8_t *addr)
 {
     assert(addr);
 
-    struct lgtd_lifx_bulb bulb;
-    memcpy(bulb.addr, addr, sizeof(bulb.addr));
-    return RB_FIND(lgtd_lifx_bulb_map, &lgtd_lifx_bulbs_table, &bulb);
+    if (!lgtd_lifx_bulbs_table.count) {
+        return NULL;
+    }
+
+    int idx = lgtd_lifx_bulb_table_find_slot(lgtd_lifx_bulb_addr_to_key(addr));
+    return idx != -1 ? lgtd_lifx_bulbs_table.slots[idx].bulb : NULL;
 }
 
 struct lgtd_lifx_bulb *
@@ -163,10 +569,17 @@ lgtd_lifx_bulb_open(struct lgtd_lifx_gateway *gw, const uint8_t *addr)
 
     bulb->gw = gw;
     memcpy(bulb->addr, addr, sizeof(bulb->addr));
-    RB_INSERT(lgtd_lifx_bulb_map, &lgtd_lifx_bulbs_table, bulb);
+    if (!lgtd_lifx_bulb_table_insert(bulb)) {
+        lgtd_warn("can't allocate a new bulb");
+        free(bulb);
+        return NULL;
+    }
+    lgtd_lifx_bulb_index_label(bulb);
+    LGTD_LIFX_BULB_CHECK_LABEL_INDEX_IF_ENABLED();
     LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(bulbs, 1);
 
     bulb->last_light_state_at = lgtd_time_monotonic_msecs();
+    bulb->journal_seqn = lgtd_lifx_bulb_journal_append(addr, false);
 
     union lgtd_timer_ctx ctx = { .as_uint = 0 };
     memcpy(&ctx.as_uint, addr, LGTD_LIFX_ADDR_LENGTH);
@@ -211,7 +624,11 @@ lgtd_lifx_bulb_close(struct lgtd_lifx_bulb *bulb)
     if (bulb->state.power == LGTD_LIFX_POWER_ON) {
         LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(bulbs_powered_on, -1);
     }
-    RB_REMOVE(lgtd_lifx_bulb_map, &lgtd_lifx_bulbs_table, bulb);
+    lgtd_lifx_bulb_unindex_label(bulb);
+    lgtd_lifx_bulb_table_remove(bulb);
+    LGTD_LIFX_BULB_CHECK_LABEL_INDEX_IF_ENABLED();
+    lgtd_subscription_bulb_closed(bulb);
+    lgtd_lifx_bulb_journal_append(bulb->addr, true);
     char addr[LGTD_LIFX_ADDR_STRLEN];
     lgtd_info(
         "closed bulb \"%.*s\" (%s) on %s",
@@ -220,6 +637,8 @@ lgtd_lifx_bulb_close(struct lgtd_lifx_bulb *bulb)
         LGTD_IEEE8023MACTOA(bulb->addr, addr),
         bulb->gw->peeraddr
     );
+    free(bulb->json_head.buf);
+    free(bulb->json_state.buf);
     free(bulb);
 }
 
@@ -255,8 +674,54 @@ lgtd_lifx_bulb_set_light_state(struct lgtd_lifx_bulb *bulb,
 
     lgtd_lifx_gateway_update_tag_refcounts(bulb->gw, bulb->state.tags, state->tags);
 
+    bool relabel = memcmp(
+        bulb->state.label, state->label, LGTD_LIFX_LABEL_SIZE
+    );
+    if (relabel) {
+        lgtd_lifx_bulb_unindex_label(bulb);
+    }
+    if (memcmp(&bulb->state, state, sizeof(bulb->state))) {
+        lgtd_lifx_bulb_drop_json_state(bulb);
+    }
+    int changes = 0;
+    if (bulb->state.hue != state->hue
+        || bulb->state.saturation != state->saturation
+        || bulb->state.brightness != state->brightness
+        || bulb->state.kelvin != state->kelvin) {
+        changes |= LGTD_LIFX_BULB_HSBK_CHANGED;
+    }
+    if (bulb->state.power != state->power) {
+        changes |= LGTD_LIFX_BULB_POWER_CHANGED;
+    }
+    if (relabel) {
+        changes |= LGTD_LIFX_BULB_LABEL_CHANGED;
+    }
+    if (bulb->state.tags != state->tags) {
+        changes |= LGTD_LIFX_BULB_TAGS_CHANGED;
+    }
+
+    bool was_stale = bulb->stale;
     bulb->last_light_state_at = received_at;
+    bulb->stale = false;
+    TAILQ_REMOVE(
+        &lgtd_lifx_bulbs_by_light_state_age, bulb, link_by_light_state_age
+    );
+    TAILQ_INSERT_TAIL(
+        &lgtd_lifx_bulbs_by_light_state_age, bulb, link_by_light_state_age
+    );
     memcpy(&bulb->state, state, sizeof(bulb->state));
+
+    if (relabel) {
+        lgtd_lifx_bulb_index_label(bulb);
+    }
+    LGTD_LIFX_BULB_CHECK_LABEL_INDEX_IF_ENABLED();
+
+    if (changes) {
+        lgtd_lifx_bulb_changed(bulb, changes);
+    } else if (was_stale) {
+        // get_light_state doesn't flag it as stale anymore:
+        lgtd_lifx_bulb_journal_changed(bulb);
+    }
 }
 
 void
@@ -269,9 +734,10 @@ lgtd_lifx_bulb_set_power_state(struct lgtd_lifx_bulb *bulb, uint16_t power)
             bulbs_powered_on, power == LGTD_LIFX_POWER_ON ? 1 : -1
         );
         lgtd_router_send_to_device(bulb, LGTD_LIFX_GET_INFO, NULL);
+        lgtd_lifx_bulb_drop_json_state(bulb);
+        bulb->state.power = power;
+        lgtd_lifx_bulb_changed(bulb, LGTD_LIFX_BULB_POWER_CHANGED);
     }
-
-    bulb->state.power = power;
 }
 
 void
@@ -281,7 +747,10 @@ lgtd_lifx_bulb_set_tags(struct lgtd_lifx_bulb *bulb, uint64_t tags)
 
     lgtd_lifx_gateway_update_tag_refcounts(bulb->gw, bulb->state.tags, tags);
 
-    bulb->state.tags = tags;
+    if (tags != bulb->state.tags) {
+        bulb->state.tags = tags;
+        lgtd_lifx_bulb_changed(bulb, LGTD_LIFX_BULB_TAGS_CHANGED);
+    }
 }
 
 void
@@ -295,6 +764,11 @@ lgtd_lifx_bulb_set_ip_state(struct lgtd_lifx_bulb *bulb,
 
     struct lgtd_lifx_bulb_ip *ip = &bulb->ips[ip_id];
     ip->state_updated_at = received_at;
+    // not pushed to the subscriptions, only get_light_state has it:
+    if (memcmp(&ip->state, state, sizeof(ip->state))) {
+        lgtd_lifx_bulb_drop_json_state(bulb);
+        lgtd_lifx_bulb_journal_changed(bulb);
+    }
     memcpy(&ip->state, state, sizeof(ip->state));
 }
 
@@ -309,6 +783,10 @@ lgtd_lifx_bulb_set_ip_firmware_info(struct lgtd_lifx_bulb *bulb,
 
     struct lgtd_lifx_bulb_ip *ip = &bulb->ips[ip_id];
     ip->fw_info_updated_at = received_at;
+    if (memcmp(&ip->fw_info, info, sizeof(ip->fw_info))) {
+        lgtd_lifx_bulb_drop_json_state(bulb);
+        lgtd_lifx_bulb_journal_changed(bulb);
+    }
     memcpy(&ip->fw_info, info, sizeof(ip->fw_info));
 }
 
@@ -319,6 +797,10 @@ lgtd_lifx_bulb_set_product_info(struct lgtd_lifx_bulb *bulb,
     assert(bulb);
     assert(info);
 
+    if (memcmp(&bulb->product_info, info, sizeof(bulb->product_info))) {
+        lgtd_lifx_bulb_drop_json_state(bulb);
+        lgtd_lifx_bulb_journal_changed(bulb);
+    }
     memcpy(&bulb->product_info, info, sizeof(bulb->product_info));
     bulb->vendor = lgtd_lifx_bulb_get_vendor_name(info->vendor_id);
     bulb->model = lgtd_lifx_bulb_get_model_name(
@@ -335,16 +817,46 @@ lgtd_lifx_bulb_set_runtime_info(struct lgtd_lifx_bulb *bulb,
     assert(info);
 
     bulb->runtime_info_updated_at = received_at;
+    if (memcmp(&bulb->runtime_info, info, sizeof(bulb->runtime_info))) {
+        lgtd_lifx_bulb_drop_json_state(bulb);
+        lgtd_lifx_bulb_journal_changed(bulb);
+    }
     memcpy(&bulb->runtime_info, info, sizeof(bulb->runtime_info));
 }
 
+void
+lgtd_lifx_bulb_set_clock_offset(struct lgtd_lifx_bulb *bulb,
+                                int64_t sample,
+                                lgtd_time_mono_t received_at)
+{
+    assert(bulb);
+
+    int64_t delta = sample - bulb->clock_offset;
+    if (!bulb->clock_offset_updated_at
+        || delta > LGTD_LIFX_BULB_CLOCK_OFFSET_MAX_JUMP_MSECS
+        || delta < -LGTD_LIFX_BULB_CLOCK_OFFSET_MAX_JUMP_MSECS) {
+        bulb->clock_offset = sample;
+    } else {
+        // smooth the jitter of the samples out like for the RTT:
+        bulb->clock_offset += delta / 4;
+    }
+    bulb->clock_offset_updated_at = received_at;
+}
+
 void
 lgtd_lifx_bulb_set_label(struct lgtd_lifx_bulb *bulb,
                          const char label[LGTD_LIFX_LABEL_SIZE])
 {
     assert(bulb);
 
-    memcpy(bulb->state.label, label, LGTD_LIFX_LABEL_SIZE);
+    if (memcmp(bulb->state.label, label, LGTD_LIFX_LABEL_SIZE)) {
+        lgtd_lifx_bulb_unindex_label(bulb);
+        memcpy(bulb->state.label, label, LGTD_LIFX_LABEL_SIZE);
+        lgtd_lifx_bulb_index_label(bulb);
+        lgtd_lifx_bulb_drop_json_state(bulb);
+        lgtd_lifx_bulb_changed(bulb, LGTD_LIFX_BULB_LABEL_CHANGED);
+    }
+    LGTD_LIFX_BULB_CHECK_LABEL_INDEX_IF_ENABLED();
 }
 
 void
@@ -65,6 +65,10 @@ enum {
         LGTD_LIFX_BULB_FETCH_HARDWARE_INFO_TIMER_MSECS * 4
 };
 
+// Past that, a new clock offset sample replaces the current estimate instead
+// of being averaged with it (the bulb clock was probably reset):
+enum { LGTD_LIFX_BULB_CLOCK_OFFSET_MAX_JUMP_MSECS = 1000 };
+
 enum lgtd_lifx_bulb_ips {
     LGTD_LIFX_BULB_MCU_IP = 0,
     LGTD_LIFX_BULB_WIFI_IP,
@@ -81,13 +85,48 @@ struct lgtd_lifx_bulb_ip {
     lgtd_time_mono_t                    fw_info_updated_at;
 };
 
+// With --lifx-acked-delivery, what happened to the last command sent to the
+// bulb:
+enum lgtd_lifx_bulb_delivery {
+    LGTD_LIFX_BULB_DELIVERY_NONE = 0,
+    LGTD_LIFX_BULB_DELIVERY_PENDING,
+    LGTD_LIFX_BULB_DELIVERY_ACKED,
+    LGTD_LIFX_BULB_DELIVERY_FAILED
+};
+
+// What changed in the state of a bulb, see lgtd_subscription_bulb_changed:
+enum lgtd_lifx_bulb_changes {
+    LGTD_LIFX_BULB_HSBK_CHANGED = 1,
+    LGTD_LIFX_BULB_POWER_CHANGED = 1 << 1,
+    LGTD_LIFX_BULB_LABEL_CHANGED = 1 << 2,
+    LGTD_LIFX_BULB_TAGS_CHANGED = 1 << 3,
+    LGTD_LIFX_BULB_ALL_CHANGED = (1 << 4) - 1
+};
+
+// Pieces of the JSON representation of the bulb in get_light_state, they
+// are formatted by lgtd_proto_get_light_state the first time they are
+// needed and sent as is until the bulb changes (len is 0 when nothing is
+// cached, buf is kept around to be reused):
+struct lgtd_lifx_bulb_json {
+    char    *buf;
+    int     len;
+    int     size;
+    // the firmware and runtime details are only included in debug mode:
+    bool    debug;
+};
+
 struct lgtd_lifx_bulb {
-    RB_ENTRY(lgtd_lifx_bulb)        link;
     SLIST_ENTRY(lgtd_lifx_bulb)     link_by_gw;
+    LIST_ENTRY(lgtd_lifx_bulb)      link_by_label;
+    TAILQ_ENTRY(lgtd_lifx_bulb)     link_by_light_state_age;
+    struct lgtd_lifx_bulb_label     *label;
     lgtd_time_mono_t                last_light_state_at;
     lgtd_time_mono_t                runtime_info_updated_at;
     lgtd_time_mono_t                dirty_at;
     uint16_t                        expected_power_on;
+    enum lgtd_lifx_bulb_delivery    delivery;
+    // restored from --lifx-state-file and not heard from yet:
+    bool                            stale;
     uint8_t                         addr[LGTD_LIFX_ADDR_LENGTH];
     float                           ambient_light; // lux
     const char                      *model;
@@ -97,26 +136,130 @@ struct lgtd_lifx_bulb {
     struct lgtd_lifx_bulb_ip        ips[LGTD_LIFX_BULB_IP_COUNT];
     struct lgtd_lifx_product_info   product_info;
     struct lgtd_lifx_runtime_info   runtime_info;
+    // bulb clock - our monotonic clock, in ms, see TIME_STATE:
+    int64_t                         clock_offset;
+    lgtd_time_mono_t                clock_offset_updated_at;
+    // lets the router know if the bulb is already in the list of devices
+    // it's building, see lgtd_router_targets_to_devices:
+    uint32_t                        resolved_gen;
+    // address and gateway, this doesn't change for the lifetime of the bulb:
+    struct lgtd_lifx_bulb_json      json_head;
+    // everything else but the tags, dropped by the setters below:
+    struct lgtd_lifx_bulb_json      json_state;
+    // changes not pushed to the subscribed clients yet, see
+    // lgtd_subscription_bulb_changed:
+    LIST_ENTRY(lgtd_lifx_bulb)      link_by_changes;
+    int                             changes;
+    // sequence number of the last change, see lgtd_lifx_bulb_journal:
+    uint64_t                        journal_seqn;
 };
-RB_HEAD(lgtd_lifx_bulb_map, lgtd_lifx_bulb);
 SLIST_HEAD(lgtd_lifx_bulb_list, lgtd_lifx_bulb);
+TAILQ_HEAD(lgtd_lifx_bulb_queue, lgtd_lifx_bulb);
+
+// All the bulbs with the same label, the index is maintained as the labels
+// are received from the bulbs so we don't have to look at every bulb when we
+// need to send something to a label:
+struct lgtd_lifx_bulb_label {
+    LIST_ENTRY(lgtd_lifx_bulb_label)    link;
+    LIST_HEAD(, lgtd_lifx_bulb)         bulbs;
+    uint32_t                            hash;
+    int                                 len;
+    char                                label[LGTD_LIFX_LABEL_SIZE];
+};
+LIST_HEAD(lgtd_lifx_bulb_label_list, lgtd_lifx_bulb_label);
+
+#define LGTD_LIFX_BULB_FOREACH_WITH_LABEL(bulb, bulb_label) \
+    LIST_FOREACH((bulb), &(bulb_label)->bulbs, link_by_label)
+
+enum { LGTD_LIFX_BULB_LABELS_MIN_BUCKETS = 16 };
+
+struct lgtd_lifx_bulb_slot {
+    uint64_t                        key;
+    struct lgtd_lifx_bulb           *bulb;
+};
+
+// Bulbs are indexed by address (packed in an integer, see
+// lgtd_lifx_bulb_addr_to_key) in an open-addressing hash table with linear
+// probing, and kept in a compact array sorted by address for iteration:
+struct lgtd_lifx_bulb_table {
+    struct lgtd_lifx_bulb_slot      *slots;
+    int                             nslots; // always a power of two
+    struct lgtd_lifx_bulb           **sorted;
+    int                             count;
+    int                             capacity;
+};
 
-extern struct lgtd_lifx_bulb_map lgtd_lifx_bulbs_table;
+extern struct lgtd_lifx_bulb_table lgtd_lifx_bulbs_table;
 
-static inline int
-lgtd_lifx_bulb_cmp(const struct lgtd_lifx_bulb *a, const struct lgtd_lifx_bulb *b)
+// All the bulbs, from the one with the oldest last_light_state_at to the most
+// recently updated one, so the discovery watchdog doesn't have to look at
+// every bulb to find the ones that timed out:
+extern struct lgtd_lifx_bulb_queue lgtd_lifx_bulbs_by_light_state_age;
+
+enum { LGTD_LIFX_BULB_TABLE_MIN_SLOTS = 64 };
+
+// Each change of what get_light_state reports about a bulb (not only the
+// changes pushed to the subscriptions, the firmware, runtime and wifi info
+// too), and each bulb opened or closed, gets the next sequence number in a
+// ring of the last LGTD_LIFX_BULB_JOURNAL_SIZE entries, so get_light_state
+// can tell what changed since a given sequence number:
+struct lgtd_lifx_bulb_journal_entry {
+    uint64_t                        seqn;
+    uint8_t                         addr[LGTD_LIFX_ADDR_LENGTH];
+    bool                            closed;
+};
+
+enum { LGTD_LIFX_BULB_JOURNAL_SIZE = 4096 }; // must be a power of two
+
+struct lgtd_lifx_bulb_journal {
+    // the sequence numbers start after the time lightsd started at (in ms
+    // since the epoch) to tell them apart from the ones of a previous run,
+    // see lgtd_lifx_bulb_journal_setup:
+    uint64_t                            first_seqn;
+    // last sequence number given, the entry is at seqn % JOURNAL_SIZE:
+    uint64_t                            seqn;
+    struct lgtd_lifx_bulb_journal_entry entries[LGTD_LIFX_BULB_JOURNAL_SIZE];
+};
+
+extern struct lgtd_lifx_bulb_journal lgtd_lifx_bulb_journal;
+
+#define LGTD_LIFX_BULB_JOURNAL_ENTRY(seqn)                                  \
+    (&lgtd_lifx_bulb_journal.entries[                                       \
+        (seqn) & (LGTD_LIFX_BULB_JOURNAL_SIZE - 1)                          \
+    ])
+
+// Iterate over all the bulbs ordered by address, don't close bulbs from
+// there, use LGTD_LIFX_BULB_FOREACH_SAFE instead:
+#define LGTD_LIFX_BULB_FOREACH(bulb)                                        \
+    for (int bulb##_idx = 0;                                                \
+         bulb##_idx < lgtd_lifx_bulbs_table.count                           \
+         && ((bulb) = lgtd_lifx_bulbs_table.sorted[bulb##_idx]);            \
+         bulb##_idx++)
+
+// Iterate over all the bulbs ordered by address, in reverse order, so the
+// current bulb can be closed from the loop:
+#define LGTD_LIFX_BULB_FOREACH_SAFE(bulb)                                   \
+    for (int bulb##_idx = lgtd_lifx_bulbs_table.count - 1;                  \
+         bulb##_idx >= 0                                                    \
+         && ((bulb) = lgtd_lifx_bulbs_table.sorted[bulb##_idx]);            \
+         bulb##_idx = LGTD_MIN(bulb##_idx, lgtd_lifx_bulbs_table.count) - 1)
+
+#define LGTD_LIFX_BULB_TABLE_EMPTY() (lgtd_lifx_bulbs_table.count == 0)
+
+static inline uint64_t
+lgtd_lifx_bulb_addr_to_key(const uint8_t *addr)
 {
-    return memcmp(a->addr, b->addr, sizeof(a->addr));
+    // big endian so that the keys are ordered like the addresses:
+    return (uint64_t)addr[0] << 40 | (uint64_t)addr[1] << 32
+        | (uint64_t)addr[2] << 24 | (uint64_t)addr[3] << 16
+        | (uint64_t)addr[4] << 8 | (uint64_t)addr[5];
 }
 
-RB_GENERATE_STATIC(
-    lgtd_lifx_bulb_map,
-    lgtd_lifx_bulb,
-    link,
-    lgtd_lifx_bulb_cmp
-);
-
 struct lgtd_lifx_bulb *lgtd_lifx_bulb_get(const uint8_t *);
+void lgtd_lifx_bulb_journal_setup(void);
+bool lgtd_lifx_bulb_journal_has(uint64_t);
+const struct lgtd_lifx_bulb_label *lgtd_lifx_bulb_find_label(const char *);
+void lgtd_lifx_bulb_check_label_index(void);
 struct lgtd_lifx_bulb *lgtd_lifx_bulb_open(struct lgtd_lifx_gateway *, const uint8_t *);
 void lgtd_lifx_bulb_close(struct lgtd_lifx_bulb *);
 
@@ -142,6 +285,9 @@ void lgtd_lifx_bulb_set_product_info(struct lgtd_lifx_bulb *,
 void lgtd_lifx_bulb_set_runtime_info(struct lgtd_lifx_bulb *,
                                      const struct lgtd_lifx_runtime_info *,
                                      lgtd_time_mono_t);
+void lgtd_lifx_bulb_set_clock_offset(struct lgtd_lifx_bulb *,
+                                     int64_t,
+                                     lgtd_time_mono_t);
 void lgtd_lifx_bulb_set_label(struct lgtd_lifx_bulb *,
                               const char [LGTD_LIFX_LABEL_SIZE]);
 void lgtd_lifx_bulb_set_ambient_light(struct lgtd_lifx_bulb *, float);
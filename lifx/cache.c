@@ -0,0 +1,525 @@
+// Copyright (c) 2015, Louis Opter <kalessin@kalessin.fr>
+//
+// This file is part of lighstd.
+//
+// lighstd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// lighstd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with lighstd.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <sys/mman.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/tree.h>
+#include <assert.h>
+#include <endian.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include "wire_proto.h"
+#include "core/time_monotonic.h"
+#include "bulb.h"
+#include "gateway.h"
+#include "tagging.h"
+#include "cache.h"
+#include "core/timer.h"
+#include "core/lightsd.h"
+
+static struct lgtd_timer *lgtd_lifx_cache_timer = NULL;
+
+// Shared mapping of the file we last wrote, it lets the next saves only
+// update the records that changed:
+static struct {
+    const char  *path;
+    char        *data;
+    size_t      size;
+} lgtd_lifx_cache_map = { NULL, NULL, 0 };
+
+static bool
+lgtd_lifx_cache_write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len) {
+        ssize_t nbytes = write(fd, p, len);
+        if (nbytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += nbytes;
+        len -= nbytes;
+    }
+    return true;
+}
+
+static size_t
+lgtd_lifx_cache_size(const struct lgtd_lifx_cache_header *header)
+{
+    return sizeof(*header)
+        + header->gateway_count * sizeof(struct lgtd_lifx_cache_gateway)
+        + header->bulb_count * sizeof(struct lgtd_lifx_cache_bulb);
+}
+
+static char *
+lgtd_lifx_cache_build(size_t *size)
+{
+    struct lgtd_lifx_cache_header header = {
+        .magic = LGTD_LIFX_CACHE_MAGIC, // not nul terminated, that's ok
+        .version = LGTD_LIFX_CACHE_VERSION
+    };
+    struct lgtd_lifx_gateway *gw;
+    LIST_FOREACH(gw, &lgtd_lifx_gateways, link) {
+        header.gateway_count++;
+        struct lgtd_lifx_bulb *bulb;
+        SLIST_FOREACH(bulb, &gw->bulbs, link_by_gw) {
+            header.bulb_count++;
+        }
+    }
+
+    *size = lgtd_lifx_cache_size(&header);
+    char *buf = calloc(1, *size);
+    if (!buf) {
+        return NULL;
+    }
+    memcpy(buf, &header, sizeof(header));
+    struct lgtd_lifx_cache_gateway *gw_records =
+        (struct lgtd_lifx_cache_gateway *)&buf[sizeof(header)];
+    struct lgtd_lifx_cache_bulb *bulb_records =
+        (struct lgtd_lifx_cache_bulb *)&gw_records[header.gateway_count];
+
+    uint32_t gw_idx = 0, bulb_idx = 0;
+    LIST_FOREACH(gw, &lgtd_lifx_gateways, link) {
+        struct lgtd_lifx_cache_gateway *gw_record = &gw_records[gw_idx];
+        assert(gw->peerlen <= sizeof(gw_record->peer));
+        memcpy(&gw_record->peer, gw->peer, gw->peerlen);
+        gw_record->peerlen = gw->peerlen;
+        memcpy(gw_record->site, gw->site.as_array, sizeof(gw_record->site));
+        gw_record->tag_ids = gw->tag_ids;
+        int tag_id;
+        LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, gw->tag_ids) {
+            memcpy(
+                gw_record->tag_labels[tag_id],
+                gw->tags[tag_id]->label,
+                LGTD_LIFX_LABEL_SIZE
+            );
+        }
+
+        struct lgtd_lifx_bulb *bulb;
+        SLIST_FOREACH(bulb, &gw->bulbs, link_by_gw) {
+            struct lgtd_lifx_cache_bulb *bulb_record = &bulb_records[bulb_idx];
+            memcpy(bulb_record->addr, bulb->addr, sizeof(bulb_record->addr));
+            bulb_record->gateway = gw_idx;
+            bulb_record->state = bulb->state;
+            bulb_record->product_info = bulb->product_info;
+            for (int ip = 0; ip != LGTD_LIFX_BULB_IP_COUNT; ip++) {
+                bulb_record->fw_info[ip] = bulb->ips[ip].fw_info;
+            }
+            bulb_idx++;
+        }
+        gw_idx++;
+    }
+
+    return buf;
+}
+
+static void
+lgtd_lifx_cache_unmap(void)
+{
+    if (lgtd_lifx_cache_map.data) {
+        munmap(lgtd_lifx_cache_map.data, lgtd_lifx_cache_map.size);
+        lgtd_lifx_cache_map.path = NULL;
+        lgtd_lifx_cache_map.data = NULL;
+        lgtd_lifx_cache_map.size = 0;
+    }
+}
+
+static void
+lgtd_lifx_cache_map_file(const char *path, size_t size)
+{
+    lgtd_lifx_cache_unmap();
+
+    int fd = open(path, O_RDWR);
+    if (fd == -1) {
+        return;
+    }
+    void *data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        lgtd_warn("can't map %s, the state will be fully rewritten", path);
+        return;
+    }
+
+    lgtd_lifx_cache_map.path = path;
+    lgtd_lifx_cache_map.data = data;
+    lgtd_lifx_cache_map.size = size;
+}
+
+static void
+lgtd_lifx_cache_set_flags(uint32_t flags, int msync_flags)
+{
+    struct lgtd_lifx_cache_header *header =
+        (struct lgtd_lifx_cache_header *)lgtd_lifx_cache_map.data;
+    header->flags = flags;
+    // the mapping starts on a page boundary and the header fits in the
+    // first page:
+    msync(lgtd_lifx_cache_map.data, sizeof(*header), msync_flags);
+}
+
+// Clear the DIRTY flag left by the previous updates once their records are
+// on disk:
+static void
+lgtd_lifx_cache_settle(void)
+{
+    const struct lgtd_lifx_cache_header *header =
+        (const struct lgtd_lifx_cache_header *)lgtd_lifx_cache_map.data;
+    if (!header || !(header->flags & LGTD_LIFX_CACHE_DIRTY)) {
+        return;
+    }
+
+    // most of it was already written back since the last update, if it
+    // doesn't reach the disk the file just stays dirty:
+    msync(lgtd_lifx_cache_map.data, lgtd_lifx_cache_map.size, MS_SYNC);
+    lgtd_lifx_cache_set_flags(0, MS_ASYNC);
+}
+
+// Copy the records that changed over the mapped file, returns false if the
+// layout changed and the file must be written again:
+static bool
+lgtd_lifx_cache_update_in_place(const char *path, const char *buf, size_t size)
+{
+    char *data = lgtd_lifx_cache_map.data;
+    if (!data
+        || strcmp(lgtd_lifx_cache_map.path, path)
+        || lgtd_lifx_cache_map.size != size) {
+        return false;
+    }
+
+    // the file can still be flagged dirty from the previous updates:
+    struct lgtd_lifx_cache_header mapped_header;
+    memcpy(&mapped_header, data, sizeof(mapped_header));
+    mapped_header.flags = 0;
+    if (memcmp(&mapped_header, buf, sizeof(mapped_header))) {
+        return false;
+    }
+
+    const char *records = &buf[sizeof(struct lgtd_lifx_cache_header)];
+    char *mapped_records = &data[sizeof(struct lgtd_lifx_cache_header)];
+    size_t records_size = size - sizeof(struct lgtd_lifx_cache_header);
+    if (!memcmp(mapped_records, records, records_size)) {
+        lgtd_lifx_cache_settle();
+        return true;
+    }
+
+    // A crash before the records are written back would leave a mix of old
+    // and new records behind, flag the file so it's ignored if that happens.
+    // The records are flushed asynchronously and the flag is only cleared
+    // by lgtd_lifx_cache_settle, once nothing changed for a whole interval:
+    const struct lgtd_lifx_cache_header *header =
+        (const struct lgtd_lifx_cache_header *)buf;
+    if (!(((struct lgtd_lifx_cache_header *)data)->flags
+          & LGTD_LIFX_CACHE_DIRTY)) {
+        lgtd_lifx_cache_set_flags(LGTD_LIFX_CACHE_DIRTY, MS_SYNC);
+    }
+
+    int updated = 0;
+    size_t offset = 0;
+    for (uint32_t i = 0; i != header->gateway_count + header->bulb_count; i++) {
+        size_t record_size = i < header->gateway_count ?
+            sizeof(struct lgtd_lifx_cache_gateway)
+            : sizeof(struct lgtd_lifx_cache_bulb);
+        if (memcmp(&mapped_records[offset], &records[offset], record_size)) {
+            memcpy(&mapped_records[offset], &records[offset], record_size);
+            updated++;
+        }
+        offset += record_size;
+    }
+    msync(data, size, MS_ASYNC);
+
+    lgtd_debug("updated %d records in %s", updated, path);
+    return true;
+}
+
+// Write a new file and move it over the previous one, so we never leave
+// a truncated file behind:
+static bool
+lgtd_lifx_cache_write(const char *path, const char *buf, size_t size)
+{
+    char tmp_path[PATH_MAX];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (n < 0 || n >= (int)sizeof(tmp_path)) {
+        lgtd_warnx("can't save the state to %s: path too long", path);
+        return false;
+    }
+    int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if (fd == -1) {
+        lgtd_warn("can't save the state to %s", tmp_path);
+        return false;
+    }
+    bool ok = lgtd_lifx_cache_write_all(fd, buf, size) && !fsync(fd);
+    ok = !close(fd) && ok;
+    if (!ok || rename(tmp_path, path)) {
+        lgtd_warn("can't save the state to %s", path);
+        unlink(tmp_path);
+        return false;
+    }
+
+    const struct lgtd_lifx_cache_header *header =
+        (const struct lgtd_lifx_cache_header *)buf;
+    lgtd_debug(
+        "saved %u gateways and %u bulbs to %s",
+        header->gateway_count, header->bulb_count, path
+    );
+    return true;
+}
+
+bool
+lgtd_lifx_cache_save(const char *path)
+{
+    assert(path);
+
+    size_t size;
+    char *buf = lgtd_lifx_cache_build(&size);
+    if (!buf) {
+        lgtd_warn("can't save the state to %s", path);
+        return false;
+    }
+
+    bool ok = lgtd_lifx_cache_update_in_place(path, buf, size);
+    if (!ok) {
+        // the previous mapping points to the file we are about to replace:
+        lgtd_lifx_cache_unmap();
+        ok = lgtd_lifx_cache_write(path, buf, size);
+        if (ok) {
+            lgtd_lifx_cache_map_file(path, size);
+        }
+    }
+
+    free(buf);
+    return ok;
+}
+
+static void
+lgtd_lifx_cache_restore_bulb(struct lgtd_lifx_gateway *gw,
+                             const struct lgtd_lifx_cache_bulb *record,
+                             lgtd_time_mono_t now)
+{
+    if (lgtd_lifx_bulb_get(record->addr)) {
+        return;
+    }
+
+    struct lgtd_lifx_bulb *bulb = lgtd_lifx_gateway_get_or_open_bulb(
+        gw, record->addr
+    );
+    if (!bulb) {
+        return;
+    }
+
+    struct lgtd_lifx_light_state state = record->state;
+    state.tags &= gw->tag_ids;
+    lgtd_lifx_bulb_set_light_state(bulb, &state, now);
+    bulb->stale = true;
+
+    if (record->product_info.vendor_id) {
+        lgtd_lifx_bulb_set_product_info(bulb, &record->product_info);
+    }
+    for (int ip = 0; ip != LGTD_LIFX_BULB_IP_COUNT; ip++) {
+        if (record->fw_info[ip].version) {
+            lgtd_lifx_bulb_set_ip_firmware_info(
+                bulb, ip, &record->fw_info[ip], now
+            );
+        }
+    }
+}
+
+static struct lgtd_lifx_gateway *
+lgtd_lifx_cache_restore_gateway(const struct lgtd_lifx_cache_gateway *record,
+                                lgtd_time_mono_t now)
+{
+    const struct sockaddr *peer = (const struct sockaddr *)&record->peer;
+    if (lgtd_lifx_gateway_get(peer, record->peerlen)) {
+        return NULL;
+    }
+
+    struct lgtd_lifx_gateway *gw = lgtd_lifx_gateway_open(
+        peer, record->peerlen, record->site, now
+    );
+    if (!gw) {
+        return NULL;
+    }
+
+    int tag_id;
+    LGTD_LIFX_WIRE_FOREACH_TAG_ID(tag_id, record->tag_ids) {
+        char label[LGTD_LIFX_LABEL_SIZE + 1] = { 0 };
+        memcpy(label, record->tag_labels[tag_id], LGTD_LIFX_LABEL_SIZE);
+        lgtd_lifx_gateway_allocate_tag_id(gw, tag_id, label);
+    }
+
+    // The gateway starts with a GET_LIGHT_STATE (see lgtd_lifx_gateway_open)
+    // also make sure it's still a gateway for this site:
+    lgtd_lifx_gateway_send_to_site(gw, LGTD_LIFX_GET_PAN_GATEWAY, NULL);
+
+    return gw;
+}
+
+static bool
+lgtd_lifx_cache_is_valid(const char *data, size_t size)
+{
+    const struct lgtd_lifx_cache_header *header =
+        (const struct lgtd_lifx_cache_header *)data;
+    if (size < sizeof(*header)
+        || memcmp(header->magic, LGTD_LIFX_CACHE_MAGIC, sizeof(header->magic))
+        || header->version != LGTD_LIFX_CACHE_VERSION
+        || header->flags & LGTD_LIFX_CACHE_DIRTY
+        || header->gateway_count > INT_MAX / sizeof(struct lgtd_lifx_cache_gateway)
+        || header->bulb_count > INT_MAX / sizeof(struct lgtd_lifx_cache_bulb)
+        || lgtd_lifx_cache_size(header) != size) {
+        return false;
+    }
+
+    const struct lgtd_lifx_cache_gateway *gws =
+        (const struct lgtd_lifx_cache_gateway *)&data[sizeof(*header)];
+    for (uint32_t i = 0; i != header->gateway_count; i++) {
+        if (gws[i].peerlen > sizeof(gws[i].peer)
+            || (gws[i].peer.ss_family != AF_INET
+                && gws[i].peer.ss_family != AF_INET6)) {
+            return false;
+        }
+    }
+    const struct lgtd_lifx_cache_bulb *bulbs =
+        (const struct lgtd_lifx_cache_bulb *)&gws[header->gateway_count];
+    for (uint32_t i = 0; i != header->bulb_count; i++) {
+        if (bulbs[i].gateway >= header->gateway_count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Returns the number of gateways restored, -1 if the file couldn't be read:
+int
+lgtd_lifx_cache_load(const char *path)
+{
+    assert(path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            lgtd_warn("can't load the state from %s", path);
+        }
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        lgtd_warn("can't load the state from %s", path);
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    char *data = size ?
+        mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED || !lgtd_lifx_cache_is_valid(data, size)) {
+        lgtd_warnx("ignoring invalid or outdated state file %s", path);
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+        return -1;
+    }
+
+    const struct lgtd_lifx_cache_header *header =
+        (const struct lgtd_lifx_cache_header *)data;
+    const struct lgtd_lifx_cache_gateway *gw_records =
+        (const struct lgtd_lifx_cache_gateway *)&data[sizeof(*header)];
+    const struct lgtd_lifx_cache_bulb *bulb_records =
+        (const struct lgtd_lifx_cache_bulb *)&gw_records[header->gateway_count];
+
+    int gateway_count = header->gateway_count;
+    struct lgtd_lifx_gateway **gws = calloc(
+        gateway_count ? gateway_count : 1, sizeof(*gws)
+    );
+    if (!gws) {
+        lgtd_warn("can't load the state from %s", path);
+        munmap(data, size);
+        return -1;
+    }
+
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    for (int i = 0; i != gateway_count; i++) {
+        gws[i] = lgtd_lifx_cache_restore_gateway(&gw_records[i], now);
+    }
+    for (uint32_t i = 0; i != header->bulb_count; i++) {
+        struct lgtd_lifx_gateway *gw = gws[bulb_records[i].gateway];
+        if (gw) {
+            lgtd_lifx_cache_restore_bulb(gw, &bulb_records[i], now);
+        }
+    }
+    lgtd_info(
+        "restored %u gateways and %u bulbs from %s",
+        header->gateway_count, header->bulb_count, path
+    );
+
+    free(gws);
+    munmap(data, size);
+    return gateway_count;
+}
+
+static void
+lgtd_lifx_cache_save_callback(struct lgtd_timer *timer,
+                              union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    (void)ctx;
+
+    lgtd_lifx_cache_save(lgtd_opts.lifx_state_file);
+}
+
+bool
+lgtd_lifx_cache_start(void)
+{
+    assert(lgtd_opts.lifx_state_file);
+    assert(!lgtd_lifx_cache_timer);
+
+    union lgtd_timer_ctx ctx = { .as_ptr = NULL };
+    lgtd_lifx_cache_timer = lgtd_timer_start(
+        LGTD_TIMER_PERSISTENT,
+        LGTD_LIFX_CACHE_SAVE_INTERVAL_MSECS,
+        lgtd_lifx_cache_save_callback,
+        ctx
+    );
+    return lgtd_lifx_cache_timer != NULL;
+}
+
+void
+lgtd_lifx_cache_close(void)
+{
+    if (lgtd_lifx_cache_timer) {
+        lgtd_timer_stop(lgtd_lifx_cache_timer);
+        lgtd_lifx_cache_timer = NULL;
+        lgtd_lifx_cache_save(lgtd_opts.lifx_state_file);
+    }
+    lgtd_lifx_cache_settle();
+    lgtd_lifx_cache_unmap();
+}
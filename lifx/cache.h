@@ -0,0 +1,67 @@
+// Copyright (c) 2015, Louis Opter <kalessin@kalessin.fr>
+//
+// This file is part of lighstd.
+//
+// lighstd is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// lighstd is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with lighstd.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+// The gateways and bulbs known by lightsd are saved in the file given with
+// --lifx-state-file and restored when it starts again, so that clients get
+// the last known state of the bulbs right away instead of waiting for the
+// discovery. The file is made of fixed size records in the host byte order
+// (it isn't meant to be moved between machines): a header, the gateways,
+// then the bulbs. It's mapped in memory to be loaded without any parsing and
+// only the records that changed are written back, see lgtd_lifx_cache_save.
+
+enum { LGTD_LIFX_CACHE_VERSION = 2 };
+enum { LGTD_LIFX_CACHE_SAVE_INTERVAL_MSECS = 10 * 1000 };
+
+#define LGTD_LIFX_CACHE_MAGIC "LGTDLIFX"
+
+enum lgtd_lifx_cache_flags {
+    // Set while records updated in place may not be on disk yet, a file
+    // with this flag set was only partially written and is ignored:
+    LGTD_LIFX_CACHE_DIRTY = 1
+};
+
+struct lgtd_lifx_cache_header {
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                flags;
+    uint32_t                gateway_count;
+    uint32_t                bulb_count;
+};
+
+struct lgtd_lifx_cache_gateway {
+    struct sockaddr_storage peer;
+    uint32_t                peerlen;
+    uint8_t                 site[LGTD_LIFX_ADDR_LENGTH];
+    uint64_t                tag_ids;
+    char                    tag_labels[LGTD_LIFX_GATEWAY_MAX_TAGS][LGTD_LIFX_LABEL_SIZE];
+};
+
+struct lgtd_lifx_cache_bulb {
+    uint8_t                             addr[LGTD_LIFX_ADDR_LENGTH];
+    uint32_t                            gateway; // index in the gateway records
+    struct lgtd_lifx_light_state        state;
+    struct lgtd_lifx_product_info       product_info;
+    struct lgtd_lifx_ip_firmware_info   fw_info[LGTD_LIFX_BULB_IP_COUNT];
+};
+
+bool lgtd_lifx_cache_save(const char *);
+int lgtd_lifx_cache_load(const char *);
+bool lgtd_lifx_cache_start(void);
+void lgtd_lifx_cache_close(void);
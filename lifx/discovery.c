@@ -75,6 +75,36 @@ lgtd_lifx_discovery_timeout_event_callback(evutil_socket_t socket,
     }
 }
 
+// Arm the watchdog for the next bulb or gateway to time out, the oldest ones
+// are at the head of their lists:
+static void
+lgtd_lifx_discovery_schedule_watchdog(lgtd_time_mono_t now)
+{
+    const struct lgtd_lifx_bulb *bulb = TAILQ_FIRST(
+        &lgtd_lifx_bulbs_by_light_state_age
+    );
+    const struct lgtd_lifx_gateway *gw = TAILQ_FIRST(
+        &lgtd_lifx_gateways_by_last_pkt
+    );
+    if (!bulb && !gw) {
+        lgtd_debug("nothing left to watch, stopping watchdog timer");
+        return;
+    }
+
+    lgtd_time_mono_t oldest_update_at = bulb ? bulb->last_light_state_at : now;
+    if (gw) {
+        oldest_update_at = LGTD_MIN(oldest_update_at, gw->last_pkt_at);
+    }
+    lgtd_time_mono_t deadline =
+        oldest_update_at + LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS;
+    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(
+        deadline > now ? deadline - now : 0
+    );
+    if (event_add(lgtd_watchdog_interval_ev, &tv)) {
+        lgtd_err(1, "can't start watchdog");
+    }
+}
+
 static void
 lgtd_lifx_discovery_watchdog_interval_callback(evutil_socket_t socket,
                                                short events,
@@ -87,49 +117,38 @@ lgtd_lifx_discovery_watchdog_interval_callback(evutil_socket_t socket,
     bool start_discovery = false;
     lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
 
-    struct lgtd_lifx_bulb *bulb, *next_bulb;
-    RB_FOREACH_SAFE(
-        bulb,
-        lgtd_lifx_bulb_map,
-        &lgtd_lifx_bulbs_table,
-        next_bulb
-    ) {
+    // Only the bulbs and gateways that timed out are visited, the first one
+    // that didn't means that the following ones didn't either:
+    struct lgtd_lifx_bulb *bulb;
+    while ((bulb = TAILQ_FIRST(&lgtd_lifx_bulbs_by_light_state_age))) {
         int light_state_lag = now - bulb->last_light_state_at;
-        if (light_state_lag >= LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS) {
-            lgtd_info(
-                "closing bulb \"%.*s\" that hasn't been updated for %dms",
-                LGTD_LIFX_LABEL_SIZE, bulb->state.label, light_state_lag
-            );
-            lgtd_lifx_gateway_remove_and_close_bulb(bulb->gw, bulb);
-            start_discovery = true;
-            continue;
+        if (light_state_lag < LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS) {
+            break;
         }
+        lgtd_info(
+            "closing bulb \"%.*s\" that hasn't been updated for %dms",
+            LGTD_LIFX_LABEL_SIZE, bulb->state.label, light_state_lag
+        );
+        lgtd_lifx_gateway_remove_and_close_bulb(bulb->gw, bulb);
+        start_discovery = true;
     }
 
     // Repeat for the gateways, we could also look if we are removing the last
     // bulb on the gateway but this will also support architectures where
-    // gateways aren't bulbs themselves:
-    struct lgtd_lifx_gateway *gw, *next_gw;
-    LIST_FOREACH_SAFE(gw, &lgtd_lifx_gateways, link, next_gw) {
-        // The gateway latency is the difference during the last round-trip-time
-        // (RTT) and has been a PITA to get right (it's off sometimes). Anyway,
-        // here we are interested in a timeout: how much time elapsed since the
-        // last update, this is different than the last RTT.
-        int gw_lag = lgtd_lifx_gateway_msecs_since_last_update(gw);
-        if (gw_lag >= LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS) {
-            lgtd_info(
-                "closing bulb gateway %s that hasn't received traffic for %dms",
-                gw->peeraddr, gw_lag
-            );
-            lgtd_lifx_gateway_close(gw);
-            start_discovery = true;
-        } else if (gw_lag >= LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_MSECS) {
-            lgtd_info(
-                "no update on bulb gateway %s for %dms, forcing refresh",
-                gw->peeraddr, gw_lag
-            );
-            lgtd_lifx_gateway_force_refresh(gw);
+    // gateways aren't bulbs themselves. Gateways that are just late get their
+    // refresh forced by their own watchdog timer, see gateway.c:
+    struct lgtd_lifx_gateway *gw;
+    while ((gw = TAILQ_FIRST(&lgtd_lifx_gateways_by_last_pkt))) {
+        int gw_lag = now - gw->last_pkt_at;
+        if (gw_lag < LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS) {
+            break;
         }
+        lgtd_info(
+            "closing bulb gateway %s that hasn't received traffic for %dms",
+            gw->peeraddr, gw_lag
+        );
+        lgtd_lifx_gateway_close(gw);
+        start_discovery = true;
     }
 
     // If anything happens restart a discovery right away, maybe something just
@@ -137,6 +156,8 @@ lgtd_lifx_discovery_watchdog_interval_callback(evutil_socket_t socket,
     if (start_discovery) {
         lgtd_lifx_broadcast_discovery();
     }
+
+    lgtd_lifx_discovery_schedule_watchdog(now);
 }
 
 bool
@@ -155,7 +176,7 @@ lgtd_lifx_discovery_setup(void)
     lgtd_watchdog_interval_ev = event_new(
         lgtd_ev_base,
         -1,
-        EV_PERSIST,
+        0,
         lgtd_lifx_discovery_watchdog_interval_callback,
         NULL
     );
@@ -189,17 +210,14 @@ void
 lgtd_lifx_discovery_start_watchdog(void)
 {
     assert(
-        !RB_EMPTY(&lgtd_lifx_bulbs_table) || !LIST_EMPTY(&lgtd_lifx_gateways)
+        !LGTD_LIFX_BULB_TABLE_EMPTY() || !LIST_EMPTY(&lgtd_lifx_gateways)
     );
 
+    // Devices are added with the most recent update time, so if the watchdog
+    // is already armed it will fire first for one of the existing devices:
     bool pending = evtimer_pending(lgtd_watchdog_interval_ev, NULL);
     if (!pending) {
-        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(
-            LGTD_LIFX_DISCOVERY_WATCHDOG_INTERVAL_MSECS
-        );
-        if (event_add(lgtd_watchdog_interval_ev, &tv)) {
-            lgtd_err(1, "can't start watchdog");
-        }
+        lgtd_lifx_discovery_schedule_watchdog(lgtd_time_monotonic_msecs());
         lgtd_debug("starting watchdog timer");
     }
 }
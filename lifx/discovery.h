@@ -18,9 +18,12 @@
 #pragma once
 
 enum lgtd_lifx_discovery_constants {
-    LGTD_LIFX_DISCOVERY_WATCHDOG_INTERVAL_MSECS = 500,
     LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS = 20000,
+    // Refresh a device at least this often so it doesn't time out when idle:
+    LGTD_LIFX_DISCOVERY_DEVICE_MAX_REFRESH_INTERVAL_MSECS =
+        LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS / 2,
     LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_MSECS = 2000,
+    LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_RETRY_MSECS = 500,
     LGTD_LIFX_DISCOVERY_ACTIVE_DISCOVERY_INTERVAL_MSECS = 2000,
     LGTD_LIFX_DISCOVERY_PASSIVE_DISCOVERY_INTERVAL_MSECS = 10000,
 };
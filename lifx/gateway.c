@@ -17,6 +17,7 @@
 
 #include <sys/queue.h>
 #include <sys/tree.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 #include <assert.h>
 #include <endian.h>
@@ -25,12 +26,12 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include <event2/event.h>
-#include <event2/buffer.h>
 #include <event2/util.h>
 
 #include "wire_proto.h"
@@ -53,20 +54,327 @@
 struct lgtd_lifx_gateway_list lgtd_lifx_gateways =
     LIST_HEAD_INITIALIZER(&lgtd_lifx_gateways);
 
+struct lgtd_lifx_gateway_queue lgtd_lifx_gateways_by_last_pkt =
+    TAILQ_HEAD_INITIALIZER(lgtd_lifx_gateways_by_last_pkt);
+
+// Gateways indexed by peer address, so we can route packets received on the
+// broadcast or shared sockets without walking the whole gateway list:
+static struct {
+    struct lgtd_lifx_gateway_list   *buckets;
+    int                             nbuckets;
+    int                             count;
+} lgtd_lifx_gateway_peers = { NULL, 0, 0 };
+
+enum { LGTD_LIFX_GATEWAY_PEERS_MIN_BUCKETS = 16 };
+
+TAILQ_HEAD(lgtd_lifx_gateway_write_queue, lgtd_lifx_gateway);
+
+static struct {
+    evutil_socket_t                         socket;
+    struct event                            *read_ev;
+    struct event                            *write_ev;
+    struct lgtd_lifx_gateway_write_queue    pending_writes;
+    int                                     refcount;
+} lgtd_lifx_gateway_shared_endpoint = {
+    .socket = -1,
+    .read_ev = NULL,
+    .write_ev = NULL,
+    .pending_writes = TAILQ_HEAD_INITIALIZER(
+        lgtd_lifx_gateway_shared_endpoint.pending_writes
+    ),
+    .refcount = 0
+};
+
+static struct lgtd_lifx_gateway_list *
+lgtd_lifx_gateway_peer_bucket(const struct sockaddr *peer,
+                              ev_socklen_t peerlen)
+{
+    assert(lgtd_lifx_gateway_peers.nbuckets);
+
+    // the peer is always zero-filled past its actual address:
+    uint32_t hash = lgtd_fnv1a(peer, peerlen, 0);
+    int idx = hash & (lgtd_lifx_gateway_peers.nbuckets - 1);
+    return &lgtd_lifx_gateway_peers.buckets[idx];
+}
+
+static bool
+lgtd_lifx_gateway_resize_peers(int nbuckets)
+{
+    struct lgtd_lifx_gateway_list *buckets = calloc(nbuckets, sizeof(*buckets));
+    if (!buckets) {
+        return false;
+    }
+
+    struct lgtd_lifx_gateway_list *old_buckets = lgtd_lifx_gateway_peers.buckets;
+    int old_nbuckets = lgtd_lifx_gateway_peers.nbuckets;
+    lgtd_lifx_gateway_peers.buckets = buckets;
+    lgtd_lifx_gateway_peers.nbuckets = nbuckets;
+    for (int i = 0; i != old_nbuckets; i++) {
+        while (!LIST_EMPTY(&old_buckets[i])) {
+            struct lgtd_lifx_gateway *gw = LIST_FIRST(&old_buckets[i]);
+            LIST_REMOVE(gw, link_by_peer);
+            struct lgtd_lifx_gateway_list *bucket;
+            bucket = lgtd_lifx_gateway_peer_bucket(gw->peer, gw->peerlen);
+            LIST_INSERT_HEAD(bucket, gw, link_by_peer);
+        }
+    }
+    free(old_buckets);
+
+    return true;
+}
+
+static bool
+lgtd_lifx_gateway_index_peer(struct lgtd_lifx_gateway *gw)
+{
+    assert(gw);
+    assert(gw->peer);
+
+    if (!lgtd_lifx_gateway_peers.nbuckets) {
+        int nbuckets = LGTD_LIFX_GATEWAY_PEERS_MIN_BUCKETS;
+        if (!lgtd_lifx_gateway_resize_peers(nbuckets)) {
+            return false;
+        }
+    } else if (lgtd_lifx_gateway_peers.count == lgtd_lifx_gateway_peers.nbuckets) {
+        // Lookups stay correct (just slower) if we can't grow the table:
+        lgtd_lifx_gateway_resize_peers(lgtd_lifx_gateway_peers.nbuckets * 2);
+    }
+
+    struct lgtd_lifx_gateway_list *bucket;
+    bucket = lgtd_lifx_gateway_peer_bucket(gw->peer, gw->peerlen);
+    LIST_INSERT_HEAD(bucket, gw, link_by_peer);
+    lgtd_lifx_gateway_peers.count++;
+
+    return true;
+}
+
+static void
+lgtd_lifx_gateway_unindex_peer(struct lgtd_lifx_gateway *gw)
+{
+    assert(gw);
+    assert(lgtd_lifx_gateway_peers.count > 0);
+
+    LIST_REMOVE(gw, link_by_peer);
+    if (!--lgtd_lifx_gateway_peers.count) {
+        free(lgtd_lifx_gateway_peers.buckets);
+        lgtd_lifx_gateway_peers.buckets = NULL;
+        lgtd_lifx_gateway_peers.nbuckets = 0;
+    }
+}
+
+static void
+lgtd_lifx_gateway_close_shared_endpoint(void)
+{
+    assert(TAILQ_EMPTY(&lgtd_lifx_gateway_shared_endpoint.pending_writes));
+
+    if (lgtd_lifx_gateway_shared_endpoint.read_ev) {
+        event_del(lgtd_lifx_gateway_shared_endpoint.read_ev);
+        event_free(lgtd_lifx_gateway_shared_endpoint.read_ev);
+        lgtd_lifx_gateway_shared_endpoint.read_ev = NULL;
+    }
+    if (lgtd_lifx_gateway_shared_endpoint.write_ev) {
+        event_del(lgtd_lifx_gateway_shared_endpoint.write_ev);
+        event_free(lgtd_lifx_gateway_shared_endpoint.write_ev);
+        lgtd_lifx_gateway_shared_endpoint.write_ev = NULL;
+    }
+    if (lgtd_lifx_gateway_shared_endpoint.socket != -1) {
+        evutil_closesocket(lgtd_lifx_gateway_shared_endpoint.socket);
+        lgtd_lifx_gateway_shared_endpoint.socket = -1;
+    }
+}
+
+static void
+lgtd_lifx_gateway_count_refresh_reason(enum lgtd_lifx_gateway_refresh_reason reason,
+                                       int value)
+{
+    static const int offsets[] = {
+        [LGTD_LIFX_GATEWAY_REFRESH_COMMAND] =
+            offsetof(struct lgtd_stats, gateways_refresh_command),
+        [LGTD_LIFX_GATEWAY_REFRESH_CLIENT] =
+            offsetof(struct lgtd_stats, gateways_refresh_client),
+        [LGTD_LIFX_GATEWAY_REFRESH_CHURN] =
+            offsetof(struct lgtd_stats, gateways_refresh_churn),
+        [LGTD_LIFX_GATEWAY_REFRESH_IDLE] =
+            offsetof(struct lgtd_stats, gateways_refresh_idle)
+    };
+
+    if (reason != LGTD_LIFX_GATEWAY_REFRESH_NONE) {
+        lgtd_stats_add(offsets[reason], value);
+    }
+}
+
+static uint8_t
+lgtd_lifx_gateway_message_seqn(const struct lgtd_lifx_message *msg)
+{
+    return ((const struct lgtd_lifx_packet_header *)msg->data)->seqn;
+}
+
+static void
+lgtd_lifx_gateway_free_message(struct lgtd_lifx_gateway *gw,
+                               struct lgtd_lifx_message *msg)
+{
+    uint8_t seqn = lgtd_lifx_gateway_message_seqn(msg);
+    if (gw->unacked_by_seqn[seqn] == msg) {
+        gw->unacked_by_seqn[seqn] = NULL;
+    }
+    free(msg->bulbs);
+    free(msg);
+}
+
+static void
+lgtd_lifx_gateway_unqueue_message(struct lgtd_lifx_gateway *gw,
+                                  enum lgtd_lifx_gateway_priority prio,
+                                  struct lgtd_lifx_message *msg)
+{
+    TAILQ_REMOVE(&gw->pkt_queues[prio], msg, link);
+    gw->pkt_queues_bytes -= msg->size;
+    assert(gw->pkt_queues_bytes >= 0);
+}
+
+static void
+lgtd_lifx_gateway_remove_message(struct lgtd_lifx_gateway *gw,
+                                 enum lgtd_lifx_gateway_priority prio,
+                                 struct lgtd_lifx_message *msg)
+{
+    lgtd_lifx_gateway_unqueue_message(gw, prio, msg);
+    lgtd_lifx_gateway_free_message(gw, msg);
+}
+
+static void
+lgtd_lifx_gateway_clear_pkt_queues(struct lgtd_lifx_gateway *gw)
+{
+    for (int prio = 0; prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT; prio++) {
+        while (!TAILQ_EMPTY(&gw->pkt_queues[prio])) {
+            lgtd_lifx_gateway_remove_message(
+                gw, prio, TAILQ_FIRST(&gw->pkt_queues[prio])
+            );
+        }
+    }
+    while (!TAILQ_EMPTY(&gw->unacked_msgs)) {
+        struct lgtd_lifx_message *msg = TAILQ_FIRST(&gw->unacked_msgs);
+        TAILQ_REMOVE(&gw->unacked_msgs, msg, link);
+        lgtd_lifx_gateway_free_message(gw, msg);
+    }
+}
+
+static void
+lgtd_lifx_gateway_add_rtt_sample(struct lgtd_lifx_gateway *gw, int sample)
+{
+    assert(sample >= 0);
+
+    struct lgtd_lifx_gateway_rtt *rtt = &gw->rtt;
+    if (!rtt->samples) {
+        rtt->srtt_x8 = sample << 3;
+        rtt->rttvar_x4 = sample << 1;
+    } else {
+        // srtt += (sample - srtt) / 8 and rttvar += (|delta| - rttvar) / 4:
+        int delta = sample - (rtt->srtt_x8 >> 3);
+        rtt->srtt_x8 += delta;
+        delta = delta < 0 ? -delta : delta;
+        rtt->rttvar_x4 += delta - (rtt->rttvar_x4 >> 2);
+    }
+    rtt->samples++;
+
+    int bucket = 0;
+    while (sample && bucket != LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE - 1) {
+        sample >>= 1;
+        bucket++;
+    }
+    rtt->histogram[bucket]++;
+}
+
+// Use the packet as an RTT sample if it's the first response to a request
+// we sent to this gateway:
+static void
+lgtd_lifx_gateway_match_response(struct lgtd_lifx_gateway *gw,
+                                 const struct lgtd_lifx_packet_header *hdr,
+                                 lgtd_time_mono_t received_at)
+{
+    if (hdr->source != lgtd_lifx_wire_get_client_id()) {
+        return;
+    }
+
+    lgtd_time_mono_t sent_at = gw->rtt.sent_at[hdr->seqn];
+    if (!sent_at || sent_at > received_at) {
+        return;
+    }
+    gw->rtt.sent_at[hdr->seqn] = 0;
+
+    lgtd_time_mono_t sample = received_at - sent_at;
+    if (sample <= LGTD_LIFX_GATEWAY_MAX_RTT_SAMPLE_MSECS) {
+        lgtd_lifx_gateway_add_rtt_sample(gw, (int)sample);
+    }
+}
+
+static void
+lgtd_lifx_gateway_log_rtt(const struct lgtd_lifx_gateway *gw)
+{
+    if (!gw->rtt.samples) {
+        return;
+    }
+
+    char histogram[LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE * 32];
+    int len = 0;
+    for (int i = 0; i != LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE; i++) {
+        if (!gw->rtt.histogram[i]) {
+            continue;
+        }
+        const char *op = i == LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE - 1 ?
+            ">=" : "<";
+        int bound = i == LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE - 1 ?
+            1 << (i - 1) : 1 << i;
+        len += snprintf(
+            &histogram[len], sizeof(histogram) - len, "%s%s%dms: %d",
+            len ? ", " : "", op, bound, gw->rtt.histogram[i]
+        );
+    }
+
+    lgtd_debug(
+        "rtt to %s over %d samples: srtt=%dms, rttvar=%dms (%s)",
+        gw->peeraddr, gw->rtt.samples,
+        gw->rtt.srtt_x8 >> 3, gw->rtt.rttvar_x4 >> 2, histogram
+    );
+}
+
 void
 lgtd_lifx_gateway_close(struct lgtd_lifx_gateway *gw)
 {
     assert(gw);
 
+    lgtd_lifx_gateway_count_refresh_reason(gw->refresh_reason, -1);
     LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(gateways, -1);
     lgtd_timer_stop(gw->refresh_timer);
-    event_del(gw->socket_ev);
-    if (gw->socket != -1) {
-        evutil_closesocket(gw->socket);
+    lgtd_timer_stop(gw->watchdog_timer);
+    if (gw->retransmit_timer) {
+        lgtd_timer_stop(gw->retransmit_timer);
+    }
+    if (gw->shared_socket) {
+        if (gw->pending_write) {
+            TAILQ_REMOVE(
+                &lgtd_lifx_gateway_shared_endpoint.pending_writes,
+                gw,
+                link_by_pending_write
+            );
+        }
+        lgtd_lifx_gateway_unindex_peer(gw);
         LIST_REMOVE(gw, link);
+        TAILQ_REMOVE(&lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt);
+        if (!--lgtd_lifx_gateway_shared_endpoint.refcount) {
+            lgtd_lifx_gateway_close_shared_endpoint();
+        }
+    } else {
+        event_del(gw->socket_ev);
+        if (gw->socket != -1) {
+            evutil_closesocket(gw->socket);
+            lgtd_lifx_gateway_unindex_peer(gw);
+            LIST_REMOVE(gw, link);
+            TAILQ_REMOVE(
+                &lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt
+            );
+        }
+        event_free(gw->socket_ev);
     }
-    event_free(gw->socket_ev);
-    evbuffer_free(gw->write_buf);
+    lgtd_lifx_gateway_clear_pkt_queues(gw);
+    lgtd_lifx_gateway_log_rtt(gw);
     for (int i = 0; i != LGTD_LIFX_GATEWAY_MAX_TAGS; i++) {
         if (gw->tags[i]) {
             lgtd_lifx_tagging_decref(gw->tags[i], gw);
@@ -133,27 +441,549 @@ lgtd_lifx_gateway_handle_packet(struct lgtd_lifx_gateway *gw,
         }
     }
 
-    if (gw) {
-        // gw->last_pkt_at is used to compute timeouts based on known
-        // traffic only:
-        if (pkt_info->handle != lgtd_lifx_wire_enosys_packet_handler) {
-            gw->last_pkt_at = received_at;
-        }
-        pkt_info->handle(gw, hdr, pkt);
-    } else {
-        bool addressable = hdr->protocol & LGTD_LIFX_PROTOCOL_ADDRESSABLE;
-        bool tagged = hdr->protocol & LGTD_LIFX_PROTOCOL_TAGGED;
-        unsigned int protocol = hdr->protocol & LGTD_LIFX_PROTOCOL_VERSION_MASK;
-        char target[LGTD_LIFX_ADDR_STRLEN], peer_addr[INET6_ADDRSTRLEN];
-        LGTD_LIFX_WIRE_PRINT_TARGET(hdr, target);
-        LGTD_SOCKADDRTOA(peer, peer_addr);
-        lgtd_info(
-            "%s <-- %s - (Packet from unknown client or gateway, header "
-            "info: addressable=%d, tagged=%d, protocol=%d, target=%s)",
-            pkt_info->name, peer_addr, addressable, tagged, protocol, target
+    if (gw) {
+        // gw->last_pkt_at is used to compute timeouts based on known
+        // traffic only:
+        if (pkt_info->handle != lgtd_lifx_wire_enosys_packet_handler) {
+            gw->last_pkt_at = received_at;
+            TAILQ_REMOVE(
+                &lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt
+            );
+            TAILQ_INSERT_TAIL(
+                &lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt
+            );
+        }
+        lgtd_lifx_gateway_match_response(gw, hdr, received_at);
+        pkt_info->handle(gw, hdr, pkt);
+    } else {
+        bool addressable = hdr->protocol & LGTD_LIFX_PROTOCOL_ADDRESSABLE;
+        bool tagged = hdr->protocol & LGTD_LIFX_PROTOCOL_TAGGED;
+        unsigned int protocol = hdr->protocol & LGTD_LIFX_PROTOCOL_VERSION_MASK;
+        char target[LGTD_LIFX_ADDR_STRLEN], peer_addr[INET6_ADDRSTRLEN];
+        LGTD_LIFX_WIRE_PRINT_TARGET(hdr, target);
+        LGTD_SOCKADDRTOA(peer, peer_addr);
+        lgtd_info(
+            "%s <-- %s - (Packet from unknown client or gateway, header "
+            "info: addressable=%d, tagged=%d, protocol=%d, target=%s)",
+            pkt_info->name, peer_addr, addressable, tagged, protocol, target
+        );
+    }
+}
+
+static bool
+lgtd_lifx_gateway_has_pending_packets(const struct lgtd_lifx_gateway *gw)
+{
+    return gw->pkt_queues_bytes != 0;
+}
+
+static bool
+lgtd_lifx_gateway_same_destination(const struct lgtd_lifx_packet_header *a,
+                                   const struct lgtd_lifx_packet_header *b)
+{
+    return a->protocol == b->protocol
+        && !memcmp(&a->target, &b->target, sizeof(a->target))
+        && !memcmp(a->site, b->site, sizeof(a->site))
+        && a->at_time == b->at_time;
+}
+
+static void
+lgtd_lifx_gateway_schedule_write(struct lgtd_lifx_gateway *gw)
+{
+    if (gw->shared_socket) {
+        if (!gw->pending_write) {
+            TAILQ_INSERT_TAIL(
+                &lgtd_lifx_gateway_shared_endpoint.pending_writes,
+                gw,
+                link_by_pending_write
+            );
+            gw->pending_write = true;
+        }
+        event_add(lgtd_lifx_gateway_shared_endpoint.write_ev, NULL);
+    } else {
+        event_add(gw->socket_ev, NULL);
+    }
+}
+
+static bool
+lgtd_lifx_gateway_message_wants_ack(const struct lgtd_lifx_message *msg)
+{
+    const struct lgtd_lifx_packet_header *hdr = (const void *)msg->data;
+    return hdr->flags & LGTD_LIFX_FLAG_ACK_REQUIRED;
+}
+
+static bool
+lgtd_lifx_gateway_message_is_tagged(const struct lgtd_lifx_message *msg)
+{
+    const struct lgtd_lifx_packet_header *hdr = (const void *)msg->data;
+    return hdr->protocol & LGTD_LIFX_PROTOCOL_TAGGED;
+}
+
+static void
+lgtd_lifx_gateway_set_delivery(struct lgtd_lifx_gateway *gw,
+                               const uint8_t *addr,
+                               enum lgtd_lifx_bulb_delivery delivery)
+{
+    struct lgtd_lifx_bulb *bulb = lgtd_lifx_bulb_get(addr);
+    if (bulb && bulb->gw == gw) {
+        bulb->delivery = delivery;
+    }
+}
+
+// Figure out which bulbs of the gateway should acknowledge the message, from
+// the target in its (encoded) header:
+static bool
+lgtd_lifx_gateway_expect_acks(struct lgtd_lifx_gateway *gw,
+                              struct lgtd_lifx_message *msg)
+{
+    const struct lgtd_lifx_packet_header *hdr = (const void *)msg->data;
+    bool tagged = lgtd_lifx_gateway_message_is_tagged(msg);
+    uint64_t tags = le64toh(hdr->target.tags);
+
+    int nbulbs = 0;
+    struct lgtd_lifx_bulb *bulb;
+    SLIST_FOREACH(bulb, &gw->bulbs, link_by_gw) {
+        nbulbs++;
+    }
+    if (!nbulbs) {
+        return false;
+    }
+    msg->bulbs = calloc(nbulbs, sizeof(*msg->bulbs));
+    if (!msg->bulbs) {
+        lgtd_warn("can't track the delivery of a packet to %s", gw->peeraddr);
+        return false;
+    }
+
+    msg->nbulbs = 0;
+    SLIST_FOREACH(bulb, &gw->bulbs, link_by_gw) {
+        bool targeted;
+        if (tagged) {
+            targeted = !tags || bulb->state.tags & tags;
+        } else {
+            targeted = !memcmp(
+                bulb->addr, hdr->target.device_addr, sizeof(bulb->addr)
+            );
+        }
+        if (targeted) {
+            memcpy(msg->bulbs[msg->nbulbs++], bulb->addr, sizeof(bulb->addr));
+            bulb->delivery = LGTD_LIFX_BULB_DELIVERY_PENDING;
+        }
+    }
+
+    return msg->nbulbs != 0;
+}
+
+// Remove the copies of msg queued to be retransmitted to the bulb at addr, or
+// to all its bulbs if addr is NULL:
+static void
+lgtd_lifx_gateway_drop_retransmit_copies(struct lgtd_lifx_gateway *gw,
+                                         const struct lgtd_lifx_message *msg,
+                                         const uint8_t *addr)
+{
+    struct lgtd_lifx_message *copy, *next_copy;
+    TAILQ_FOREACH_SAFE(
+        copy, &gw->pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH], link, next_copy
+    ) {
+        if (copy->retransmit_of != msg) {
+            continue;
+        }
+        const struct lgtd_lifx_packet_header *hdr = (const void *)copy->data;
+        if (!addr
+            || !memcmp(hdr->target.device_addr, addr, LGTD_LIFX_ADDR_LENGTH)) {
+            lgtd_lifx_gateway_remove_message(
+                gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH, copy
+            );
+        }
+    }
+}
+
+// Stop waiting for the bulb at addr to acknowledge msg, return false if that
+// bulb wasn't expected to:
+static bool
+lgtd_lifx_gateway_forget_unacked_bulb(struct lgtd_lifx_gateway *gw,
+                                      struct lgtd_lifx_message *msg,
+                                      const uint8_t *addr)
+{
+    for (int i = 0; i != msg->nbulbs; i++) {
+        if (!memcmp(msg->bulbs[i], addr, LGTD_LIFX_ADDR_LENGTH)) {
+            memmove(
+                msg->bulbs[i], msg->bulbs[--msg->nbulbs], LGTD_LIFX_ADDR_LENGTH
+            );
+            lgtd_lifx_gateway_drop_retransmit_copies(gw, msg, addr);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Forget about a message that was waiting for acks, either because all of its
+// bulbs acknowledged it or because it's superseded by a newer message:
+static void
+lgtd_lifx_gateway_release_unacked(struct lgtd_lifx_gateway *gw,
+                                  struct lgtd_lifx_message *msg)
+{
+    lgtd_lifx_gateway_drop_retransmit_copies(gw, msg, NULL);
+    if (msg->in_flight) {
+        TAILQ_REMOVE(&gw->unacked_msgs, msg, link);
+    } else { // queued again to be retransmitted
+        lgtd_lifx_gateway_unqueue_message(
+            gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH, msg
+        );
+    }
+    lgtd_lifx_gateway_free_message(gw, msg);
+}
+
+static lgtd_time_mono_t
+lgtd_lifx_gateway_retransmit_at(const struct lgtd_lifx_gateway *gw,
+                                const struct lgtd_lifx_message *msg)
+{
+    int rto = LGTD_MAX(
+        (int)lgtd_lifx_gateway_rto(gw), LGTD_LIFX_GATEWAY_MIN_RTO_MSECS
+    );
+    return msg->sent_at + (rto << msg->retransmits);
+}
+
+static lgtd_time_mono_t
+lgtd_lifx_gateway_next_retransmit_at(const struct lgtd_lifx_gateway *gw)
+{
+    lgtd_time_mono_t next = 0;
+    const struct lgtd_lifx_message *msg;
+    TAILQ_FOREACH(msg, &gw->unacked_msgs, link) {
+        lgtd_time_mono_t at = lgtd_lifx_gateway_retransmit_at(gw, msg);
+        if (!next || at < next) {
+            next = at;
+        }
+    }
+    return next;
+}
+
+static void
+lgtd_lifx_gateway_give_up_message(struct lgtd_lifx_gateway *gw,
+                                  struct lgtd_lifx_message *msg)
+{
+    const struct lgtd_lifx_packet_info *pkt_info;
+    pkt_info = lgtd_lifx_wire_get_packet_info(msg->type);
+    lgtd_warnx(
+        "%d bulb(s) on %s didn't acknowledge %s after %d retransmits",
+        msg->nbulbs, gw->peeraddr, pkt_info ? pkt_info->name : "a packet",
+        msg->retransmits
+    );
+    for (int i = 0; i != msg->nbulbs; i++) {
+        lgtd_lifx_gateway_set_delivery(
+            gw, msg->bulbs[i], LGTD_LIFX_BULB_DELIVERY_FAILED
+        );
+    }
+    lgtd_lifx_gateway_release_unacked(gw, msg);
+}
+
+// Queue a device-targeted copy of the tagged message msg for each of the bulbs
+// that didn't acknowledge it after prev_msg. The bulbs that did acknowledge it
+// must not get it twice (e.g: SET_WAVEFORM would be played again). Return the
+// last copy queued or prev_msg:
+static struct lgtd_lifx_message *
+lgtd_lifx_gateway_queue_retransmit_copies(struct lgtd_lifx_gateway *gw,
+                                          struct lgtd_lifx_message *msg,
+                                          struct lgtd_lifx_message *prev_msg)
+{
+    struct lgtd_lifx_message_queue *queue =
+        &gw->pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH];
+
+    for (int i = 0; i != msg->nbulbs; i++) {
+        struct lgtd_lifx_message *copy = malloc(sizeof(*copy) + msg->size);
+        if (!copy) {
+            lgtd_warn("can't allocate a retransmission for %s", gw->peeraddr);
+            break;
+        }
+        memcpy(copy, msg, sizeof(*copy) + msg->size);
+        copy->bulbs = NULL;
+        copy->nbulbs = 0;
+        copy->in_flight = false;
+        copy->retransmit_of = msg;
+        struct lgtd_lifx_packet_header *hdr = (void *)copy->data;
+        hdr->protocol &= ~LGTD_LIFX_PROTOCOL_TAGGED;
+        memset(&hdr->target, 0, sizeof(hdr->target));
+        memcpy(hdr->target.device_addr, msg->bulbs[i], LGTD_LIFX_ADDR_LENGTH);
+        if (prev_msg) {
+            TAILQ_INSERT_AFTER(queue, prev_msg, copy, link);
+        } else {
+            TAILQ_INSERT_HEAD(queue, copy, link);
+        }
+        gw->pkt_queues_bytes += copy->size;
+        prev_msg = copy;
+    }
+
+    return prev_msg;
+}
+
+static void
+lgtd_lifx_gateway_retransmit_callback(struct lgtd_timer *timer,
+                                      union lgtd_timer_ctx ctx)
+{
+    struct lgtd_lifx_gateway *gw = ctx.as_ptr;
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+
+    // Retransmissions go out before anything else, in the order the messages
+    // were sent in the first place:
+    struct lgtd_lifx_message_queue *queue =
+        &gw->pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH];
+    struct lgtd_lifx_message *msg, *next_msg, *prev_msg = NULL;
+    TAILQ_FOREACH_SAFE(msg, &gw->unacked_msgs, link, next_msg) {
+        if (lgtd_lifx_gateway_retransmit_at(gw, msg) > now) {
+            continue;
+        }
+        if (msg->retransmits == LGTD_LIFX_GATEWAY_MAX_RETRANSMITS) {
+            lgtd_lifx_gateway_give_up_message(gw, msg);
+            continue;
+        }
+        if (lgtd_lifx_gateway_message_is_tagged(msg)) {
+            // msg keeps waiting for the acks of its copies:
+            msg->retransmits++;
+            msg->sent_at = now;
+            prev_msg = lgtd_lifx_gateway_queue_retransmit_copies(
+                gw, msg, prev_msg
+            );
+            continue;
+        }
+        TAILQ_REMOVE(&gw->unacked_msgs, msg, link);
+        msg->in_flight = false;
+        msg->retransmits++;
+        if (prev_msg) {
+            TAILQ_INSERT_AFTER(queue, prev_msg, msg, link);
+        } else {
+            TAILQ_INSERT_HEAD(queue, msg, link);
+        }
+        gw->pkt_queues_bytes += msg->size;
+        prev_msg = msg;
+    }
+    if (prev_msg) {
+        lgtd_lifx_gateway_schedule_write(gw);
+    }
+
+    lgtd_time_mono_t next = lgtd_lifx_gateway_next_retransmit_at(gw);
+    if (next) {
+        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(LGTD_MAX(next - now, 1));
+        lgtd_timer_reschedule(timer, &tv);
+    }
+}
+
+static void
+lgtd_lifx_gateway_arm_retransmit_timer(struct lgtd_lifx_gateway *gw,
+                                       lgtd_time_mono_t now)
+{
+    lgtd_time_mono_t next = lgtd_lifx_gateway_next_retransmit_at(gw);
+    if (!next) {
+        return;
+    }
+
+    int msecs = LGTD_MAX((int)(next - now), 1);
+    if (gw->retransmit_timer) {
+        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(msecs);
+        lgtd_timer_reschedule(gw->retransmit_timer, &tv);
+        return;
+    }
+
+    union lgtd_timer_ctx ctx = { .as_ptr = gw };
+    gw->retransmit_timer = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS,
+        msecs,
+        lgtd_lifx_gateway_retransmit_callback,
+        ctx
+    );
+    if (!gw->retransmit_timer) {
+        lgtd_warn("can't allocate a new timer");
+    }
+}
+
+// A message sent with the ack required flag has been written, keep it around
+// until its bulbs acknowledge it:
+static void
+lgtd_lifx_gateway_track_unacked(struct lgtd_lifx_gateway *gw,
+                                struct lgtd_lifx_message *msg,
+                                lgtd_time_mono_t now)
+{
+    uint8_t seqn = lgtd_lifx_gateway_message_seqn(msg);
+
+    if (!msg->retransmits) {
+        // All the sequence numbers are taken by other messages waiting
+        // for acks, or nobody to wait for, deliver that one at most once:
+        if (gw->unacked_by_seqn[seqn]
+            || !lgtd_lifx_gateway_expect_acks(gw, msg)) {
+            free(msg->bulbs);
+            free(msg);
+            return;
+        }
+
+        // A newer value of the same state supersedes the older one, which
+        // mustn't be retransmitted anymore to the bulbs that get the new one:
+        const struct lgtd_lifx_packet_info *pkt_info;
+        pkt_info = lgtd_lifx_wire_get_packet_info(msg->type);
+        if (pkt_info && pkt_info->last_write_wins) {
+            const struct lgtd_lifx_packet_header *hdr = (const void *)msg->data;
+            struct lgtd_lifx_message *unacked, *next_unacked;
+            TAILQ_FOREACH_SAFE(unacked, &gw->unacked_msgs, link, next_unacked) {
+                const struct lgtd_lifx_packet_header *unacked_hdr;
+                unacked_hdr = (const void *)unacked->data;
+                if (unacked->type != msg->type
+                    || unacked_hdr->at_time != hdr->at_time) {
+                    continue;
+                }
+                for (int i = 0; i != msg->nbulbs; i++) {
+                    lgtd_lifx_gateway_forget_unacked_bulb(
+                        gw, unacked, msg->bulbs[i]
+                    );
+                }
+                if (!unacked->nbulbs) {
+                    lgtd_lifx_gateway_release_unacked(gw, unacked);
+                }
+            }
+        }
+
+        gw->unacked_by_seqn[seqn] = msg;
+    }
+
+    msg->sent_at = now;
+    msg->in_flight = true;
+    TAILQ_INSERT_TAIL(&gw->unacked_msgs, msg, link);
+    lgtd_lifx_gateway_arm_retransmit_timer(gw, now);
+}
+
+// Dequeue the first npkts messages after they have been written to the
+// gateway socket:
+static void
+lgtd_lifx_gateway_consume_pkt_queues(struct lgtd_lifx_gateway *gw, int npkts)
+{
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+
+    for (int prio = 0; npkts && prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT;) {
+        struct lgtd_lifx_message *msg = TAILQ_FIRST(&gw->pkt_queues[prio]);
+        if (!msg) {
+            prio++;
+            continue;
+        }
+        if (msg->type == LGTD_LIFX_GET_TAG_LABELS) {
+            gw->pending_refresh_req = false;
+        }
+        // Don't take RTT samples from retransmissions (Karn's algorithm),
+        // there is no way to know which transmission is acknowledged:
+        uint8_t seqn = lgtd_lifx_gateway_message_seqn(msg);
+        gw->rtt.sent_at[seqn] = msg->retransmits ? 0 : now;
+        if (msg->retransmit_of) {
+            lgtd_lifx_gateway_remove_message(gw, prio, msg);
+        } else if (lgtd_lifx_gateway_message_wants_ack(msg)) {
+            lgtd_lifx_gateway_unqueue_message(gw, prio, msg);
+            lgtd_lifx_gateway_track_unacked(gw, msg, now);
+        } else {
+            lgtd_lifx_gateway_remove_message(gw, prio, msg);
+        }
+        npkts--;
+    }
+}
+
+// Give the packet its sequence number before it's written, the header is
+// already encoded but seqn is a single byte. A retransmission keeps its
+// sequence number so late acks for the previous transmissions still count,
+// and the sequence numbers of the messages waiting for acks are skipped:
+static void
+lgtd_lifx_gateway_stamp_seqn(struct lgtd_lifx_gateway *gw,
+                             struct lgtd_lifx_message *msg)
+{
+    if (msg->retransmits) {
+        return;
+    }
+
+    uint8_t seqn = gw->rtt.next_seqn;
+    for (int i = 0; gw->unacked_by_seqn[seqn] && i != UINT8_MAX; i++) {
+        seqn++;
+    }
+    struct lgtd_lifx_packet_header *hdr =
+        (struct lgtd_lifx_packet_header *)msg->data;
+    hdr->seqn = seqn;
+    gw->rtt.next_seqn = seqn + 1;
+}
+
+#if LGTD_HAVE_SENDMMSG
+// Write up to LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE queued packets with one
+// syscall, each packet still goes out in its own datagram:
+static bool
+lgtd_lifx_gateway_write_pkt_queues(struct lgtd_lifx_gateway *gw)
+{
+    struct mmsghdr msgs[LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE];
+    struct iovec iovs[LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE];
+
+    int npkts = 0;
+    for (int prio = 0; prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT; prio++) {
+        struct lgtd_lifx_message *msg;
+        TAILQ_FOREACH(msg, &gw->pkt_queues[prio], link) {
+            if (npkts == LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE) {
+                break;
+            }
+            lgtd_lifx_gateway_stamp_seqn(gw, msg);
+            iovs[npkts].iov_base = msg->data;
+            iovs[npkts].iov_len = msg->size;
+            npkts++;
+        }
+    }
+    if (!npkts) {
+        return true;
+    }
+
+    memset(msgs, 0, sizeof(msgs[0]) * npkts);
+    for (int i = 0; i != npkts; i++) {
+        if (gw->shared_socket) {
+            msgs[i].msg_hdr.msg_name = gw->peer;
+            msgs[i].msg_hdr.msg_namelen = gw->peerlen;
+        }
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nsent = sendmmsg(gw->socket, msgs, npkts, 0);
+    if (nsent == -1) {
+        int error = EVUTIL_SOCKET_ERROR();
+        return error == EAGAIN || error == EINTR;
+    }
+
+    lgtd_lifx_gateway_consume_pkt_queues(gw, nsent);
+
+    return true;
+}
+#else
+static struct lgtd_lifx_message *
+lgtd_lifx_gateway_first_message(const struct lgtd_lifx_gateway *gw)
+{
+    for (int prio = 0; prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT; prio++) {
+        if (!TAILQ_EMPTY(&gw->pkt_queues[prio])) {
+            return TAILQ_FIRST(&gw->pkt_queues[prio]);
+        }
+    }
+    return NULL;
+}
+
+static bool
+lgtd_lifx_gateway_write_pkt_queues(struct lgtd_lifx_gateway *gw)
+{
+    struct lgtd_lifx_message *msg = lgtd_lifx_gateway_first_message(gw);
+    if (!msg) {
+        return true;
+    }
+    lgtd_lifx_gateway_stamp_seqn(gw, msg);
+
+    int nbytes;
+    if (gw->shared_socket) {
+        nbytes = sendto(
+            gw->socket, msg->data, msg->size, 0, gw->peer, gw->peerlen
         );
+    } else {
+        nbytes = send(gw->socket, msg->data, msg->size, 0);
     }
+    if (nbytes == -1) {
+        return errno == EAGAIN;
+    }
+
+    lgtd_lifx_gateway_consume_pkt_queues(gw, 1);
+
+    return true;
 }
+#endif
 
 static void
 lgtd_lifx_gateway_socket_event_callback(evutil_socket_t socket,
@@ -179,36 +1009,12 @@ lgtd_lifx_gateway_socket_event_callback(evutil_socket_t socket,
     }
 
     if (events & EV_WRITE) {
-        assert(gw->pkt_ring_tail >= 0);
-        assert(gw->pkt_ring_tail < (int)LGTD_ARRAY_SIZE(gw->pkt_ring));
-
-        int to_write = gw->pkt_ring[gw->pkt_ring_tail].size;
-        int nbytes = evbuffer_write_atmost(gw->write_buf, gw->socket, to_write);
-        if (nbytes == -1 && errno != EAGAIN) {
+        if (!lgtd_lifx_gateway_write_pkt_queues(gw)) {
             lgtd_warn("can't write to %s", gw->peeraddr);
             goto drop_gw_and_restart_discovery;
         }
 
-        // Callbacks are called in any order, so we keep two timers to make
-        // sure we can get the latency right, otherwise we could be compute the
-        // latency with last_pkt_at < last_req_at, which isn't true since the
-        // pkt will be for an answer to the previous write:
-        gw->last_req_at = gw->next_req_at;
-        gw->next_req_at = lgtd_time_monotonic_msecs();
-
-        gw->pkt_ring[gw->pkt_ring_tail].size -= nbytes;
-        if (gw->pkt_ring[gw->pkt_ring_tail].size == 0) {
-            enum lgtd_lifx_packet_type type;
-            type = gw->pkt_ring[gw->pkt_ring_tail].type;
-            if (type == LGTD_LIFX_GET_TAG_LABELS) {
-                gw->pending_refresh_req = false;
-            }
-            gw->pkt_ring[gw->pkt_ring_tail].type = 0;
-            LGTD_LIFX_GATEWAY_INC_MESSAGE_RING_INDEX(gw->pkt_ring_tail);
-            gw->pkt_ring_full = false;
-        }
-
-        if (!evbuffer_get_length(gw->write_buf)) {
+        if (!lgtd_lifx_gateway_has_pending_packets(gw)) {
             event_del(gw->socket_ev);
         }
     }
@@ -223,6 +1029,123 @@ drop_gw_and_restart_discovery:
     return;
 }
 
+static void
+lgtd_lifx_gateway_shared_socket_event_callback(evutil_socket_t socket,
+                                               short events,
+                                               void *ctx)
+{
+    (void)socket;
+    (void)ctx;
+
+    if (events & EV_READ) {
+        bool ok = lgtd_lifx_wire_handle_receive(
+            lgtd_lifx_gateway_shared_endpoint.socket, NULL
+        );
+        // Invalid datagrams are skipped, only give up on the gateways if the
+        // socket itself is unusable:
+        if (!ok) {
+            int error = EVUTIL_SOCKET_ERROR();
+            if (error == EBADF || error == ENOTSOCK) {
+                goto drop_all_gws_and_restart_discovery;
+            }
+        }
+    }
+
+    if (events & EV_WRITE) {
+        struct lgtd_lifx_gateway_write_queue *pending_writes;
+        pending_writes = &lgtd_lifx_gateway_shared_endpoint.pending_writes;
+        bool restart_discovery = false;
+        struct lgtd_lifx_gateway *gw, *next_gw;
+        TAILQ_FOREACH_SAFE(gw, pending_writes, link_by_pending_write, next_gw) {
+            if (!lgtd_lifx_gateway_write_pkt_queues(gw)) {
+                int error = EVUTIL_SOCKET_ERROR();
+                if (error == EBADF || error == ENOTSOCK) {
+                    lgtd_warn("can't write to the shared socket");
+                    goto drop_all_gws_and_restart_discovery;
+                }
+                // Only this peer is unreachable, keep the other gateways:
+                lgtd_warn("can't write to %s", gw->peeraddr);
+                lgtd_lifx_gateway_close(gw);
+                restart_discovery = true;
+                continue;
+            }
+            if (!lgtd_lifx_gateway_has_pending_packets(gw)) {
+                TAILQ_REMOVE(pending_writes, gw, link_by_pending_write);
+                gw->pending_write = false;
+            }
+        }
+        // The endpoint is gone if the last gateway has just been closed:
+        if (TAILQ_EMPTY(pending_writes)
+            && lgtd_lifx_gateway_shared_endpoint.write_ev) {
+            event_del(lgtd_lifx_gateway_shared_endpoint.write_ev);
+        }
+        if (restart_discovery && !lgtd_lifx_broadcast_discovery()) {
+            lgtd_err(1, "can't start auto discovery");
+        }
+    }
+
+    return;
+
+drop_all_gws_and_restart_discovery:
+    // The endpoint is closed with the last gateway:
+    lgtd_lifx_gateway_close_all();
+    if (!lgtd_lifx_broadcast_discovery()) {
+        lgtd_err(1, "can't start auto discovery");
+    }
+}
+
+static bool
+lgtd_lifx_gateway_open_shared_endpoint(void)
+{
+    assert(lgtd_lifx_gateway_shared_endpoint.socket == -1);
+
+    // Packets from the bulbs are always over IPv4 (the discovery is done via
+    // IPv4 broadcasts):
+    lgtd_lifx_gateway_shared_endpoint.socket = socket(
+        AF_INET, SOCK_DGRAM, IPPROTO_UDP
+    );
+    if (lgtd_lifx_gateway_shared_endpoint.socket == -1) {
+        return false;
+    }
+
+    int err = evutil_make_socket_nonblocking(
+        lgtd_lifx_gateway_shared_endpoint.socket
+    );
+    if (err == -1) {
+        goto error;
+    }
+
+    lgtd_lifx_gateway_shared_endpoint.read_ev = event_new(
+        lgtd_ev_base,
+        lgtd_lifx_gateway_shared_endpoint.socket,
+        EV_READ|EV_PERSIST,
+        lgtd_lifx_gateway_shared_socket_event_callback,
+        NULL
+    );
+    lgtd_lifx_gateway_shared_endpoint.write_ev = event_new(
+        lgtd_ev_base,
+        lgtd_lifx_gateway_shared_endpoint.socket,
+        EV_WRITE|EV_PERSIST,
+        lgtd_lifx_gateway_shared_socket_event_callback,
+        NULL
+    );
+    if (!lgtd_lifx_gateway_shared_endpoint.read_ev
+        || !lgtd_lifx_gateway_shared_endpoint.write_ev) {
+        goto error;
+    }
+
+    if (!event_add(lgtd_lifx_gateway_shared_endpoint.read_ev, NULL)) {
+        return true;
+    }
+
+    int errsave;
+error:
+    errsave = errno;
+    lgtd_lifx_gateway_close_shared_endpoint();
+    errno = errsave;
+    return false;
+}
+
 static bool
 lgtd_lifx_gateway_send_to_site_impl(struct lgtd_lifx_gateway *gw,
                                     enum lgtd_lifx_packet_type pkt_type,
@@ -243,9 +1166,7 @@ lgtd_lifx_gateway_send_to_site_impl(struct lgtd_lifx_gateway *gw,
     );
     assert(*pkt_info);
 
-    lgtd_lifx_gateway_enqueue_packet(gw, &hdr, *pkt_info, pkt);
-
-    return true; // FIXME, have real return values on the send paths...
+    return lgtd_lifx_gateway_enqueue_packet(gw, &hdr, *pkt_info, pkt);
 }
 
 static bool
@@ -265,7 +1186,7 @@ lgtd_lifx_gateway_send_to_site_quiet(struct lgtd_lifx_gateway *gw,
         pkt_info->name, LGTD_IEEE8023MACTOA(gw->site.as_array, site)
     );
 
-    return rv; // FIXME, have real return values on the send paths...
+    return rv;
 }
 
 bool
@@ -284,7 +1205,7 @@ lgtd_lifx_gateway_send_to_site(struct lgtd_lifx_gateway *gw,
         pkt_info->name, LGTD_IEEE8023MACTOA(gw->site.as_array, site)
     );
 
-    return rv; // FIXME, have real return values on the send paths...
+    return rv;
 }
 
 static void
@@ -298,6 +1219,157 @@ lgtd_lifx_gateway_send_get_all_light_state(struct lgtd_lifx_gateway *gw)
     lgtd_lifx_gateway_send_to_site_quiet(gw, LGTD_LIFX_GET_TAG_LABELS, &pkt);
 
     gw->pending_refresh_req = true;
+
+    // keep track of the bulbs clocks for synchronized commands:
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    lgtd_time_mono_t sync_age = now - gw->clock_sync_req_at;
+    if (!gw->clock_sync_req_at
+        || sync_age >= LGTD_LIFX_GATEWAY_CLOCK_SYNC_INTERVAL_MSECS) {
+        lgtd_lifx_gateway_send_to_site_quiet(gw, LGTD_LIFX_GET_TIME, NULL);
+        gw->clock_sync_req_at = now;
+    }
+}
+
+static bool
+lgtd_lifx_gateway_happened_within(lgtd_time_mono_t at,
+                                  lgtd_time_mono_t now,
+                                  int msecs)
+{
+    return at && now - at < (lgtd_time_mono_t)msecs;
+}
+
+// Pick the refresh interval of the gateway: poll as fast as allowed when a
+// command was just sent or a client is reading the bulbs, at twice that when
+// the bulbs are changing on their own and back off up to the maximum interval
+// otherwise. A slow gateway (high latency) is never polled faster than twice
+// its latency so the requests don't pile up. Returns true when the interval
+// got shorter and the next refresh should be pulled in:
+static bool
+lgtd_lifx_gateway_update_refresh_interval(struct lgtd_lifx_gateway *gw,
+                                          lgtd_time_mono_t now)
+{
+    int min_interval = lgtd_opts.lifx_refresh_min_msecs;
+    // An idle gateway still has to answer before the watchdog closes it:
+    int max_interval = LGTD_MIN(
+        lgtd_opts.lifx_refresh_max_msecs,
+        LGTD_LIFX_DISCOVERY_DEVICE_MAX_REFRESH_INTERVAL_MSECS
+    );
+
+    enum lgtd_lifx_gateway_refresh_reason reason;
+    int interval;
+    if (lgtd_lifx_gateway_happened_within(
+        gw->last_command_at, now, LGTD_LIFX_GATEWAY_REFRESH_COMMAND_MSECS
+    )) {
+        reason = LGTD_LIFX_GATEWAY_REFRESH_COMMAND;
+        interval = min_interval;
+    } else if (lgtd_lifx_gateway_happened_within(
+        gw->last_client_read_at, now, LGTD_LIFX_GATEWAY_REFRESH_CLIENT_MSECS
+    )) {
+        reason = LGTD_LIFX_GATEWAY_REFRESH_CLIENT;
+        interval = min_interval;
+    } else if (lgtd_lifx_gateway_happened_within(
+        gw->last_change_at, now, LGTD_LIFX_GATEWAY_REFRESH_CHURN_MSECS
+    )) {
+        reason = LGTD_LIFX_GATEWAY_REFRESH_CHURN;
+        interval = 2 * min_interval;
+    } else if (gw->refresh_reason == LGTD_LIFX_GATEWAY_REFRESH_IDLE) {
+        reason = LGTD_LIFX_GATEWAY_REFRESH_IDLE;
+        interval = 2 * gw->refresh_interval;
+    } else {
+        reason = LGTD_LIFX_GATEWAY_REFRESH_IDLE;
+        interval = 4 * min_interval;
+    }
+    // Don't ask again before the previous request could have been answered:
+    if (gw->rtt.samples) {
+        interval = LGTD_MAX(interval, (int)lgtd_lifx_gateway_rto(gw));
+    }
+    interval = LGTD_MAX(LGTD_MIN(interval, max_interval), min_interval);
+
+    if (reason != gw->refresh_reason) {
+        lgtd_lifx_gateway_count_refresh_reason(gw->refresh_reason, -1);
+        lgtd_lifx_gateway_count_refresh_reason(reason, 1);
+        lgtd_daemon_update_proctitle();
+    }
+    if (reason != gw->refresh_reason || interval != gw->refresh_interval) {
+        static const char *reasons[] = {
+            [LGTD_LIFX_GATEWAY_REFRESH_COMMAND] = "command sent",
+            [LGTD_LIFX_GATEWAY_REFRESH_CLIENT] = "read by a client",
+            [LGTD_LIFX_GATEWAY_REFRESH_CHURN] = "state changing",
+            [LGTD_LIFX_GATEWAY_REFRESH_IDLE] = "idle"
+        };
+        lgtd_debug(
+            "refreshing %s every %dms (%s)",
+            gw->peeraddr, interval, reasons[reason]
+        );
+    }
+
+    bool shorter = interval < gw->refresh_interval;
+    gw->refresh_reason = reason;
+    gw->refresh_interval = interval;
+    return shorter;
+}
+
+// A gateway refreshed every refresh_interval should have answered within its
+// retransmission timeout (derived from the RTT), past that the refresh is
+// forced:
+static int
+lgtd_lifx_gateway_watchdog_timeout(const struct lgtd_lifx_gateway *gw)
+{
+    return LGTD_MAX(
+        gw->refresh_interval + (int)lgtd_lifx_gateway_rto(gw),
+        LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_MSECS
+    );
+}
+
+static void
+lgtd_lifx_gateway_schedule_watchdog(struct lgtd_lifx_gateway *gw)
+{
+    int lag = lgtd_lifx_gateway_msecs_since_last_update(gw);
+    int timeout = LGTD_MAX(lgtd_lifx_gateway_watchdog_timeout(gw) - lag, 0);
+    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(timeout);
+    lgtd_timer_reschedule(gw->watchdog_timer, &tv);
+}
+
+// Packets received in the meantime only push the deadline back, so instead of
+// re-scheduling the timer for each packet, look at how long the gateway has
+// really been silent when it fires:
+static void
+lgtd_lifx_gateway_watchdog_callback(struct lgtd_timer *timer,
+                                    union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    struct lgtd_lifx_gateway *gw = ctx.as_ptr;
+
+    int lag = lgtd_lifx_gateway_msecs_since_last_update(gw);
+    if (lag < lgtd_lifx_gateway_watchdog_timeout(gw)) {
+        lgtd_lifx_gateway_schedule_watchdog(gw);
+        return;
+    }
+
+    lgtd_info(
+        "no update on bulb gateway %s for %dms, forcing refresh",
+        gw->peeraddr, lag
+    );
+    lgtd_lifx_gateway_force_refresh(gw);
+    // give the forced refresh a chance to be answered before trying again:
+    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(LGTD_MAX(
+        (int)lgtd_lifx_gateway_rto(gw),
+        LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_RETRY_MSECS
+    ));
+    lgtd_timer_reschedule(gw->watchdog_timer, &tv);
+}
+
+// Something happened on the gateway, refresh it faster if needed:
+static void
+lgtd_lifx_gateway_speed_up_refresh(struct lgtd_lifx_gateway *gw)
+{
+    lgtd_time_mono_t now = lgtd_time_monotonic_msecs();
+    if (lgtd_lifx_gateway_update_refresh_interval(gw, now)) {
+        // the watchdog deadline moved closer too:
+        lgtd_lifx_gateway_schedule_watchdog(gw);
+        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(gw->refresh_interval);
+        lgtd_timer_reschedule(gw->refresh_timer, &tv);
+    }
 }
 
 static void
@@ -308,16 +1380,27 @@ lgtd_lifx_gateway_refresh_callback(struct lgtd_timer *timer,
     struct lgtd_lifx_gateway *gw = ctx.as_ptr;
     lgtd_lifx_gateway_send_get_all_light_state(gw);
 
-    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(
-        LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS
-    );
+    lgtd_lifx_gateway_update_refresh_interval(gw, lgtd_time_monotonic_msecs());
+    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(gw->refresh_interval);
     lgtd_timer_reschedule(gw->refresh_timer, &tv);
     lgtd_debug(
         "scheduling next GET_LIGHT_STATE on %s in %dms",
-        gw->peeraddr, LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS
+        gw->peeraddr, gw->refresh_interval
     );
 }
 
+void
+lgtd_lifx_gateway_mark_client_read(struct lgtd_lifx_gateway *gw)
+{
+    assert(gw);
+
+    gw->last_client_read_at = lgtd_time_monotonic_msecs();
+    if (gw->refresh_reason != LGTD_LIFX_GATEWAY_REFRESH_COMMAND
+        && gw->refresh_reason != LGTD_LIFX_GATEWAY_REFRESH_CLIENT) {
+        lgtd_lifx_gateway_speed_up_refresh(gw);
+    }
+}
+
 void
 lgtd_lifx_gateway_force_refresh(struct lgtd_lifx_gateway *gw)
 {
@@ -326,7 +1409,7 @@ lgtd_lifx_gateway_force_refresh(struct lgtd_lifx_gateway *gw)
     lgtd_timer_activate(gw->refresh_timer);
 }
 
-static struct lgtd_lifx_bulb *
+struct lgtd_lifx_bulb *
 lgtd_lifx_gateway_get_or_open_bulb(struct lgtd_lifx_gateway *gw,
                                    const uint8_t *bulb_addr)
 {
@@ -362,28 +1445,42 @@ lgtd_lifx_gateway_open(const struct sockaddr *peer,
         lgtd_warn("can't allocate a new gateway bulb");
         return false;
     }
-    gw->socket = socket(peer->sa_family, SOCK_DGRAM, IPPROTO_UDP);
-    if (gw->socket == -1) {
-        lgtd_warn("can't open a new socket");
-        goto error_socket;
-    }
-    if (connect(gw->socket, peer, addrlen) == -1
-        || evutil_make_socket_nonblocking(gw->socket) == -1) {
-        lgtd_warn("can't open a new socket");
-        goto error_connect;
-    }
+    if (lgtd_opts.lifx_shared_socket) {
+        if (lgtd_lifx_gateway_shared_endpoint.socket == -1
+            && !lgtd_lifx_gateway_open_shared_endpoint()) {
+            lgtd_warn("can't open the shared socket");
+            goto error_socket;
+        }
+        gw->shared_socket = true;
+        gw->socket = lgtd_lifx_gateway_shared_endpoint.socket;
+        lgtd_lifx_gateway_shared_endpoint.refcount++;
+    } else {
+        gw->socket = socket(peer->sa_family, SOCK_DGRAM, IPPROTO_UDP);
+        if (gw->socket == -1) {
+            lgtd_warn("can't open a new socket");
+            goto error_socket;
+        }
+        if (connect(gw->socket, peer, addrlen) == -1
+            || evutil_make_socket_nonblocking(gw->socket) == -1) {
+            lgtd_warn("can't open a new socket");
+            goto error_connect;
+        }
 
-    gw->socket_ev = event_new(
-        lgtd_ev_base,
-        gw->socket,
-        EV_READ|EV_WRITE|EV_PERSIST,
-        lgtd_lifx_gateway_socket_event_callback,
-        gw
-    );
-    gw->write_buf = evbuffer_new();
-    if (!gw->socket_ev || !gw->write_buf) {
-        goto error_allocate;
+        gw->socket_ev = event_new(
+            lgtd_ev_base,
+            gw->socket,
+            EV_READ|EV_WRITE|EV_PERSIST,
+            lgtd_lifx_gateway_socket_event_callback,
+            gw
+        );
+        if (!gw->socket_ev) {
+            goto error_allocate;
+        }
+    }
+    for (int prio = 0; prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT; prio++) {
+        TAILQ_INIT(&gw->pkt_queues[prio]);
     }
+    TAILQ_INIT(&gw->unacked_msgs);
     gw->peer = malloc(addrlen);
     if (!gw->peer) {
         goto error_allocate;
@@ -393,14 +1490,15 @@ lgtd_lifx_gateway_open(const struct sockaddr *peer,
     gw->peerlen = addrlen;
     LGTD_SOCKADDRTOA(gw->peer, gw->peeraddr);
     memcpy(gw->site.as_array, site, sizeof(gw->site.as_array));
-    gw->last_req_at = received_at;
-    gw->next_req_at = received_at;
     gw->last_pkt_at = received_at;
+    // start fast to get the state of the new bulbs:
+    gw->last_change_at = received_at;
+    gw->refresh_interval = lgtd_opts.lifx_refresh_min_msecs;
 
     union lgtd_timer_ctx ctx = { .as_ptr = gw };
     gw->refresh_timer = lgtd_timer_start(
         LGTD_TIMER_ACTIVATE_NOW,
-        LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS,
+        gw->refresh_interval,
         lgtd_lifx_gateway_refresh_callback,
         ctx
     );
@@ -408,6 +1506,23 @@ lgtd_lifx_gateway_open(const struct sockaddr *peer,
         lgtd_warn("can't allocate a new timer");
         goto error_allocate;
     }
+    gw->watchdog_timer = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS,
+        lgtd_lifx_gateway_watchdog_timeout(gw),
+        lgtd_lifx_gateway_watchdog_callback,
+        ctx
+    );
+    if (!gw->watchdog_timer) {
+        lgtd_warn("can't allocate a new timer");
+        lgtd_timer_stop(gw->refresh_timer);
+        goto error_allocate;
+    }
+
+    if (!lgtd_lifx_gateway_index_peer(gw)) {
+        lgtd_timer_stop(gw->refresh_timer);
+        lgtd_timer_stop(gw->watchdog_timer);
+        goto error_allocate;
+    }
 
     char site_addr[LGTD_LIFX_ADDR_STRLEN];
     lgtd_info(
@@ -415,6 +1530,7 @@ lgtd_lifx_gateway_open(const struct sockaddr *peer,
         LGTD_IEEE8023MACTOA(gw->site.as_array, site_addr), gw->peeraddr
     );
     LIST_INSERT_HEAD(&lgtd_lifx_gateways, gw, link);
+    TAILQ_INSERT_TAIL(&lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt);
 
     // In case this is the first bulb (re-)discovered, start the watchdog, it
     // will stop by itself:
@@ -429,11 +1545,14 @@ error_allocate:
     if (gw->socket_ev) {
         event_free(gw->socket_ev);
     }
-    if (gw->write_buf) {
-        evbuffer_free(gw->write_buf);
-    }
 error_connect:
-    evutil_closesocket(gw->socket);
+    if (gw->shared_socket) {
+        if (!--lgtd_lifx_gateway_shared_endpoint.refcount) {
+            lgtd_lifx_gateway_close_shared_endpoint();
+        }
+    } else {
+        evutil_closesocket(gw->socket);
+    }
 error_socket:
     free(gw->peer);
     free(gw);
@@ -445,8 +1564,14 @@ lgtd_lifx_gateway_get(const struct sockaddr *peer, ev_socklen_t peerlen)
 {
     assert(peer);
 
-    struct lgtd_lifx_gateway *gw, *next_gw;
-    LIST_FOREACH_SAFE(gw, &lgtd_lifx_gateways, link, next_gw) {
+    if (!lgtd_lifx_gateway_peers.nbuckets) {
+        return NULL;
+    }
+
+    struct lgtd_lifx_gateway_list *bucket;
+    bucket = lgtd_lifx_gateway_peer_bucket(peer, peerlen);
+    struct lgtd_lifx_gateway *gw;
+    LIST_FOREACH(gw, bucket, link_by_peer) {
         if (peer->sa_family == gw->peer->sa_family
             && peerlen == gw->peerlen
             && !memcmp(gw->peer, peer, peerlen)) {
@@ -466,7 +1591,86 @@ lgtd_lifx_gateway_close_all(void)
     }
 }
 
-void
+// Make room for size bytes in the queues of gw, an high priority packet can
+// evict the oldest low priority packets if that frees enough space, nothing
+// is evicted otherwise:
+static bool
+lgtd_lifx_gateway_reserve_pkt_queues(struct lgtd_lifx_gateway *gw,
+                                     enum lgtd_lifx_gateway_priority prio,
+                                     int size)
+{
+    int needed = gw->pkt_queues_bytes + size - lgtd_opts.lifx_queue_max_bytes;
+    if (needed <= 0) {
+        return true;
+    }
+
+    int evictable = 0;
+    for (int victim = LGTD_LIFX_GATEWAY_PRIORITY_COUNT - 1;
+         evictable < needed && victim > (int)prio;
+         victim--) {
+        const struct lgtd_lifx_message *msg;
+        TAILQ_FOREACH(msg, &gw->pkt_queues[victim], link) {
+            evictable += msg->size;
+            if (evictable >= needed) {
+                break;
+            }
+        }
+    }
+    if (evictable < needed) {
+        return false;
+    }
+
+    for (int victim = LGTD_LIFX_GATEWAY_PRIORITY_COUNT - 1;
+         needed > 0;
+         victim--) {
+        struct lgtd_lifx_message_queue *queue = &gw->pkt_queues[victim];
+        while (needed > 0 && !TAILQ_EMPTY(queue)) {
+            struct lgtd_lifx_message *msg = TAILQ_FIRST(queue);
+            if (msg->type == LGTD_LIFX_GET_TAG_LABELS) {
+                gw->pending_refresh_req = false;
+            }
+            needed -= msg->size;
+            lgtd_lifx_gateway_remove_message(gw, victim, msg);
+        }
+    }
+
+    return true;
+}
+
+// Look for a packet, not sent yet, that a packet of a last_write_wins type can
+// overwrite in place. Only other last_write_wins packets of a different type
+// can be skipped: they don't touch the same state, anything else must be sent
+// before the new packet. The same type with a different target stops the
+// search too since the targets could overlap (e.g: a tag and a device):
+static struct lgtd_lifx_message *
+lgtd_lifx_gateway_find_overwritable_message(struct lgtd_lifx_gateway *gw,
+                                            enum lgtd_lifx_gateway_priority prio,
+                                            const struct lgtd_lifx_packet_header *hdr,
+                                            const struct lgtd_lifx_packet_info *pkt_info)
+{
+    struct lgtd_lifx_message *msg;
+    TAILQ_FOREACH_REVERSE(msg, &gw->pkt_queues[prio], lgtd_lifx_message_queue, link) {
+        // A retransmission of an older value is tracked with its original
+        // message, send it as is and the new value after it:
+        if (msg->retransmit_of) {
+            return NULL;
+        }
+        if (msg->type == pkt_info->type) {
+            const void *queued_hdr = msg->data;
+            return lgtd_lifx_gateway_same_destination(queued_hdr, hdr) ?
+                msg : NULL;
+        }
+        const struct lgtd_lifx_packet_info *queued_pkt_info;
+        queued_pkt_info = lgtd_lifx_wire_get_packet_info(msg->type);
+        if (!queued_pkt_info || !queued_pkt_info->last_write_wins) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+bool
 lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *gw,
                                  const struct lgtd_lifx_packet_header *hdr,
                                  const struct lgtd_lifx_packet_info *pkt_info,
@@ -476,18 +1680,65 @@ lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *gw,
     assert(hdr);
     assert(pkt_info);
     assert(!memcmp(hdr->site, gw->site.as_array, LGTD_LIFX_ADDR_LENGTH));
-    assert(gw->pkt_ring_head >= 0);
-    assert(gw->pkt_ring_head < (int)LGTD_ARRAY_SIZE(gw->pkt_ring));
 
-    if (gw->pkt_ring_full) {
+    int size = sizeof(*hdr) + pkt_info->size;
+    enum lgtd_lifx_gateway_priority prio = pkt_info->priority;
+
+    if (pkt && pkt_info->last_write_wins) {
+        struct lgtd_lifx_message *msg;
+        msg = lgtd_lifx_gateway_find_overwritable_message(
+            gw, prio, hdr, pkt_info
+        );
+        if (msg) {
+            if (msg->retransmits) {
+                // That's a new value, not a retransmission anymore:
+                uint8_t seqn = lgtd_lifx_gateway_message_seqn(msg);
+                if (gw->unacked_by_seqn[seqn] == msg) {
+                    gw->unacked_by_seqn[seqn] = NULL;
+                }
+                free(msg->bulbs);
+                msg->bulbs = NULL;
+                msg->nbulbs = 0;
+                msg->retransmits = 0;
+            }
+            memcpy(&msg->data[sizeof(*hdr)], pkt, pkt_info->size);
+            lgtd_debug(
+                "overwrote pending %s on %s", pkt_info->name, gw->peeraddr
+            );
+            return true;
+        }
+    }
+
+    if (!lgtd_lifx_gateway_reserve_pkt_queues(gw, prio, size)) {
         lgtd_warnx(
             "dropping packet type %s: packet queue on %s is full",
             pkt_info->name, gw->peeraddr
         );
-        return;
+        return false;
     }
 
-    evbuffer_add(gw->write_buf, hdr, sizeof(*hdr));
+    struct lgtd_lifx_message *msg = malloc(sizeof(*msg) + size);
+    if (!msg) {
+        lgtd_warn(
+            "dropping packet type %s: can't allocate memory on %s",
+            pkt_info->name, gw->peeraddr
+        );
+        return false;
+    }
+
+    msg->type = pkt_info->type;
+    msg->size = size;
+    msg->bulbs = NULL;
+    msg->nbulbs = 0;
+    msg->retransmits = 0;
+    msg->sent_at = 0;
+    msg->in_flight = false;
+    msg->retransmit_of = NULL;
+    memcpy(msg->data, hdr, sizeof(*hdr));
+    if (lgtd_opts.lifx_acked_delivery && pkt_info->ack_required) {
+        struct lgtd_lifx_packet_header *msg_hdr = (void *)msg->data;
+        msg_hdr->flags |= LGTD_LIFX_FLAG_ACK_REQUIRED;
+    }
     if (pkt) {
 #ifndef NDEBUG
         // actually decode the header instead of just calling
@@ -497,15 +1748,23 @@ lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *gw,
         lgtd_lifx_wire_decode_header(&decoded_hdr);
         assert(pkt_info->size == decoded_hdr.size - sizeof(*hdr));
 #endif
-        evbuffer_add(gw->write_buf, pkt, pkt_info->size);
+        memcpy(&msg->data[sizeof(*hdr)], pkt, pkt_info->size);
+    } else {
+        memset(&msg->data[sizeof(*hdr)], 0, pkt_info->size);
     }
-    gw->pkt_ring[gw->pkt_ring_head].size = sizeof(*hdr) + pkt_info->size;
-    gw->pkt_ring[gw->pkt_ring_head].type = pkt_info->type;
-    LGTD_LIFX_GATEWAY_INC_MESSAGE_RING_INDEX(gw->pkt_ring_head);
-    if (gw->pkt_ring_head == gw->pkt_ring_tail) {
-        gw->pkt_ring_full = true;
+    TAILQ_INSERT_TAIL(&gw->pkt_queues[prio], msg, link);
+    gw->pkt_queues_bytes += size;
+
+    if (prio == LGTD_LIFX_GATEWAY_PRIORITY_HIGH) {
+        gw->last_command_at = lgtd_time_monotonic_msecs();
+        if (gw->refresh_reason != LGTD_LIFX_GATEWAY_REFRESH_COMMAND) {
+            lgtd_lifx_gateway_speed_up_refresh(gw);
+        }
     }
-    event_add(gw->socket_ev, NULL);
+
+    lgtd_lifx_gateway_schedule_write(gw);
+
+    return true;
 }
 
 void
@@ -554,10 +1813,63 @@ lgtd_lifx_gateway_latency(const struct lgtd_lifx_gateway *gw)
 {
     assert(gw);
 
-    if (gw->last_req_at < gw->last_pkt_at) { // this doesn't look right
-        return gw->last_pkt_at - gw->last_req_at;
+    return gw->rtt.srtt_x8 >> 3;
+}
+
+lgtd_time_mono_t
+lgtd_lifx_gateway_rto(const struct lgtd_lifx_gateway *gw)
+{
+    assert(gw);
+
+    if (!gw->rtt.samples) {
+        return LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS;
+    }
+    // srtt + 4 * rttvar:
+    return (gw->rtt.srtt_x8 >> 3) + gw->rtt.rttvar_x4;
+}
+
+// How far in the future synchronized commands must be scheduled for their
+// packets to reach every bulb in time, retransmissions included:
+lgtd_time_mono_t
+lgtd_lifx_gateway_sync_lead_time(void)
+{
+    lgtd_time_mono_t lead = LGTD_LIFX_GATEWAY_MIN_SYNC_LEAD_MSECS;
+
+    struct lgtd_lifx_gateway *gw;
+    LIST_FOREACH(gw, &lgtd_lifx_gateways, link) {
+        lead = LGTD_MAX(lead, 2 * lgtd_lifx_gateway_rto(gw));
+    }
+
+    return lead;
+}
+
+void
+lgtd_lifx_gateway_handle_ack(struct lgtd_lifx_gateway *gw,
+                             const struct lgtd_lifx_packet_header *hdr,
+                             const void *pkt)
+{
+    assert(gw);
+    assert(hdr);
+
+    (void)pkt;
+
+    if (hdr->source != lgtd_lifx_wire_get_client_id()) {
+        return;
+    }
+
+    struct lgtd_lifx_message *msg = gw->unacked_by_seqn[hdr->seqn];
+    if (!msg) {
+        return;
+    }
+
+    const uint8_t *addr = hdr->target.device_addr;
+    if (lgtd_lifx_gateway_forget_unacked_bulb(gw, msg, addr)) {
+        lgtd_lifx_gateway_set_delivery(gw, addr, LGTD_LIFX_BULB_DELIVERY_ACKED);
+    }
+
+    if (!msg->nbulbs) {
+        lgtd_lifx_gateway_release_unacked(gw, msg);
     }
-    return 0;
 }
 
 void
@@ -598,6 +1910,12 @@ lgtd_lifx_gateway_handle_light_status(struct lgtd_lifx_gateway *gw,
     LGTD_LIFX_GATEWAY_GET_BULB_OR_RETURN(b, gw, hdr->target.device_addr);
 
     assert(sizeof(*pkt) == sizeof(b->state));
+    if (memcmp(&b->state, pkt, sizeof(b->state))) {
+        gw->last_change_at = gw->last_pkt_at;
+        if (gw->refresh_reason == LGTD_LIFX_GATEWAY_REFRESH_IDLE) {
+            lgtd_lifx_gateway_speed_up_refresh(gw);
+        }
+    }
     lgtd_lifx_bulb_set_light_state(
         b, (const struct lgtd_lifx_light_state *)pkt, gw->last_pkt_at
     );
@@ -621,8 +1939,8 @@ lgtd_lifx_gateway_handle_light_status(struct lgtd_lifx_gateway *gw,
     }
 
     lgtd_time_mono_t latency = lgtd_lifx_gateway_latency(gw);
-    if (latency < LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS) {
-        int timeout = LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS - latency;
+    if (latency < (lgtd_time_mono_t)gw->refresh_interval) {
+        int timeout = gw->refresh_interval - latency;
         struct timeval tv = LGTD_MSECS_TO_TIMEVAL(timeout);
         lgtd_timer_reschedule(gw->refresh_timer, &tv);
         lgtd_debug(
@@ -952,3 +2270,27 @@ lgtd_lifx_gateway_handle_ambient_light(struct lgtd_lifx_gateway *gw,
         lgtd_lifx_bulb_set_ambient_light, pkt->illuminance
     );
 }
+
+void
+lgtd_lifx_gateway_handle_time_state(struct lgtd_lifx_gateway *gw,
+                                    const struct lgtd_lifx_packet_header *hdr,
+                                    const struct lgtd_lifx_packet_time_state *pkt)
+{
+    char device_time[64], addr[LGTD_LIFX_ADDR_STRLEN];
+    lgtd_debug(
+        "TIME_STATE <-- %s - %s time=%s",
+        gw->peeraddr, LGTD_IEEE8023MACTOA(hdr->target.device_addr, addr),
+        LGTD_LIFX_WIRE_PRINT_NSEC_TIMESTAMP(pkt->time, device_time)
+    );
+
+    // The bulb read its clock about half a round-trip before we got the
+    // response:
+    lgtd_time_mono_t read_at = gw->last_pkt_at;
+    read_at -= LGTD_MIN(lgtd_lifx_gateway_latency(gw) / 2, read_at);
+    int64_t offset = (int64_t)(pkt->time / (1000 * 1000)) - (int64_t)read_at;
+
+    LGTD_LIFX_GATEWAY_SET_BULB_ATTR(
+        gw, hdr->target.device_addr,
+        lgtd_lifx_bulb_set_clock_offset, offset, gw->last_pkt_at
+    );
+}
@@ -17,24 +17,105 @@
 
 #pragma once
 
-// Send GET_LIGHT_STATE to the gateway at most every this interval. FYI,
-// according to my own tests, aggressively polling a bulb doesn't raise its
-// consumption at all (and it's interesting to note that a turned off bulb
-// still draw about 2W in ZigBee and about 3W in WiFi).
+// Send GET_LIGHT_STATE to the gateway at most every this interval (default for
+// --lifx-refresh-interval). FYI, according to my own tests, aggressively
+// polling a bulb doesn't raise its consumption at all (and it's interesting to
+// note that a turned off bulb still draw about 2W in ZigBee and about 3W in
+// WiFi), but it does use airtime.
 enum { LGTD_LIFX_GATEWAY_MIN_REFRESH_INTERVAL_MSECS = 800 };
+// And at least every this interval, when nothing happens on the gateway:
+enum { LGTD_LIFX_GATEWAY_MAX_REFRESH_INTERVAL_MSECS = 10000 };
 
-// You can't send more than one lifx packet per UDP datagram.
-enum { LGTD_LIFX_GATEWAY_PACKET_RING_SIZE = 16 };
+// How long a gateway is refreshed at the fastest pace after a command has been
+// sent to it or a client has read the state of its bulbs, and at twice that
+// pace after the state of one its bulbs changed on its own:
+enum { LGTD_LIFX_GATEWAY_REFRESH_COMMAND_MSECS = 5000 };
+enum { LGTD_LIFX_GATEWAY_REFRESH_CLIENT_MSECS = 60000 };
+enum { LGTD_LIFX_GATEWAY_REFRESH_CHURN_MSECS = 30000 };
+
+// Why a gateway is refreshed at its current interval, the number of gateways
+// for each reason is kept in the stats:
+enum lgtd_lifx_gateway_refresh_reason {
+    LGTD_LIFX_GATEWAY_REFRESH_NONE = 0,
+    LGTD_LIFX_GATEWAY_REFRESH_COMMAND,
+    LGTD_LIFX_GATEWAY_REFRESH_CLIENT,
+    LGTD_LIFX_GATEWAY_REFRESH_CHURN,
+    LGTD_LIFX_GATEWAY_REFRESH_IDLE
+};
+
+// You can't send more than one lifx packet per UDP datagram, this is how many
+// datagrams are handed to the kernel at once when the socket is writable:
+enum { LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE = 16 };
+
+// Default for --lifx-queue-max-bytes, a little more than a thousand
+// SET_LIGHT_COLOR packets:
+enum { LGTD_LIFX_GATEWAY_DEFAULT_QUEUE_MAX_BYTES = 64 * 1024 };
 
 enum { LGTD_LIFX_GATEWAY_MAX_TAGS = 64 };
 
+// Until a response has been matched to a request, this is the retransmission
+// timeout of a gateway (same initial value as in RFC 6298):
+enum { LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS = 1000 };
+// Responses that come back later than this aren't used as RTT samples, most
+// likely they don't answer the request that used the same sequence number:
+enum { LGTD_LIFX_GATEWAY_MAX_RTT_SAMPLE_MSECS = 5000 };
+// Bucket i of the RTT histogram counts the samples in [2^(i-1), 2^i) ms, the
+// last bucket counts everything above:
+enum { LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE = 12 };
+
+// Round-trip time estimator (Jacobson/Karels, as in RFC 6298). Each packet
+// written to the gateway gets its own sequence number, the first response that
+// carries our source identifier and that sequence number is the RTT sample:
+struct lgtd_lifx_gateway_rtt {
+    // Indexed by sequence number, 0 when no response is expected:
+    lgtd_time_mono_t                sent_at[UINT8_MAX + 1];
+    uint8_t                         next_seqn;
+    // Fixed-point like in the BSD TCP stack: srtt is scaled by 8 and rttvar
+    // by 4, which keeps enough precision for the few ms of a LAN:
+    int                             srtt_x8;
+    int                             rttvar_x4;
+    int                             samples;
+    int                             histogram[LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE];
+};
+
+// With --lifx-acked-delivery, a SET_* packet is retransmitted this many times
+// when some of its bulbs don't acknowledge it, the retransmission timeout is
+// doubled each time and never goes below this floor:
+enum { LGTD_LIFX_GATEWAY_MAX_RETRANSMITS = 3 };
+enum { LGTD_LIFX_GATEWAY_MIN_RTO_MSECS = 50 };
+
+// The clock offset of the bulbs (see TIME_STATE) is measured again this often,
+// and synchronized commands are scheduled at least this far in the future,
+// in addition to the round-trip time of the slowest gateway:
+enum { LGTD_LIFX_GATEWAY_CLOCK_SYNC_INTERVAL_MSECS = 60000 };
+enum { LGTD_LIFX_GATEWAY_MIN_SYNC_LEAD_MSECS = 50 };
+
+// A packet (header and payload) waiting to be sent to a gateway, or when it
+// has been sent with the ack required flag, waiting to be acknowledged:
 struct lgtd_lifx_message {
-    enum lgtd_lifx_packet_type  type;
-    int                         size;
+    TAILQ_ENTRY(lgtd_lifx_message)  link;
+    enum lgtd_lifx_packet_type      type;
+    int                             size;
+    // The bulbs that haven't acknowledged the packet yet, set the first
+    // time the packet is sent:
+    uint8_t                         (*bulbs)[LGTD_LIFX_ADDR_LENGTH];
+    int                             nbulbs;
+    int                             retransmits;
+    lgtd_time_mono_t                sent_at;
+    // true when the message is in unacked_msgs instead of pkt_queues:
+    bool                            in_flight;
+    // Set on the device-targeted copies of a tagged message that are queued
+    // to retransmit it to the bulbs that didn't acknowledge it, a copy isn't
+    // tracked by itself, the acks it gets count for retransmit_of:
+    struct lgtd_lifx_message        *retransmit_of;
+    uint8_t                         data[];
 };
+TAILQ_HEAD(lgtd_lifx_message_queue, lgtd_lifx_message);
 
 struct lgtd_lifx_gateway {
     LIST_ENTRY(lgtd_lifx_gateway)   link;
+    TAILQ_ENTRY(lgtd_lifx_gateway)  link_by_last_pkt;
+    LIST_ENTRY(lgtd_lifx_gateway)   link_by_peer;
     struct lgtd_lifx_bulb_list      bulbs;
 #define LGTD_LIFX_GATEWAY_GET_BULB_OR_RETURN(b, gw, bulb_addr)  do {    \
     (b) = lgtd_lifx_gateway_get_or_open_bulb((gw), (bulb_addr));        \
@@ -60,29 +141,46 @@ struct lgtd_lifx_gateway {
     struct lgtd_lifx_tag            *tags[LGTD_LIFX_GATEWAY_MAX_TAGS];
     uint8_t                         tag_refcounts[LGTD_LIFX_GATEWAY_MAX_TAGS];
     evutil_socket_t                 socket;
-    // Those three timestamps let us measure the latency of the gateway. If we
-    // aren't the only client on the network then this won't be accurate since
-    // we will get pushed packets we didn't ask for, but good enough for our
-    // purpose of rate limiting our requests to the gateway:
-    lgtd_time_mono_t                last_req_at;
-    lgtd_time_mono_t                next_req_at;
+    // Last time we received a known packet from the gateway, packets pushed
+    // to other clients on the network count too:
     lgtd_time_mono_t                last_pkt_at;
-    struct lgtd_lifx_message        pkt_ring[LGTD_LIFX_GATEWAY_PACKET_RING_SIZE];
-#define LGTD_LIFX_GATEWAY_INC_MESSAGE_RING_INDEX(idx)  do { \
-    (idx) += 1;                                             \
-    (idx) %= LGTD_LIFX_GATEWAY_PACKET_RING_SIZE;            \
-} while(0)
-    int                             pkt_ring_head;
-    int                             pkt_ring_tail;
-    bool                            pkt_ring_full;
+    struct lgtd_lifx_gateway_rtt    rtt;
+    // One queue per priority, bounded by lgtd_opts.lifx_queue_max_bytes:
+    struct lgtd_lifx_message_queue  pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_COUNT];
+    int                             pkt_queues_bytes;
     struct event                    *socket_ev;
-    struct evbuffer                 *write_buf;
+    // When lgtd_opts.lifx_shared_socket is set, socket is shared by all the
+    // gateways (socket_ev is NULL) and packets are sent to peer explicitly:
+    bool                            shared_socket;
+    TAILQ_ENTRY(lgtd_lifx_gateway)  link_by_pending_write;
+    bool                            pending_write;
     bool                            pending_refresh_req;
     struct lgtd_timer               *refresh_timer;
+    // Forces a refresh when the gateway stays silent for longer than its
+    // refresh interval, re-scheduled lazily from last_pkt_at:
+    struct lgtd_timer               *watchdog_timer;
+    lgtd_time_mono_t                clock_sync_req_at;
+    // Messages sent with the ack required flag (see --lifx-acked-delivery)
+    // waiting for the acks of their bulbs, indexed by sequence number too
+    // (that includes the messages queued again to be retransmitted):
+    struct lgtd_lifx_message_queue  unacked_msgs;
+    struct lgtd_lifx_message        *unacked_by_seqn[UINT8_MAX + 1];
+    struct lgtd_timer               *retransmit_timer;
+    // The refresh interval adapts to the latency and to the activity on the
+    // gateway, see lgtd_lifx_gateway_update_refresh_interval:
+    int                             refresh_interval;
+    enum lgtd_lifx_gateway_refresh_reason refresh_reason;
+    lgtd_time_mono_t                last_command_at;
+    lgtd_time_mono_t                last_client_read_at;
+    lgtd_time_mono_t                last_change_at;
 };
 LIST_HEAD(lgtd_lifx_gateway_list, lgtd_lifx_gateway);
+TAILQ_HEAD(lgtd_lifx_gateway_queue, lgtd_lifx_gateway);
 
 extern struct lgtd_lifx_gateway_list lgtd_lifx_gateways;
+// All the gateways, from the one that has been silent for the longest time to
+// the one we last received a packet from (ordered by last_pkt_at):
+extern struct lgtd_lifx_gateway_queue lgtd_lifx_gateways_by_last_pkt;
 
 #define LGTD_LIFX_GATEWAY_SET_BULB_ATTR(gw, bulb_addr, bulb_fn, ...) do {   \
     struct lgtd_lifx_bulb *b;                                               \
@@ -107,11 +205,15 @@ struct lgtd_lifx_gateway *lgtd_lifx_gateway_open(const struct sockaddr *,
 void lgtd_lifx_gateway_close(struct lgtd_lifx_gateway *);
 void lgtd_lifx_gateway_close_all(void);
 void lgtd_lifx_gateway_remove_and_close_bulb(struct lgtd_lifx_gateway *, struct lgtd_lifx_bulb *);
+struct lgtd_lifx_bulb *lgtd_lifx_gateway_get_or_open_bulb(struct lgtd_lifx_gateway *, const uint8_t *);
 
 void lgtd_lifx_gateway_force_refresh(struct lgtd_lifx_gateway *);
+void lgtd_lifx_gateway_mark_client_read(struct lgtd_lifx_gateway *);
 lgtd_time_mono_t lgtd_lifx_gateway_latency(const struct lgtd_lifx_gateway *);
+lgtd_time_mono_t lgtd_lifx_gateway_rto(const struct lgtd_lifx_gateway *);
+lgtd_time_mono_t lgtd_lifx_gateway_sync_lead_time(void);
 
-void lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *,
+bool lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *,
                                       const struct lgtd_lifx_packet_header *,
                                       const struct lgtd_lifx_packet_info *,
                                       void *);
@@ -134,6 +236,9 @@ void lgtd_lifx_gateway_handle_packet(struct lgtd_lifx_gateway *,
                                      const void *,
                                      lgtd_time_mono_t);
 
+void lgtd_lifx_gateway_handle_ack(struct lgtd_lifx_gateway *,
+                                  const struct lgtd_lifx_packet_header *,
+                                  const void *);
 void lgtd_lifx_gateway_handle_pan_gateway(struct lgtd_lifx_gateway *,
                                           const struct lgtd_lifx_packet_header *,
                                           const struct lgtd_lifx_packet_pan_gateway *);
@@ -167,3 +272,6 @@ void lgtd_lifx_gateway_handle_bulb_label(struct lgtd_lifx_gateway *,
 void lgtd_lifx_gateway_handle_ambient_light(struct lgtd_lifx_gateway *,
                                             const struct lgtd_lifx_packet_header *,
                                             const struct lgtd_lifx_packet_ambient_light *);
+void lgtd_lifx_gateway_handle_time_state(struct lgtd_lifx_gateway *,
+                                         const struct lgtd_lifx_packet_header *,
+                                         const struct lgtd_lifx_packet_time_state *);
@@ -40,29 +40,85 @@
 struct lgtd_lifx_tag_list lgtd_lifx_tags =
     LIST_HEAD_INITIALIZER(&lgtd_lifx_tags);
 
+// The same tags are usually defined on every site, they are indexed by label
+// so "#tag" targets don't have to walk every tag:
+static struct {
+    struct lgtd_lifx_tag_list   *buckets;
+    int                         nbuckets;
+    int                         count;
+} lgtd_lifx_tagging_labels = { NULL, 0, 0 };
+
+LGTD_LIST_HASH_TABLE_GENERATE_STATIC(
+    lgtd_lifx_tagging_labels, lgtd_lifx_tagging_labels, lgtd_lifx_tag_list,
+    lgtd_lifx_tag, link_by_label, LGTD_LIFX_TAGGING_MIN_BUCKETS
+)
+
 static struct lgtd_lifx_site *
-lgtd_lifx_tagging_find_site(struct lgtd_lifx_site_list *sites,
-                            struct lgtd_lifx_gateway *gw)
+lgtd_lifx_tagging_find_site(struct lgtd_lifx_tag *tag,
+                            const struct lgtd_lifx_gateway *gw)
 {
-    struct lgtd_lifx_site *site = NULL;
-    LIST_FOREACH(site, sites, link) {
+    struct lgtd_lifx_site *site;
+    LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
         if (site->gw == gw) {
-            break;
+            return site;
         }
     }
+    return NULL;
+}
+
+static struct lgtd_lifx_site *
+lgtd_lifx_tagging_add_site(struct lgtd_lifx_tag *tag,
+                           struct lgtd_lifx_gateway *gw,
+                           int tag_id)
+{
+    if (tag->nsites == tag->sites_capacity) {
+        int capacity = LGTD_MAX(
+            tag->sites_capacity * 2, LGTD_LIFX_TAGGING_MIN_SITES
+        );
+        struct lgtd_lifx_site *sites = realloc(
+            tag->sites, capacity * sizeof(*sites)
+        );
+        if (!sites) {
+            return NULL;
+        }
+        tag->sites = sites;
+        tag->sites_capacity = capacity;
+    }
+
+    struct lgtd_lifx_site *site = &tag->sites[tag->nsites++];
+    site->gw = gw;
+    site->tag_id = tag_id;
     return site;
 }
 
+static void
+lgtd_lifx_tagging_remove_site(struct lgtd_lifx_tag *tag,
+                              struct lgtd_lifx_site *site)
+{
+    assert(site >= tag->sites && site < tag->sites + tag->nsites);
+
+    // the order of the sites doesn't matter, move the last one in the hole:
+    *site = tag->sites[--tag->nsites];
+}
+
 struct lgtd_lifx_tag *
 lgtd_lifx_tagging_find_tag(const char *tag_label)
 {
-    struct lgtd_lifx_tag *tag = NULL;
-    LIST_FOREACH(tag, &lgtd_lifx_tags, link) {
-        if (!strcmp(tag->label, tag_label)) {
-            break;
+    assert(tag_label);
+
+    if (!lgtd_lifx_tagging_labels.nbuckets) {
+        return NULL;
+    }
+
+    int len = LGTD_MIN(strlen(tag_label), LGTD_LIFX_LABEL_SIZE);
+    uint32_t hash = lgtd_fnv1a(tag_label, len, 0);
+    struct lgtd_lifx_tag *tag;
+    LIST_FOREACH(tag, lgtd_lifx_tagging_labels_bucket(hash), link_by_label) {
+        if (tag->hash == hash && !strcmp(tag->label, tag_label)) {
+            return tag;
         }
     }
-    return tag;
+    return NULL;
 }
 
 struct lgtd_lifx_tag *
@@ -77,6 +133,11 @@ lgtd_lifx_tagging_allocate_tag(const char *tag_label)
     }
 
     strncpy(tag->label, tag_label, sizeof(tag->label) - 1);
+    tag->hash = lgtd_fnv1a(tag->label, strlen(tag->label), 0);
+    if (!lgtd_lifx_tagging_labels_insert(tag)) {
+        free(tag);
+        return NULL;
+    }
     LIST_INSERT_HEAD(&lgtd_lifx_tags, tag, link);
     return tag;
 }
@@ -85,9 +146,11 @@ void
 lgtd_lifx_tagging_deallocate_tag(struct lgtd_lifx_tag *tag)
 {
     assert(tag);
-    assert(LIST_EMPTY(&tag->sites));
+    assert(!tag->nsites);
 
     LIST_REMOVE(tag, link);
+    lgtd_lifx_tagging_labels_remove(tag);
+    free(tag->sites);
     free(tag);
 }
 
@@ -110,9 +173,9 @@ lgtd_lifx_tagging_incref(const char *tag_label,
         dealloc_tag = true;
     }
 
-    struct lgtd_lifx_site *site = lgtd_lifx_tagging_find_site(&tag->sites, gw);
+    struct lgtd_lifx_site *site = lgtd_lifx_tagging_find_site(tag, gw);
     if (!site) {
-        site = calloc(1, sizeof(*site));
+        site = lgtd_lifx_tagging_add_site(tag, gw, tag_id);
         if (!site) {
             if (dealloc_tag) {
                 lgtd_lifx_tagging_deallocate_tag(tag);
@@ -129,9 +192,6 @@ lgtd_lifx_tagging_incref(const char *tag_label,
             tag_label, gw->peeraddr,
             LGTD_IEEE8023MACTOA(gw->site.as_array, site_addr), tag_id
         );
-        site->gw = gw;
-        site->tag_id = tag_id;
-        LIST_INSERT_HEAD(&tag->sites, site, link);
     }
     assert(site->tag_id == tag_id);
 
@@ -145,8 +205,7 @@ lgtd_lifx_tagging_decref(struct lgtd_lifx_tag *tag,
     assert(tag);
     assert(gw);
 
-    struct lgtd_lifx_site *site;
-    site = lgtd_lifx_tagging_find_site(&tag->sites, gw);
+    struct lgtd_lifx_site *site = lgtd_lifx_tagging_find_site(tag, gw);
     if (site) {
         char site_addr[LGTD_LIFX_ADDR_STRLEN];
         lgtd_debug(
@@ -154,10 +213,9 @@ lgtd_lifx_tagging_decref(struct lgtd_lifx_tag *tag,
             tag->label, gw->peeraddr,
             LGTD_IEEE8023MACTOA(gw->site.as_array, site_addr)
         );
-        LIST_REMOVE(site, link);
-        free(site);
+        lgtd_lifx_tagging_remove_site(tag, site);
     }
-    if (LIST_EMPTY(&tag->sites)) {
+    if (!tag->nsites) {
         lgtd_info("forgetting unused tag [%s]", tag->label);
         lgtd_lifx_tagging_deallocate_tag(tag);
     }
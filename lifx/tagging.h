@@ -21,20 +21,32 @@ struct lgtd_lifx_gateway;
 
 extern struct lgtd_lifx_tag_list lgtd_lifx_tags;
 
+// Where a tag is defined, the sites of a tag are kept in a dense array so
+// sending something to a tag is a tight loop over its gateways:
 struct lgtd_lifx_site {
-    LIST_ENTRY(lgtd_lifx_site)  link;
-    int                         tag_id;
     struct lgtd_lifx_gateway    *gw;
+    int                         tag_id;
 };
-LIST_HEAD(lgtd_lifx_site_list, lgtd_lifx_site);
 
 struct lgtd_lifx_tag {
     LIST_ENTRY(lgtd_lifx_tag)   link;
+    LIST_ENTRY(lgtd_lifx_tag)   link_by_label;
+    uint32_t                    hash;
     char                        label[LGTD_LIFX_LABEL_SIZE];
-    struct lgtd_lifx_site_list  sites;
+    struct lgtd_lifx_site       *sites;
+    int                         nsites;
+    int                         sites_capacity;
 };
 LIST_HEAD(lgtd_lifx_tag_list, lgtd_lifx_tag);
 
+enum { LGTD_LIFX_TAGGING_MIN_BUCKETS = 16 };
+enum { LGTD_LIFX_TAGGING_MIN_SITES = 4 };
+
+#define LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag)                   \
+    for ((site) = (tag)->sites;                                     \
+         (site) != (tag)->sites + (tag)->nsites;                    \
+         (site)++)
+
 struct lgtd_lifx_tag *lgtd_lifx_tagging_incref(const char *,
                                                struct lgtd_lifx_gateway *,
                                                int);
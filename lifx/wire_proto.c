@@ -17,6 +17,7 @@
 
 #include <sys/queue.h>
 #include <sys/tree.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 #include <assert.h>
 #include <endian.h>
@@ -127,7 +128,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_PAN_GATEWAY",
-            .type = LGTD_LIFX_GET_PAN_GATEWAY
+            .type = LGTD_LIFX_GET_PAN_GATEWAY,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             .name = "PAN_GATEWAY",
@@ -142,12 +144,14 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .name = "SET_TAG_LABELS",
             .type = LGTD_LIFX_SET_TAG_LABELS,
             .size = sizeof(struct lgtd_lifx_packet_tag_labels),
+            .ack_required = true,
             .encode = ENCODER(lgtd_lifx_wire_encode_tag_labels)
         },
         {
             REQUEST_ONLY,
             .name = "GET_TAG_LABELS",
             .type = LGTD_LIFX_GET_TAG_LABELS,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW,
             .size = sizeof(struct lgtd_lifx_packet_tags),
             .encode = ENCODER(lgtd_lifx_wire_encode_tags)
         },
@@ -165,6 +169,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .name = "SET_LIGHT_COLOR",
             .type = LGTD_LIFX_SET_LIGHT_COLOR,
             .size = sizeof(struct lgtd_lifx_packet_light_color),
+            .ack_required = true,
+            .last_write_wins = true,
             .encode = ENCODER(lgtd_lifx_wire_encode_light_color)
         },
         {
@@ -172,13 +178,15 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .name = "SET_WAVEFORM",
             .type = LGTD_LIFX_SET_WAVEFORM,
             .size = sizeof(struct lgtd_lifx_packet_waveform),
+            .ack_required = true,
             .encode = ENCODER(lgtd_lifx_wire_encode_waveform)
         },
         {
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_LIGHT_STATUS",
-            .type = LGTD_LIFX_GET_LIGHT_STATE
+            .type = LGTD_LIFX_GET_LIGHT_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -194,6 +202,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .size = sizeof(struct lgtd_lifx_packet_power_state),
             .name = "SET_POWER_STATE",
             .type = LGTD_LIFX_SET_POWER_STATE,
+            .ack_required = true,
+            .last_write_wins = true,
         },
         {
             RESPONSE_ONLY,
@@ -208,6 +218,7 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .name = "SET_TAGS",
             .type = LGTD_LIFX_SET_TAGS,
             .size = sizeof(struct lgtd_lifx_packet_tags),
+            .ack_required = true,
             .encode = ENCODER(lgtd_lifx_wire_encode_tags)
         },
         {
@@ -222,7 +233,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_MESH_INFO",
-            .type = LGTD_LIFX_GET_MESH_INFO
+            .type = LGTD_LIFX_GET_MESH_INFO,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -236,7 +248,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_MESH_FIRMWARE",
-            .type = LGTD_LIFX_GET_MESH_FIRMWARE
+            .type = LGTD_LIFX_GET_MESH_FIRMWARE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -251,6 +264,7 @@ lgtd_lifx_wire_load_packet_info_map(void)
             NO_PAYLOAD,
             .name = "GET_WIFI_INFO",
             .type = LGTD_LIFX_GET_WIFI_INFO,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW,
         },
         {
             RESPONSE_ONLY,
@@ -264,7 +278,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_WIFI_FIRMWARE_STATE",
-            .type = LGTD_LIFX_GET_WIFI_FIRMWARE_STATE
+            .type = LGTD_LIFX_GET_WIFI_FIRMWARE_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -278,7 +293,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_VERSION",
-            .type = LGTD_LIFX_GET_VERSION
+            .type = LGTD_LIFX_GET_VERSION,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -292,7 +308,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_INFO",
-            .type = LGTD_LIFX_GET_INFO
+            .type = LGTD_LIFX_GET_INFO,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -307,7 +324,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .encode = lgtd_lifx_wire_null_packet_encoder_decoder,
             .name = "SET_BULB_LABEL",
             .type = LGTD_LIFX_SET_BULB_LABEL,
-            .size = sizeof(struct lgtd_lifx_packet_label)
+            .size = sizeof(struct lgtd_lifx_packet_label),
+            .ack_required = true
         },
         {
             RESPONSE_ONLY,
@@ -321,7 +339,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
             REQUEST_ONLY,
             NO_PAYLOAD,
             .name = "GET_AMBIENT_LIGHT",
-            .type = LGTD_LIFX_GET_AMBIENT_LIGHT
+            .type = LGTD_LIFX_GET_AMBIENT_LIGHT,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             RESPONSE_ONLY,
@@ -331,26 +350,32 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .decode = DECODER(lgtd_lifx_wire_decode_ambient_light),
             .handle = HANDLER(lgtd_lifx_gateway_handle_ambient_light)
         },
-        // Unimplemented but "known" packets
         {
-            UNIMPLEMENTED,
+            REQUEST_ONLY,
+            NO_PAYLOAD,
             .name = "GET_TIME",
-            .type = LGTD_LIFX_GET_TIME
+            .type = LGTD_LIFX_GET_TIME,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
-            UNIMPLEMENTED,
-            .name = "SET_TIME",
-            .type = LGTD_LIFX_SET_TIME
+            RESPONSE_ONLY,
+            .name = "TIME_STATE",
+            .type = LGTD_LIFX_TIME_STATE,
+            .size = sizeof(struct lgtd_lifx_packet_time_state),
+            .decode = DECODER(lgtd_lifx_wire_decode_time_state),
+            .handle = HANDLER(lgtd_lifx_gateway_handle_time_state)
         },
+        // Unimplemented but "known" packets
         {
             UNIMPLEMENTED,
-            .name = "TIME_STATE",
-            .type = LGTD_LIFX_TIME_STATE
+            .name = "SET_TIME",
+            .type = LGTD_LIFX_SET_TIME
         },
         {
             UNIMPLEMENTED,
             .name = "GET_RESET_SWITCH_STATE",
-            .type = LGTD_LIFX_GET_RESET_SWITCH_STATE
+            .type = LGTD_LIFX_GET_RESET_SWITCH_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -360,7 +385,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_DUMMY_PAYLOAD",
-            .type = LGTD_LIFX_GET_DUMMY_PAYLOAD
+            .type = LGTD_LIFX_GET_DUMMY_PAYLOAD,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -375,12 +401,14 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_BULB_LABEL",
-            .type = LGTD_LIFX_GET_BULB_LABEL
+            .type = LGTD_LIFX_GET_BULB_LABEL,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
             .name = "GET_MCU_RAIL_VOLTAGE",
-            .type = LGTD_LIFX_GET_MCU_RAIL_VOLTAGE
+            .type = LGTD_LIFX_GET_MCU_RAIL_VOLTAGE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -423,9 +451,11 @@ lgtd_lifx_wire_load_packet_info_map(void)
             .type = LGTD_LIFX_SET_PAN_GATEWAY
         },
         {
-            UNIMPLEMENTED,
+            RESPONSE_ONLY,
             .name = "ACK",
-            .type = LGTD_LIFX_ACK
+            .type = LGTD_LIFX_ACK,
+            .decode = lgtd_lifx_wire_null_packet_encoder_decoder,
+            .handle = HANDLER(lgtd_lifx_gateway_handle_ack)
         },
         {
             UNIMPLEMENTED,
@@ -440,7 +470,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_LOCATION",
-            .type = LGTD_LIFX_GET_LOCATION
+            .type = LGTD_LIFX_GET_LOCATION,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -455,7 +486,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_GROUP",
-            .type = LGTD_LIFX_GET_GROUP
+            .type = LGTD_LIFX_GET_GROUP,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -470,7 +502,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_OWNER",
-            .type = LGTD_LIFX_GET_OWNER
+            .type = LGTD_LIFX_GET_OWNER,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -485,7 +518,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_FACTORY_TEST_MODE",
-            .type = LGTD_LIFX_GET_FACTORY_TEST_MODE
+            .type = LGTD_LIFX_GET_FACTORY_TEST_MODE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -515,7 +549,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_RAIL_VOLTAGE",
-            .type = LGTD_LIFX_GET_RAIL_VOLTAGE
+            .type = LGTD_LIFX_GET_RAIL_VOLTAGE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -525,7 +560,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_TEMPERATURE",
-            .type = LGTD_LIFX_GET_TEMPERATURE
+            .type = LGTD_LIFX_GET_TEMPERATURE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -545,7 +581,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_SIMPLE_EVENT",
-            .type = LGTD_LIFX_GET_SIMPLE_EVENT
+            .type = LGTD_LIFX_GET_SIMPLE_EVENT,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -555,7 +592,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_POWER",
-            .type = LGTD_LIFX_GET_POWER
+            .type = LGTD_LIFX_GET_POWER,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -590,7 +628,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_AUTH_KEY",
-            .type = LGTD_LIFX_GET_AUTH_KEY
+            .type = LGTD_LIFX_GET_AUTH_KEY,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -620,7 +659,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_HOST",
-            .type = LGTD_LIFX_GET_HOST
+            .type = LGTD_LIFX_GET_HOST,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -630,7 +670,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_WIFI_STATE",
-            .type = LGTD_LIFX_GET_WIFI_STATE
+            .type = LGTD_LIFX_GET_WIFI_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -645,7 +686,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_ACCESS_POINTS",
-            .type = LGTD_LIFX_GET_ACCESS_POINTS
+            .type = LGTD_LIFX_GET_ACCESS_POINTS,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -660,7 +702,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_ACCESS_POINT",
-            .type = LGTD_LIFX_GET_ACCESS_POINT
+            .type = LGTD_LIFX_GET_ACCESS_POINT,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -675,7 +718,8 @@ lgtd_lifx_wire_load_packet_info_map(void)
         {
             UNIMPLEMENTED,
             .name = "GET_DIMMER_VOLTAGE",
-            .type = LGTD_LIFX_GET_DIMMER_VOLTAGE
+            .type = LGTD_LIFX_GET_DIMMER_VOLTAGE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -709,6 +753,12 @@ lgtd_lifx_wire_setup(void)
     } while (!lgtd_lifx_client_id);
 }
 
+uint32_t
+lgtd_lifx_wire_get_client_id(void)
+{
+    return lgtd_lifx_client_id;
+}
+
 
 #define WAVEFORM_ENTRY(e) { .str = e, .len = sizeof(e) - 1 }
 const struct lgtd_lifx_waveform_string_id lgtd_lifx_waveform_table[] = {
@@ -737,6 +787,162 @@ lgtd_lifx_wire_waveform_string_id_to_type(const char *s, int len)
     return LGTD_LIFX_WAVEFORM_INVALID;
 }
 
+union lgtd_lifx_wire_recv_buf {
+    char                            buf[LGTD_LIFX_MAX_PACKET_SIZE];
+    struct lgtd_lifx_packet_header  hdr;
+};
+
+#if LGTD_HAVE_RECVMMSG
+// The daemon is single threaded and lgtd_lifx_wire_handle_receive is never
+// re-entered, so we can reuse the same buffers for every socket:
+static struct {
+    struct mmsghdr                  msgs[LGTD_LIFX_WIRE_RECV_BATCH_SIZE];
+    struct iovec                    iovs[LGTD_LIFX_WIRE_RECV_BATCH_SIZE];
+    struct sockaddr_storage         peers[LGTD_LIFX_WIRE_RECV_BATCH_SIZE];
+    union lgtd_lifx_wire_recv_buf   bufs[LGTD_LIFX_WIRE_RECV_BATCH_SIZE];
+} lgtd_lifx_wire_recv_arena;
+#endif
+
+// Decode and dispatch one datagram, the peer address is only formatted when
+// something is actually logged since that's done for every packet received.
+//
+// \return false if the datagram is invalid.
+static bool
+lgtd_lifx_wire_handle_datagram(struct lgtd_lifx_gateway *gw,
+                               union lgtd_lifx_wire_recv_buf *read,
+                               int nbytes,
+                               const struct sockaddr *peer,
+                               ev_socklen_t addrlen,
+                               lgtd_time_mono_t received_at)
+{
+    char peer_addr[INET6_ADDRSTRLEN];
+
+    if (nbytes < LGTD_LIFX_PACKET_HEADER_SIZE) {
+        lgtd_warnx(
+            "broadcast packet too short from %s",
+            LGTD_SOCKADDRTOA(peer, peer_addr)
+        );
+        return false;
+    }
+
+    lgtd_lifx_wire_decode_header(&read->hdr);
+    if (read->hdr.size != nbytes) {
+        lgtd_warnx(
+            "incomplete broadcast packet from %s",
+            LGTD_SOCKADDRTOA(peer, peer_addr)
+        );
+        return false;
+    }
+    int proto_version = read->hdr.protocol & LGTD_LIFX_PROTOCOL_VERSION_MASK;
+    if (proto_version != LGTD_LIFX_PROTOCOL_V1) {
+        lgtd_warnx(
+            "unsupported protocol %d from %s",
+            proto_version, LGTD_SOCKADDRTOA(peer, peer_addr)
+        );
+    }
+    if (read->hdr.packet_type == LGTD_LIFX_GET_PAN_GATEWAY) {
+        return true;
+    }
+
+    const struct lgtd_lifx_packet_info *pkt_info =
+        lgtd_lifx_wire_get_packet_info(read->hdr.packet_type);
+    if (!pkt_info) {
+        lgtd_info(
+            "received unknown packet %#x from %s",
+            read->hdr.packet_type, LGTD_SOCKADDRTOA(peer, peer_addr)
+        );
+        return true;
+    }
+    if (!(read->hdr.protocol & LGTD_LIFX_PROTOCOL_ADDRESSABLE)) {
+        lgtd_warnx(
+            "received non-addressable packet %s from %s",
+            pkt_info->name, LGTD_SOCKADDRTOA(peer, peer_addr)
+        );
+        return true;
+    }
+    void *pkt = &read->buf[LGTD_LIFX_PACKET_HEADER_SIZE];
+    pkt_info->decode(pkt);
+    lgtd_lifx_gateway_handle_packet(
+        gw, peer, addrlen, pkt_info, &read->hdr, pkt, received_at
+    );
+
+    return true;
+}
+
+#if LGTD_HAVE_RECVMMSG
+bool
+lgtd_lifx_wire_handle_receive(evutil_socket_t socket,
+                              struct lgtd_lifx_gateway *gw)
+{
+    assert(socket != -1);
+
+    struct mmsghdr *msgs = lgtd_lifx_wire_recv_arena.msgs;
+    for (int i = 0; i != LGTD_LIFX_WIRE_RECV_BATCH_SIZE; i++) {
+        lgtd_lifx_wire_recv_arena.iovs[i].iov_base =
+            lgtd_lifx_wire_recv_arena.bufs[i].buf;
+        lgtd_lifx_wire_recv_arena.iovs[i].iov_len =
+            sizeof(lgtd_lifx_wire_recv_arena.bufs[i].buf);
+    }
+
+    while (true) {
+        // if we get back a sockaddr_in the end of the struct will not be
+        // initialized and we will be comparing unintialized stuff in
+        // lgtd_lifx_gateway_get:
+        memset(
+            lgtd_lifx_wire_recv_arena.peers,
+            0,
+            sizeof(lgtd_lifx_wire_recv_arena.peers)
+        );
+        memset(msgs, 0, sizeof(lgtd_lifx_wire_recv_arena.msgs));
+        for (int i = 0; i != LGTD_LIFX_WIRE_RECV_BATCH_SIZE; i++) {
+            msgs[i].msg_hdr.msg_name = &lgtd_lifx_wire_recv_arena.peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            msgs[i].msg_hdr.msg_iov = &lgtd_lifx_wire_recv_arena.iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int nmsgs = recvmmsg(
+            socket, msgs, LGTD_LIFX_WIRE_RECV_BATCH_SIZE, 0, NULL
+        );
+        if (nmsgs == -1) {
+            int error = EVUTIL_SOCKET_ERROR();
+            if (error == EINTR) {
+                continue;
+            }
+            if (error == EAGAIN) {
+                return true;
+            }
+            lgtd_warn("can't receive LIFX packet");
+            // the caller checks the error to know if the socket is usable:
+            EVUTIL_SET_SOCKET_ERROR(error);
+            return false;
+        }
+
+        lgtd_time_mono_t received_at = lgtd_time_monotonic_msecs();
+        for (int i = 0; i != nmsgs; i++) {
+            bool ok = lgtd_lifx_wire_handle_datagram(
+                gw,
+                &lgtd_lifx_wire_recv_arena.bufs[i],
+                msgs[i].msg_len,
+                (const struct sockaddr *)&lgtd_lifx_wire_recv_arena.peers[i],
+                msgs[i].msg_hdr.msg_namelen,
+                received_at
+            );
+            // Anyone can send to the shared socket, so an invalid datagram
+            // only resets the socket connected to a gateway:
+            if (!ok && gw) {
+                return false;
+            }
+        }
+
+        // A short batch means the socket has been drained, don't waste a
+        // syscall just to get EAGAIN back:
+        if (nmsgs < LGTD_LIFX_WIRE_RECV_BATCH_SIZE) {
+            return true;
+        }
+    }
+}
+#else
 bool
 lgtd_lifx_wire_handle_receive(evutil_socket_t socket,
                               struct lgtd_lifx_gateway *gw)
@@ -750,10 +956,7 @@ lgtd_lifx_wire_handle_receive(evutil_socket_t socket,
         // in lgtd_lifx_gateway_get:
         memset(&peer, 0, sizeof(peer));
         ev_socklen_t addrlen = sizeof(peer);
-        union {
-            char buf[LGTD_LIFX_MAX_PACKET_SIZE];
-            struct lgtd_lifx_packet_header hdr;
-        } read;
+        union lgtd_lifx_wire_recv_buf read;
         int nbytes = recvfrom(
             socket,
             read.buf,
@@ -771,58 +974,27 @@ lgtd_lifx_wire_handle_receive(evutil_socket_t socket,
                 return true;
             }
             lgtd_warn("can't receive LIFX packet");
+            // the caller checks the error to know if the socket is usable:
+            EVUTIL_SET_SOCKET_ERROR(error);
             return false;
         }
 
-        lgtd_time_mono_t received_at = lgtd_time_monotonic_msecs();
-        char peer_addr[INET6_ADDRSTRLEN];
-        LGTD_SOCKADDRTOA((const struct sockaddr *)&peer, peer_addr);
-
-        if (nbytes < LGTD_LIFX_PACKET_HEADER_SIZE) {
-            lgtd_warnx("broadcast packet too short from %s", peer_addr);
-            return false;
-        }
-
-        lgtd_lifx_wire_decode_header(&read.hdr);
-        if (read.hdr.size != nbytes) {
-            lgtd_warnx("incomplete broadcast packet from %s", peer_addr);
+        bool ok = lgtd_lifx_wire_handle_datagram(
+            gw,
+            &read,
+            nbytes,
+            (const struct sockaddr *)&peer,
+            addrlen,
+            lgtd_time_monotonic_msecs()
+        );
+        // Anyone can send to the shared socket, so an invalid datagram only
+        // resets the socket connected to a gateway:
+        if (!ok && gw) {
             return false;
         }
-        int proto_version = read.hdr.protocol & LGTD_LIFX_PROTOCOL_VERSION_MASK;
-        if (proto_version != LGTD_LIFX_PROTOCOL_V1) {
-            lgtd_warnx(
-                "unsupported protocol %d from %s",
-                read.hdr.protocol & LGTD_LIFX_PROTOCOL_VERSION_MASK, peer_addr
-            );
-        }
-        if (read.hdr.packet_type == LGTD_LIFX_GET_PAN_GATEWAY) {
-            continue;
-        }
-
-        const struct lgtd_lifx_packet_info *pkt_info =
-            lgtd_lifx_wire_get_packet_info(read.hdr.packet_type);
-        if (!pkt_info) {
-            lgtd_info(
-                "received unknown packet %#x from %s",
-                read.hdr.packet_type, peer_addr
-            );
-            continue;
-        }
-        if (!(read.hdr.protocol & LGTD_LIFX_PROTOCOL_ADDRESSABLE)) {
-            lgtd_warnx(
-                "received non-addressable packet %s from %s",
-                pkt_info->name, peer_addr
-            );
-            continue;
-        }
-        void *pkt = &read.buf[LGTD_LIFX_PACKET_HEADER_SIZE];
-        pkt_info->decode(pkt);
-        struct sockaddr *addr = (struct sockaddr *)&peer;
-        lgtd_lifx_gateway_handle_packet(
-            gw, addr, addrlen, pkt_info, &read.hdr, pkt, received_at
-        );
     }
 }
+#endif
 
 static void
 lgtd_lifx_wire_encode_header(struct lgtd_lifx_packet_header *hdr, int flags)
@@ -1066,3 +1238,11 @@ lgtd_lifx_wire_decode_ambient_light(struct lgtd_lifx_packet_ambient_light *pkt)
 
     pkt->illuminance = lgtd_lifx_wire_lefloattoh(pkt->illuminance);
 }
+
+void
+lgtd_lifx_wire_decode_time_state(struct lgtd_lifx_packet_time_state *pkt)
+{
+    assert(pkt);
+
+    pkt->time = le64toh(pkt->time);
+}
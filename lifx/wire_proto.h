@@ -95,8 +95,9 @@ struct lgtd_lifx_packet_header {
     //! identifier in the Frame. See _ack_required_ and _res_required_ fields in
     //! the Frame Address.
     uint8_t         seqn;
-    //! Apparently this is a unix epoch timestamp in milliseconds at which the
-    //! payload should be run.
+    //! Timestamp at which the payload should be run, on the bulb clock and
+    //! in the same unit as TIME_STATE (nanoseconds since the epoch), 0 means
+    //! now.
     uint64le_t      at_time;
     uint16le_t      packet_type;
     uint8_t         reserved[2];
@@ -136,6 +137,11 @@ enum lgtd_lifx_flags {
 // headers:
 enum { LGTD_LIFX_MAX_PACKET_SIZE = 4096 };
 
+// How many datagrams we try to get out of a socket with one recvmmsg call,
+// this is also the number of LGTD_LIFX_MAX_PACKET_SIZE buffers kept around
+// for the receive path:
+enum { LGTD_LIFX_WIRE_RECV_BATCH_SIZE = 16 };
+
 enum lgtd_lifx_packet_type { // FIXME: normalize and prefix everything correctly
     // Device
     LGTD_LIFX_SET_SITE = 0x01,
@@ -356,6 +362,10 @@ struct lgtd_lifx_packet_runtime_info {
     uint64le_t  downtime;
 };
 
+struct lgtd_lifx_packet_time_state {
+    uint64le_t  time; // ns since epoch
+};
+
 struct lgtd_lifx_packet_ambient_light {
     floatle_t illuminance; // lux
 };
@@ -380,11 +390,27 @@ extern const struct lgtd_lifx_waveform_string_id lgtd_lifx_waveform_table[];
 
 struct lgtd_lifx_gateway;
 
+// Packets sent on behalf of a client always go out before the packets
+// lightsd sends on its own to refresh the state of the bulbs:
+enum lgtd_lifx_gateway_priority {
+    LGTD_LIFX_GATEWAY_PRIORITY_HIGH = 0,
+    LGTD_LIFX_GATEWAY_PRIORITY_LOW,
+    LGTD_LIFX_GATEWAY_PRIORITY_COUNT
+};
+
 struct lgtd_lifx_packet_info {
     RB_ENTRY(lgtd_lifx_packet_info)     link;
     const char                          *name;
     enum lgtd_lifx_packet_type          type;
     unsigned                            size;
+    // A newer packet of this type can overwrite one that hasn't been sent
+    // yet to the same target (the payload is an absolute state):
+    bool                                last_write_wins;
+    // The packet changes the state of the bulbs, with --lifx-acked-delivery
+    // the bulbs are asked to acknowledge it:
+    bool                                ack_required;
+    // The queue of the gateway this packet goes into:
+    enum lgtd_lifx_gateway_priority     priority;
     void                                (*decode)(void *);
     void                                (*encode)(void *);
     void                                (*handle)(struct lgtd_lifx_gateway *,
@@ -448,6 +474,7 @@ enum lgtd_lifx_waveform_type lgtd_lifx_wire_waveform_string_id_to_type(const cha
 const struct lgtd_lifx_packet_info *lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type);
 
 void lgtd_lifx_wire_setup(void);
+uint32_t lgtd_lifx_wire_get_client_id(void);
 
 bool lgtd_lifx_wire_handle_receive(evutil_socket_t, struct lgtd_lifx_gateway *);
 
@@ -482,3 +509,4 @@ void lgtd_lifx_wire_decode_ip_firmware_info(struct lgtd_lifx_packet_ip_firmware_
 void lgtd_lifx_wire_decode_product_info(struct lgtd_lifx_packet_product_info *);
 void lgtd_lifx_wire_decode_runtime_info(struct lgtd_lifx_packet_runtime_info *);
 void lgtd_lifx_wire_decode_ambient_light(struct lgtd_lifx_packet_ambient_light *);
+void lgtd_lifx_wire_decode_time_state(struct lgtd_lifx_packet_time_state *);
@@ -0,0 +1,123 @@
+#include "client.c"
+
+#include "lifx/wire_proto.h"
+
+#include "mock_daemon.h"
+#define MOCKED_EVBUFFER_PULLUP
+#define MOCKED_EVBUFFER_DRAIN
+#define MOCKED_EVBUFFER_GET_LENGTH
+#define MOCKED_BUFFEREVENT_GET_INPUT
+#include "mock_event2.h"
+#include "mock_gateway.h"
+#define MOCKED_JSONRPC_DISPATCH_REQUEST
+#define MOCKED_JSONRPC_DISPATCH_BATCH_PART
+#define MOCKED_JSONRPC_END_BATCH
+#include "mock_jsonrpc.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+#include "tests_utils.h"
+#include "tests_client_utils.h"
+
+#define REQUEST "{"                             \
+    "\"jsonrpc\": \"2.0\","                     \
+    "\"method\": \"set_light_from_hsbk\","      \
+    "\"params\": [\"*\", 120, 1, 1, 3500, 0],"  \
+    "\"id\": 42"                                \
+"}"
+
+enum { BATCH_SIZE = 200 };
+
+static char batch[BATCH_SIZE * sizeof(REQUEST) + 2];
+
+static int jsonrpc_dispatch_batch_part_call_count = 0;
+
+int
+lgtd_jsonrpc_dispatch_batch_part(struct lgtd_client *client,
+                                 const jsmntok_t *tokens,
+                                 int ntokens)
+{
+    (void)client;
+    (void)tokens;
+
+    if (ntokens != 15) {
+        errx(1, "ntokens = %d (expected 15)", ntokens);
+    }
+
+    jsonrpc_dispatch_batch_part_call_count++;
+
+    return ntokens;
+}
+
+static int jsonrpc_end_batch_call_count = 0;
+
+void
+lgtd_jsonrpc_end_batch(struct lgtd_client *client)
+{
+    (void)client;
+
+    jsonrpc_end_batch_call_count++;
+}
+
+void
+lgtd_jsonrpc_dispatch_request(struct lgtd_client *client, int parsed)
+{
+    (void)client;
+    (void)parsed;
+
+    errx(1, "jsonrpc_dispatch_request shouldn't have been called");
+}
+
+int
+main(void)
+{
+    int len = 0;
+    batch[len++] = '[';
+    for (int i = 0; i != BATCH_SIZE; i++) {
+        if (i) {
+            batch[len++] = ',';
+        }
+        memcpy(&batch[len], REQUEST, sizeof(REQUEST) - 1);
+        len += sizeof(REQUEST) - 1;
+    }
+    batch[len++] = ']';
+    if (len <= (int)sizeof(client_input) / 2) {
+        errx(1, "the batch should be larger than the input buffer");
+    }
+
+    struct lgtd_client *client;
+    client = lgtd_tests_insert_mock_client(FAKE_BUFFEREVENT);
+
+    // the batch is bigger than LGTD_CLIENT_MAX_REQUEST_BUF_SIZE but is
+    // executed as it's received:
+    for (int i = 0; i < len; i += 1000) {
+        lgtd_tests_client_feed(client, &batch[i], LGTD_MIN(1000, len - i));
+        if (client_input_len >= (int)sizeof(REQUEST)) {
+            errx(1, "%d bytes buffered", client_input_len);
+        }
+        if (client->jsmn_tokens_size != LGTD_CLIENT_MIN_JSMN_TOKENS) {
+            errx(
+                1, "jsmn_tokens_size = %d (expected %d)",
+                client->jsmn_tokens_size, LGTD_CLIENT_MIN_JSMN_TOKENS
+            );
+        }
+    }
+
+    if (jsonrpc_dispatch_batch_part_call_count != BATCH_SIZE) {
+        errx(
+            1, "jsonrpc_dispatch_batch_part_call_count = %d (expected %d)",
+            jsonrpc_dispatch_batch_part_call_count, BATCH_SIZE
+        );
+    }
+    if (jsonrpc_end_batch_call_count != 1) {
+        errx(
+            1, "jsonrpc_end_batch_call_count = %d (expected 1)",
+            jsonrpc_end_batch_call_count
+        );
+    }
+    lgtd_tests_client_check_input_len(0);
+
+    return 0;
+}
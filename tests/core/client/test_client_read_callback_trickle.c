@@ -0,0 +1,167 @@
+#include "client.c"
+
+#include "lifx/wire_proto.h"
+
+#include "mock_daemon.h"
+#define MOCKED_EVBUFFER_PULLUP
+#define MOCKED_EVBUFFER_DRAIN
+#define MOCKED_EVBUFFER_GET_LENGTH
+#define MOCKED_BUFFEREVENT_GET_INPUT
+#include "mock_event2.h"
+#include "mock_gateway.h"
+#define MOCKED_JSONRPC_DISPATCH_REQUEST
+#define MOCKED_JSONRPC_DISPATCH_BATCH_PART
+#define MOCKED_JSONRPC_END_BATCH
+#include "mock_jsonrpc.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+#include "tests_utils.h"
+#include "tests_client_utils.h"
+
+#define REQUEST "{"                     \
+    "\"jsonrpc\": \"2.0\","             \
+    "\"method\": \"get_light_state\","  \
+    "\"params\": [\"*\"],"              \
+    "\"id\": 42"                        \
+"}"
+
+#define REQUEST_LEN (int)(sizeof(REQUEST) - 1)
+
+#define BATCH "[" REQUEST "," REQUEST "," REQUEST "," REQUEST "]"
+
+static const char input[] = BATCH " \n" REQUEST;
+
+#define INPUT_LEN (int)(sizeof(input) - 1)
+
+static void
+check_request(const struct lgtd_client *client,
+              const jsmntok_t *tokens,
+              int ntokens,
+              int first_token)
+{
+    const char *json = client->json + tokens[0].start;
+    int len = tokens[0].end - tokens[0].start;
+
+    if (ntokens != 10 || len != REQUEST_LEN || memcmp(json, REQUEST, len)) {
+        errx(
+            1, "got unexpected json %.*s (%d tokens) (expected %s)",
+            len, json, ntokens, REQUEST
+        );
+    }
+    // the parents are indexes in the whole array of tokens:
+    for (int i = 1; i != ntokens; i++) {
+        int parent = tokens[i].parent - first_token;
+        if (parent < 0 || parent >= i) {
+            errx(1, "token %d has an invalid parent %d", i, tokens[i].parent);
+        }
+    }
+}
+
+static int jsonrpc_dispatch_batch_part_call_count = 0;
+static int jsonrpc_end_batch_call_count = 0;
+
+int
+lgtd_jsonrpc_dispatch_batch_part(struct lgtd_client *client,
+                                 const jsmntok_t *tokens,
+                                 int ntokens)
+{
+    if (jsonrpc_end_batch_call_count) {
+        errx(1, "the batch was already over");
+    }
+
+    // the request was dispatched as soon as it was received:
+    if (client_input_len != tokens[0].end) {
+        errx(
+            1, "%d bytes buffered (expected %d)",
+            client_input_len, tokens[0].end
+        );
+    }
+    check_request(client, tokens, ntokens, 1);
+
+    jsonrpc_dispatch_batch_part_call_count++;
+
+    return ntokens;
+}
+
+void
+lgtd_jsonrpc_end_batch(struct lgtd_client *client)
+{
+    (void)client;
+
+    if (jsonrpc_dispatch_batch_part_call_count != 4) {
+        errx(
+            1, "jsonrpc_dispatch_batch_part_call_count = %d (expected 4)",
+            jsonrpc_dispatch_batch_part_call_count
+        );
+    }
+    if (jsonrpc_end_batch_call_count++) {
+        errx(1, "jsonrpc_end_batch should have been called once");
+    }
+}
+
+static int jsonrpc_dispatch_request_call_count = 0;
+
+void
+lgtd_jsonrpc_dispatch_request(struct lgtd_client *client, int parsed)
+{
+    if (!jsonrpc_end_batch_call_count) {
+        errx(1, "the batch should have been over");
+    }
+
+    // the batch has been drained, the request is at the beginning:
+    if (client->jsmn_tokens[0].start != 0) {
+        errx(
+            1, "the request starts at %d (expected 0)",
+            client->jsmn_tokens[0].start
+        );
+    }
+    check_request(client, client->jsmn_tokens, parsed, 0);
+
+    if (jsonrpc_dispatch_request_call_count++) {
+        errx(1, "jsonrpc_dispatch_request should have been called once");
+    }
+}
+
+int
+main(void)
+{
+    struct lgtd_client *client;
+    client = lgtd_tests_insert_mock_client(FAKE_BUFFEREVENT);
+
+    // a slow client, sending one byte at a time:
+    for (int i = 0; i != INPUT_LEN; i++) {
+        lgtd_tests_client_feed(client, &input[i], 1);
+        // no byte is ever tokenized twice:
+        if ((int)client->jsmn_ctx.pos > client_input_len) {
+            errx(
+                1, "pos = %d past the end of the input (%d bytes)",
+                client->jsmn_ctx.pos, client_input_len
+            );
+        }
+    }
+
+    if (jsonrpc_dispatch_request_call_count != 1
+        || jsonrpc_end_batch_call_count != 1) {
+        errx(
+            1, "jsonrpc_dispatch_request_call_count = %d, "
+            "jsonrpc_end_batch_call_count = %d (expected 1, 1)",
+            jsonrpc_dispatch_request_call_count, jsonrpc_end_batch_call_count
+        );
+    }
+    // the elements of the batch don't pile up:
+    if (client->jsmn_tokens_size != LGTD_CLIENT_MIN_JSMN_TOKENS) {
+        errx(
+            1, "jsmn_tokens_size = %d (expected %d)",
+            client->jsmn_tokens_size, LGTD_CLIENT_MIN_JSMN_TOKENS
+        );
+    }
+    lgtd_tests_client_check_input_len(0);
+    if (client->jsmn_ctx.pos || client->jsmn_ctx.toknext) {
+        errx(1, "the parser wasn't rewound with the input buffer");
+    }
+
+    return 0;
+}
@@ -2,3 +2,104 @@
 
 #define FAKE_BUFFEREVENT (void *)0xfeed
 #define FAKE_BUFFEREVENT_INPUT_BUF (void *)3412
+
+// What the client sent and we haven't drained yet, like a real evbuffer
+// after evbuffer_pullup(input, -1):
+static char client_input[LGTD_CLIENT_MAX_REQUEST_BUF_SIZE * 4];
+static int client_input_len = 0;
+
+static int evbuffer_get_length_call_count = 0;
+static int evbuffer_pullup_call_count = 0;
+static int evbuffer_drain_call_count = 0;
+
+static void
+lgtd_tests_client_feed(struct lgtd_client *client, const char *data, int len)
+{
+    if (client_input_len + len > (int)sizeof(client_input)) {
+        errx(1, "the fake input buffer is too small");
+    }
+
+    memcpy(&client_input[client_input_len], data, len);
+    client_input_len += len;
+    lgtd_client_read_callback(FAKE_BUFFEREVENT, client);
+}
+
+static void
+lgtd_tests_client_check_input_len(int expected)
+{
+    if (client_input_len != expected) {
+        errx(
+            1, "%d bytes left in the input buffer (expected %d)",
+            client_input_len, expected
+        );
+    }
+}
+
+struct evbuffer *
+bufferevent_get_input(struct bufferevent *bufev)
+{
+    if (bufev != FAKE_BUFFEREVENT) {
+        errx(
+            1, "bufferevent_get_input got bufev %p (expected %p)",
+            bufev, FAKE_BUFFEREVENT
+        );
+    }
+
+    return FAKE_BUFFEREVENT_INPUT_BUF;
+}
+
+size_t
+evbuffer_get_length(const struct evbuffer *buf)
+{
+    if (buf != FAKE_BUFFEREVENT_INPUT_BUF) {
+        errx(
+            1, "evbuffer_get_length got buf %p (expected %p)",
+            buf, FAKE_BUFFEREVENT_INPUT_BUF
+        );
+    }
+
+    evbuffer_get_length_call_count++;
+
+    return client_input_len;
+}
+
+unsigned char *
+evbuffer_pullup(struct evbuffer *buf, ev_ssize_t size)
+{
+    if (buf != FAKE_BUFFEREVENT_INPUT_BUF) {
+        errx(
+            1, "evbuffer_pullup got buf %p (expected %p)",
+            buf, FAKE_BUFFEREVENT_INPUT_BUF
+        );
+    }
+    if (size != -1) {
+        errx(1, "trying to pullup %jd bytes (expected -1)", (intmax_t)size);
+    }
+
+    evbuffer_pullup_call_count++;
+
+    return (unsigned char *)client_input;
+}
+
+int
+evbuffer_drain(struct evbuffer *buf, size_t len)
+{
+    if (buf != FAKE_BUFFEREVENT_INPUT_BUF) {
+        errx(
+            1, "evbuffer_drain got buf %p (expected %p)",
+            buf, FAKE_BUFFEREVENT_INPUT_BUF
+        );
+    }
+    if (!len || (int)len > client_input_len) {
+        errx(
+            1, "trying to drain %ju bytes out of %d",
+            (uintmax_t)len, client_input_len
+        );
+    }
+
+    evbuffer_drain_call_count++;
+
+    client_input_len -= len;
+    memmove(client_input, &client_input[len], client_input_len);
+    return 0;
+}
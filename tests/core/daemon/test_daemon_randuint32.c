@@ -14,6 +14,7 @@ int mock_close(int);
 #include "mock_pipe.h"
 #include "mock_router.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 static const uint32_t MOCK_RANDOM_NUMBER = 0x72616e64;
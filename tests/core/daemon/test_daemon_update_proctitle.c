@@ -10,6 +10,7 @@ void mock_setproctitle(const char *fmt, ...)
 #include "mock_pipe.h"
 #include "mock_router.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 #include "tests_utils.h"
@@ -107,5 +108,17 @@ main(void)
         errx(1, "setproctitle should have been called");
     }
 
+    expected = (
+        "listening_on([::ffff:127.0.0.1]:1234); "
+        "lifx_gateways(found=1); "
+        "lifx_refresh(command=0, client=0, churn=0, idle=1); "
+        "bulbs(found=2, on=1); "
+        "clients(connected=1)"
+    );
+    LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(gateways_refresh_idle, 1);
+    if (setproctitle_call_count != 8) {
+        errx(1, "setproctitle should have been called");
+    }
+
     return 0;
 }
@@ -19,6 +19,7 @@ pid_t mock_getpid(void);
 #include "mock_pipe.h"
 #include "mock_router.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 #include "tests_utils.h"
@@ -0,0 +1,236 @@
+#include "jsonrpc.c"
+
+#include <time.h>
+
+#include "mock_client_buf.h"
+#include "mock_log.h"
+#include "mock_proto.h"
+#include "mock_wire_proto.h"
+#include "test_jsonrpc_utils.h"
+
+// Compare the perfect hash tables used to find methods and parameters with
+// the linear search they replaced, over the keys of representative requests.
+//
+// The timings are only printed, the results of both lookups must match, build
+// it with: make bench_jsonrpc_lookup
+
+#define KEY_NODE(key) LGTD_JSONRPC_NODE(key, -1, -1, NULL, false)
+
+static const struct lgtd_jsonrpc_node request_nodes[] = {
+    KEY_NODE("jsonrpc"), KEY_NODE("method"), KEY_NODE("params"), KEY_NODE("id")
+};
+
+static const struct lgtd_jsonrpc_node waveform_nodes[] = {
+    KEY_NODE("target"), KEY_NODE("waveform"), KEY_NODE("hue"),
+    KEY_NODE("saturation"), KEY_NODE("brightness"), KEY_NODE("kelvin"),
+    KEY_NODE("period"), KEY_NODE("cycles"), KEY_NODE("skew_ratio"),
+    KEY_NODE("transient")
+};
+
+static const char *requests[] = {
+    "{"
+        "\"jsonrpc\": \"2.0\","
+        "\"method\": \"set_waveform\","
+        "\"params\": {"
+            "\"target\": \"*\", \"waveform\": \"SAW\","
+            "\"hue\": 0, \"saturation\": 1, \"brightness\": 1, \"kelvin\": 3500,"
+            "\"period\": 500, \"cycles\": 4, \"skew_ratio\": 0.5,"
+            "\"transient\": true"
+        "},"
+        "\"id\": 42"
+    "}",
+    "{"
+        "\"jsonrpc\": \"2.0\","
+        "\"method\": \"set_light_from_hsbk\","
+        "\"params\": [\"*\", 0, 1, 1, 3500, 0],"
+        "\"id\": 43"
+    "}",
+    "{"
+        "\"jsonrpc\": \"2.0\","
+        "\"method\": \"get_light_state\","
+        "\"params\": [\"*\"],"
+        "\"id\": 44"
+    "}",
+    "{"
+        "\"jsonrpc\": \"2.0\","
+        "\"method\": \"synchronize\","
+        "\"params\": {\"delay\": 500},"
+        "\"id\": 45"
+    "}",
+    "{"
+        "\"jsonrpc\": \"2.0\","
+        "\"method\": \"power_toggle\","
+        "\"params\": [\"*\"],"
+        "\"id\": 46"
+    "}"
+};
+
+enum { MAX_LOOKUPS = 128, ITERATIONS = 20000 };
+
+static struct {
+    const char                      *key;
+    int                             keylen;
+    const char                      *(*get_key)(const void *, int, int *);
+    const void                      *keys;
+    int                             nkeys;
+    struct lgtd_jsonrpc_hash_table  *table;
+} lookups[MAX_LOOKUPS];
+static int nlookups = 0;
+
+static void
+add_lookup(const char *json,
+           const jsmntok_t *tok,
+           const char *(*get_key)(const void *, int, int *),
+           const void *keys,
+           int nkeys,
+           struct lgtd_jsonrpc_hash_table *table)
+{
+    if (nlookups == MAX_LOOKUPS) {
+        errx(1, "too many lookups");
+    }
+
+    lookups[nlookups].key = &json[tok->start];
+    lookups[nlookups].keylen = LGTD_JSONRPC_TOKEN_LEN(tok);
+    lookups[nlookups].get_key = get_key;
+    lookups[nlookups].keys = keys;
+    lookups[nlookups].nkeys = nkeys;
+    lookups[nlookups].table = table;
+    nlookups++;
+}
+
+// what lgtd_jsonrpc_dispatch_one and
+// lgtd_jsonrpc_extract_values_from_schema_and_dict used to do:
+static int
+linear_get(const char *(*get_key)(const void *, int, int *),
+           const void *keys,
+           int nkeys,
+           const char *key,
+           int keylen)
+{
+    for (int i = 0; i != nkeys; i++) {
+        int candidate_len;
+        const char *candidate = get_key(keys, i, &candidate_len);
+        if (candidate_len == keylen && !memcmp(candidate, key, keylen)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double
+now_nsecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1E9 + ts.tv_nsec;
+}
+
+int
+main(void)
+{
+    static struct lgtd_jsonrpc_hash_table request_table, waveform_table;
+    lgtd_jsonrpc_hash_table_build(
+        &lgtd_jsonrpc_methods_table,
+        lgtd_jsonrpc_method_name,
+        lgtd_jsonrpc_methods,
+        LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods)
+    );
+    lgtd_jsonrpc_hash_table_build(
+        &request_table,
+        lgtd_jsonrpc_node_key,
+        request_nodes,
+        LGTD_ARRAY_SIZE(request_nodes)
+    );
+    lgtd_jsonrpc_hash_table_build(
+        &waveform_table,
+        lgtd_jsonrpc_node_key,
+        waveform_nodes,
+        LGTD_ARRAY_SIZE(waveform_nodes)
+    );
+
+    static jsmntok_t tokens[LGTD_ARRAY_SIZE(requests)][64];
+    for (int i = 0; i != LGTD_ARRAY_SIZE(requests); i++) {
+        const char *json = requests[i];
+        jsmntok_t *tok = tokens[i];
+        int parsed = parse_json(tok, 64, json, strlen(json));
+        if (parsed <= 0) {
+            errx(1, "can't parse %s", json);
+        }
+
+        for (int ti = 1; ti < parsed && tok[ti].parent == 0; ti++) {
+            add_lookup(
+                json, &tok[ti], lgtd_jsonrpc_node_key, request_nodes,
+                LGTD_ARRAY_SIZE(request_nodes), &request_table
+            );
+            const jsmntok_t *value = &tok[ti + 1];
+            int keylen = LGTD_JSONRPC_TOKEN_LEN(&tok[ti]);
+            if (!memcmp(&json[tok[ti].start], "method", keylen)) {
+                add_lookup(
+                    json, value, lgtd_jsonrpc_method_name,
+                    lgtd_jsonrpc_methods, LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods),
+                    &lgtd_jsonrpc_methods_table
+                );
+            } else if (value->type == JSMN_OBJECT) {
+                for (int pi = ti + 2; pi < parsed; pi += 2) {
+                    add_lookup(
+                        json, &tok[pi], lgtd_jsonrpc_node_key, waveform_nodes,
+                        LGTD_ARRAY_SIZE(waveform_nodes), &waveform_table
+                    );
+                }
+            }
+            // skip the value:
+            ti++;
+            while (ti + 1 < parsed && tok[ti + 1].parent > 0) {
+                ti++;
+            }
+        }
+    }
+
+    for (int i = 0; i != nlookups; i++) {
+        int expected = linear_get(
+            lookups[i].get_key, lookups[i].keys, lookups[i].nkeys,
+            lookups[i].key, lookups[i].keylen
+        );
+        int got = lgtd_jsonrpc_hash_table_get(
+            lookups[i].table, lookups[i].get_key, lookups[i].keys,
+            lookups[i].key, lookups[i].keylen
+        );
+        if (got != expected) {
+            errx(
+                1, "%.*s: hash table index %d (expected %d)",
+                lookups[i].keylen, lookups[i].key, got, expected
+            );
+        }
+    }
+
+    volatile int sink = 0;
+    double start = now_nsecs();
+    for (int n = 0; n != ITERATIONS; n++) {
+        for (int i = 0; i != nlookups; i++) {
+            sink += linear_get(
+                lookups[i].get_key, lookups[i].keys, lookups[i].nkeys,
+                lookups[i].key, lookups[i].keylen
+            );
+        }
+    }
+    double linear = (now_nsecs() - start) / ((double)ITERATIONS * nlookups);
+
+    start = now_nsecs();
+    for (int n = 0; n != ITERATIONS; n++) {
+        for (int i = 0; i != nlookups; i++) {
+            sink += lgtd_jsonrpc_hash_table_get(
+                lookups[i].table, lookups[i].get_key, lookups[i].keys,
+                lookups[i].key, lookups[i].keylen
+            );
+        }
+    }
+    double hashed = (now_nsecs() - start) / ((double)ITERATIONS * nlookups);
+
+    printf(
+        "%d keys looked up %d times: linear search %.1fns, "
+        "perfect hash %.1fns per key\n",
+        nlookups, ITERATIONS, linear, hashed
+    );
+
+    return 0;
+}
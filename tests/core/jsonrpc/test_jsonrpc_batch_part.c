@@ -0,0 +1,104 @@
+#include "jsonrpc.c"
+
+#include "mock_client_buf.h"
+#include "mock_log.h"
+#define MOCKED_LGTD_PROTO_POWER_ON
+#include "mock_proto.h"
+#include "mock_wire_proto.h"
+#include "test_jsonrpc_utils.h"
+
+static int power_on_call_count = 0;
+
+void
+lgtd_proto_power_on(struct lgtd_client *client,
+                    const struct lgtd_proto_target_list *targets)
+{
+    if (!client) {
+        errx(1, "missing client!");
+    }
+
+    if (strcmp(SLIST_FIRST(targets)->target, "*")) {
+        errx(
+            1, "Invalid target [%s] (expected=[*])",
+            SLIST_FIRST(targets)->target
+        );
+    }
+
+    power_on_call_count++;
+}
+
+// what lgtd_client_input_parse does as each element of a batch is received:
+static int
+dispatch_part(struct lgtd_client *client, const char *json)
+{
+    jsmntok_t tokens[32];
+    int parsed = parse_json(
+        tokens, LGTD_ARRAY_SIZE(tokens), json, strlen(json)
+    );
+
+    client->json = json;
+    return lgtd_jsonrpc_dispatch_batch_part(client, tokens, parsed);
+}
+
+int
+main(void)
+{
+    struct lgtd_client client = { .json = NULL, .jsmn_tokens = NULL };
+
+    // only notifications, nothing is written:
+    const char notification[] = "{"
+        "\"method\": \"power_on\","
+        "\"params\": [\"*\"],"
+        "\"jsonrpc\": \"2.0\""
+    "}";
+    dispatch_part(&client, notification);
+    lgtd_jsonrpc_end_batch(&client);
+    if (power_on_call_count != 1) {
+        errx(1, "power_on should have been called");
+    }
+    if (client_write_buf_idx || client.batch_sent) {
+        errx(1, "got client buf %s (expected nothing)", client_write_buf);
+    }
+
+    client.sync_at = 42;
+    int ntokens = dispatch_part(&client, "{"
+        "\"method\": \"power_on\","
+        "\"id\": \"004daf12-0561-4fbc-bfdb-bfe69cfbf4b5\","
+        "\"params\": [\"*\"],"
+        "\"jsonrpc\": \"2.0\""
+    "}");
+    if (ntokens != 10) {
+        errx(1, "ntokens = %d (expected 10)", ntokens);
+    }
+    dispatch_part(&client, notification);
+    ntokens = dispatch_part(&client, "[1, [2]]");
+    if (ntokens != 4) {
+        errx(1, "ntokens = %d (expected 4)", ntokens);
+    }
+    if (power_on_call_count != 3) {
+        errx(1, "power_on should have been called 3 times");
+    }
+    if (client.batch_sent != 2) {
+        errx(1, "batch_sent = %d (expected 2)", client.batch_sent);
+    }
+
+    lgtd_jsonrpc_end_batch(&client);
+    // we mocked power_on:
+    const char expected[] = (
+        "[,"
+        "{"
+            "\"jsonrpc\": \"2.0\", "
+            "\"id\": null, "
+            "\"error\": {\"code\": -32600, \"message\": \"Invalid request\"}"
+        "}"
+        "]"
+    );
+    if (strcmp(expected, client_write_buf)) {
+        errx(1, "got client buf %s (expected %s)", client_write_buf, expected);
+    }
+    if (client.batch_sent || client.sync_at) {
+        errx(1, "the batch wasn't reset");
+    }
+
+    return 0;
+}
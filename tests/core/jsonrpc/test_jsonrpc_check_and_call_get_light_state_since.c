@@ -0,0 +1,147 @@
+#include "jsonrpc.c"
+
+#include "mock_client_buf.h"
+#include "mock_log.h"
+#define MOCKED_LGTD_PROTO_GET_LIGHT_STATE
+#define MOCKED_LGTD_PROTO_GET_LIGHT_STATE_SINCE
+#include "mock_proto.h"
+#include "mock_wire_proto.h"
+
+#include "test_jsonrpc_utils.h"
+
+static int get_light_state_call_count = 0;
+static int get_light_state_since_call_count = 0;
+static uint64_t expected_since = 0;
+
+void
+lgtd_proto_get_light_state(struct lgtd_client *client,
+                           const struct lgtd_proto_target_list *targets)
+{
+    if (!client) {
+        errx(1, "missing client!");
+    }
+
+    if (strcmp(SLIST_FIRST(targets)->target, "*")) {
+        errx(
+            1, "Invalid target [%s] (expected=[*])",
+            SLIST_FIRST(targets)->target
+        );
+    }
+    get_light_state_call_count++;
+}
+
+void
+lgtd_proto_get_light_state_since(struct lgtd_client *client,
+                                 const struct lgtd_proto_target_list *targets,
+                                 uint64_t since)
+{
+    if (!client) {
+        errx(1, "missing client!");
+    }
+
+    if (strcmp(SLIST_FIRST(targets)->target, "*")) {
+        errx(
+            1, "Invalid target [%s] (expected=[*])",
+            SLIST_FIRST(targets)->target
+        );
+    }
+    if (since != expected_since) {
+        errx(
+            1, "since = %ju (expected %ju)",
+            (uintmax_t)since, (uintmax_t)expected_since
+        );
+    }
+    get_light_state_since_call_count++;
+}
+
+static void
+check_and_call(const char *json,
+               int expected_call_count,
+               int expected_since_call_count)
+{
+    jsmntok_t tokens[32];
+    int parsed = parse_json(
+        tokens, LGTD_ARRAY_SIZE(tokens), json, strlen(json)
+    );
+
+    struct lgtd_jsonrpc_request req = TEST_REQUEST_INITIALIZER;
+    struct lgtd_client client = {
+        .io = NULL, .current_request = &req, .json = json
+    };
+    bool ok = lgtd_jsonrpc_check_and_extract_request(&req, tokens, parsed, json);
+    if (!ok) {
+        errx(1, "can't parse request");
+    }
+
+    lgtd_jsonrpc_check_and_call_get_light_state(&client);
+
+    if (get_light_state_call_count != expected_call_count
+        || get_light_state_since_call_count != expected_since_call_count) {
+        errx(
+            1, "get_light_state_call_count = %d, "
+            "get_light_state_since_call_count = %d (expected %d, %d)",
+            get_light_state_call_count, get_light_state_since_call_count,
+            expected_call_count, expected_since_call_count
+        );
+    }
+}
+
+int
+main(void)
+{
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"get_light_state\","
+            "\"params\": [\"*\"],"
+            "\"id\": \"42\""
+        "}",
+        1, 0
+    );
+
+    expected_since = UINT64_C(4294967296);
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"get_light_state\","
+            "\"params\": {\"target\": \"*\", \"since\": 4294967296},"
+            "\"id\": \"42\""
+        "}",
+        1, 1
+    );
+
+    expected_since = 0;
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"get_light_state\","
+            "\"params\": [\"*\", 0],"
+            "\"id\": \"42\""
+        "}",
+        1, 2
+    );
+
+    // since can't be negative:
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"get_light_state\","
+            "\"params\": [\"*\", -1],"
+            "\"id\": \"42\""
+        "}",
+        1, 2
+    );
+
+    // or a string:
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"get_light_state\","
+            "\"params\": {\"target\": \"*\", \"since\": \"42\"},"
+            "\"id\": \"42\""
+        "}",
+        1, 2
+    );
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "jsonrpc.c"
+
+#include "mock_client_buf.h"
+#include "mock_log.h"
+#define MOCKED_LGTD_PROTO_SUBSCRIBE
+#define MOCKED_LGTD_PROTO_UNSUBSCRIBE
+#include "mock_proto.h"
+#include "mock_wire_proto.h"
+
+#include "test_jsonrpc_utils.h"
+
+static int subscribe_call_count = 0;
+static int expected_fields = 0;
+
+void
+lgtd_proto_subscribe(struct lgtd_client *client,
+                     const struct lgtd_proto_target_list *targets,
+                     int fields)
+{
+    if (!client) {
+        errx(1, "missing client!");
+    }
+
+    if (strcmp(SLIST_FIRST(targets)->target, "*")) {
+        errx(
+            1, "Invalid target [%s] (expected=[*])",
+            SLIST_FIRST(targets)->target
+        );
+    }
+    if (fields != expected_fields) {
+        errx(1, "fields = %#x (expected %#x)", fields, expected_fields);
+    }
+    subscribe_call_count++;
+}
+
+static int unsubscribe_call_count = 0;
+
+void
+lgtd_proto_unsubscribe(struct lgtd_client *client)
+{
+    if (!client) {
+        errx(1, "missing client!");
+    }
+
+    unsubscribe_call_count++;
+}
+
+#define FAKE_BUFFEREVENT (void *)0xfeed
+
+static void
+check_and_call(const char *json, int expected_call_count)
+{
+    jsmntok_t tokens[32];
+    int parsed = parse_json(
+        tokens, LGTD_ARRAY_SIZE(tokens), json, strlen(json)
+    );
+
+    struct lgtd_jsonrpc_request req = TEST_REQUEST_INITIALIZER;
+    struct lgtd_client client = {
+        .io = FAKE_BUFFEREVENT, .current_request = &req, .json = json
+    };
+    bool ok = lgtd_jsonrpc_check_and_extract_request(&req, tokens, parsed, json);
+    if (!ok) {
+        errx(1, "can't parse request");
+    }
+
+    lgtd_jsonrpc_check_and_call_subscribe(&client);
+
+    if (subscribe_call_count != expected_call_count) {
+        errx(
+            1, "subscribe_call_count = %d (expected %d)",
+            subscribe_call_count, expected_call_count
+        );
+    }
+}
+
+int
+main(void)
+{
+    expected_fields = LGTD_LIFX_BULB_POWER_CHANGED
+        | LGTD_LIFX_BULB_LABEL_CHANGED;
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"subscribe\","
+            "\"params\": {\"target\": \"*\", \"fields\": [\"power\", \"label\"]},"
+            "\"id\": \"42\""
+        "}",
+        1
+    );
+
+    // every field by default:
+    expected_fields = LGTD_LIFX_BULB_ALL_CHANGED;
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"subscribe\","
+            "\"params\": [\"*\"],"
+            "\"id\": \"42\""
+        "}",
+        2
+    );
+
+    // unknown fields are rejected:
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"subscribe\","
+            "\"params\": {\"target\": \"*\", \"fields\": [\"power\", \"color\"]},"
+            "\"id\": \"42\""
+        "}",
+        2
+    );
+
+    // and so is an empty list of fields:
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"subscribe\","
+            "\"params\": {\"target\": \"*\", \"fields\": []},"
+            "\"id\": \"42\""
+        "}",
+        2
+    );
+
+    // the target is mandatory:
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"subscribe\","
+            "\"params\": {\"fields\": [\"hsbk\"]},"
+            "\"id\": \"42\""
+        "}",
+        2
+    );
+
+    // the command pipe can't subscribe nor unsubscribe:
+    const char *json = "{"
+        "\"jsonrpc\": \"2.0\","
+        "\"method\": \"subscribe\","
+        "\"params\": [\"*\"],"
+        "\"id\": \"42\""
+    "}";
+    jsmntok_t tokens[32];
+    int parsed = parse_json(
+        tokens, LGTD_ARRAY_SIZE(tokens), json, strlen(json)
+    );
+    struct lgtd_jsonrpc_request req = TEST_REQUEST_INITIALIZER;
+    struct lgtd_client client = {
+        .io = NULL, .current_request = &req, .json = json
+    };
+    bool ok = lgtd_jsonrpc_check_and_extract_request(&req, tokens, parsed, json);
+    if (!ok) {
+        errx(1, "can't parse request");
+    }
+    reset_client_write_buf();
+    lgtd_jsonrpc_check_and_call_subscribe(&client);
+    lgtd_jsonrpc_check_and_call_unsubscribe(&client);
+    if (subscribe_call_count != 2 || unsubscribe_call_count) {
+        errx(1, "the command pipe shouldn't be able to subscribe");
+    }
+    const char *expected_error = "\"code\": -32600";
+    if (!strstr(client_write_buf, expected_error)) {
+        errx(
+            1, "got %s (expected an error with %s)",
+            client_write_buf, expected_error
+        );
+    }
+
+    return 0;
+}
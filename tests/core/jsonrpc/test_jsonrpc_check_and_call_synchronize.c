@@ -0,0 +1,93 @@
+#include "jsonrpc.c"
+
+#include "mock_client_buf.h"
+#include "mock_log.h"
+#define MOCKED_LGTD_PROTO_SYNCHRONIZE
+#include "mock_proto.h"
+#include "mock_wire_proto.h"
+
+#include "test_jsonrpc_utils.h"
+
+static int synchronize_call_count = 0;
+static int expected_delay = 0;
+
+void
+lgtd_proto_synchronize(struct lgtd_client *client, int delay_msecs)
+{
+    if (!client) {
+        errx(1, "missing client!");
+    }
+
+    if (delay_msecs != expected_delay) {
+        errx(
+            1, "delay_msecs = %d (expected %d)", delay_msecs, expected_delay
+        );
+    }
+    synchronize_call_count++;
+}
+
+static void
+check_and_call(const char *json, int expected_call_count)
+{
+    jsmntok_t tokens[32];
+    int parsed = parse_json(
+        tokens, LGTD_ARRAY_SIZE(tokens), json, strlen(json)
+    );
+
+    struct lgtd_jsonrpc_request req = TEST_REQUEST_INITIALIZER;
+    struct lgtd_client client = {
+        .io = NULL, .current_request = &req, .json = json
+    };
+    bool ok = lgtd_jsonrpc_check_and_extract_request(&req, tokens, parsed, json);
+    if (!ok) {
+        errx(1, "can't parse request");
+    }
+
+    lgtd_jsonrpc_check_and_call_synchronize(&client);
+
+    if (synchronize_call_count != expected_call_count) {
+        errx(
+            1, "synchronize_call_count = %d (expected %d)",
+            synchronize_call_count, expected_call_count
+        );
+    }
+}
+
+int
+main(void)
+{
+    expected_delay = 250;
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"synchronize\","
+            "\"params\": {\"delay\": 250},"
+            "\"id\": \"42\""
+        "}",
+        1
+    );
+
+    // the delay is optional:
+    expected_delay = 0;
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"synchronize\","
+            "\"id\": \"42\""
+        "}",
+        2
+    );
+
+    // and can't be negative:
+    check_and_call(
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"synchronize\","
+            "\"params\": [-1],"
+            "\"id\": \"42\""
+        "}",
+        2
+    );
+
+    return 0;
+}
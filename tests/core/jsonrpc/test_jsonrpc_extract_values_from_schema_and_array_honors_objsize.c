@@ -23,7 +23,7 @@ main(void)
         int             target_ntokens;
         const jsmntok_t *label;
     } params = { NULL, 0, NULL };
-    static const struct lgtd_jsonrpc_node schema[] = {
+    static const struct lgtd_jsonrpc_node schema_nodes[] = {
         LGTD_JSONRPC_NODE(
             "target",
             offsetof(struct lgtd_jsonrpc_target_args, target),
@@ -41,6 +41,9 @@ main(void)
             false
         )
     };
+    static struct lgtd_jsonrpc_schema schema = LGTD_JSONRPC_SCHEMA(
+        schema_nodes
+    );
 
     // invalidate all the tokens so that the test will crash if we go beyond
     // the first list:
@@ -52,7 +55,7 @@ main(void)
     }
 
     bool ok = lgtd_jsonrpc_extract_and_validate_params_against_schema(
-        &params, schema, LGTD_ARRAY_SIZE(schema), &tokens[1], parsed - 1, json
+        &params, &schema, &tokens[1], parsed - 1, json
     );
 
     if (ok) {
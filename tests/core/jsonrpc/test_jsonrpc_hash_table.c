@@ -0,0 +1,133 @@
+#include "jsonrpc.c"
+
+#include "mock_client_buf.h"
+#include "mock_log.h"
+#include "mock_proto.h"
+#define MOCKED_LGTD_LIFX_WIRE_WAVEFORM_STRING_ID_TO_TYPE
+#include "mock_wire_proto.h"
+#include "test_jsonrpc_utils.h"
+
+enum lgtd_lifx_waveform_type
+lgtd_lifx_wire_waveform_string_id_to_type(const char *s, int len)
+{
+    (void)s;
+    (void)len;
+
+    return LGTD_LIFX_WAVEFORM_SAW;
+}
+
+static void
+check_method(const char *name, int expected)
+{
+    int mi = lgtd_jsonrpc_hash_table_get(
+        &lgtd_jsonrpc_methods_table,
+        lgtd_jsonrpc_method_name,
+        lgtd_jsonrpc_methods,
+        name,
+        strlen(name)
+    );
+    if (mi != expected) {
+        errx(1, "got index %d for %s (expected %d)", mi, name, expected);
+    }
+}
+
+// Go through lgtd_jsonrpc_dispatch_one with every parameter named, this
+// builds the real tables of the request and of each method (a key that
+// can't be given a slot would make lgtd_errx exit):
+static void
+check_dispatch(const char *method, const char *params)
+{
+    char json[512];
+    snprintf(
+        json, sizeof(json),
+        "{"
+            "\"jsonrpc\": \"2.0\","
+            "\"method\": \"%s\","
+            "\"params\": %s,"
+            "\"id\": 42"
+        "}",
+        method, params
+    );
+    jsmntok_t tokens[64];
+    int parsed = parse_json(tokens, LGTD_ARRAY_SIZE(tokens), json, strlen(json));
+    if (parsed <= 0) {
+        errx(1, "can't parse %s", json);
+    }
+
+    reset_client_write_buf();
+    // subscribe isn't available without a connection to the client:
+    struct lgtd_client client = { .io = (void *)0xfeed, .json = json };
+    lgtd_jsonrpc_dispatch_one(&client, tokens, parsed, NULL);
+    if (client_write_buf_idx) {
+        errx(
+            1, "got %.*s back for %s (expected nothing)",
+            client_write_buf_idx, client_write_buf, method
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_jsonrpc_hash_table_build(
+        &lgtd_jsonrpc_methods_table,
+        lgtd_jsonrpc_method_name,
+        lgtd_jsonrpc_methods,
+        LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods)
+    );
+    if (!lgtd_jsonrpc_methods_table.ready) {
+        errx(1, "the methods table isn't ready");
+    }
+
+    // each method has a slot of its own:
+    int nslots = 0;
+    for (int i = 0; i != LGTD_JSONRPC_HASH_TABLE_SIZE; i++) {
+        nslots += lgtd_jsonrpc_methods_table.slots[i] != 0;
+    }
+    if (nslots != LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods)) {
+        errx(
+            1, "%d slots used (expected %d)",
+            nslots, (int)LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods)
+        );
+    }
+    for (int i = 0; i != LGTD_ARRAY_SIZE(lgtd_jsonrpc_methods); i++) {
+        check_method(lgtd_jsonrpc_methods[i].name, i);
+    }
+
+    check_method("", -1);
+    check_method("power", -1);
+    check_method("power_onn", -1);
+    check_method("POWER_ON", -1);
+    check_method("set_light_from_hsb", -1);
+
+    check_dispatch("power_on", "{\"target\": \"*\"}");
+    check_dispatch("power_off", "{\"target\": \"*\"}");
+    check_dispatch("power_toggle", "{\"target\": \"*\"}");
+    check_dispatch(
+        "set_light_from_hsbk",
+        "{"
+            "\"target\": \"*\", \"hue\": 0, \"saturation\": 1,"
+            "\"brightness\": 1, \"kelvin\": 3500, \"transition\": 0"
+        "}"
+    );
+    check_dispatch(
+        "set_waveform",
+        "{"
+            "\"target\": \"*\", \"waveform\": \"SAW\","
+            "\"hue\": 0, \"saturation\": 1, \"brightness\": 1,"
+            "\"kelvin\": 3500, \"period\": 500, \"cycles\": 4,"
+            "\"skew_ratio\": 0.5, \"transient\": true"
+        "}"
+    );
+    check_dispatch("get_light_state", "{\"target\": \"*\", \"since\": 0}");
+    check_dispatch("tag", "{\"target\": \"*\", \"label\": \"kitchen\"}");
+    check_dispatch("untag", "{\"target\": \"*\", \"label\": \"kitchen\"}");
+    check_dispatch("set_label", "{\"target\": \"*\", \"label\": \"lamp\"}");
+    check_dispatch("synchronize", "{\"delay\": 500}");
+    check_dispatch(
+        "subscribe", "{\"target\": \"*\", \"fields\": [\"power\"]}"
+    );
+    check_dispatch("unsubscribe", "{}");
+
+    return 0;
+}
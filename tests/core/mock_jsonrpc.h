@@ -9,6 +9,26 @@ lgtd_jsonrpc_dispatch_request(struct lgtd_client *client, int parsed)
 }
 #endif
 
+#ifndef MOCKED_JSONRPC_DISPATCH_BATCH_PART
+int
+lgtd_jsonrpc_dispatch_batch_part(struct lgtd_client *client,
+                                 const jsmntok_t *tokens,
+                                 int ntokens)
+{
+    (void)client;
+    (void)tokens;
+    return ntokens;
+}
+#endif
+
+#ifndef MOCKED_JSONRPC_END_BATCH
+void
+lgtd_jsonrpc_end_batch(struct lgtd_client *client)
+{
+    (void)client;
+}
+#endif
+
 #ifndef MOCKED_JSONRPC_SEND_ERROR
 void
 lgtd_jsonrpc_send_error(struct lgtd_client *client,
@@ -32,6 +32,15 @@ lgtd_proto_set_light_from_hsbk(struct lgtd_client *client,
 }
 #endif
 
+#ifndef MOCKED_LGTD_PROTO_SYNCHRONIZE
+void
+lgtd_proto_synchronize(struct lgtd_client *client, int delay_msecs)
+{
+    (void)client;
+    (void)delay_msecs;
+}
+#endif
+
 #ifndef MOCKED_LGTD_PROTO_POWER_ON
 void
 lgtd_proto_power_on(struct lgtd_client *client,
@@ -131,3 +140,35 @@ lgtd_proto_set_label(struct lgtd_client *client,
     (void)label;
 }
 #endif
+
+#ifndef MOCKED_LGTD_PROTO_SUBSCRIBE
+void
+lgtd_proto_subscribe(struct lgtd_client *client,
+                     const struct lgtd_proto_target_list *targets,
+                     int fields)
+{
+    (void)client;
+    (void)targets;
+    (void)fields;
+}
+#endif
+
+#ifndef MOCKED_LGTD_PROTO_UNSUBSCRIBE
+void
+lgtd_proto_unsubscribe(struct lgtd_client *client)
+{
+    (void)client;
+}
+#endif
+
+#ifndef MOCKED_LGTD_PROTO_GET_LIGHT_STATE_SINCE
+void
+lgtd_proto_get_light_state_since(struct lgtd_client *client,
+                                 const struct lgtd_proto_target_list *targets,
+                                 uint64_t since)
+{
+    (void)client;
+    (void)targets;
+    (void)since;
+}
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "core/time_monotonic.h"
 #include "lifx/wire_proto.h"  // enum lgtd_lifx_packet_type
 
 struct lgtd_proto_target_list;
@@ -18,8 +19,23 @@ lgtd_router_send(const struct lgtd_proto_target_list *targets,
 }
 #endif
 
+#ifndef MOCKED_LGTD_ROUTER_SEND_AT
+bool
+lgtd_router_send_at(const struct lgtd_proto_target_list *targets,
+                    enum lgtd_lifx_packet_type pkt_type,
+                    void *pkt,
+                    lgtd_time_mono_t at)
+{
+    (void)targets;
+    (void)pkt_type;
+    (void)pkt;
+    (void)at;
+    return true;
+}
+#endif
+
 #ifndef MOCKED_LGTD_ROUTER_SEND_TO_DEVICE
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -27,11 +43,27 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     (void)bulb;
     (void)pkt_type;
     (void)pkt;
+    return true;
+}
+#endif
+
+#ifndef MOCKED_LGTD_ROUTER_SEND_TO_DEVICE_AT
+bool
+lgtd_router_send_to_device_at(struct lgtd_lifx_bulb *bulb,
+                              enum lgtd_lifx_packet_type pkt_type,
+                              void *pkt,
+                              lgtd_time_mono_t at)
+{
+    (void)bulb;
+    (void)pkt_type;
+    (void)pkt;
+    (void)at;
+    return true;
 }
 #endif
 
 #ifndef MOCKED_LGTD_ROUTER_SEND_TO_TAG
-void
+bool
 lgtd_router_send_to_tag(const struct lgtd_lifx_tag *tag,
                         enum lgtd_lifx_packet_type pkt_type,
                         void *pkt)
@@ -39,11 +71,12 @@ lgtd_router_send_to_tag(const struct lgtd_lifx_tag *tag,
     (void)tag;
     (void)pkt_type;
     (void)pkt;
+    return true;
 }
 #endif
 
 #ifndef MOCKED_LGTD_ROUTER_SEND_TO_LABEL
-void
+bool
 lgtd_router_send_to_label(const char *label,
                           enum lgtd_lifx_packet_type pkt_type,
                           void *pkt)
@@ -51,15 +84,17 @@ lgtd_router_send_to_label(const char *label,
     (void)label;
     (void)pkt_type;
     (void)pkt;
+    return true;
 }
 #endif
 
 #ifndef MOCKED_LGTD_ROUTER_BROADCAST
-void
+bool
 lgtd_router_broadcast(enum lgtd_lifx_packet_type pkt_type, void *pkt)
 {
     (void)pkt_type;
     (void)pkt;
+    return true;
 }
 #endif
 
@@ -79,3 +114,14 @@ lgtd_router_device_list_free(struct lgtd_router_device_list *devices)
     (void)devices;
 }
 #endif
+
+#ifndef MOCKED_LGTD_ROUTER_DEVICE_MATCHES_TARGETS
+bool
+lgtd_router_device_matches_targets(const struct lgtd_lifx_bulb *device,
+                                   const struct lgtd_proto_target_list *targets)
+{
+    (void)device;
+    (void)targets;
+    return false;
+}
+#endif
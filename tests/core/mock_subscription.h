@@ -0,0 +1,52 @@
+#pragma once
+
+struct lgtd_client;
+struct lgtd_lifx_bulb;
+struct lgtd_proto_target_list;
+
+#ifndef MOCKED_LGTD_SUBSCRIPTION_ADD
+bool
+lgtd_subscription_add(struct lgtd_client *client,
+                      const struct lgtd_proto_target_list *targets,
+                      int fields)
+{
+    (void)client;
+    (void)targets;
+    (void)fields;
+    return true;
+}
+#endif
+
+#ifndef MOCKED_LGTD_SUBSCRIPTION_REMOVE
+bool
+lgtd_subscription_remove(struct lgtd_client *client)
+{
+    (void)client;
+    return false;
+}
+#endif
+
+#ifndef MOCKED_LGTD_SUBSCRIPTION_SEND_PENDING
+void
+lgtd_subscription_send_pending(struct lgtd_client *client)
+{
+    (void)client;
+}
+#endif
+
+#ifndef MOCKED_LGTD_SUBSCRIPTION_BULB_CHANGED
+void
+lgtd_subscription_bulb_changed(struct lgtd_lifx_bulb *bulb, int changes)
+{
+    (void)bulb;
+    (void)changes;
+}
+#endif
+
+#ifndef MOCKED_LGTD_SUBSCRIPTION_BULB_CLOSED
+void
+lgtd_subscription_bulb_closed(struct lgtd_lifx_bulb *bulb)
+{
+    (void)bulb;
+}
+#endif
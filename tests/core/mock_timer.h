@@ -31,3 +31,32 @@ lgtd_timer_stop(struct lgtd_timer *timer)
     (void)timer;
 }
 #endif
+
+#ifndef MOCKED_LGTD_TIMER_ACTIVATE
+void
+lgtd_timer_activate(struct lgtd_timer *timer)
+{
+    (void)timer;
+}
+#endif
+
+#ifndef MOCKED_LGTD_TIMER_RESCHEDULE
+struct lgtd_timer *last_timer_passed_to_timer_reschedule = NULL;
+
+bool
+lgtd_timer_reschedule(struct lgtd_timer *timer, const struct timeval *tv)
+{
+    (void)tv;
+    last_timer_passed_to_timer_reschedule = timer;
+    return true;
+}
+#endif
+
+#ifndef MOCKED_LGTD_TIMER_ISPENDING
+bool
+lgtd_timer_ispending(const struct lgtd_timer *timer)
+{
+    (void)timer;
+    return false;
+}
+#endif
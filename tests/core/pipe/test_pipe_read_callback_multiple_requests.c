@@ -19,6 +19,7 @@
 #include "mock_jsonrpc.h"
 #include "mock_log.h"
 #include "mock_router.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 #include "tests_utils.h"
@@ -62,20 +63,26 @@ lgtd_jsonrpc_dispatch_request(struct lgtd_client *client, int parsed)
         errx(1, "number of parsed json tokens not passed in");
     }
 
+    // both requests are tokenized in one pass over the buffer:
+    if (client->json != (char *)request) {
+        errx(1, "the json buffer should always be the whole input");
+    }
+    const char *json = client->json + client->jsmn_tokens[0].start;
+
     switch (jsonrpc_dispatch_request_call_count) {
     case 0:
-        if (memcmp(client->json, request, sizeof(request) - 1)) {
+        if (memcmp(json, REQUEST_1, sizeof(REQUEST_1) - 1)
+            || client->jsmn_tokens[0].end != sizeof(REQUEST_1) - 1) {
             errx(
-                1, "got unexpected json %s (expected %s)",
-                client->json, request
+                1, "got unexpected json %s (expected %s)", json, REQUEST_1
             );
         }
         break;
     case 1:
-        if (memcmp(client->json, REQUEST_2, sizeof(REQUEST_2) - 1)) {
+        if (memcmp(json, REQUEST_2, sizeof(REQUEST_2) - 1)
+            || client->jsmn_tokens[0].end != sizeof(request) - 1) {
             errx(
-                1, "got unexpected json %s (expected %s)",
-                client->json, REQUEST_2
+                1, "got unexpected json %s (expected %s)", json, REQUEST_2
             );
         }
         break;
@@ -121,26 +128,14 @@ evbuffer_drain(struct evbuffer *buf, size_t len)
         errx(1, "got unexpected buf %p (expected %p)", buf, (void *)2);
     }
 
-    switch (evbuffer_drain_call_count) {
-    case 0:
-        if (len != sizeof(REQUEST_1) - 1) {
-            errx(
-                1, "trying to drain %ju bytes (expected %ju)",
-                (uintmax_t)len, (uintmax_t)sizeof(REQUEST_1) - 1
-            );
-        }
-        break;
-    case 1:
-        if (len != sizeof(REQUEST_2) - 1) {
-            errx(
-                1, "trying to drain %ju bytes (expected %ju)",
-                (uintmax_t)len, (uintmax_t)sizeof(REQUEST_2) - 1
-            );
-        }
-        break;
-    default:
+    if (evbuffer_drain_call_count) {
         errx(1, "evbuffer_drain_call_count = %d", evbuffer_drain_call_count);
-        break;
+    }
+    if (len != sizeof(request) - 1) {
+        errx(
+            1, "trying to drain %ju bytes (expected %ju)",
+            (uintmax_t)len, (uintmax_t)sizeof(request) - 1
+        );
     }
     evbuffer_drain_call_count++;
 
@@ -162,21 +157,11 @@ evbuffer_pullup(struct evbuffer *buf, ev_ssize_t size)
         );
     }
 
-    int offset;
-    switch (evbuffer_pullup_call_count) {
-    case 0:
-        offset = 0;
-        break;
-    case 1:
-        offset = sizeof(REQUEST_1) - 1;
-        break;
-    default:
-        offset = sizeof(request);
-        break;
+    if (evbuffer_pullup_call_count++) {
+        errx(1, "evbuffer_pullup_call_count = %d", evbuffer_pullup_call_count);
     }
-    evbuffer_pullup_call_count++;
 
-    return &request[offset];
+    return request;
 }
 
 static int evbuffer_get_length_call_count = 0;
@@ -193,9 +178,6 @@ evbuffer_get_length(const struct evbuffer *buf)
     case 0:
         len = sizeof(request) - 1;
         break;
-    case 1:
-        len = sizeof(request) - sizeof(REQUEST_1);
-        break;
     default:
         len = 0;
         break;
@@ -253,5 +235,18 @@ main(void)
 
     lgtd_command_pipe_read_callback(pipe->fd, EV_READ, pipe);
 
+    if (jsonrpc_dispatch_request_call_count != 2) {
+        errx(
+            1, "jsonrpc_dispatch_request_call_count = %d (expected 2)",
+            jsonrpc_dispatch_request_call_count
+        );
+    }
+    if (evbuffer_drain_call_count != 1) {
+        errx(
+            1, "evbuffer_drain_call_count = %d (expected 1)",
+            evbuffer_drain_call_count
+        );
+    }
+
     return 0;
 }
@@ -0,0 +1,221 @@
+#include "proto.c"
+
+#include "mock_client_buf.h"
+#include "mock_daemon.h"
+#include "mock_gateway.h"
+#include "mock_event2.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+#include "tests_utils.h"
+
+#define MOCKED_ROUTER_TARGETS_TO_DEVICES
+#define MOCKED_ROUTER_DEVICE_LIST_FREE
+#include "tests_proto_utils.h"
+
+static struct lgtd_lifx_gateway gw_bulb_1 = {
+    .bulbs = LIST_HEAD_INITIALIZER(&gw_bulb_1.bulbs),
+    .peeraddr = "[::ffff:127.0.0.1]:1"
+};
+static struct lgtd_lifx_bulb bulb_1 = {
+    .addr = { 1, 2, 3, 4, 5 },
+    .state = {
+        .hue = 0xaaaa,
+        .saturation = 0xffff,
+        .brightness = 0xbbbb,
+        .kelvin = 3600,
+        .label = "wave",
+        .power = LGTD_LIFX_POWER_ON,
+        .tags = 0
+    },
+    .ips[LGTD_LIFX_BULB_WIFI_IP] = {
+        .fw_info.version = 0x10001
+    },
+    .model = "testbulb",
+    .gw = &gw_bulb_1
+};
+
+void
+lgtd_router_device_list_free(struct lgtd_router_device_list *devices)
+{
+    if (!devices) {
+        lgtd_errx(1, "the device list must be passed");
+    }
+}
+
+struct lgtd_router_device_list *
+lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
+{
+    if (targets != (void *)0x2a) {
+        lgtd_errx(1, "unexpected targets list");
+    }
+
+    static struct lgtd_router_device_list devices = { .count = 0 };
+    if (!devices.count) {
+        lgtd_tests_insert_mock_device(&devices, &bulb_1);
+    }
+
+    return &devices;
+}
+
+static void
+get_light_state(const char *expected)
+{
+    struct lgtd_client *client = lgtd_tests_insert_mock_client(
+        FAKE_BUFFEREVENT
+    );
+
+    reset_client_write_buf();
+
+    lgtd_proto_get_light_state(client, (void *)0x2a);
+
+    if (client_write_buf_idx != (int)strlen(expected)
+        || memcmp(expected, client_write_buf, client_write_buf_idx)) {
+        lgtd_errx(
+            1, "got %.*s instead of %s",
+            client_write_buf_idx, client_write_buf, expected
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_opts.verbosity = LGTD_INFO;
+
+    const char *expected = ("["
+        "{"
+            "\"_lifx\":{"
+                "\"addr\":\"01:02:03:04:05:00\","
+                "\"gateway\":{"
+                    "\"site\":\"00:00:00:00:00:00\","
+                    "\"url\":\"tcp://[::ffff:127.0.0.1]:1\","
+                    "\"latency\":0"
+                "},"
+                "\"mcu\":{\"firmware_version\":\"0.0\"},"
+                "\"wifi\":{\"firmware_version\":\"1.1\"}"
+            "},"
+            "\"_model\":\"testbulb\","
+            "\"_vendor\":null,"
+            "\"hsbk\":[240,1,0.733333,3600],"
+            "\"power\":true,"
+            "\"label\":\"wave\","
+            "\"tags\":[]"
+        "}"
+    "]");
+    get_light_state(expected);
+    if (!bulb_1.json_head.len || !bulb_1.json_state.len) {
+        lgtd_errx(1, "the state of the bulb should have been cached");
+    }
+
+    // the cache is used as long as the bulb setters don't drop it:
+    bulb_1.state.power = LGTD_LIFX_POWER_OFF;
+    get_light_state(expected);
+
+    // what isn't cached is always up to date:
+    bulb_1.stale = true;
+    const char *expected_stale = ("["
+        "{"
+            "\"_lifx\":{"
+                "\"addr\":\"01:02:03:04:05:00\","
+                "\"gateway\":{"
+                    "\"site\":\"00:00:00:00:00:00\","
+                    "\"url\":\"tcp://[::ffff:127.0.0.1]:1\","
+                    "\"latency\":0"
+                "},"
+                "\"stale\":true,"
+                "\"mcu\":{\"firmware_version\":\"0.0\"},"
+                "\"wifi\":{\"firmware_version\":\"1.1\"}"
+            "},"
+            "\"_model\":\"testbulb\","
+            "\"_vendor\":null,"
+            "\"hsbk\":[240,1,0.733333,3600],"
+            "\"power\":true,"
+            "\"label\":\"wave\","
+            "\"tags\":[]"
+        "}"
+    "]");
+    get_light_state(expected_stale);
+
+    // what lgtd_lifx_bulb_drop_json_state does:
+    bulb_1.json_state.len = 0;
+    bulb_1.stale = false;
+    const char *expected_off = ("["
+        "{"
+            "\"_lifx\":{"
+                "\"addr\":\"01:02:03:04:05:00\","
+                "\"gateway\":{"
+                    "\"site\":\"00:00:00:00:00:00\","
+                    "\"url\":\"tcp://[::ffff:127.0.0.1]:1\","
+                    "\"latency\":0"
+                "},"
+                "\"mcu\":{\"firmware_version\":\"0.0\"},"
+                "\"wifi\":{\"firmware_version\":\"1.1\"}"
+            "},"
+            "\"_model\":\"testbulb\","
+            "\"_vendor\":null,"
+            "\"hsbk\":[240,1,0.733333,3600],"
+            "\"power\":false,"
+            "\"label\":\"wave\","
+            "\"tags\":[]"
+        "}"
+    "]");
+    get_light_state(expected_off);
+
+    // the cache is formatted again when the verbosity changes:
+    lgtd_opts.verbosity = LGTD_DEBUG;
+    get_light_state(
+        "["
+            "{"
+                "\"_lifx\":{"
+                    "\"addr\":\"01:02:03:04:05:00\","
+                    "\"gateway\":{"
+                        "\"site\":\"00:00:00:00:00:00\","
+                        "\"url\":\"tcp://[::ffff:127.0.0.1]:1\","
+                        "\"latency\":0"
+                    "},"
+                    "\"mcu\":{"
+                        "\"firmware_built_at\":\"1970-01-01T00:00:00+00:00\","
+                        "\"firmware_installed_at\":\"1970-01-01T00:00:00+00:00\","
+                        "\"firmware_version\":\"0.0\","
+                        "\"signal_strength\":0.000000,"
+                        "\"tx_bytes\":0,"
+                        "\"rx_bytes\":0,"
+                        "\"temperature\":0"
+                    "},"
+                    "\"wifi\":{"
+                        "\"firmware_built_at\":\"1970-01-01T00:00:00+00:00\","
+                        "\"firmware_installed_at\":\"1970-01-01T00:00:00+00:00\","
+                        "\"firmware_version\":\"1.1\","
+                        "\"signal_strength\":0.000000,"
+                        "\"tx_bytes\":0,"
+                        "\"rx_bytes\":0,"
+                        "\"temperature\":0"
+                    "},"
+                    "\"product_info\":{"
+                        "\"vendor_id\":\"0\","
+                        "\"product_id\":\"0\","
+                        "\"version\":0"
+                    "},"
+                    "\"runtime_info\":{"
+                        "\"time\":\"1970-01-01T00:00:00+00:00\","
+                        "\"uptime\":0,"
+                        "\"downtime\":0"
+                    "}"
+                "},"
+                "\"_model\":\"testbulb\","
+                "\"_vendor\":null,"
+                "\"hsbk\":[240,1,0.733333,3600],"
+                "\"power\":false,"
+                "\"label\":\"wave\","
+                "\"tags\":[]"
+            "}"
+        "]"
+    );
+    if (!bulb_1.json_state.debug) {
+        lgtd_errx(1, "the cached state should be the one for debug mode");
+    }
+
+    return 0;
+}
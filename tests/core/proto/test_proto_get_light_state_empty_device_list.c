@@ -4,6 +4,7 @@
 #include "mock_daemon.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 #include "tests_utils.h"
@@ -31,8 +32,7 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
         lgtd_errx(1, "unexpected targets list");
     }
 
-    static struct lgtd_router_device_list devices =
-        SLIST_HEAD_INITIALIZER(&devices);
+    static struct lgtd_router_device_list devices = { .count = 0 };
 
     return &devices;
 }
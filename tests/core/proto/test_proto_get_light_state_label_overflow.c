@@ -5,6 +5,7 @@
 #include "mock_gateway.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 #include "tests_utils.h"
@@ -32,9 +33,8 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
         lgtd_errx(1, "unexpected targets list");
     }
 
-    static struct lgtd_router_device_list devices =
-        SLIST_HEAD_INITIALIZER(&devices);
-    if (SLIST_FIRST(&devices)) {
+    static struct lgtd_router_device_list devices = { .count = 0 };
+    if (devices.count) {
         return &devices;
     }
 
@@ -64,8 +64,7 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
         .gw = &gw_bulb_1
     };
     memset(&bulb_1.state.label, 'a', sizeof(bulb_1.state.label));
-    static struct lgtd_router_device device_1 = { .device = &bulb_1 };
-    SLIST_INSERT_HEAD(&devices, &device_1, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_1);
 
     return &devices;
 }
@@ -0,0 +1,175 @@
+#include "proto.c"
+
+#include "mock_client_buf.h"
+#include "mock_daemon.h"
+#include "mock_gateway.h"
+#include "mock_event2.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+#include "tests_utils.h"
+
+#define MOCKED_ROUTER_TARGETS_TO_DEVICES
+#define MOCKED_ROUTER_DEVICE_LIST_FREE
+#include "tests_proto_utils.h"
+
+static struct lgtd_lifx_gateway gw = {
+    .bulbs = LIST_HEAD_INITIALIZER(&gw.bulbs),
+    .peeraddr = "[::ffff:127.0.0.1]:1"
+};
+static struct lgtd_lifx_bulb bulb_1 = {
+    .addr = { 1, 2, 3, 4, 5 },
+    .state = { .label = "wave", .power = LGTD_LIFX_POWER_ON },
+    .gw = &gw
+};
+static struct lgtd_lifx_bulb bulb_2 = {
+    .addr = { 5, 4, 3, 2, 1 },
+    .state = { .label = "lamp" },
+    .gw = &gw
+};
+
+#define BULB_JSON(addr, power, label)                                   \
+    "{"                                                                 \
+        "\"_lifx\":{"                                                   \
+            "\"addr\":\"" addr "\","                                    \
+            "\"gateway\":{"                                             \
+                "\"site\":\"00:00:00:00:00:00\","                       \
+                "\"url\":\"tcp://[::ffff:127.0.0.1]:1\","               \
+                "\"latency\":0"                                         \
+            "},"                                                        \
+            "\"mcu\":{\"firmware_version\":\"0.0\"},"                   \
+            "\"wifi\":{\"firmware_version\":\"0.0\"}"                   \
+        "},"                                                            \
+        "\"_model\":null,"                                              \
+        "\"_vendor\":null,"                                             \
+        "\"hsbk\":[0,0,0,0],"                                           \
+        "\"power\":" power ","                                          \
+        "\"label\":\"" label "\","                                      \
+        "\"tags\":[]"                                                   \
+    "}"
+
+#define BULB_1_JSON BULB_JSON("01:02:03:04:05:00", "true", "wave")
+#define BULB_2_JSON BULB_JSON("05:04:03:02:01:00", "false", "lamp")
+
+void
+lgtd_router_device_list_free(struct lgtd_router_device_list *devices)
+{
+    if (!devices) {
+        lgtd_errx(1, "the device list must be passed");
+    }
+}
+
+struct lgtd_router_device_list *
+lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
+{
+    if (targets != (void *)0x2a) {
+        lgtd_errx(1, "unexpected targets list");
+    }
+
+    static struct lgtd_router_device_list devices = { .count = 0 };
+    if (!devices.count) {
+        lgtd_tests_insert_mock_device(&devices, &bulb_1);
+        lgtd_tests_insert_mock_device(&devices, &bulb_2);
+    }
+
+    return &devices;
+}
+
+static void
+get_light_state_since(uint64_t since, const char *expected)
+{
+    struct lgtd_client *client = lgtd_tests_insert_mock_client(
+        FAKE_BUFFEREVENT
+    );
+
+    reset_client_write_buf();
+
+    lgtd_proto_get_light_state_since(client, (void *)0x2a, since);
+
+    if (client_write_buf_idx != (int)strlen(expected)
+        || memcmp(expected, client_write_buf, client_write_buf_idx)) {
+        lgtd_errx(
+            1, "got %.*s instead of %s",
+            client_write_buf_idx, client_write_buf, expected
+        );
+    }
+}
+
+static void
+set_journal_entry(uint64_t seqn, const uint8_t *addr, bool closed)
+{
+    struct lgtd_lifx_bulb_journal_entry *entry;
+    entry = LGTD_LIFX_BULB_JOURNAL_ENTRY(seqn);
+    entry->seqn = seqn;
+    memcpy(entry->addr, addr, sizeof(entry->addr));
+    entry->closed = closed;
+}
+
+int
+main(void)
+{
+    lgtd_opts.verbosity = LGTD_INFO;
+
+    lgtd_lifx_bulb_journal.seqn = 10;
+    bulb_1.journal_seqn = 9;
+    bulb_2.journal_seqn = 3;
+    const uint8_t gone[LGTD_LIFX_ADDR_LENGTH] = { 1, 1, 1, 1, 1, 1 };
+    const uint8_t back[LGTD_LIFX_ADDR_LENGTH] = { 2, 2, 2, 2, 2, 2 };
+    set_journal_entry(4, gone, true);
+    set_journal_entry(6, back, true);
+    set_journal_entry(7, back, false);
+    set_journal_entry(8, back, true);
+
+    // only the bulbs that changed after since are sent:
+    get_light_state_since(
+        5,
+        "{\"seq\":10,\"resync\":false,\"bulbs\":["
+            BULB_1_JSON
+        "],\"closed\":[\"02:02:02:02:02:02\"]}"
+    );
+    get_light_state_since(
+        2,
+        "{\"seq\":10,\"resync\":false,\"bulbs\":["
+            BULB_2_JSON "," BULB_1_JSON
+        "],\"closed\":[\"02:02:02:02:02:02\",\"01:01:01:01:01:01\"]}"
+    );
+    get_light_state_since(
+        10, "{\"seq\":10,\"resync\":false,\"bulbs\":[],\"closed\":[]}"
+    );
+
+    // a sequence number from the future (lightsd restarted and made less
+    // changes than that so far), start over:
+    const char *expected_resync = (
+        "{\"seq\":10,\"resync\":true,\"bulbs\":["
+            BULB_2_JSON "," BULB_1_JSON
+        "],\"closed\":[]}"
+    );
+    get_light_state_since(11, expected_resync);
+
+    // a sequence number from before lightsd restarted, start over too:
+    lgtd_lifx_bulb_journal.first_seqn = 2;
+    get_light_state_since(1, expected_resync);
+    get_light_state_since(
+        2,
+        "{\"seq\":10,\"resync\":false,\"bulbs\":["
+            BULB_2_JSON "," BULB_1_JSON
+        "],\"closed\":[\"02:02:02:02:02:02\",\"01:01:01:01:01:01\"]}"
+    );
+
+    // the journal wrapped, start over too:
+    memset(&lgtd_lifx_bulb_journal, 0, sizeof(lgtd_lifx_bulb_journal));
+    lgtd_lifx_bulb_journal.seqn = LGTD_LIFX_BULB_JOURNAL_SIZE + 10;
+    get_light_state_since(
+        10,
+        "{\"seq\":4106,\"resync\":false,\"bulbs\":[],\"closed\":[]}"
+    );
+    get_light_state_since(
+        9,
+        "{\"seq\":4106,\"resync\":true,\"bulbs\":["
+            BULB_2_JSON "," BULB_1_JSON
+        "],\"closed\":[]}"
+    );
+
+    return 0;
+}
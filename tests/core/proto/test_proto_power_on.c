@@ -4,6 +4,7 @@
 #include "mock_daemon.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 #include "tests_utils.h"
@@ -5,6 +5,7 @@
 #include "mock_gateway.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 #include "tests_utils.h"
@@ -33,8 +34,7 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
         lgtd_errx(1, "unexpected targets list");
     }
 
-    static struct lgtd_router_device_list devices =
-        SLIST_HEAD_INITIALIZER(&devices);
+    static struct lgtd_router_device_list devices = { .count = 0 };
 
     static struct lgtd_lifx_gateway gw_bulb_1 = {
         .bulbs = LIST_HEAD_INITIALIZER(&gw_bulb_1.bulbs)
@@ -52,8 +52,7 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
         },
         .gw = &gw_bulb_1
     };
-    static struct lgtd_router_device device_1 = { .device = &bulb_1 };
-    SLIST_INSERT_HEAD(&devices, &device_1, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_1);
 
     struct lgtd_lifx_tag *gw_2_tag_1 = lgtd_tests_insert_mock_tag("vapor");
     struct lgtd_lifx_tag *gw_2_tag_2 = lgtd_tests_insert_mock_tag("d^-^b");
@@ -78,15 +77,14 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
         },
         .gw = &gw_bulb_2
     };
-    static struct lgtd_router_device device_2 = { .device = &bulb_2 };
-    SLIST_INSERT_HEAD(&devices, &device_2, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_2);
 
     return &devices;
 }
 
 static int router_send_to_device_call_count = 0;
 
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -124,6 +122,8 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     }
 
     router_send_to_device_call_count++;
+
+    return true;
 }
 
 int
@@ -5,6 +5,7 @@
 #include "mock_gateway.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 #include "tests_utils.h"
@@ -39,7 +40,7 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
 
 static int router_send_to_device_call_count = 0;
 
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -49,6 +50,8 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     (void)pkt;
 
     router_send_to_device_call_count++;
+
+    return true;
 }
 
 static int client_send_error_call_count = 0;
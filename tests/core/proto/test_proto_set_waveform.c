@@ -6,6 +6,7 @@
 #include "mock_daemon.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #define MOCKED_LGTD_LIFX_WIRE_ENCODE_WAVEFORM
 #include "mock_wire_proto.h"
@@ -109,6 +110,7 @@ main(void)
     targets = lgtd_tests_build_target_list("*", NULL);
 
     struct lgtd_client client;
+    memset(&client, 0, sizeof(client));
 
     lgtd_proto_set_waveform(
         &client, targets, LGTD_LIFX_WAVEFORM_SAW,
@@ -7,6 +7,7 @@
 #include "mock_gateway.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #define MOCKED_LGTD_LIFX_WIRE_ENCODE_TAG_LABELS
 #define MOCKED_LGTD_LIFX_WIRE_ENCODE_TAGS
@@ -20,10 +21,8 @@
 
 #define FAKE_TARGET_LIST (void *)0x2a
 
-static struct lgtd_router_device_list devices =
-    SLIST_HEAD_INITIALIZER(&devices);
-static struct lgtd_router_device_list device_1_only =
-    SLIST_HEAD_INITIALIZER(&device_1_only);
+static struct lgtd_router_device_list devices = { .count = 0 };
+static struct lgtd_router_device_list device_1_only = { .count = 0 };
 
 static int lifx_wire_encode_tag_labels_call_count = 0;
 
@@ -47,7 +46,7 @@ lgtd_lifx_wire_encode_tags(struct lgtd_lifx_packet_tags *pkt)
 
 static bool send_to_device_called = false;
 
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -91,6 +90,8 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     }
 
     send_to_device_called = true;
+
+    return true;
 }
 
 static bool gateway_send_to_site_called = false;
@@ -222,9 +223,8 @@ setup_devices(void)
         },
         .gw = &gw_bulb_1
     };
-    static struct lgtd_router_device device_1 = { .device = &bulb_1 };
-    SLIST_INSERT_HEAD(&devices, &device_1, link);
-    SLIST_INSERT_HEAD(&device_1_only, &device_1, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_1);
+    lgtd_tests_insert_mock_device(&device_1_only, &bulb_1);
 
     struct lgtd_lifx_tag *gw_2_tag_1 = lgtd_tests_insert_mock_tag("vapor");
     struct lgtd_lifx_tag *gw_2_tag_2 = lgtd_tests_insert_mock_tag("d^-^b");
@@ -249,8 +249,7 @@ setup_devices(void)
         },
         .gw = &gw_bulb_2
     };
-    static struct lgtd_router_device device_2 = { .device = &bulb_2 };
-    SLIST_INSERT_HEAD(&devices, &device_2, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_2);
 }
 
 int
@@ -7,6 +7,7 @@
 #include "mock_gateway.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #define MOCKED_LGTD_LIFX_WIRE_ENCODE_TAG_LABELS
 #define MOCKED_LGTD_LIFX_WIRE_ENCODE_TAGS
@@ -20,8 +21,7 @@
 
 #define FAKE_TARGET_LIST (void *)0x2a
 
-static struct lgtd_router_device_list devices =
-    SLIST_HEAD_INITIALIZER(&devices);
+static struct lgtd_router_device_list devices = { .count = 0 };
 
 static int lifx_wire_encode_tag_labels_call_count = 0;
 
@@ -45,7 +45,7 @@ lgtd_lifx_wire_encode_tags(struct lgtd_lifx_packet_tags *pkt)
 
 static bool send_to_device_called = false;
 
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -93,6 +93,8 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     }
 
     send_to_device_called = true;
+
+    return true;
 }
 
 static bool gateway_send_to_site_called_for_gw_1 = false;
@@ -259,8 +261,7 @@ setup_devices(void)
         },
         .gw = &gw_bulb_1
     };
-    static struct lgtd_router_device device_1 = { .device = &bulb_1 };
-    SLIST_INSERT_HEAD(&devices, &device_1, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_1);
     struct lgtd_lifx_tag *gw_1_tag_1 = lgtd_tests_insert_mock_tag("dub");
     lgtd_tests_add_tag_to_gw(gw_1_tag_1, &gw_bulb_1, 0);
 
@@ -286,8 +287,7 @@ setup_devices(void)
         },
         .gw = &gw_bulb_2
     };
-    static struct lgtd_router_device device_2 = { .device = &bulb_2 };
-    SLIST_INSERT_HEAD(&devices, &device_2, link);
+    lgtd_tests_insert_mock_device(&devices, &bulb_2);
 }
 
 int
@@ -5,6 +5,7 @@
 #include "mock_gateway.h"
 #include "mock_event2.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 #include "tests_utils.h"
@@ -33,15 +34,14 @@ lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
 
     targets_to_devices_called = true;
 
-    static struct lgtd_router_device_list devices =
-        SLIST_HEAD_INITIALIZER(&devices);
+    static struct lgtd_router_device_list devices = { .count = 0 };
 
     return &devices;
 }
 
 static bool send_to_device_called = false;
 
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -50,6 +50,8 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     (void)pkt_type;
     (void)pkt;
     send_to_device_called = true;
+
+    return true;
 }
 
 int
@@ -37,7 +37,7 @@ lgtd_client_send_error(struct lgtd_client *client,
 #endif
 
 #ifndef MOCKED_ROUTER_SEND_TO_DEVICE
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -45,6 +45,7 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
     (void)bulb;
     (void)pkt_type;
     (void)pkt;
+    return true;
 }
 #endif
 
@@ -61,6 +62,36 @@ lgtd_router_send(const struct lgtd_proto_target_list *targets,
 }
 #endif
 
+#ifndef MOCKED_ROUTER_SEND_TO_DEVICE_AT
+bool
+lgtd_router_send_to_device_at(struct lgtd_lifx_bulb *bulb,
+                              enum lgtd_lifx_packet_type pkt_type,
+                              void *pkt,
+                              lgtd_time_mono_t at)
+{
+    (void)bulb;
+    (void)pkt_type;
+    (void)pkt;
+    (void)at;
+    return true;
+}
+#endif
+
+#ifndef MOCKED_ROUTER_SEND_AT
+bool
+lgtd_router_send_at(const struct lgtd_proto_target_list *targets,
+                    enum lgtd_lifx_packet_type pkt_type,
+                    void *pkt,
+                    lgtd_time_mono_t at)
+{
+    (void)targets;
+    (void)pkt_type;
+    (void)pkt;
+    (void)at;
+    return true;
+}
+#endif
+
 #ifndef MOCKED_ROUTER_TARGETS_TO_DEVICES
 struct lgtd_router_device_list *
 lgtd_router_targets_to_devices(const struct lgtd_proto_target_list *targets)
@@ -0,0 +1,91 @@
+#include "router.c"
+
+#include "mock_daemon.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "tests_utils.h"
+#include "tests_router_utils.h"
+
+static struct lgtd_lifx_bulb *bulbs[5];
+
+// A bulb must match the targets if and only if lgtd_router_targets_to_devices
+// resolves the targets to it:
+static void
+check_targets(struct lgtd_proto_target_list *targets, int expected_matches)
+{
+    int matches = 0;
+    for (int i = 0; i != LGTD_ARRAY_SIZE(bulbs); i++) {
+        bool matched = lgtd_router_device_matches_targets(bulbs[i], targets);
+
+        bool resolved = false;
+        struct lgtd_router_device_list *devices;
+        devices = lgtd_router_targets_to_devices(targets);
+        struct lgtd_lifx_bulb **device;
+        LGTD_ROUTER_DEVICE_LIST_FOREACH(device, devices) {
+            resolved = resolved || *device == bulbs[i];
+        }
+        lgtd_router_device_list_free(devices);
+
+        if (matched != resolved) {
+            lgtd_errx(
+                1, "bulb %d %s the targets but is%s resolved from them",
+                i, matched ? "matches" : "doesn't match", resolved ? "" : "n't"
+            );
+        }
+        matches += matched;
+    }
+
+    if (matches != expected_matches) {
+        lgtd_errx(
+            1, "%d bulbs matched (expected %d)", matches, expected_matches
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway *gw_1 = lgtd_tests_insert_mock_gateway(1);
+    struct lgtd_lifx_gateway *gw_2 = lgtd_tests_insert_mock_gateway(2);
+
+    struct lgtd_lifx_tag *tag_foo = lgtd_tests_insert_mock_tag("foo");
+    lgtd_tests_add_tag_to_gw(tag_foo, gw_1, 42);
+    lgtd_tests_add_tag_to_gw(tag_foo, gw_2, 63);
+
+    struct lgtd_lifx_tag *tag_bar = lgtd_tests_insert_mock_tag("bar");
+    lgtd_tests_add_tag_to_gw(tag_bar, gw_2, 42);
+
+    bulbs[0] = lgtd_tests_insert_mock_bulb(gw_1, 3);
+    bulbs[0]->state.tags = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(42);
+
+    bulbs[1] = lgtd_tests_insert_mock_bulb(gw_1, 4);
+    // tag id 63 is foo on gw_2 but not on gw_1:
+    bulbs[1]->state.tags = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(63);
+
+    bulbs[2] = lgtd_tests_insert_mock_bulb(gw_2, 5);
+    lgtd_tests_set_mock_bulb_label(bulbs[2], "desk");
+
+    bulbs[3] = lgtd_tests_insert_mock_bulb(gw_2, 6);
+    bulbs[3]->state.tags =
+        LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(63) | LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(42);
+
+    // a label that looks like the address of another bulb:
+    bulbs[4] = lgtd_tests_insert_mock_bulb(gw_2, 7);
+    lgtd_tests_set_mock_bulb_label(bulbs[4], "5");
+
+    check_targets(lgtd_tests_build_target_list(NULL), 0);
+    check_targets(lgtd_tests_build_target_list("", NULL), 0);
+    check_targets(lgtd_tests_build_target_list("*", NULL), 5);
+    check_targets(lgtd_tests_build_target_list("#pouet", "label", NULL), 0);
+    check_targets(lgtd_tests_build_target_list("#foo", NULL), 2);
+    check_targets(lgtd_tests_build_target_list("#bar", NULL), 1);
+    check_targets(lgtd_tests_build_target_list("desk", NULL), 1);
+    check_targets(lgtd_tests_build_target_list("4", NULL), 1);
+    check_targets(lgtd_tests_build_target_list("5", NULL), 1);
+    check_targets(lgtd_tests_build_target_list("desk", "5", "#foo", NULL), 3);
+
+    return 0;
+}
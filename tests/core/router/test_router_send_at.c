@@ -0,0 +1,85 @@
+#include "router.c"
+
+#include "mock_daemon.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "tests_utils.h"
+#include "tests_router_utils.h"
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    // the bulbs are all behind the same gateway but can't be sent a single
+    // site-wide packet since their clocks differ:
+    struct lgtd_lifx_gateway *gw_1 = lgtd_tests_insert_mock_gateway(1);
+    struct lgtd_lifx_bulb *bulb_1 = lgtd_tests_insert_mock_bulb(gw_1, 1);
+    bulb_1->clock_offset = 1000;
+    bulb_1->clock_offset_updated_at = 42;
+    struct lgtd_lifx_bulb *bulb_2 = lgtd_tests_insert_mock_bulb(gw_1, 2);
+    bulb_2->clock_offset = -500;
+    bulb_2->clock_offset_updated_at = 42;
+    struct lgtd_lifx_bulb *bulb_3 = lgtd_tests_insert_mock_bulb(gw_1, 3);
+
+    struct lgtd_lifx_packet_power_state payload = {
+        .power = LGTD_LIFX_POWER_ON
+    };
+    struct lgtd_proto_target_list *targets;
+    targets = lgtd_tests_build_target_list("*", NULL);
+    lgtd_router_send_at(targets, LGTD_LIFX_SET_POWER_STATE, &payload, 2000);
+
+    if (lgtd_tests_gw_pkt_queue_size != 3) {
+        lgtd_errx(
+            1, "%d packets sent (expected 3)", lgtd_tests_gw_pkt_queue_size
+        );
+    }
+
+    const struct {
+        const struct lgtd_lifx_bulb *bulb;
+        uint64_t                    at_time;
+    } expected[] = {
+        { bulb_1, UINT64_C(3000) * 1000 * 1000 },
+        { bulb_2, UINT64_C(1500) * 1000 * 1000 },
+        // the clock of the bulb is unknown, run the packet right away:
+        { bulb_3, 0 }
+    };
+    for (int i = 0; i != lgtd_tests_gw_pkt_queue_size; i++) {
+        struct lgtd_lifx_packet_header *hdr = lgtd_tests_gw_pkt_queue[i].hdr;
+        lgtd_lifx_wire_decode_header(hdr);
+
+        if (lgtd_tests_gw_pkt_queue[i].pkt != &payload) {
+            lgtd_errx(1, "invalid payload");
+        }
+
+        int flags = LGTD_LIFX_ADDRESSABLE|LGTD_LIFX_RES_REQUIRED;
+        if (!lgtd_tests_lifx_header_has_flags(hdr, flags)) {
+            lgtd_errx(1, "the packet should have been sent to a device");
+        }
+
+        int j;
+        for (j = 0; j != LGTD_ARRAY_SIZE(expected); j++) {
+            const uint8_t *addr = expected[j].bulb->addr;
+            if (!memcmp(hdr->target.device_addr, addr, LGTD_LIFX_ADDR_LENGTH)) {
+                break;
+            }
+        }
+        if (j == LGTD_ARRAY_SIZE(expected)) {
+            lgtd_errx(1, "the packet has been sent to an unknown bulb");
+        }
+        if (hdr->at_time != expected[j].at_time) {
+            lgtd_errx(
+                1, "at_time = %ju (expected %ju)",
+                (uintmax_t)hdr->at_time, (uintmax_t)expected[j].at_time
+            );
+        }
+    }
+
+    if (bulb_1->expected_power_on != LGTD_LIFX_POWER_ON
+        || bulb_3->expected_power_on != LGTD_LIFX_POWER_ON) {
+        lgtd_errx(1, "expected_power_on wasn't updated on the targets");
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "router.c"
+
+#include "mock_daemon.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "tests_utils.h"
+#include "tests_router_utils.h"
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway *gw_1 = lgtd_tests_insert_mock_gateway(1);
+    struct lgtd_lifx_bulb *bulb_1 = lgtd_tests_insert_mock_bulb(gw_1, 1);
+    struct lgtd_lifx_bulb *bulb_2 = lgtd_tests_insert_mock_bulb(gw_1, 2);
+
+    struct lgtd_lifx_gateway *gw_2 = lgtd_tests_insert_mock_gateway(2);
+    struct lgtd_lifx_tag *tag_foo = lgtd_tests_insert_mock_tag("foo");
+    lgtd_tests_add_tag_to_gw(tag_foo, gw_2, 42);
+    struct lgtd_lifx_bulb *bulb_3 = lgtd_tests_insert_mock_bulb(gw_2, 3);
+    bulb_3->state.tags = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(42);
+    struct lgtd_lifx_bulb *bulb_4 = lgtd_tests_insert_mock_bulb(gw_2, 4);
+    bulb_4->state.tags = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(42);
+    struct lgtd_lifx_bulb *bulb_5 = lgtd_tests_insert_mock_bulb(gw_2, 5);
+    struct lgtd_lifx_bulb *bulb_6 = lgtd_tests_insert_mock_bulb(gw_2, 6);
+    lgtd_tests_set_mock_bulb_label(bulb_6, "desk");
+
+    struct lgtd_lifx_packet_power_state payload = {
+        .power = LGTD_LIFX_POWER_ON
+    };
+    struct lgtd_proto_target_list *targets;
+    targets = lgtd_tests_build_target_list("1", "2", "3", "4", "desk", NULL);
+    lgtd_router_send(targets, LGTD_LIFX_SET_POWER_STATE, &payload);
+
+    if (lgtd_tests_gw_pkt_queue_size != 3) {
+        lgtd_errx(
+            1, "%d packets sent (expected 3)", lgtd_tests_gw_pkt_queue_size
+        );
+    }
+
+    bool site_wide_sent = false, tagged_sent = false, device_sent = false;
+    for (int i = 0; i != lgtd_tests_gw_pkt_queue_size; i++) {
+        struct lgtd_lifx_gateway *recpt_gw = lgtd_tests_gw_pkt_queue[i].gw;
+        struct lgtd_lifx_packet_header *hdr = lgtd_tests_gw_pkt_queue[i].hdr;
+        lgtd_lifx_wire_decode_header(hdr);
+
+        if (lgtd_tests_gw_pkt_queue[i].pkt != &payload) {
+            lgtd_errx(1, "invalid payload");
+        }
+
+        int flags;
+        if (recpt_gw == gw_1) {
+            flags = LGTD_LIFX_ADDRESSABLE|LGTD_LIFX_TAGGED|LGTD_LIFX_RES_REQUIRED;
+            if (!lgtd_tests_lifx_header_has_flags(hdr, flags)) {
+                lgtd_errx(1, "gw_1 should have received a site-wide packet");
+            }
+            if (hdr->target.tags != 0) {
+                lgtd_errx(1, "tags should be 0 for a site-wide packet");
+            }
+            site_wide_sent = true;
+        } else if (recpt_gw == gw_2
+                   && hdr->protocol & LGTD_LIFX_PROTOCOL_TAGGED) {
+            if (hdr->target.tags != LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(42)) {
+                lgtd_errx(
+                    1, "unexpected tags %#jx (expected %#jx)",
+                    (uintmax_t)hdr->target.tags,
+                    (uintmax_t)LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(42)
+                );
+            }
+            tagged_sent = true;
+        } else if (recpt_gw == gw_2) {
+            flags = LGTD_LIFX_ADDRESSABLE|LGTD_LIFX_RES_REQUIRED;
+            if (!lgtd_tests_lifx_header_has_flags(hdr, flags)) {
+                lgtd_errx(1, "the packet header doesn't have the right flags");
+            }
+            if (memcmp(hdr->target.device_addr, bulb_6->addr, sizeof(bulb_6->addr))) {
+                lgtd_errx(1, "the packet should have been sent to bulb_6");
+            }
+            device_sent = true;
+        } else {
+            lgtd_errx(1, "the packet has been sent to the wrong gateway");
+        }
+    }
+
+    if (!site_wide_sent || !tagged_sent || !device_sent) {
+        lgtd_errx(
+            1, "site_wide_sent = %d, tagged_sent = %d, device_sent = %d "
+            "(expected 1, 1, 1)", site_wide_sent, tagged_sent, device_sent
+        );
+    }
+
+    struct lgtd_lifx_bulb *targeted[] = {
+        bulb_1, bulb_2, bulb_3, bulb_4, bulb_6
+    };
+    for (int i = 0; i != LGTD_ARRAY_SIZE(targeted); i++) {
+        if (targeted[i]->expected_power_on != LGTD_LIFX_POWER_ON) {
+            lgtd_errx(1, "expected_power_on wasn't updated on a target");
+        }
+    }
+    if (bulb_5->expected_power_on) {
+        lgtd_errx(1, "bulb_5 wasn't targeted");
+    }
+
+    return 0;
+}
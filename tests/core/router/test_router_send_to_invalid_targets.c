@@ -2,6 +2,7 @@
 
 #include "mock_daemon.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "tests_utils.h"
 #include "tests_router_utils.h"
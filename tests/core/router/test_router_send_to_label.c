@@ -2,6 +2,7 @@
 
 #include "mock_daemon.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "tests_utils.h"
 #include "tests_router_utils.h"
@@ -18,9 +19,9 @@ main(void)
     struct lgtd_lifx_bulb *bulb_3 = lgtd_tests_insert_mock_bulb(gw_2, 3);
 
     const char *label = "feed";
-    strcpy(bulb_1->state.label, label);
-    strcpy(bulb_3->state.label, label);
-    strcpy(bulb_2->state.label, "trololo");
+    lgtd_tests_set_mock_bulb_label(bulb_1, label);
+    lgtd_tests_set_mock_bulb_label(bulb_3, label);
+    lgtd_tests_set_mock_bulb_label(bulb_2, "trololo");
 
     struct lgtd_lifx_packet_power_state payload = {
         .power = LGTD_LIFX_POWER_ON
@@ -2,6 +2,7 @@
 
 #include "mock_daemon.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "tests_utils.h"
 #include "tests_router_utils.h"
@@ -14,9 +15,9 @@ count_device(const struct lgtd_router_device_list *devices, const void *device)
     }
 
     int count = 0;
-    struct lgtd_router_device *it;
-    SLIST_FOREACH(it, devices, link) {
-        if (it->device == device) {
+    struct lgtd_lifx_bulb **it;
+    LGTD_ROUTER_DEVICE_LIST_FOREACH(it, devices) {
+        if (*it == device) {
             count++;
         }
     }
@@ -31,13 +32,7 @@ len(const struct lgtd_router_device_list *devices)
         lgtd_errx(1, "unexpected NULL devices list");
     }
 
-    int count = 0;
-    struct lgtd_router_device *it;
-    SLIST_FOREACH(it, devices, link) {
-        count++;
-    }
-
-    return count;
+    return devices->count;
 }
 
 int
@@ -61,7 +56,7 @@ main(void)
     struct lgtd_lifx_bulb *bulb_2_gw_1 = lgtd_tests_insert_mock_bulb(gw_1, 4);
 
     struct lgtd_lifx_bulb *bulb_1_gw_2 = lgtd_tests_insert_mock_bulb(gw_2, 5);
-    strcpy(bulb_1_gw_2->state.label, "desk");
+    lgtd_tests_set_mock_bulb_label(bulb_1_gw_2, "desk");
 
     struct lgtd_lifx_bulb *bulb_2_gw_2 = lgtd_tests_insert_mock_bulb(gw_2, 6);
     bulb_2_gw_2->state.tags =
@@ -172,7 +167,7 @@ main(void)
 
     // targeting a label shouldn't break at the first match:
     struct lgtd_lifx_bulb *bulb_3_gw_2 = lgtd_tests_insert_mock_bulb(gw_2, 7);
-    strcpy(bulb_3_gw_2->state.label, "desk");
+    lgtd_tests_set_mock_bulb_label(bulb_3_gw_2, "desk");
     targets = lgtd_tests_build_target_list("desk", NULL);
     devices = lgtd_router_targets_to_devices(targets);
     if ((count = count_device(devices, bulb_1_gw_2)) != 1) {
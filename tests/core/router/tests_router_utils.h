@@ -10,7 +10,7 @@ struct {
     int                             pkt_size;
 } lgtd_tests_gw_pkt_queue[16] = { { NULL, NULL, NULL, 0}, };
 
-void
+bool
 lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *gw,
                                  const struct lgtd_lifx_packet_header *hdr,
                                  const struct lgtd_lifx_packet_info *pkt_info,
@@ -29,6 +29,8 @@ lgtd_lifx_gateway_enqueue_packet(struct lgtd_lifx_gateway *gw,
     lgtd_tests_gw_pkt_queue[lgtd_tests_gw_pkt_queue_size].pkt = pkt;
     lgtd_tests_gw_pkt_queue[lgtd_tests_gw_pkt_queue_size].pkt_size = pkt_info->size;
     lgtd_tests_gw_pkt_queue_size++;
+
+    return true;
 }
 
 void
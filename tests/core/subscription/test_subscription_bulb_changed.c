@@ -0,0 +1,213 @@
+#include <err.h>
+
+#include "subscription.c"
+
+#include "mock_client_buf.h"
+#include "mock_daemon.h"
+#define MOCKED_EVENT_ACTIVE
+#include "mock_event2.h"
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_proto.h"
+#define MOCKED_LGTD_ROUTER_DEVICE_MATCHES_TARGETS
+#include "mock_router.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+#include "tests_utils.h"
+
+#define FAKE_BUFFEREVENT (void *)0xfeed
+
+static int event_active_call_count = 0;
+
+void
+event_active(struct event *ev, int res, short ncalls)
+{
+    if (ev != MOCK_EVENT_NEW_EVENT_PTR) {
+        errx(
+            1, "event_active got ev %p (expected %p)",
+            ev, MOCK_EVENT_NEW_EVENT_PTR
+        );
+    }
+    (void)res;
+    (void)ncalls;
+
+    event_active_call_count++;
+}
+
+static int matches_targets_call_count = 0;
+
+// Only "*" and labels are used in there, see the router tests for the rest:
+bool
+lgtd_router_device_matches_targets(const struct lgtd_lifx_bulb *device,
+                                   const struct lgtd_proto_target_list *targets)
+{
+    matches_targets_call_count++;
+
+    const char *target = SLIST_FIRST(targets)->target;
+    return !strcmp(target, "*") || lgtd_lifx_bulb_has_label(device, target);
+}
+
+static void
+flush(const char *expected)
+{
+    reset_client_write_buf();
+    lgtd_subscription_flush_callback(-1, 0, NULL);
+    if (strcmp(client_write_buf, expected)) {
+        errx(
+            1, "got notification %s (expected %s)", client_write_buf, expected
+        );
+    }
+    if (!LIST_EMPTY(&lgtd_subscription_changed_bulbs)) {
+        errx(1, "the changes should have been dropped after the flush");
+    }
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_gateway *gw = lgtd_tests_insert_mock_gateway(1);
+    struct lgtd_lifx_bulb *bulb_1 = lgtd_tests_insert_mock_bulb(gw, 1);
+    struct lgtd_lifx_bulb *bulb_2 = lgtd_tests_insert_mock_bulb(gw, 2);
+    lgtd_tests_set_mock_bulb_label(bulb_2, "desk");
+
+    // nobody is subscribed, nothing is tracked:
+    lgtd_lifx_bulb_set_power_state(bulb_1, LGTD_LIFX_POWER_ON);
+    if (event_active_call_count || bulb_1->changes) {
+        errx(1, "the changes shouldn't be tracked without subscriptions");
+    }
+
+    // the command pipe can't subscribe:
+    struct lgtd_client client = { .io = NULL };
+    struct lgtd_proto_target_list *targets;
+    targets = lgtd_tests_build_target_list("*", NULL);
+    if (lgtd_subscription_add(&client, targets, LGTD_LIFX_BULB_ALL_CHANGED)) {
+        errx(1, "a client without a connection shouldn't subscribe");
+    }
+    if (client.subscription) {
+        errx(1, "the subscription shouldn't be attached to the client");
+    }
+
+    client.io = FAKE_BUFFEREVENT;
+    if (!lgtd_subscription_add(&client, targets, LGTD_LIFX_BULB_ALL_CHANGED)) {
+        errx(1, "couldn't subscribe");
+    }
+    if (!client.subscription || client.subscription->client != &client) {
+        errx(1, "the subscription wasn't attached to the client");
+    }
+
+    // the changes of the same iteration of the event loop are coalesced:
+    lgtd_lifx_bulb_set_power_state(bulb_1, LGTD_LIFX_POWER_OFF);
+    lgtd_tests_set_mock_bulb_label(bulb_1, "lamp");
+    lgtd_lifx_bulb_set_power_state(bulb_2, LGTD_LIFX_POWER_ON);
+    if (event_active_call_count != 1) {
+        errx(
+            1, "event_active_call_count = %d (expected 1)",
+            event_active_call_count
+        );
+    }
+    int expected_changes = LGTD_LIFX_BULB_POWER_CHANGED
+        | LGTD_LIFX_BULB_LABEL_CHANGED;
+    if (bulb_1->changes != expected_changes) {
+        errx(
+            1, "changes = %#x (expected %#x)",
+            bulb_1->changes, expected_changes
+        );
+    }
+    flush(
+        "{\"jsonrpc\": \"2.0\", "
+        "\"method\": \"light_state_changed\", "
+        "\"params\": ["
+            "{\"_lifx\":{\"addr\":\"00:00:00:00:00:02\"},\"power\":true},"
+            "{\"_lifx\":{\"addr\":\"00:00:00:00:00:01\"},"
+            "\"power\":false,\"label\":\"lamp\"}"
+        "]}"
+    );
+
+    // setting the same value again isn't a change:
+    lgtd_lifx_bulb_set_power_state(bulb_2, LGTD_LIFX_POWER_ON);
+    if (event_active_call_count != 1 || bulb_2->changes) {
+        errx(1, "setting the same power state again isn't a change");
+    }
+
+    // only the subscribed fields of the subscribed bulbs are sent:
+    targets = lgtd_tests_build_target_list("desk", NULL);
+    if (!lgtd_subscription_add(&client, targets, LGTD_LIFX_BULB_HSBK_CHANGED)) {
+        errx(1, "couldn't update the subscription");
+    }
+    struct lgtd_lifx_light_state state = bulb_2->state;
+    state.hue = 0xffff;
+    state.saturation = 0;
+    state.brightness = 0xffff;
+    state.kelvin = 2700;
+    state.power = LGTD_LIFX_POWER_OFF;
+    lgtd_lifx_bulb_set_light_state(bulb_2, &state, 42);
+    lgtd_lifx_bulb_set_power_state(bulb_1, LGTD_LIFX_POWER_ON);
+    if (event_active_call_count != 2) {
+        errx(
+            1, "event_active_call_count = %d (expected 2)",
+            event_active_call_count
+        );
+    }
+    flush(
+        "{\"jsonrpc\": \"2.0\", "
+        "\"method\": \"light_state_changed\", "
+        "\"params\": ["
+            "{\"_lifx\":{\"addr\":\"00:00:00:00:00:02\"},"
+            "\"hsbk\":[360,0,1,2700]}"
+        "]}"
+    );
+
+    // nothing is sent when nothing matches:
+    lgtd_lifx_bulb_set_power_state(bulb_2, LGTD_LIFX_POWER_ON);
+    flush("");
+
+    // only the bulbs that changed are matched against the targets, not every
+    // targeted bulb:
+    targets = lgtd_tests_build_target_list("*", NULL);
+    if (!lgtd_subscription_add(&client, targets, LGTD_LIFX_BULB_POWER_CHANGED)) {
+        errx(1, "couldn't update the subscription");
+    }
+    struct lgtd_lifx_bulb *bulb_42 = NULL;
+    for (int i = 3; i != 64; i++) {
+        struct lgtd_lifx_bulb *bulb = lgtd_tests_insert_mock_bulb(gw, i);
+        if (i == 42) {
+            bulb_42 = bulb;
+        }
+    }
+    matches_targets_call_count = 0;
+    lgtd_lifx_bulb_set_power_state(bulb_42, LGTD_LIFX_POWER_ON);
+    flush(
+        "{\"jsonrpc\": \"2.0\", "
+        "\"method\": \"light_state_changed\", "
+        "\"params\": ["
+            "{\"_lifx\":{\"addr\":\"00:00:00:00:00:2a\"},\"power\":true}"
+        "]}"
+    );
+    if (matches_targets_call_count != 1) {
+        errx(
+            1, "matches_targets_call_count = %d (expected 1)",
+            matches_targets_call_count
+        );
+    }
+
+    // a closed bulb isn't flushed:
+    lgtd_lifx_bulb_set_power_state(bulb_1, LGTD_LIFX_POWER_OFF);
+    SLIST_REMOVE(&gw->bulbs, bulb_1, lgtd_lifx_bulb, link_by_gw);
+    lgtd_lifx_bulb_close(bulb_1);
+    if (!LIST_EMPTY(&lgtd_subscription_changed_bulbs)) {
+        errx(1, "the closed bulb is still in the list of changes");
+    }
+
+    if (!lgtd_subscription_remove(&client) || client.subscription) {
+        errx(1, "couldn't unsubscribe");
+    }
+    if (lgtd_subscription_remove(&client)) {
+        errx(1, "the client wasn't subscribed anymore");
+    }
+    lgtd_lifx_bulb_set_power_state(bulb_2, LGTD_LIFX_POWER_OFF);
+    if (bulb_2->changes) {
+        errx(1, "the changes shouldn't be tracked without subscriptions");
+    }
+
+    return 0;
+}
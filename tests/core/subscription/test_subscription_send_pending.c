@@ -0,0 +1,116 @@
+#include <err.h>
+
+#include "subscription.c"
+
+#include "mock_client_buf.h"
+#include "mock_daemon.h"
+#include "mock_event2.h"
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_proto.h"
+#define MOCKED_LGTD_ROUTER_DEVICE_MATCHES_TARGETS
+#include "mock_router.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+#include "tests_utils.h"
+
+#define FAKE_BUFFEREVENT (void *)0xfeed
+
+#define EXPECTED_NOTIFICATION                                       \
+    "{\"jsonrpc\": \"2.0\", "                                       \
+    "\"method\": \"light_state_changed\", "                         \
+    "\"params\": ["                                                 \
+        "{\"_lifx\":{\"addr\":\"00:00:00:00:00:01\"},\"power\":true}" \
+    "]}"
+
+bool
+lgtd_router_device_matches_targets(const struct lgtd_lifx_bulb *device,
+                                   const struct lgtd_proto_target_list *targets)
+{
+    (void)device;
+
+    const char *target = SLIST_FIRST(targets)->target;
+    if (strcmp(target, "000000000001")) {
+        errx(1, "got target %s (expected 000000000001)", target);
+    }
+
+    return true;
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_gateway *gw = lgtd_tests_insert_mock_gateway(1);
+    struct lgtd_lifx_bulb *bulb = lgtd_tests_insert_mock_bulb(gw, 1);
+
+    struct lgtd_client client = { .io = FAKE_BUFFEREVENT };
+    struct lgtd_proto_target_list *targets;
+    targets = lgtd_tests_build_target_list("000000000001", NULL);
+    if (!lgtd_subscription_add(&client, targets, LGTD_LIFX_BULB_ALL_CHANGED)) {
+        errx(1, "couldn't subscribe");
+    }
+
+    // the client is getting the response to a batch, wait for its end:
+    client.batch_sent = 1;
+    lgtd_lifx_bulb_set_power_state(bulb, LGTD_LIFX_POWER_ON);
+    lgtd_subscription_flush_callback(-1, 0, NULL);
+    if (client_write_buf_idx) {
+        errx(
+            1, "nothing should have been written in the middle of a batch "
+            "(got %s)", client_write_buf
+        );
+    }
+    if (client.subscription->pending_len == 0) {
+        errx(1, "the notification should be pending");
+    }
+
+    lgtd_subscription_send_pending(&client);
+    if (client_write_buf_idx) {
+        errx(1, "the batch isn't over yet");
+    }
+
+    client.batch_sent = 0;
+    lgtd_subscription_send_pending(&client);
+    if (strcmp(client_write_buf, EXPECTED_NOTIFICATION)) {
+        errx(
+            1, "got notification %s (expected %s)",
+            client_write_buf, EXPECTED_NOTIFICATION
+        );
+    }
+    if (client.subscription->pending_len) {
+        errx(1, "the notification is still pending after being sent");
+    }
+
+    // and it's sent only once:
+    reset_client_write_buf();
+    lgtd_subscription_send_pending(&client);
+    if (client_write_buf_idx) {
+        errx(1, "the notification was sent twice");
+    }
+
+    // the notification is dropped if it's been pending for too long:
+    client.batch_sent = 1;
+    for (int i = 0; i != LGTD_SUBSCRIPTION_MAX_PENDING_SIZE / 32; i++) {
+        lgtd_lifx_bulb_set_power_state(
+            bulb, i % 2 ? LGTD_LIFX_POWER_ON : LGTD_LIFX_POWER_OFF
+        );
+        lgtd_subscription_flush_callback(-1, 0, NULL);
+    }
+    if (client.subscription->pending_size > LGTD_SUBSCRIPTION_MAX_PENDING_SIZE) {
+        errx(
+            1, "pending_size = %d (max %d)",
+            client.subscription->pending_size,
+            LGTD_SUBSCRIPTION_MAX_PENDING_SIZE
+        );
+    }
+
+    lgtd_subscription_close_all();
+    if (client.subscription || !LIST_EMPTY(&lgtd_subscriptions)) {
+        errx(1, "the subscriptions weren't closed");
+    }
+    if (lgtd_subscription_flush_ev) {
+        errx(1, "the flush event wasn't freed");
+    }
+
+    return 0;
+}
@@ -30,6 +30,7 @@
 #include "core/stats.h"
 #include "lifx/bulb.h"
 #include "lifx/gateway.h"
+#include "core/router.h"
 #include "tests_utils.h"
 #include "core/lightsd.h"
 
@@ -56,6 +57,7 @@ lgtd_tests_insert_mock_gateway(int id)
 #endif
 
     LIST_INSERT_HEAD(&lgtd_lifx_gateways, gw, link);
+    TAILQ_INSERT_TAIL(&lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt);
 
     LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(gateways, 1);
 
@@ -81,6 +83,17 @@ lgtd_tests_insert_mock_bulb(struct lgtd_lifx_gateway *gw, uint64_t addr)
     return bulb;
 }
 
+void
+lgtd_tests_set_mock_bulb_label(struct lgtd_lifx_bulb *bulb, const char *label)
+{
+    assert(bulb);
+    assert(label);
+
+    char buf[LGTD_LIFX_LABEL_SIZE] = { 0 };
+    memcpy(buf, label, LGTD_MIN(strlen(label), sizeof(buf)));
+    lgtd_lifx_bulb_set_label(bulb, buf);
+}
+
 struct lgtd_proto_target_list *
 lgtd_tests_build_target_list(const char *target, ...)
 {
@@ -114,9 +127,9 @@ struct lgtd_lifx_tag *
 lgtd_tests_insert_mock_tag(const char *tag_label)
 {
     assert(strlen(tag_label) < LGTD_LIFX_LABEL_SIZE);
-    struct lgtd_lifx_tag *tag = calloc(1, sizeof(*tag));
-    strcpy(tag->label, tag_label);
-    LIST_INSERT_HEAD(&lgtd_lifx_tags, tag, link);
+    // go through tagging.c so the tag is indexed by label too:
+    struct lgtd_lifx_tag *tag = lgtd_lifx_tagging_allocate_tag(tag_label);
+    assert(tag);
     return tag;
 }
 
@@ -125,10 +138,15 @@ lgtd_tests_add_tag_to_gw(struct lgtd_lifx_tag *tag,
                          struct lgtd_lifx_gateway *gw,
                          int tag_id)
 {
-    struct lgtd_lifx_site *site = calloc(1, sizeof(*site));
+    if (tag->nsites == tag->sites_capacity) {
+        tag->sites_capacity = tag->sites_capacity * 2 + 1;
+        tag->sites = realloc(
+            tag->sites, tag->sites_capacity * sizeof(*tag->sites)
+        );
+    }
+    struct lgtd_lifx_site *site = &tag->sites[tag->nsites++];
     site->gw = gw;
     site->tag_id = tag_id;
-    LIST_INSERT_HEAD(&tag->sites, site, link);
 
     gw->tags[tag_id] = tag;
     gw->tag_ids |= LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(tag_id);
@@ -136,6 +154,22 @@ lgtd_tests_add_tag_to_gw(struct lgtd_lifx_tag *tag,
     return site;
 }
 
+void
+lgtd_tests_insert_mock_device(struct lgtd_router_device_list *devices,
+                              struct lgtd_lifx_bulb *bulb)
+{
+    devices->devices = reallocarray(
+        devices->devices, devices->count + 1, sizeof(*devices->devices)
+    );
+    memmove(
+        &devices->devices[1],
+        &devices->devices[0],
+        devices->count * sizeof(*devices->devices)
+    );
+    devices->devices[0] = bulb;
+    devices->capacity = ++devices->count;
+}
+
 struct lgtd_listen *
 lgtd_tests_insert_mock_listener(const char *ipv4, uint16_t port)
 {
@@ -2,6 +2,7 @@
 
 struct bufferevent;
 struct sockaddr;
+struct lgtd_router_device_list;
 
 static inline bool
 lgtd_tests_lifx_header_has_flags(const struct lgtd_lifx_packet_header *hdr,
@@ -44,11 +45,14 @@ void lgtd_tests_remove_temp_dir(char *);
 
 struct lgtd_lifx_gateway *lgtd_tests_insert_mock_gateway(int);
 struct lgtd_lifx_bulb *lgtd_tests_insert_mock_bulb(struct lgtd_lifx_gateway *, uint64_t);
+void lgtd_tests_set_mock_bulb_label(struct lgtd_lifx_bulb *, const char *);
 struct lgtd_proto_target_list *lgtd_tests_build_target_list(const char *, ...);
 struct lgtd_lifx_tag *lgtd_tests_insert_mock_tag(const char *);
 struct lgtd_lifx_site *lgtd_tests_add_tag_to_gw(struct lgtd_lifx_tag *,
                                                 struct lgtd_lifx_gateway *,
                                                 int);
+void lgtd_tests_insert_mock_device(struct lgtd_router_device_list *,
+                                   struct lgtd_lifx_bulb *);
 struct lgtd_listen *lgtd_tests_insert_mock_listener(const char *, uint16_t);
 struct lgtd_client *lgtd_tests_insert_mock_client(struct bufferevent *);
 void lgtd_tests_check_sockaddr_in(const struct sockaddr *, int, int, uint32_t, uint16_t);
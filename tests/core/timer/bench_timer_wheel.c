@@ -0,0 +1,147 @@
+// Compare the timing wheel against the previous implementation of lgtd_timer
+// (one libevent event per timer) when starting, rescheduling and stopping a
+// lot of timers, build it with: make bench_timer_wheel
+
+#include <stdio.h>
+#include <string.h>
+
+#include "core/timer.c"
+
+#include "mock_log.h"
+
+struct event_base *lgtd_ev_base = NULL;
+
+enum { DEFAULT_TIMER_COUNT = 10000 };
+
+static void
+bench_timer_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    (void)ctx;
+}
+
+static void
+bench_event_callback(evutil_socket_t socket, short events, void *ctx)
+{
+    (void)socket;
+    (void)events;
+    (void)ctx;
+}
+
+static int
+bench_random_msecs(void)
+{
+    return 1 + rand() % (60 * 1000);
+}
+
+static double
+bench_elapsed_usecs(const struct timeval *start)
+{
+    struct timeval now, elapsed;
+    evutil_gettimeofday(&now, NULL);
+    evutil_timersub(&now, start, &elapsed);
+    return elapsed.tv_sec * 1e6 + elapsed.tv_usec;
+}
+
+static void
+bench_report(const char *impl, const char *op, double usecs, int count)
+{
+    printf(
+        "%-8s %-12s %10.0fus %8.3fus/timer\n", impl, op, usecs, usecs / count
+    );
+}
+
+static void
+bench_libevent(struct event **events, int count)
+{
+    struct timeval start;
+
+    srand(count);
+    evutil_gettimeofday(&start, NULL);
+    for (int i = 0; i != count; i++) {
+        events[i] = event_new(
+            lgtd_ev_base, -1, EV_PERSIST, bench_event_callback, NULL
+        );
+        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(bench_random_msecs());
+        if (!events[i] || evtimer_add(events[i], &tv)) {
+            errx(1, "can't start timer %d", i);
+        }
+    }
+    bench_report("libevent", "start", bench_elapsed_usecs(&start), count);
+
+    evutil_gettimeofday(&start, NULL);
+    for (int i = 0; i != count; i++) {
+        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(bench_random_msecs());
+        evtimer_add(events[i], &tv);
+    }
+    bench_report("libevent", "reschedule", bench_elapsed_usecs(&start), count);
+
+    evutil_gettimeofday(&start, NULL);
+    for (int i = 0; i != count; i++) {
+        event_del(events[i]);
+        event_free(events[i]);
+    }
+    bench_report("libevent", "stop", bench_elapsed_usecs(&start), count);
+}
+
+static void
+bench_wheel(struct lgtd_timer **timers, int count)
+{
+    struct timeval start;
+    union lgtd_timer_ctx ctx = { .as_uint = 0 };
+
+    srand(count);
+    evutil_gettimeofday(&start, NULL);
+    for (int i = 0; i != count; i++) {
+        timers[i] = lgtd_timer_start(
+            LGTD_TIMER_PERSISTENT, bench_random_msecs(),
+            bench_timer_callback, ctx
+        );
+        if (!timers[i]) {
+            errx(1, "can't start timer %d", i);
+        }
+    }
+    bench_report("wheel", "start", bench_elapsed_usecs(&start), count);
+
+    evutil_gettimeofday(&start, NULL);
+    for (int i = 0; i != count; i++) {
+        struct timeval tv = LGTD_MSECS_TO_TIMEVAL(bench_random_msecs());
+        lgtd_timer_reschedule(timers[i], &tv);
+    }
+    bench_report("wheel", "reschedule", bench_elapsed_usecs(&start), count);
+
+    evutil_gettimeofday(&start, NULL);
+    for (int i = 0; i != count; i++) {
+        lgtd_timer_stop(timers[i]);
+    }
+    bench_report("wheel", "stop", bench_elapsed_usecs(&start), count);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_TIMER_COUNT;
+    if (count <= 0) {
+        errx(1, "usage: %s [timer_count]", argv[0]);
+    }
+
+    lgtd_ev_base = event_base_new();
+    if (!lgtd_ev_base) {
+        errx(1, "can't create the event base");
+    }
+
+    void **handles = calloc(count, sizeof(*handles));
+    if (!handles) {
+        err(1, "can't allocate %d timers", count);
+    }
+
+    printf("%d timers:\n", count);
+    bench_libevent((struct event **)handles, count);
+    bench_wheel((struct lgtd_timer **)handles, count);
+
+    free(handles);
+    lgtd_timer_stop_all();
+    event_base_free(lgtd_ev_base);
+
+    return 0;
+}
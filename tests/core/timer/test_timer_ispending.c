@@ -2,43 +2,45 @@
 
 #include "core/timer.c"
 
-#define MOCKED_EVENT_PENDING
 #include "mock_event2.h"
+#include "mock_log.h"
 #include "tests_shims.h"
+#include "tests_timer_utils.h"
 
-static int event_pending_call_count = 0;
+static void
+my_test_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    (void)ctx;
+}
 
 int
-event_pending(const struct event *ev, short events, struct timeval *tv)
+main(void)
 {
-    (void)events;
+    lgtd_tests_monotonic_msecs = 1000;
 
-    if (ev != MOCK_EVENT_NEW_EVENT_PTR) {
-        errx(1, "got event %p (expected %p)", ev, MOCK_EVENT_NEW_EVENT_PTR);
-    }
+    union lgtd_timer_ctx ctx = { .as_uint = 0 };
+    struct lgtd_timer *timer = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS, 100, my_test_callback, ctx
+    );
 
-    if (tv) {
-        errx(1, "got unexpected parameter tv");
+    if (!lgtd_timer_ispending(timer)) {
+        errx(1, "lgtd_timer_ispending returned false (expected true)");
     }
 
-    if (event_pending_call_count++) {
-        errx(1, "event_pending should have been called once");
+    lgtd_tests_timer_run_until(1100);
+    if (lgtd_timer_ispending(timer)) {
+        errx(1, "lgtd_timer_ispending returned true (expected false)");
     }
 
-    return true;
-}
-
-int
-main(void)
-{
-    struct lgtd_timer timer = { .event = MOCK_EVENT_NEW_EVENT_PTR };
-
-    if (!lgtd_timer_ispending(&timer)) {
-        errx(1, "lgtd_timer_ispending returned false (expected true)");
+    lgtd_timer_activate(timer);
+    if (!lgtd_timer_ispending(timer)) {
+        errx(1, "an activated timer should be pending");
     }
 
-    if (!event_pending_call_count) {
-        errx(1, "event_pending wasn't called");
+    lgtd_tests_timer_run_until(1101);
+    if (lgtd_timer_ispending(timer)) {
+        errx(1, "lgtd_timer_ispending returned true (expected false)");
     }
 
     return 0;
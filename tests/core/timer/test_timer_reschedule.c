@@ -4,9 +4,12 @@
 
 #define MOCKED_EVENT_ADD
 #include "mock_event2.h"
+#include "mock_log.h"
 #include "tests_shims.h"
+#include "tests_timer_utils.h"
 
 static int event_add_call_count = 0;
+static struct timeval last_tv_passed_to_event_add = { 0, 0 };
 
 int
 event_add(struct event *ev, const struct timeval *tv)
@@ -15,30 +18,88 @@ event_add(struct event *ev, const struct timeval *tv)
         errx(1, "got event %p (expected %p)", ev, MOCK_EVENT_NEW_EVENT_PTR);
     }
 
-    struct timeval expected_tv = LGTD_MSECS_TO_TIMEVAL(5);
-    if (memcmp(tv, &expected_tv, sizeof(*tv))) {
-        errx(1, "got unexpected timeout");
-    }
-
-    if (event_add_call_count++) {
-        errx(1, "event_add should have been called once");
-    }
+    last_tv_passed_to_event_add = *tv;
+    event_add_call_count++;
 
     return 0;
 }
 
+static void
+my_test_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    (void)ctx;
+}
+
+static void
+check_timer(const struct lgtd_timer *timer, int level, uint64_t expires_at)
+{
+    if (!timer->scheduled) {
+        errx(1, "the timer isn't scheduled");
+    }
+    if (timer->level != level || timer->expires_at != expires_at) {
+        errx(
+            1, "timer level = %d, expires_at = %ju (expected %d, %ju)",
+            timer->level, (uintmax_t)timer->expires_at,
+            level, (uintmax_t)expires_at
+        );
+    }
+}
+
 int
 main(void)
 {
-    struct lgtd_timer timer = { .event = MOCK_EVENT_NEW_EVENT_PTR };
-    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(5);
+    lgtd_tests_monotonic_msecs = 1000;
 
-    if (!lgtd_timer_reschedule(&timer, &tv)) {
+    union lgtd_timer_ctx ctx = { .as_uint = 0 };
+    struct lgtd_timer *timer = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS, 5, my_test_callback, ctx
+    );
+    check_timer(timer, 0, 101);
+    if (event_add_call_count != 1) {
+        errx(1, "event_add should have been called once");
+    }
+
+    // pushing the timer further doesn't need to re-arm the event, it will
+    // just wake up for nothing:
+    struct timeval tv = LGTD_MSECS_TO_TIMEVAL(2000);
+    if (!lgtd_timer_reschedule(timer, &tv)) {
         errx(1, "wrong return value");
     }
+    check_timer(timer, 1, 300);
+    if (timer->interval != 2000) {
+        errx(1, "timer interval is %d (expected 2000)", timer->interval);
+    }
+    if (event_add_call_count != 1) {
+        errx(1, "event_add shouldn't have been called again");
+    }
 
-    if (!event_add_call_count) {
-        errx(1, "event_add wasn't called");
+    // but bringing it closer does:
+    tv = (struct timeval)LGTD_MSECS_TO_TIMEVAL(1);
+    lgtd_tests_monotonic_msecs = 1002;
+    if (!lgtd_timer_reschedule(timer, &tv)) {
+        errx(1, "wrong return value");
+    }
+    check_timer(timer, 0, 101);
+    if (event_add_call_count != 1) {
+        errx(1, "event_add shouldn't have been called again");
+    }
+    // once it fires the event is re-armed for the closest timer:
+    lgtd_tests_timer_run_until(1005);
+    tv = (struct timeval)LGTD_MSECS_TO_TIMEVAL(0);
+    if (!lgtd_timer_reschedule(timer, &tv)) {
+        errx(1, "wrong return value");
+    }
+    check_timer(timer, 0, 101);
+    if (event_add_call_count != 2) {
+        errx(
+            1, "event_add called %d times (expected 2)", event_add_call_count
+        );
+    }
+    struct timeval expected_tv = LGTD_MSECS_TO_TIMEVAL(5);
+    if (last_tv_passed_to_event_add.tv_sec != expected_tv.tv_sec
+        || last_tv_passed_to_event_add.tv_usec != expected_tv.tv_usec) {
+        errx(1, "got unexpected timeout");
     }
 
     return 0;
@@ -6,13 +6,19 @@
 #define MOCKED_EVENT_ADD
 #define MOCKED_EVENT_ACTIVE
 #include "mock_event2.h"
+#include "mock_log.h"
 #include "tests_shims.h"
+#include "tests_timer_utils.h"
+
+static int callback_call_count = 0;
 
 static void
 my_test_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
 {
     (void)timer;
     (void)ctx;
+
+    callback_call_count++;
 }
 
 static int event_active_call_count = 0;
@@ -62,8 +68,8 @@ event_new(struct event_base *base,
         errx(1, "got cb %p (expected %p)", cb, lgtd_timer_callback);
     }
 
-    if (!ctx) {
-        errx(1, "didn't get any context");
+    if (ctx) {
+        errx(1, "got unexpected context %p", ctx);
     }
 
     if (event_new_call_count++) {
@@ -85,10 +91,8 @@ event_add(struct event *ev, const struct timeval *timeout)
     if (!timeout) {
         errx(1, "a timeout should have been passed in");
     }
-    // so i don't know wth clang and mac os x are doing but memcmp
-    // gets whacked in -O2 and returns a difference when there isn't,
-    // so we have to do it the painful way:
-    struct timeval expected_tv = LGTD_MSECS_TO_TIMEVAL(5);
+    // 5ms from 1001ms is rounded up to the tick at 1010ms:
+    struct timeval expected_tv = LGTD_MSECS_TO_TIMEVAL(9);
     if (timeout->tv_sec != expected_tv.tv_sec
         || timeout->tv_usec != expected_tv.tv_usec) {
         errx(1, "got invalid timeout");
@@ -104,17 +108,13 @@ event_add(struct event *ev, const struct timeval *timeout)
 int
 main(void)
 {
+    lgtd_tests_monotonic_msecs = 1001;
+
     union lgtd_timer_ctx ctx = { .as_uint = 7614 };
     struct lgtd_timer *timer = lgtd_timer_start(
         LGTD_TIMER_ACTIVATE_NOW, 5, my_test_callback, ctx
     );
 
-    if (timer->event != MOCK_EVENT_NEW_EVENT_PTR) {
-        errx(
-            1, "timer has event %p (expected %p)",
-            timer->event, MOCK_EVENT_NEW_EVENT_PTR
-        );
-    }
     if (timer->ctx.as_uint != ctx.as_uint) {
         errx(
             1, "timer ctx is %ju (expected %ju)",
@@ -130,6 +130,16 @@ main(void)
     if (LIST_FIRST(&lgtd_timers) != timer) {
         errx(1, "the timer wasn't inserted in the timers list");
     }
+    if (!timer->scheduled || timer->level != 0 || timer->expires_at != 101) {
+        errx(
+            1, "timer scheduled = %d, level = %d, expires_at = %ju "
+            "(expected 1, 0, 101)",
+            timer->scheduled, timer->level, (uintmax_t)timer->expires_at
+        );
+    }
+    if (TAILQ_FIRST(&lgtd_timer_wheel.activated) != timer) {
+        errx(1, "the timer wasn't activated");
+    }
 
     if (!event_new_call_count) {
         errx(1, "event_new wasn't called");
@@ -141,5 +151,19 @@ main(void)
         errx(1, "the timer wasn't activated");
     }
 
+    // the activated timer runs right away, that consumes the timeout (like a
+    // non-persistent libevent event):
+    lgtd_tests_timer_run_until(1002);
+    if (callback_call_count != 1) {
+        errx(1, "the callback should have been called");
+    }
+    if (lgtd_timer_ispending(timer)) {
+        errx(1, "the timer shouldn't be pending anymore");
+    }
+    lgtd_tests_timer_run_until(1100);
+    if (callback_call_count != 1) {
+        errx(1, "the callback should have been called only once");
+    }
+
     return 0;
 }
@@ -3,16 +3,24 @@
 #include "core/timer.c"
 
 #define MOCKED_EVENT_NEW
-#define MOCKED_EVENT_ADD
 #define MOCKED_EVENT_ACTIVE
 #include "mock_event2.h"
+#include "mock_log.h"
 #include "tests_shims.h"
+#include "tests_timer_utils.h"
+
+static int callback_call_count = 0;
 
 static void
 my_test_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
 {
     (void)timer;
-    (void)ctx;
+
+    if (ctx.as_uint != 7614) {
+        errx(1, "got ctx %ju (expected 7614)", (uintmax_t)ctx.as_uint);
+    }
+
+    callback_call_count++;
 }
 
 void
@@ -33,96 +41,66 @@ event_new(struct event_base *base,
           event_callback_fn cb,
           void *ctx)
 {
-    if (base != MOCK_LGTD_EV_BASE) {
-        errx(1, "got base %p (expected %p)", base, MOCK_LGTD_EV_BASE);
-    }
-
-    if (fd != -1) {
-        errx(1, "got fd %d (expected -1)", fd);
-    }
-
-    if (events != EV_PERSIST) {
-        errx(1, "got events %#x (expected %#x)", events, EV_PERSIST);
-    }
-
-    if (cb != lgtd_timer_callback) {
-        errx(1, "got cb %p (expected %p)", cb, lgtd_timer_callback);
-    }
-
-    if (!ctx) {
-        errx(1, "didn't get any context");
-    }
+    (void)base;
+    (void)fd;
+    (void)events;
+    (void)cb;
+    (void)ctx;
 
-    if (event_new_call_count++) {
-        errx(1, "event_new should be called once");
-    }
+    event_new_call_count++;
 
     return MOCK_EVENT_NEW_EVENT_PTR;
 }
 
-static int event_add_call_count = 0;
-
-int
-event_add(struct event *ev, const struct timeval *timeout)
-{
-    if (ev != MOCK_EVENT_NEW_EVENT_PTR) {
-        errx(1, "got ev %p (expected %p)", ev, MOCK_EVENT_NEW_EVENT_PTR);
-    }
-
-    if (!timeout) {
-        errx(1, "a timeout should have been passed in");
-    }
-    // so i don't know wth clang and mac os x are doing but memcmp
-    // gets whacked in -O2 and returns a difference when there isn't,
-    // so we have to do it the painful way:
-    struct timeval expected_tv = LGTD_MSECS_TO_TIMEVAL(5);
-    if (timeout->tv_sec != expected_tv.tv_sec
-        || timeout->tv_usec != expected_tv.tv_usec) {
-        errx(1, "got invalid timeout");
-    }
-
-    if (event_add_call_count++) {
-        errx(1, "event_add should be called once");
-    }
-
-    return 0;
-}
-
 int
 main(void)
 {
+    lgtd_tests_monotonic_msecs = 1000;
+
     union lgtd_timer_ctx ctx = { .as_uint = 7614 };
     struct lgtd_timer *timer = lgtd_timer_start(
-        LGTD_TIMER_PERSISTENT, 5, my_test_callback, ctx
+        LGTD_TIMER_PERSISTENT, 50, my_test_callback, ctx
+    );
+    struct lgtd_timer *other_timer = lgtd_timer_start(
+        LGTD_TIMER_PERSISTENT, 50, my_test_callback, ctx
     );
 
-    if (timer->event != MOCK_EVENT_NEW_EVENT_PTR) {
-        errx(
-            1, "timer has event %p (expected %p)",
-            timer->event, MOCK_EVENT_NEW_EVENT_PTR
-        );
+    if (!(timer->flags & LGTD_TIMER_PERSISTENT)) {
+        errx(1, "the timer isn't persistent");
     }
-    if (timer->ctx.as_uint != ctx.as_uint) {
-        errx(
-            1, "timer ctx is %ju (expected %ju)",
-            (uintmax_t)timer->ctx.as_uint, (uintmax_t)ctx.as_uint
-        );
+    if (timer->interval != 50) {
+        errx(1, "timer interval is %d (expected 50)", timer->interval);
     }
-    if (timer->callback != my_test_callback) {
+    if (event_new_call_count != 1) {
         errx(
-            1, "timer callback is %p (expected %p)",
-            timer->callback, my_test_callback
+            1, "event_new called %d times (expected 1)", event_new_call_count
         );
     }
-    if (LIST_FIRST(&lgtd_timers) != timer) {
-        errx(1, "the timer wasn't inserted in the timers list");
+
+    lgtd_timer_stop(other_timer);
+
+    lgtd_tests_timer_run_until(1049);
+    if (callback_call_count) {
+        errx(1, "the timer fired too early");
     }
 
-    if (!event_new_call_count) {
-        errx(1, "event_new wasn't called");
+    lgtd_tests_timer_run_until(1050);
+    if (callback_call_count != 1) {
+        errx(1, "the timer should have fired once");
+    }
+    if (!lgtd_timer_ispending(timer) || timer->expires_at != 110) {
+        errx(
+            1, "the timer should be re-scheduled at tick 110 (got %ju)",
+            (uintmax_t)timer->expires_at
+        );
     }
-    if (!event_add_call_count) {
-        errx(1, "event_add wasn't called");
+
+    // a late wakeup catches up on the missed ticks:
+    lgtd_tests_timer_run_until(1200);
+    if (callback_call_count != 4) {
+        errx(
+            1, "the timer fired %d times (expected 4)", callback_call_count
+        );
     }
 
     return 0;
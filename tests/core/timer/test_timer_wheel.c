@@ -0,0 +1,169 @@
+#include <string.h>
+
+#include "core/timer.c"
+
+#include "mock_event2.h"
+#include "mock_log.h"
+#include "tests_shims.h"
+#include "tests_timer_utils.h"
+
+enum { TIMER_COUNT = 6 };
+
+static const int timeouts[TIMER_COUNT] = {
+    10,
+    630,  // last slot of the first level
+    640,  // first cascade
+    45000, // third level
+    3 * 3600 * 1000, // fourth level
+    // beyond the horizon of the wheel (~46 hours):
+    72 * 3600 * 1000
+};
+
+static lgtd_time_mono_t fired_at[TIMER_COUNT];
+static struct lgtd_timer *timers[TIMER_COUNT];
+
+static void
+my_test_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+
+    if (fired_at[ctx.as_uint]) {
+        errx(1, "timer %ju fired twice", (uintmax_t)ctx.as_uint);
+    }
+    fired_at[ctx.as_uint] = lgtd_tests_monotonic_msecs;
+}
+
+static struct lgtd_timer *victim = NULL;
+
+static void
+my_stopping_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)ctx;
+
+    // stopping a timer of the same slot from a callback is fine:
+    lgtd_timer_stop(victim);
+    lgtd_timer_stop(timer);
+}
+
+static void
+my_victim_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    (void)ctx;
+
+    errx(1, "the stopped timer shouldn't have fired");
+}
+
+static int batch_call_count = 0;
+
+static void
+my_batch_callback(struct lgtd_timer *timer, union lgtd_timer_ctx ctx)
+{
+    (void)timer;
+    (void)ctx;
+
+    batch_call_count++;
+}
+
+int
+main(void)
+{
+    lgtd_time_mono_t start = 123456;
+    lgtd_tests_monotonic_msecs = start;
+
+    for (int i = 0; i != TIMER_COUNT; i++) {
+        union lgtd_timer_ctx ctx = { .as_uint = i };
+        timers[i] = lgtd_timer_start(
+            LGTD_TIMER_DEFAULT_FLAGS, timeouts[i], my_test_callback, ctx
+        );
+    }
+    union lgtd_timer_ctx ctx = { .as_uint = 0 };
+    // the slots are LIFO, the victim will be right after the other one:
+    victim = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS, 200, my_victim_callback, ctx
+    );
+    lgtd_timer_start(LGTD_TIMER_DEFAULT_FLAGS, 200, my_stopping_callback, ctx);
+
+    if (timers[3]->level != 2 || timers[4]->level != 3) {
+        errx(
+            1, "got levels %d, %d (expected 2, 3)",
+            timers[3]->level, timers[4]->level
+        );
+    }
+
+    // wake up every 7ms for the first 2 minutes then every second:
+    lgtd_time_mono_t end = start + timeouts[TIMER_COUNT - 1] + 1000;
+    while (lgtd_tests_monotonic_msecs < end) {
+        lgtd_time_mono_t step = 7;
+        if (lgtd_tests_monotonic_msecs - start > 120 * 1000) {
+            step = 1000;
+        }
+        lgtd_tests_timer_run_until(lgtd_tests_monotonic_msecs + step);
+    }
+
+    for (int i = 0; i != TIMER_COUNT; i++) {
+        if (!fired_at[i]) {
+            errx(1, "timer %d didn't fire", i);
+        }
+        lgtd_time_mono_t expected = start + timeouts[i];
+        if (fired_at[i] < expected) {
+            errx(
+                1, "timer %d fired too early at %ju (expected %ju)",
+                i, (uintmax_t)fired_at[i], (uintmax_t)expected
+            );
+        }
+        lgtd_time_mono_t late = fired_at[i] - expected;
+        lgtd_time_mono_t max_late = i < 3 ? 7 : 1000;
+        max_late += LGTD_TIMER_WHEEL_TICK_MSECS;
+        if (late > max_late) {
+            errx(
+                1, "timer %d fired %jums late (expected at most %jums)",
+                i, (uintmax_t)late, (uintmax_t)max_late
+            );
+        }
+        if (lgtd_timer_ispending(timers[i])) {
+            errx(1, "timer %d is still pending", i);
+        }
+    }
+
+    if (lgtd_timer_wheel.count != 0) {
+        errx(1, "%d timers left in the wheel", lgtd_timer_wheel.count);
+    }
+
+    // stopping a timer of the same batch of activated timers is fine too,
+    // even when it's the last one of the batch:
+    victim = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS, 60000, my_victim_callback, ctx
+    );
+    struct lgtd_timer *stopper = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS, 60000, my_stopping_callback, ctx
+    );
+    lgtd_timer_activate(stopper);
+    lgtd_timer_activate(victim);
+    lgtd_tests_timer_run_until(lgtd_tests_monotonic_msecs + 1);
+    if (!TAILQ_EMPTY(&lgtd_timer_wheel.activated)
+        || !TAILQ_EMPTY(&lgtd_timer_wheel.batch)) {
+        errx(1, "the activated timers should have been consumed");
+    }
+
+    // and the queue of activated timers is still in a good state after that:
+    struct lgtd_timer *timer = lgtd_timer_start(
+        LGTD_TIMER_DEFAULT_FLAGS, 60000, my_batch_callback, ctx
+    );
+    lgtd_timer_activate(timer);
+    if (TAILQ_FIRST(&lgtd_timer_wheel.activated) != timer
+        || TAILQ_LAST(&lgtd_timer_wheel.activated, lgtd_timer_queue) != timer) {
+        errx(1, "the timer wasn't activated");
+    }
+    lgtd_tests_timer_run_until(lgtd_tests_monotonic_msecs + 1);
+    if (batch_call_count != 1) {
+        errx(1, "batch_call_count = %d (expected 1)", batch_call_count);
+    }
+
+    lgtd_timer_stop_all();
+    if (!LIST_EMPTY(&lgtd_timers)) {
+        errx(1, "the timers list should be empty");
+    }
+
+    return 0;
+}
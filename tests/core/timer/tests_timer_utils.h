@@ -0,0 +1,17 @@
+#pragma once
+
+static lgtd_time_mono_t lgtd_tests_monotonic_msecs = 0;
+
+lgtd_time_mono_t
+lgtd_time_monotonic_msecs(void)
+{
+    return lgtd_tests_monotonic_msecs;
+}
+
+// What the tick event does when it fires at the given time:
+static void
+lgtd_tests_timer_run_until(lgtd_time_mono_t msecs)
+{
+    lgtd_tests_monotonic_msecs = msecs;
+    lgtd_timer_callback(-1, EV_TIMEOUT, NULL);
+}
@@ -0,0 +1,90 @@
+#include <fcntl.h>
+
+#include "broadcast.c"
+
+#include "mock_bulb.h"
+#define MOCKED_EVENT_ADD
+#include "mock_event2.h"
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_tagging.h"
+#include "mock_wire_proto.h"
+
+#include "tests_utils.h"
+
+static struct event *MOCK_WRITE_EV = (struct event *)0x7061726973;
+
+static int event_add_call_count = 0;
+
+int
+event_add(struct event *ev, const struct timeval *timeout)
+{
+    if (ev != MOCK_WRITE_EV) {
+        lgtd_errx(
+            1, "event_add received invalid event=%p (expected %p)",
+            ev, MOCK_WRITE_EV
+        );
+    }
+    if (timeout) {
+        lgtd_errx(1, "unexpected timeout");
+    }
+
+    event_add_call_count++;
+
+    return 0;
+}
+
+static void
+send_netlink_msg(int fd, uint16_t type)
+{
+    struct nlmsghdr msg = {
+        .nlmsg_len = NLMSG_LENGTH(0),
+        .nlmsg_type = type
+    };
+    if (send(fd, &msg, sizeof(msg), 0) != sizeof(msg)) {
+        lgtd_err(1, "can't send the netlink message");
+    }
+}
+
+int
+main(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds)
+        || fcntl(fds[0], F_SETFL, O_NONBLOCK)) {
+        lgtd_err(1, "can't setup the sockets");
+    }
+
+    lgtd_lifx_broadcast_endpoint.write_ev = MOCK_WRITE_EV;
+    lgtd_lifx_broadcast_targets.valid = true;
+
+    // unrelated routing messages are ignored
+    send_netlink_msg(fds[1], RTM_NEWROUTE);
+    lgtd_lifx_broadcast_netlink_callback(fds[0], EV_READ, NULL);
+    if (!lgtd_lifx_broadcast_targets.valid) {
+        lgtd_errx(1, "the broadcast addresses shouldn't have been dropped");
+    }
+    if (event_add_call_count != 0) {
+        lgtd_errx(
+            1, "event_add_call_count=%d (expected 0)", event_add_call_count
+        );
+    }
+
+    // a new address starts a discovery with a new list of addresses
+    send_netlink_msg(fds[1], RTM_NEWROUTE);
+    send_netlink_msg(fds[1], RTM_NEWADDR);
+    lgtd_lifx_broadcast_netlink_callback(fds[0], EV_READ, NULL);
+    if (lgtd_lifx_broadcast_targets.valid) {
+        lgtd_errx(1, "the broadcast addresses should have been dropped");
+    }
+    if (event_add_call_count != 1) {
+        lgtd_errx(
+            1, "event_add_call_count=%d (expected 1)", event_add_call_count
+        );
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return 0;
+}
@@ -302,19 +302,32 @@ main(void)
         );
     }
 
+    if (mock_getifaddrs_call_count != 1) {
+        lgtd_errx(
+            1, "mock_getifaddrs_call_count=%d (expected 1)",
+            mock_getifaddrs_call_count
+        );
+    }
+
     lgtd_tests_hr();
 
-    // getifaddrs ok, one send fails
+    // the addresses and the packet are re-used, one send fails
     ok = lgtd_lifx_broadcast_handle_write();
     if (!ok) {
         lgtd_errx(1, "write callback returned false (expected true)");
     }
-    if (mock_lifx_wire_setup_header_call_count != 2) {
+    if (mock_lifx_wire_setup_header_call_count != 1) {
         lgtd_errx(
-            1, "mock_lifx_wire_setup_header_call_count=%d (expected 2)",
+            1, "mock_lifx_wire_setup_header_call_count=%d (expected 1)",
             mock_lifx_wire_setup_header_call_count
         );
     }
+    if (mock_getifaddrs_call_count != 1) {
+        lgtd_errx(
+            1, "mock_getifaddrs_call_count=%d (expected 1)",
+            mock_getifaddrs_call_count
+        );
+    }
     if (mock_sendto_call_count != 4) {
         lgtd_errx(
             1, "mock_sendto_call_count=%d (expected 4)",
@@ -326,24 +339,24 @@ main(void)
             1, "event_del_call_count=%d (expected 2)", event_del_call_count
         );
     }
-    if (mock_freeifaddrs_call_count != 2) {
+    if (mock_freeifaddrs_call_count != 1) {
         lgtd_errx(
-            1, "freeifaddrs_call_count=%d (expected 2)",
+            1, "freeifaddrs_call_count=%d (expected 1)",
             mock_freeifaddrs_call_count
         );
     }
 
     lgtd_tests_hr();
 
-    // getifaddrs ok, all sends fail
+    // a send failed, getifaddrs is called again, all sends fail
     ok = lgtd_lifx_broadcast_handle_write();
     if (ok) {
         lgtd_errx(1, "write callback returned true (expected false)");
     }
-    if (mock_lifx_wire_setup_header_call_count != 3) {
+    if (mock_getifaddrs_call_count != 2) {
         lgtd_errx(
-            1, "mock_lifx_wire_setup_header_call_count=%d (expected 2)",
-            mock_lifx_wire_setup_header_call_count
+            1, "mock_getifaddrs_call_count=%d (expected 2)",
+            mock_getifaddrs_call_count
         );
     }
     if (mock_sendto_call_count != 6) {
@@ -357,12 +370,30 @@ main(void)
             1, "event_del_call_count=%d (expected 2)", event_del_call_count
         );
     }
-    if (mock_freeifaddrs_call_count != 3) {
+    if (mock_freeifaddrs_call_count != 2) {
         lgtd_errx(
-            1, "freeifaddrs_call_count=%d (expected 3)",
+            1, "freeifaddrs_call_count=%d (expected 2)",
             mock_freeifaddrs_call_count
         );
     }
 
+    lgtd_tests_hr();
+
+    // without netlink the addresses are listed again once they are too old
+    lgtd_lifx_broadcast_list_targets();
+    lgtd_lifx_broadcast_targets.listed_at -=
+        LGTD_LIFX_BROADCAST_TARGETS_TTL_MSECS;
+    mock_sendto_call_count = TEST_OK_SENDTO_OK_ADDR_CLASS_A;
+    ok = lgtd_lifx_broadcast_handle_write();
+    if (!ok) {
+        lgtd_errx(1, "write callback returned false (expected true)");
+    }
+    if (mock_getifaddrs_call_count != 4) {
+        lgtd_errx(
+            1, "mock_getifaddrs_call_count=%d (expected 4)",
+            mock_getifaddrs_call_count
+        );
+    }
+
     return 0;
 }
@@ -45,6 +45,8 @@ event_del(struct event *ev)
     return 0;
 }
 
+static int mock_getifaddrs_call_count = 0;
+
 int
 mock_getifaddrs(struct ifaddrs **ifap)
 {
@@ -52,6 +54,8 @@ mock_getifaddrs(struct ifaddrs **ifap)
         lgtd_errx(1, "ifap souldn't be NULL");
     }
 
+    mock_getifaddrs_call_count++;
+
     errno = ENOSYS;
 
     return -1;
@@ -189,14 +193,22 @@ main(void)
         );
     }
 
-    // getifaddrs & lgtd_lifx_broadcast_send_packet fail
+    // getifaddrs & lgtd_lifx_broadcast_send_packet fail, the fallback
+    // address isn't kept and the interfaces are listed again:
     ok = lgtd_lifx_broadcast_handle_write();
     if (ok) {
         lgtd_errx(1, "write callback returned true (expected false)");
     }
-    if (mock_lifx_wire_setup_header_call_count != 2) {
+    if (mock_getifaddrs_call_count != 2) {
         lgtd_errx(
-            1, "mock_lifx_wire_setup_header_call_count=%d (expected 2)",
+            1, "mock_getifaddrs_call_count=%d (expected 2)",
+            mock_getifaddrs_call_count
+        );
+    }
+    // the packet is only encoded once:
+    if (mock_lifx_wire_setup_header_call_count != 1) {
+        lgtd_errx(
+            1, "mock_lifx_wire_setup_header_call_count=%d (expected 1)",
             mock_lifx_wire_setup_header_call_count
         );
     }
@@ -3,6 +3,7 @@
 #include "mock_gateway.h"
 #include "mock_log.h"
 #include "mock_router.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 int
@@ -17,7 +18,7 @@ main(void)
 
     lgtd_lifx_bulb_close(bulb);
 
-    if (!RB_EMPTY(&lgtd_lifx_bulbs_table)) {
+    if (!LGTD_LIFX_BULB_TABLE_EMPTY()) {
         errx(1, "The bulbs table should be empty!");
     }
 
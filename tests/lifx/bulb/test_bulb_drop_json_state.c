@@ -0,0 +1,84 @@
+#include "bulb.c"
+
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+static char json_buf[] = "\"power\":false";
+
+static void
+cache_json_state(struct lgtd_lifx_bulb *bulb)
+{
+    bulb->json_state.buf = json_buf;
+    bulb->json_state.len = sizeof(json_buf) - 1;
+    bulb->json_state.size = sizeof(json_buf);
+}
+
+static void
+check_json_state(const struct lgtd_lifx_bulb *bulb, bool cached)
+{
+    if (!!bulb->json_state.len != cached) {
+        errx(
+            1, "the cached state should%s have been dropped",
+            cached ? "n't" : ""
+        );
+    }
+    if (bulb->json_state.buf != json_buf) {
+        errx(1, "the cache buffer should be kept around");
+    }
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_bulb bulb = {
+        .state = { .power = LGTD_LIFX_POWER_OFF },
+        .gw = (void *)0xdeaf
+    };
+
+    cache_json_state(&bulb);
+    lgtd_lifx_bulb_set_power_state(&bulb, LGTD_LIFX_POWER_OFF);
+    check_json_state(&bulb, true);
+    lgtd_lifx_bulb_set_power_state(&bulb, LGTD_LIFX_POWER_ON);
+    check_json_state(&bulb, false);
+
+    struct lgtd_lifx_ip_firmware_info fw_info = { .version = 0x10001 };
+    cache_json_state(&bulb);
+    lgtd_lifx_bulb_set_ip_firmware_info(
+        &bulb, LGTD_LIFX_BULB_WIFI_IP, &fw_info, 42
+    );
+    check_json_state(&bulb, false);
+    cache_json_state(&bulb);
+    lgtd_lifx_bulb_set_ip_firmware_info(
+        &bulb, LGTD_LIFX_BULB_WIFI_IP, &fw_info, 43
+    );
+    check_json_state(&bulb, true);
+
+    struct lgtd_lifx_ip_state ip_state = { .tx_bytes = 42 };
+    lgtd_lifx_bulb_set_ip_state(&bulb, LGTD_LIFX_BULB_MCU_IP, &ip_state, 44);
+    check_json_state(&bulb, false);
+    cache_json_state(&bulb);
+    lgtd_lifx_bulb_set_ip_state(&bulb, LGTD_LIFX_BULB_MCU_IP, &ip_state, 45);
+    check_json_state(&bulb, true);
+
+    struct lgtd_lifx_runtime_info runtime_info = { .uptime = 42 };
+    lgtd_lifx_bulb_set_runtime_info(&bulb, &runtime_info, 46);
+    check_json_state(&bulb, false);
+    cache_json_state(&bulb);
+    lgtd_lifx_bulb_set_runtime_info(&bulb, &runtime_info, 47);
+    check_json_state(&bulb, true);
+
+    // the model and vendor names are looked up again:
+    struct lgtd_lifx_product_info product_info = { .vendor_id = 1 };
+    lgtd_lifx_bulb_set_product_info(&bulb, &product_info);
+    check_json_state(&bulb, false);
+
+    // the tags aren't cached:
+    cache_json_state(&bulb);
+    lgtd_lifx_bulb_set_tags(&bulb, 0x2);
+    check_json_state(&bulb, true);
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #define MOCKED_LGTD_ROUTER_SEND_TO_DEVICE
 #include "mock_router.h"
 #define MOCKED_LGTD_TIMER_STOP
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 #include "tests_utils.h"
@@ -31,7 +32,7 @@ static int get_wifi_firmware_state_sent = 0;
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch" // we don't test the whole enum
-void
+bool
 lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
                            enum lgtd_lifx_packet_type pkt_type,
                            void *pkt)
@@ -58,6 +59,8 @@ lgtd_router_send_to_device(struct lgtd_lifx_bulb *bulb,
         get_wifi_firmware_state_sent++;
         break;
     }
+
+    return true;
 }
 #pragma GCC diagnostic pop
 
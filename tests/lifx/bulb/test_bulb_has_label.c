@@ -3,6 +3,7 @@
 #include "mock_gateway.h"
 #include "mock_log.h"
 #include "mock_router.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 void
@@ -0,0 +1,168 @@
+#include "bulb.c"
+
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#define MOCKED_LGTD_SUBSCRIPTION_BULB_CHANGED
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+static int subscription_bulb_changed_call_count = 0;
+
+void
+lgtd_subscription_bulb_changed(struct lgtd_lifx_bulb *bulb, int changes)
+{
+    (void)bulb;
+    (void)changes;
+
+    subscription_bulb_changed_call_count++;
+}
+
+static void
+check_entry(uint64_t seqn, const uint8_t *addr, bool closed)
+{
+    if (lgtd_lifx_bulb_journal.seqn != seqn) {
+        errx(
+            1, "journal seqn = %ju (expected %ju)",
+            (uintmax_t)lgtd_lifx_bulb_journal.seqn, (uintmax_t)seqn
+        );
+    }
+
+    const struct lgtd_lifx_bulb_journal_entry *entry;
+    entry = LGTD_LIFX_BULB_JOURNAL_ENTRY(seqn);
+    if (entry->seqn != seqn) {
+        errx(
+            1, "entry seqn = %ju (expected %ju)",
+            (uintmax_t)entry->seqn, (uintmax_t)seqn
+        );
+    }
+    if (memcmp(entry->addr, addr, LGTD_LIFX_ADDR_LENGTH)) {
+        errx(1, "the entry is for another bulb");
+    }
+    if (entry->closed != closed) {
+        errx(1, "closed = %d (expected %d)", entry->closed, closed);
+    }
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    uint8_t bulb_addr[LGTD_LIFX_ADDR_LENGTH] = { 5, 4, 3, 2, 1, 0 };
+
+    if (!lgtd_lifx_bulb_journal_has(0)) {
+        errx(1, "an empty journal has everything");
+    }
+
+    struct lgtd_lifx_bulb *bulb = lgtd_lifx_bulb_open(&gw, bulb_addr);
+    check_entry(1, bulb_addr, false);
+    if (bulb->journal_seqn != 1) {
+        errx(
+            1, "journal_seqn = %ju (expected 1)",
+            (uintmax_t)bulb->journal_seqn
+        );
+    }
+
+    lgtd_lifx_bulb_set_power_state(bulb, LGTD_LIFX_POWER_ON);
+    check_entry(2, bulb_addr, false);
+    if (bulb->journal_seqn != 2) {
+        errx(
+            1, "journal_seqn = %ju (expected 2)",
+            (uintmax_t)bulb->journal_seqn
+        );
+    }
+
+    // what doesn't change isn't logged:
+    lgtd_lifx_bulb_set_power_state(bulb, LGTD_LIFX_POWER_ON);
+    check_entry(2, bulb_addr, false);
+
+    struct lgtd_lifx_light_state state = bulb->state;
+    state.hue = 0xaaaa;
+    state.kelvin = 3500;
+    lgtd_lifx_bulb_set_light_state(bulb, &state, 1);
+    check_entry(3, bulb_addr, false);
+    lgtd_lifx_bulb_set_light_state(bulb, &state, 2);
+    check_entry(3, bulb_addr, false);
+
+    // unless the bulb was restored from the state file:
+    bulb->stale = true;
+    lgtd_lifx_bulb_set_light_state(bulb, &state, 3);
+    check_entry(4, bulb_addr, false);
+
+    // the rest of what get_light_state returns is logged too, but isn't
+    // pushed to the subscriptions:
+    int changed_call_count = subscription_bulb_changed_call_count;
+    struct lgtd_lifx_ip_state ip_state = { .signal_strength = 42 };
+    lgtd_lifx_bulb_set_ip_state(bulb, LGTD_LIFX_BULB_WIFI_IP, &ip_state, 4);
+    check_entry(5, bulb_addr, false);
+    lgtd_lifx_bulb_set_ip_state(bulb, LGTD_LIFX_BULB_WIFI_IP, &ip_state, 5);
+    check_entry(5, bulb_addr, false);
+    struct lgtd_lifx_ip_firmware_info fw_info = { .version = 0x10001 };
+    lgtd_lifx_bulb_set_ip_firmware_info(
+        bulb, LGTD_LIFX_BULB_MCU_IP, &fw_info, 6
+    );
+    check_entry(6, bulb_addr, false);
+    struct lgtd_lifx_product_info product_info = { .vendor_id = 1 };
+    lgtd_lifx_bulb_set_product_info(bulb, &product_info);
+    check_entry(7, bulb_addr, false);
+    lgtd_lifx_bulb_set_product_info(bulb, &product_info);
+    check_entry(7, bulb_addr, false);
+    struct lgtd_lifx_runtime_info runtime_info = { .uptime = 42 };
+    lgtd_lifx_bulb_set_runtime_info(bulb, &runtime_info, 7);
+    check_entry(8, bulb_addr, false);
+    if (bulb->journal_seqn != 8) {
+        errx(
+            1, "journal_seqn = %ju (expected 8)",
+            (uintmax_t)bulb->journal_seqn
+        );
+    }
+    if (subscription_bulb_changed_call_count != changed_call_count) {
+        errx(1, "the subscriptions shouldn't have been notified");
+    }
+
+    lgtd_lifx_bulb_close(bulb);
+    check_entry(9, bulb_addr, true);
+
+    if (!lgtd_lifx_bulb_journal_has(0) || !lgtd_lifx_bulb_journal_has(9)) {
+        errx(1, "the journal should still have everything");
+    }
+    if (lgtd_lifx_bulb_journal_has(10)) {
+        errx(1, "the journal doesn't have the future");
+    }
+
+    // the oldest entries get overwritten:
+    lgtd_lifx_bulb_journal.seqn += LGTD_LIFX_BULB_JOURNAL_SIZE;
+    if (lgtd_lifx_bulb_journal_has(8)) {
+        errx(1, "the journal wrapped past 8");
+    }
+    if (!lgtd_lifx_bulb_journal_has(9)) {
+        errx(1, "the journal still has everything after 9");
+    }
+
+    // the sequence numbers of another run aren't mistaken for ours:
+    memset(&lgtd_lifx_bulb_journal, 0, sizeof(lgtd_lifx_bulb_journal));
+    lgtd_lifx_bulb_journal_setup();
+    uint64_t first_seqn = lgtd_lifx_bulb_journal.first_seqn;
+    if (!first_seqn || lgtd_lifx_bulb_journal.seqn != first_seqn) {
+        errx(
+            1, "first_seqn = %ju, seqn = %ju (expected the current time)",
+            (uintmax_t)first_seqn, (uintmax_t)lgtd_lifx_bulb_journal.seqn
+        );
+    }
+    if (!lgtd_lifx_bulb_journal_has(first_seqn)) {
+        errx(1, "the journal has everything after its start");
+    }
+    if (lgtd_lifx_bulb_journal_has(0) || lgtd_lifx_bulb_journal_has(9)) {
+        errx(1, "the journal doesn't have the changes of a previous run");
+    }
+    bulb = lgtd_lifx_bulb_open(&gw, bulb_addr);
+    check_entry(first_seqn + 1, bulb_addr, false);
+    lgtd_lifx_bulb_close(bulb);
+    check_entry(first_seqn + 2, bulb_addr, true);
+    if (!lgtd_lifx_bulb_journal_has(first_seqn)) {
+        errx(1, "the journal still has everything after its start");
+    }
+
+    return 0;
+}
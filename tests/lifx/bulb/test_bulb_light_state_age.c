@@ -0,0 +1,69 @@
+#include "bulb.c"
+
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+static void
+check_ages(struct lgtd_lifx_bulb **expected, int count)
+{
+    int i = 0;
+    struct lgtd_lifx_bulb *bulb;
+    struct lgtd_lifx_bulb_queue *bulbs = &lgtd_lifx_bulbs_by_light_state_age;
+    TAILQ_FOREACH(bulb, bulbs, link_by_light_state_age) {
+        if (i == count) {
+            errx(1, "too many bulbs in the list");
+        }
+        if (bulb != expected[i]) {
+            errx(
+                1, "bulb %d is %p (expected %p)", i, (void *)bulb,
+                (void *)expected[i]
+            );
+        }
+        lgtd_time_mono_t updated_at = bulb->last_light_state_at;
+        if (i && updated_at < expected[i - 1]->last_light_state_at) {
+            errx(1, "the bulbs aren't ordered by last_light_state_at");
+        }
+        i++;
+    }
+    if (i != count) {
+        errx(1, "got %d bulbs (expected %d)", i, count);
+    }
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+
+    struct lgtd_lifx_bulb *bulbs[3];
+    for (int i = 0; i != LGTD_ARRAY_SIZE(bulbs); i++) {
+        uint8_t addr[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, i };
+        bulbs[i] = lgtd_lifx_bulb_open(&gw, addr);
+    }
+    check_ages(bulbs, 3);
+
+    // an update moves the bulb at the end:
+    struct lgtd_lifx_light_state state = { .label = "lair" };
+    lgtd_time_mono_t received_at = lgtd_time_monotonic_msecs() + 1000;
+    lgtd_lifx_bulb_set_light_state(bulbs[0], &state, received_at);
+    check_ages((struct lgtd_lifx_bulb *[]){ bulbs[1], bulbs[2], bulbs[0] }, 3);
+
+    lgtd_lifx_bulb_set_light_state(bulbs[2], &state, received_at + 1);
+    check_ages((struct lgtd_lifx_bulb *[]){ bulbs[1], bulbs[0], bulbs[2] }, 3);
+
+    // and closing it removes it from the list:
+    lgtd_lifx_bulb_close(bulbs[0]);
+    check_ages((struct lgtd_lifx_bulb *[]){ bulbs[1], bulbs[2] }, 2);
+
+    lgtd_lifx_bulb_close(bulbs[1]);
+    lgtd_lifx_bulb_close(bulbs[2]);
+    if (!TAILQ_EMPTY(&lgtd_lifx_bulbs_by_light_state_age)) {
+        errx(1, "the list should be empty");
+    }
+
+    return 0;
+}
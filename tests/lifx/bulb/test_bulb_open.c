@@ -4,6 +4,7 @@
 #include "mock_log.h"
 #include "mock_router.h"
 #define MOCKED_LGTD_TIMER_START
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 static int timer_start_call_count = 0;
@@ -4,6 +4,7 @@
 #include "mock_gateway.h"
 #include "mock_log.h"
 #include "mock_router.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 static int update_tag_refcouts_call_counts = 0;
@@ -47,8 +48,11 @@ main(void)
             .label = "lair",
             .tags = 0x2a
         },
+        .addr = { 1, 2, 3, 4, 5 },
         .gw = (void *)0xdeaf
     };
+    lgtd_lifx_bulb_table_insert(&bulb);
+    lgtd_lifx_bulb_index_label(&bulb);
 
     struct lgtd_lifx_light_state new_state = {
         .hue = 22222,
@@ -79,6 +83,14 @@ main(void)
     if (update_tag_refcouts_call_counts != 1) {
         errx(1, "lgtd_lifx_gateway_update_tag_refcounts wasn't called");
     }
+    if (lgtd_lifx_bulb_find_label("lair")) {
+        errx(1, "the old label should have been removed from the index");
+    }
+    const struct lgtd_lifx_bulb_label *bulb_label;
+    bulb_label = lgtd_lifx_bulb_find_label("caverne");
+    if (!bulb_label || LIST_FIRST(&bulb_label->bulbs) != &bulb) {
+        errx(1, "the bulb should have been indexed under its new label");
+    }
 
     lgtd_lifx_bulb_set_light_state(&bulb, &new_state, 2015);
     if (update_tag_refcouts_call_counts != 2) {
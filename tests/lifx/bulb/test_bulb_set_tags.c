@@ -4,6 +4,7 @@
 #include "mock_gateway.h"
 #include "mock_log.h"
 #include "mock_router.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 
 static bool update_tag_refcouts_called = false;
@@ -0,0 +1,115 @@
+#include "bulb.c"
+
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+enum { BULBS_COUNT = 1000 };
+
+static struct lgtd_lifx_bulb *bulbs[BULBS_COUNT];
+
+static void
+make_addr(int i, uint8_t *addr)
+{
+    // spread the addresses around and make them collide on the low bits:
+    uint32_t x = (uint32_t)i * 2654435761u;
+    addr[0] = 0xd0;
+    addr[1] = 0x73;
+    addr[2] = x >> 24;
+    addr[3] = x >> 16;
+    addr[4] = i & 1 ? x >> 8 : 0;
+    addr[5] = i % 7;
+}
+
+static void
+check_table(void)
+{
+    int count = 0;
+    uint64_t prev_key = 0;
+    struct lgtd_lifx_bulb *bulb;
+    LGTD_LIFX_BULB_FOREACH(bulb) {
+        uint64_t key = lgtd_lifx_bulb_addr_to_key(bulb->addr);
+        if (count && key <= prev_key) {
+            errx(1, "the bulbs aren't ordered by address");
+        }
+        prev_key = key;
+        count++;
+    }
+    if (count != lgtd_lifx_bulbs_table.count) {
+        errx(
+            1, "iterated over %d bulbs (expected %d)",
+            count, lgtd_lifx_bulbs_table.count
+        );
+    }
+
+    for (int i = 0; i != BULBS_COUNT; i++) {
+        uint8_t addr[LGTD_LIFX_ADDR_LENGTH];
+        make_addr(i, addr);
+        struct lgtd_lifx_bulb *found = lgtd_lifx_bulb_get(addr);
+        if (found != bulbs[i]) {
+            char addr_str[LGTD_LIFX_ADDR_STRLEN];
+            errx(
+                1, "got bulb %p for %s (expected %p)",
+                found, LGTD_IEEE8023MACTOA(addr, addr_str), bulbs[i]
+            );
+        }
+    }
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_gateway gw;
+
+    for (int i = 0; i != BULBS_COUNT; i++) {
+        uint8_t addr[LGTD_LIFX_ADDR_LENGTH];
+        make_addr(i, addr);
+        if (lgtd_lifx_bulb_get(addr)) {
+            errx(1, "bulb %d shouldn't exist yet", i);
+        }
+        bulbs[i] = lgtd_lifx_bulb_open(&gw, addr);
+        if (!bulbs[i]) {
+            errx(1, "couldn't open bulb %d", i);
+        }
+    }
+
+    if (lgtd_lifx_bulbs_table.count != BULBS_COUNT) {
+        errx(
+            1, "the table has %d bulbs (expected %d)",
+            lgtd_lifx_bulbs_table.count, BULBS_COUNT
+        );
+    }
+    if (lgtd_lifx_bulbs_table.nslots < BULBS_COUNT * 2) {
+        errx(
+            1, "the table has %d slots (expected at least %d)",
+            lgtd_lifx_bulbs_table.nslots, BULBS_COUNT * 2
+        );
+    }
+
+    check_table();
+
+    // remove every third bulb, this exercises the backward shift deletion:
+    for (int i = 0; i < BULBS_COUNT; i += 3) {
+        lgtd_lifx_bulb_close(bulbs[i]);
+        bulbs[i] = NULL;
+    }
+
+    check_table();
+
+    // close everything else from the safe iterator:
+    struct lgtd_lifx_bulb *bulb;
+    LGTD_LIFX_BULB_FOREACH_SAFE(bulb) {
+        lgtd_lifx_bulb_close(bulb);
+    }
+
+    if (!LGTD_LIFX_BULB_TABLE_EMPTY()) {
+        errx(1, "the table should be empty");
+    }
+    if (lgtd_lifx_bulbs_table.slots || lgtd_lifx_bulbs_table.sorted) {
+        errx(1, "the table should have been freed");
+    }
+
+    return 0;
+}
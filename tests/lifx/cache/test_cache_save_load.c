@@ -0,0 +1,278 @@
+#include "cache.c"
+
+#define MOCKED_LIFX_GATEWAY_SEND_TO_SITE
+#define MOCKED_LIFX_GATEWAY_ALLOCATE_TAG_ID
+#include "mock_gateway.h"
+#include "mock_log.h"
+#include "mock_router.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "tests_utils.h"
+
+static int gateway_open_call_count = 0;
+static int send_to_site_call_count = 0;
+
+struct lgtd_lifx_gateway *
+lgtd_lifx_gateway_get(const struct sockaddr *peer, ev_socklen_t peerlen)
+{
+    struct lgtd_lifx_gateway *gw;
+    LIST_FOREACH(gw, &lgtd_lifx_gateways, link) {
+        if (gw->peerlen == peerlen && !memcmp(gw->peer, peer, peerlen)) {
+            return gw;
+        }
+    }
+    return NULL;
+}
+
+struct lgtd_lifx_gateway *
+lgtd_lifx_gateway_open(const struct sockaddr *peer,
+                       ev_socklen_t addrlen,
+                       const uint8_t *site,
+                       lgtd_time_mono_t received_at)
+{
+    if (!received_at) {
+        errx(1, "the gateway should be opened with the current time");
+    }
+
+    struct lgtd_lifx_gateway *gw = calloc(1, sizeof(*gw));
+    gw->peer = malloc(addrlen);
+    memcpy(gw->peer, peer, addrlen);
+    gw->peerlen = addrlen;
+    memcpy(gw->site.as_array, site, sizeof(gw->site.as_array));
+    LIST_INSERT_HEAD(&lgtd_lifx_gateways, gw, link);
+
+    gateway_open_call_count++;
+
+    return gw;
+}
+
+struct lgtd_lifx_bulb *
+lgtd_lifx_gateway_get_or_open_bulb(struct lgtd_lifx_gateway *gw,
+                                   const uint8_t *bulb_addr)
+{
+    struct lgtd_lifx_bulb *bulb = lgtd_lifx_bulb_get(bulb_addr);
+    if (!bulb) {
+        bulb = lgtd_lifx_bulb_open(gw, bulb_addr);
+        SLIST_INSERT_HEAD(&gw->bulbs, bulb, link_by_gw);
+    }
+    return bulb;
+}
+
+int
+lgtd_lifx_gateway_allocate_tag_id(struct lgtd_lifx_gateway *gw,
+                                  int tag_id,
+                                  const char *tag_label)
+{
+    if (tag_id != 2 || strcmp(tag_label, "kitchen")) {
+        errx(
+            1, "allocate_tag_id(%d, %s) (expected 2, kitchen)",
+            tag_id, tag_label
+        );
+    }
+
+    gw->tag_ids |= LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(tag_id);
+    gw->tags[tag_id] = lgtd_lifx_tagging_find_tag(tag_label);
+    return tag_id;
+}
+
+bool
+lgtd_lifx_gateway_send_to_site(struct lgtd_lifx_gateway *gw,
+                               enum lgtd_lifx_packet_type pkt_type,
+                               void *pkt)
+{
+    (void)gw;
+
+    if (pkt_type != LGTD_LIFX_GET_PAN_GATEWAY || pkt) {
+        errx(1, "got pkt_type %#x (expected GET_PAN_GATEWAY)", pkt_type);
+    }
+
+    send_to_site_call_count++;
+    return true;
+}
+
+int
+main(void)
+{
+    char *tmpdir = lgtd_tests_make_temp_dir();
+    char path[PATH_MAX] = { 0 };
+    snprintf(path, sizeof(path), "%s/lightsd.state", tmpdir);
+
+    // nothing saved yet:
+    if (lgtd_lifx_cache_load(path) != -1) {
+        errx(1, "loading a missing file should fail");
+    }
+
+    struct sockaddr_in peer = {
+        .sin_family = AF_INET,
+        .sin_addr = { .s_addr = htonl(0x7f000001) },
+        .sin_port = htons(56700)
+    };
+    struct lgtd_lifx_gateway *gw = lgtd_tests_insert_mock_gateway(42);
+    gw->peer = (struct sockaddr *)&peer;
+    gw->peerlen = sizeof(peer);
+    gw->tags[2] = lgtd_tests_insert_mock_tag("kitchen");
+    gw->tag_ids = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(2);
+    struct lgtd_lifx_bulb *bulb = lgtd_tests_insert_mock_bulb(gw, 1);
+    lgtd_tests_set_mock_bulb_label(bulb, "lamp");
+    bulb->state.tags = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(2);
+    bulb->state.hue = 0xaaaa;
+    bulb->state.power = LGTD_LIFX_POWER_ON;
+    bulb->product_info.vendor_id = 1;
+    bulb->product_info.product_id = 1;
+    bulb->ips[LGTD_LIFX_BULB_WIFI_IP].fw_info.version = 42;
+    uint8_t bulb_addr[LGTD_LIFX_ADDR_LENGTH];
+    memcpy(bulb_addr, bulb->addr, sizeof(bulb_addr));
+
+    if (!lgtd_lifx_cache_save(path)) {
+        errx(1, "couldn't save the state");
+    }
+
+    // start from scratch:
+    bulb->state.tags = 0;
+    bulb->state.power = LGTD_LIFX_POWER_OFF;
+    SLIST_REMOVE(&gw->bulbs, bulb, lgtd_lifx_bulb, link_by_gw);
+    lgtd_lifx_bulb_close(bulb);
+    LIST_INIT(&lgtd_lifx_gateways);
+
+    if (lgtd_lifx_cache_load(path) != 1) {
+        errx(1, "one gateway should have been restored");
+    }
+    if (gateway_open_call_count != 1 || send_to_site_call_count != 1) {
+        errx(
+            1, "gateway_open_call_count = %d, send_to_site_call_count = %d "
+            "(expected 1, 1)", gateway_open_call_count, send_to_site_call_count
+        );
+    }
+    gw = LIST_FIRST(&lgtd_lifx_gateways);
+    if (gw->peerlen != sizeof(peer) || memcmp(gw->peer, &peer, sizeof(peer))) {
+        errx(1, "the gateway address wasn't restored");
+    }
+    if (gw->site.as_array[0] != 42) {
+        errx(1, "the gateway site wasn't restored");
+    }
+
+    bulb = lgtd_lifx_bulb_get(bulb_addr);
+    if (!bulb || bulb->gw != gw) {
+        errx(1, "the bulb wasn't restored");
+    }
+    if (strcmp(bulb->state.label, "lamp")) {
+        errx(
+            1, "label = %.*s (expected lamp)",
+            LGTD_LIFX_LABEL_SIZE, bulb->state.label
+        );
+    }
+    if (bulb->state.tags != LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(2)) {
+        errx(1, "tags = %#jx (expected 0x4)", (uintmax_t)bulb->state.tags);
+    }
+    if (bulb->state.hue != 0xaaaa || bulb->state.power != LGTD_LIFX_POWER_ON) {
+        errx(1, "the light state wasn't restored");
+    }
+    if (bulb->product_info.product_id != 1 || !bulb->model) {
+        errx(1, "the product info wasn't restored");
+    }
+    if (bulb->ips[LGTD_LIFX_BULB_WIFI_IP].fw_info.version != 42) {
+        errx(1, "the firmware info wasn't restored");
+    }
+    if (!bulb->stale) {
+        errx(1, "the bulb should be stale until we hear from it");
+    }
+
+    // the gateways we already know about aren't opened twice:
+    if (lgtd_lifx_cache_load(path) != 1 || gateway_open_call_count != 1) {
+        errx(1, "the gateway shouldn't have been opened again");
+    }
+
+    // the records that changed are updated in place:
+    struct stat st_before, st_after;
+    stat(path, &st_before);
+    if (!lgtd_lifx_cache_save(path)) {
+        errx(1, "couldn't save the state");
+    }
+    bulb->state.hue = 0x5555;
+    if (!lgtd_lifx_cache_save(path)) {
+        errx(1, "couldn't save the state");
+    }
+    stat(path, &st_after);
+    if (st_before.st_ino != st_after.st_ino) {
+        errx(1, "the file should have been updated in place");
+    }
+    int fd = open(path, O_RDONLY);
+    struct lgtd_lifx_cache_header header;
+    struct lgtd_lifx_cache_gateway gw_record;
+    struct lgtd_lifx_cache_bulb bulb_record;
+    if (read(fd, &header, sizeof(header)) != sizeof(header)
+        || read(fd, &gw_record, sizeof(gw_record)) != sizeof(gw_record)
+        || read(fd, &bulb_record, sizeof(bulb_record)) != sizeof(bulb_record)) {
+        errx(1, "couldn't read the state back");
+    }
+    close(fd);
+    if (header.flags != LGTD_LIFX_CACHE_DIRTY
+        || bulb_record.state.hue != 0x5555) {
+        errx(
+            1, "flags = %#x, hue = %#x (expected %#x, 0x5555)",
+            header.flags, bulb_record.state.hue, LGTD_LIFX_CACHE_DIRTY
+        );
+    }
+
+    // the file is flagged clean again once nothing changed:
+    bulb->state.hue = 0x6666;
+    if (!lgtd_lifx_cache_save(path) || !lgtd_lifx_cache_save(path)) {
+        errx(1, "couldn't save the state");
+    }
+    stat(path, &st_after);
+    if (st_before.st_ino != st_after.st_ino) {
+        errx(1, "the file should have been updated in place");
+    }
+    fd = open(path, O_RDONLY);
+    if (read(fd, &header, sizeof(header)) != sizeof(header)
+        || read(fd, &gw_record, sizeof(gw_record)) != sizeof(gw_record)
+        || read(fd, &bulb_record, sizeof(bulb_record)) != sizeof(bulb_record)) {
+        errx(1, "couldn't read the state back");
+    }
+    close(fd);
+    if (header.flags || bulb_record.state.hue != 0x6666) {
+        errx(
+            1, "flags = %#x, hue = %#x (expected 0, 0x6666)",
+            header.flags, bulb_record.state.hue
+        );
+    }
+
+    // but the file is replaced when its layout changes:
+    lgtd_tests_insert_mock_bulb(gw, 2);
+    if (!lgtd_lifx_cache_save(path)) {
+        errx(1, "couldn't save the state");
+    }
+    stat(path, &st_after);
+    if (st_before.st_ino == st_after.st_ino) {
+        errx(1, "the file should have been replaced");
+    }
+    size_t expected_size =
+        sizeof(header) + sizeof(gw_record) + 2 * sizeof(bulb_record);
+    if ((size_t)st_after.st_size != expected_size) {
+        errx(1, "the second bulb wasn't saved");
+    }
+
+    // a file that was partially updated is ignored:
+    lgtd_lifx_cache_close();
+    fd = open(path, O_RDWR);
+    header.flags = LGTD_LIFX_CACHE_DIRTY;
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        errx(1, "couldn't flag the state as dirty");
+    }
+    close(fd);
+    if (lgtd_lifx_cache_load(path) != -1) {
+        errx(1, "a dirty file shouldn't be loaded");
+    }
+
+    // invalid files are ignored:
+    FILE *fp = fopen(path, "w");
+    fputs("LGTDLIFX but not really", fp);
+    fclose(fp);
+    if (lgtd_lifx_cache_load(path) != -1) {
+        errx(1, "an invalid file shouldn't be loaded");
+    }
+
+    lgtd_tests_remove_temp_dir(tmpdir);
+
+    return 0;
+}
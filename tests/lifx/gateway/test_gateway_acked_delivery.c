@@ -0,0 +1,262 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+static struct lgtd_lifx_message *
+enqueue(struct lgtd_lifx_gateway *gw,
+        const uint8_t *addr,
+        enum lgtd_lifx_packet_type pkt_type,
+        void *pkt)
+{
+    union lgtd_lifx_target target = { .addr = addr };
+    struct lgtd_lifx_packet_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    const struct lgtd_lifx_packet_info *pkt_info = lgtd_lifx_wire_setup_header(
+        &hdr, LGTD_LIFX_TARGET_DEVICE, target, gw->site.as_array, pkt_type
+    );
+    // the mock doesn't setup the target, no address means site-wide:
+    if (addr) {
+        hdr.protocol = LGTD_LIFX_PROTOCOL_ADDRESSABLE;
+        memcpy(hdr.target.device_addr, addr, LGTD_LIFX_ADDR_LENGTH);
+    } else {
+        hdr.protocol = LGTD_LIFX_PROTOCOL_TAGGED;
+    }
+
+    if (!lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt)) {
+        errx(1, "%s should have been enqueued", pkt_info->name);
+    }
+    return TAILQ_LAST(
+        &gw->pkt_queues[pkt_info->priority],
+        lgtd_lifx_message_queue
+    );
+}
+
+// what lgtd_lifx_gateway_write_pkt_queues does when the socket is writable:
+static void
+write_pkts(struct lgtd_lifx_gateway *gw, int npkts)
+{
+    int i = 0;
+    for (int prio = 0; prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT; prio++) {
+        struct lgtd_lifx_message *msg;
+        TAILQ_FOREACH(msg, &gw->pkt_queues[prio], link) {
+            if (i++ == npkts) {
+                break;
+            }
+            lgtd_lifx_gateway_stamp_seqn(gw, msg);
+        }
+    }
+    lgtd_lifx_gateway_consume_pkt_queues(gw, npkts);
+}
+
+static void
+ack(struct lgtd_lifx_gateway *gw, const uint8_t *addr, uint8_t seqn)
+{
+    struct lgtd_lifx_packet_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.source = lgtd_lifx_wire_get_client_id();
+    hdr.seqn = seqn;
+    memcpy(hdr.target.device_addr, addr, LGTD_LIFX_ADDR_LENGTH);
+    lgtd_lifx_gateway_handle_ack(gw, &hdr, NULL);
+}
+
+static int
+count_unacked(const struct lgtd_lifx_gateway *gw)
+{
+    int count = 0;
+    const struct lgtd_lifx_message *msg;
+    TAILQ_FOREACH(msg, &gw->unacked_msgs, link) {
+        count++;
+    }
+    return count;
+}
+
+static void
+check_delivery(const struct lgtd_lifx_bulb *bulb,
+               enum lgtd_lifx_bulb_delivery expected)
+{
+    if (bulb->delivery != expected) {
+        errx(
+            1, "bulb %d: delivery = %d (expected %d)",
+            bulb->addr[LGTD_LIFX_ADDR_LENGTH - 1], bulb->delivery, expected
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+    lgtd_opts.lifx_acked_delivery = true;
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    gw.socket_ev = (void *)42;
+    struct lgtd_timer retransmit_timer;
+    memset(&retransmit_timer, 0, sizeof(retransmit_timer));
+    gw.retransmit_timer = &retransmit_timer;
+    union lgtd_timer_ctx ctx = { .as_ptr = &gw };
+
+    const uint8_t addr_1[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, 1 };
+    const uint8_t addr_2[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, 2 };
+    struct lgtd_lifx_bulb *bulb_1 = lgtd_lifx_gateway_get_or_open_bulb(
+        &gw, addr_1
+    );
+    struct lgtd_lifx_bulb *bulb_2 = lgtd_lifx_gateway_get_or_open_bulb(
+        &gw, addr_2
+    );
+
+    struct lgtd_lifx_packet_power_state power = { .power = LGTD_LIFX_POWER_ON };
+    struct lgtd_lifx_message *set_msg = enqueue(
+        &gw, NULL, LGTD_LIFX_SET_POWER_STATE, &power
+    );
+    struct lgtd_lifx_message *get_msg = enqueue(
+        &gw, NULL, LGTD_LIFX_GET_LIGHT_STATE, NULL
+    );
+    if (!lgtd_lifx_gateway_message_wants_ack(set_msg)) {
+        errx(1, "SET_POWER_STATE should require an ack");
+    }
+    if (lgtd_lifx_gateway_message_wants_ack(get_msg)) {
+        errx(1, "GET_LIGHT_STATE shouldn't require an ack");
+    }
+    int set_msg_size = set_msg->size;
+
+    write_pkts(&gw, 2);
+    uint8_t seqn = lgtd_lifx_gateway_message_seqn(set_msg);
+    if (gw.pkt_queues_bytes != 0) {
+        errx(1, "the queues should be empty");
+    }
+    if (count_unacked(&gw) != 1 || gw.unacked_by_seqn[seqn] != set_msg) {
+        errx(1, "SET_POWER_STATE should be waiting for acks");
+    }
+    if (set_msg->nbulbs != 2) {
+        errx(1, "nbulbs = %d (expected 2)", set_msg->nbulbs);
+    }
+    check_delivery(bulb_1, LGTD_LIFX_BULB_DELIVERY_PENDING);
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_PENDING);
+
+    ack(&gw, addr_1, seqn);
+    check_delivery(bulb_1, LGTD_LIFX_BULB_DELIVERY_ACKED);
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_PENDING);
+    if (set_msg->nbulbs != 1) {
+        errx(1, "nbulbs = %d (expected 1)", set_msg->nbulbs);
+    }
+
+    // bulb_2 doesn't answer, the site-wide packet is retransmitted to it
+    // only, bulb_1 already got it:
+    set_msg->sent_at = lgtd_time_monotonic_msecs() - 60000;
+    lgtd_lifx_gateway_retransmit_callback(&retransmit_timer, ctx);
+    struct lgtd_lifx_message *copy = TAILQ_FIRST(
+        &gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH]
+    );
+    if (!copy || copy->retransmit_of != set_msg
+        || TAILQ_NEXT(copy, link) || gw.pkt_queues_bytes != set_msg_size) {
+        errx(1, "SET_POWER_STATE should have been queued again for bulb_2");
+    }
+    const struct lgtd_lifx_packet_header *copy_hdr = (const void *)copy->data;
+    if (copy_hdr->protocol & LGTD_LIFX_PROTOCOL_TAGGED
+        || memcmp(copy_hdr->target.device_addr, addr_2, sizeof(addr_2))) {
+        errx(1, "the retransmission should be targeted at bulb_2");
+    }
+    if (set_msg->retransmits != 1 || !set_msg->in_flight) {
+        errx(1, "SET_POWER_STATE should still be waiting for acks");
+    }
+    if (last_event_passed_to_event_add != gw.socket_ev) {
+        errx(1, "the gateway should be waiting to write");
+    }
+
+    // the retransmission keeps its sequence number but isn't an RTT sample:
+    write_pkts(&gw, 1);
+    if (lgtd_lifx_gateway_message_seqn(set_msg) != seqn) {
+        errx(1, "the sequence number of a retransmission changed");
+    }
+    if (gw.rtt.sent_at[seqn] != 0) {
+        errx(1, "retransmissions shouldn't be used as RTT samples");
+    }
+    if (gw.pkt_queues_bytes != 0
+        || count_unacked(&gw) != 1 || gw.unacked_by_seqn[seqn] != set_msg) {
+        errx(1, "SET_POWER_STATE should be waiting for acks again");
+    }
+
+    // bulb_2 acks before the next retransmission goes out, it's dropped:
+    set_msg->sent_at = lgtd_time_monotonic_msecs() - 60000;
+    lgtd_lifx_gateway_retransmit_callback(&retransmit_timer, ctx);
+    if (gw.pkt_queues_bytes != set_msg_size) {
+        errx(1, "SET_POWER_STATE should have been queued again for bulb_2");
+    }
+    ack(&gw, addr_2, seqn);
+    if (gw.pkt_queues_bytes != 0 || count_unacked(&gw) != 0) {
+        errx(1, "the acknowledged SET_POWER_STATE should have been dropped");
+    }
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_ACKED);
+
+    // send it again, without any ack this time:
+    set_msg = enqueue(&gw, NULL, LGTD_LIFX_SET_POWER_STATE, &power);
+    write_pkts(&gw, 1);
+    seqn = lgtd_lifx_gateway_message_seqn(set_msg);
+
+    // no ack after the last retransmission, give up:
+    set_msg->retransmits = LGTD_LIFX_GATEWAY_MAX_RETRANSMITS;
+    set_msg->sent_at = lgtd_time_monotonic_msecs() - 60000;
+    lgtd_lifx_gateway_retransmit_callback(&retransmit_timer, ctx);
+    if (count_unacked(&gw) != 0 || gw.unacked_by_seqn[seqn]) {
+        errx(1, "SET_POWER_STATE should have been dropped");
+    }
+    check_delivery(bulb_1, LGTD_LIFX_BULB_DELIVERY_FAILED);
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_FAILED);
+
+    // a newer value supersedes the one waiting for an ack:
+    struct lgtd_lifx_message *old_msg = enqueue(
+        &gw, addr_2, LGTD_LIFX_SET_POWER_STATE, &power
+    );
+    write_pkts(&gw, 1);
+    uint8_t old_seqn = lgtd_lifx_gateway_message_seqn(old_msg);
+    power.power = LGTD_LIFX_POWER_OFF;
+    struct lgtd_lifx_message *new_msg = enqueue(
+        &gw, addr_2, LGTD_LIFX_SET_POWER_STATE, &power
+    );
+    write_pkts(&gw, 1);
+    uint8_t new_seqn = lgtd_lifx_gateway_message_seqn(new_msg);
+    if (count_unacked(&gw) != 1 || gw.unacked_by_seqn[old_seqn]) {
+        errx(1, "the older SET_POWER_STATE should have been dropped");
+    }
+    if (new_seqn == old_seqn || gw.unacked_by_seqn[new_seqn] != new_msg) {
+        errx(1, "the newer SET_POWER_STATE should be waiting for an ack");
+    }
+    check_delivery(bulb_1, LGTD_LIFX_BULB_DELIVERY_FAILED);
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_PENDING);
+
+    // another client's ack doesn't count:
+    struct lgtd_lifx_packet_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.seqn = new_seqn;
+    memcpy(hdr.target.device_addr, addr_2, LGTD_LIFX_ADDR_LENGTH);
+    lgtd_lifx_gateway_handle_ack(&gw, &hdr, NULL);
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_PENDING);
+
+    ack(&gw, addr_2, new_seqn);
+    check_delivery(bulb_2, LGTD_LIFX_BULB_DELIVERY_ACKED);
+    if (count_unacked(&gw) != 0 || gw.unacked_by_seqn[new_seqn]) {
+        errx(1, "the acknowledged SET_POWER_STATE should have been released");
+    }
+
+    // a newer value for bulb_2 only supersedes an older site-wide value on
+    // bulb_2 only:
+    set_msg = enqueue(&gw, NULL, LGTD_LIFX_SET_POWER_STATE, &power);
+    write_pkts(&gw, 1);
+    new_msg = enqueue(&gw, addr_2, LGTD_LIFX_SET_POWER_STATE, &power);
+    write_pkts(&gw, 1);
+    if (count_unacked(&gw) != 2) {
+        errx(1, "both SET_POWER_STATE should be waiting for acks");
+    }
+    if (set_msg->nbulbs != 1
+        || memcmp(set_msg->bulbs[0], addr_1, sizeof(addr_1))) {
+        errx(1, "the site-wide SET_POWER_STATE should only wait for bulb_1");
+    }
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #define MOCKED_LIFX_TAGGING_INCREF
 #include "test_gateway_utils.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 
@@ -30,10 +31,10 @@ lgtd_lifx_tagging_incref(const char *label,
     if (!tag) {
         tag = calloc(1, sizeof(*tag));
         strcpy(tag->label, label);
-        struct lgtd_lifx_site *site = calloc(1, sizeof(*site));
-        site->gw = gw;
-        site->tag_id = tag_id;
-        LIST_INSERT_HEAD(&tag->sites, site, link);
+        tag->sites = calloc(1, sizeof(*tag->sites));
+        tag->sites->gw = gw;
+        tag->sites->tag_id = tag_id;
+        tag->nsites = tag->sites_capacity = 1;
     }
 
     tagging_incref_called = true;
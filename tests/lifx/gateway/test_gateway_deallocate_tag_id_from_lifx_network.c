@@ -5,6 +5,7 @@
 #define MOCKED_LIFX_TAGGING_DECREF
 #include "test_gateway_utils.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 
@@ -34,10 +35,7 @@ main(void)
     struct lgtd_lifx_packet_header hdr;
     memset(&hdr, 0, sizeof(hdr));
 
-    struct lgtd_lifx_tag tag = {
-        .label = "test",
-        .sites = LIST_HEAD_INITIALIZER(&tag.sites)
-    };
+    struct lgtd_lifx_tag tag = { .label = "test" };
 
     gw.tags[0] = &tag;
     gw.tag_ids = LGTD_LIFX_WIRE_TAG_ID_TO_VALUE(0)
@@ -2,6 +2,7 @@
 
 #include "test_gateway_utils.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 
@@ -12,6 +13,7 @@ main(void)
 
     struct lgtd_lifx_gateway gw;
     memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
     gw.socket_ev = (void *)42;
 
     struct lgtd_lifx_packet_power_state pkt;
@@ -28,34 +30,39 @@ main(void)
         LGTD_LIFX_SET_POWER_STATE
     );
 
-    lgtd_lifx_gateway_enqueue_packet(&gw, &hdr, pkt_info, &pkt);
+    if (!lgtd_lifx_gateway_enqueue_packet(&gw, &hdr, pkt_info, &pkt)) {
+        errx(1, "the packet should have been enqueued");
+    }
+
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH) != 1
+        || count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW) != 0) {
+        errx(1, "the packet should have been enqueued with high priority");
+    }
+
+    struct lgtd_lifx_message *msg;
+    msg = TAILQ_FIRST(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH]);
 
-    if (memcmp(gw_write_buf, &hdr, sizeof(hdr))) {
+    if (memcmp(msg->data, &hdr, sizeof(hdr))) {
         errx(1, "header incorrectly buffered");
     }
 
-    if (memcmp(&gw_write_buf[sizeof(hdr)], &pkt, sizeof(pkt))) {
+    if (memcmp(&msg->data[sizeof(hdr)], &pkt, sizeof(pkt))) {
         errx(1, "pkt incorrectly buffered");
     }
 
-    if (gw.pkt_ring[0].type != LGTD_LIFX_SET_POWER_STATE) {
+    if (msg->type != LGTD_LIFX_SET_POWER_STATE) {
         errx(1, "packet type incorrectly enqueued");
     }
 
-    if (gw.pkt_ring[0].size != sizeof(pkt) + sizeof(hdr)) {
+    if (msg->size != sizeof(pkt) + sizeof(hdr)) {
         errx(1, "packet size incorrectly enqueued");
     }
 
-    if (gw.pkt_ring_head != 1) {
-        errx(1, "packet ring head should be on index 1");
-    }
-
-    if (gw.pkt_ring_tail != 0) {
-        errx(1, "packet ring tail should be on index 0");
-    }
-
-    if (gw.pkt_ring_full == true) {
-        errx(1, "packet ring shouldn't be full");
+    if (gw.pkt_queues_bytes != msg->size) {
+        errx(
+            1, "pkt_queues_bytes = %d (expected %d)",
+            gw.pkt_queues_bytes, msg->size
+        );
     }
 
     if (last_event_passed_to_event_add != gw.socket_ev) {
@@ -0,0 +1,107 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+static void
+enqueue(struct lgtd_lifx_gateway *gw,
+        const uint8_t *addr,
+        enum lgtd_lifx_packet_type pkt_type,
+        void *pkt)
+{
+    union lgtd_lifx_target target = { .addr = addr };
+    struct lgtd_lifx_packet_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    const struct lgtd_lifx_packet_info *pkt_info = lgtd_lifx_wire_setup_header(
+        &hdr, LGTD_LIFX_TARGET_DEVICE, target, gw->site.as_array, pkt_type
+    );
+    // the mock doesn't setup the target:
+    memcpy(hdr.target.device_addr, addr, LGTD_LIFX_ADDR_LENGTH);
+
+    if (!lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, pkt)) {
+        errx(1, "%s should have been enqueued", pkt_info->name);
+    }
+}
+
+static const struct lgtd_lifx_packet_light_color *
+get_light_color(const struct lgtd_lifx_message *msg)
+{
+    if (!msg || msg->type != LGTD_LIFX_SET_LIGHT_COLOR) {
+        errx(1, "expected a SET_LIGHT_COLOR packet");
+    }
+    return (const void *)&msg->data[sizeof(struct lgtd_lifx_packet_header)];
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    gw.socket_ev = (void *)42;
+
+    const uint8_t addr_1[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, 1 };
+    const uint8_t addr_2[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, 2 };
+
+    struct lgtd_lifx_packet_light_color color = { .hue = 1 };
+    struct lgtd_lifx_packet_power_state power = { .power = LGTD_LIFX_POWER_ON };
+    struct lgtd_lifx_packet_waveform waveform = { .hue = 42 };
+
+    enqueue(&gw, addr_1, LGTD_LIFX_SET_LIGHT_COLOR, &color);
+    enqueue(&gw, addr_1, LGTD_LIFX_SET_POWER_STATE, &power);
+    int bytes = gw.pkt_queues_bytes;
+
+    // overwrites the first packet in place, across SET_POWER_STATE:
+    color.hue = 2;
+    enqueue(&gw, addr_1, LGTD_LIFX_SET_LIGHT_COLOR, &color);
+
+    struct lgtd_lifx_message_queue *queue;
+    queue = &gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH];
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH) != 2) {
+        errx(1, "the second SET_LIGHT_COLOR should have been collapsed");
+    }
+    if (get_light_color(TAILQ_FIRST(queue))->hue != 2) {
+        errx(1, "the queued SET_LIGHT_COLOR should have the latest payload");
+    }
+    if (gw.pkt_queues_bytes != bytes) {
+        errx(
+            1, "pkt_queues_bytes = %d (expected %d)",
+            gw.pkt_queues_bytes, bytes
+        );
+    }
+
+    // a different target is queued separately:
+    color.hue = 3;
+    enqueue(&gw, addr_2, LGTD_LIFX_SET_LIGHT_COLOR, &color);
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH) != 3) {
+        errx(1, "SET_LIGHT_COLOR to another device should be queued");
+    }
+
+    // and we can't go past it (it could be a tag that includes addr_1):
+    color.hue = 4;
+    enqueue(&gw, addr_1, LGTD_LIFX_SET_LIGHT_COLOR, &color);
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH) != 4) {
+        errx(1, "SET_LIGHT_COLOR shouldn't have been reordered");
+    }
+    if (get_light_color(TAILQ_FIRST(queue))->hue != 2) {
+        errx(1, "the first SET_LIGHT_COLOR shouldn't have been touched");
+    }
+    if (get_light_color(TAILQ_LAST(queue, lgtd_lifx_message_queue))->hue != 4) {
+        errx(1, "the last SET_LIGHT_COLOR should have the latest payload");
+    }
+
+    // nor past anything that isn't last write wins:
+    enqueue(&gw, addr_1, LGTD_LIFX_SET_WAVEFORM, &waveform);
+    color.hue = 5;
+    enqueue(&gw, addr_1, LGTD_LIFX_SET_LIGHT_COLOR, &color);
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH) != 6) {
+        errx(1, "SET_LIGHT_COLOR shouldn't have been moved before a waveform");
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+static void
+enqueue(struct lgtd_lifx_gateway *gw, enum lgtd_lifx_packet_type pkt_type)
+{
+    union lgtd_lifx_target target = { .tags = 0 };
+    struct lgtd_lifx_packet_header hdr;
+    const struct lgtd_lifx_packet_info *pkt_info = lgtd_lifx_wire_setup_header(
+        &hdr, LGTD_LIFX_TARGET_ALL_DEVICES, target, gw->site.as_array, pkt_type
+    );
+
+    if (!lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, NULL)) {
+        errx(1, "%s should have been enqueued", pkt_info->name);
+    }
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    gw.socket_ev = (void *)42;
+
+    enqueue(&gw, LGTD_LIFX_GET_LIGHT_STATE);
+    enqueue(&gw, LGTD_LIFX_SET_POWER_STATE);
+    enqueue(&gw, LGTD_LIFX_GET_TAG_LABELS);
+
+    const struct lgtd_lifx_message *msg;
+    msg = TAILQ_FIRST(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH]);
+    if (!msg || msg->type != LGTD_LIFX_SET_POWER_STATE
+        || TAILQ_NEXT(msg, link)) {
+        errx(1, "SET_POWER_STATE should be alone in the high priority queue");
+    }
+
+    msg = TAILQ_FIRST(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_LOW]);
+    if (!msg || msg->type != LGTD_LIFX_GET_LIGHT_STATE) {
+        errx(1, "GET_LIGHT_STATE should be first in the low priority queue");
+    }
+    msg = TAILQ_NEXT(msg, link);
+    if (!msg || msg->type != LGTD_LIFX_GET_TAG_LABELS
+        || TAILQ_NEXT(msg, link)) {
+        errx(1, "GET_TAG_LABELS should be last in the low priority queue");
+    }
+
+    // and the high priority packet goes out first:
+    lgtd_lifx_gateway_consume_pkt_queues(&gw, 1);
+    if (!TAILQ_EMPTY(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH])) {
+        errx(1, "SET_POWER_STATE should have been consumed first");
+    }
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW) != 2) {
+        errx(1, "the low priority queue shouldn't have been touched");
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+enum { HDR_SIZE = sizeof(struct lgtd_lifx_packet_header) };
+enum { PWR_SIZE = sizeof(struct lgtd_lifx_packet_power_state) };
+enum { TAGS_SIZE = sizeof(struct lgtd_lifx_packet_tags) };
+
+static bool
+enqueue(struct lgtd_lifx_gateway *gw, enum lgtd_lifx_packet_type pkt_type)
+{
+    union lgtd_lifx_target target = { .tags = 0 };
+    struct lgtd_lifx_packet_header hdr;
+    const struct lgtd_lifx_packet_info *pkt_info = lgtd_lifx_wire_setup_header(
+        &hdr, LGTD_LIFX_TARGET_ALL_DEVICES, target, gw->site.as_array, pkt_type
+    );
+
+    return lgtd_lifx_gateway_enqueue_packet(gw, &hdr, pkt_info, NULL);
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    gw.socket_ev = (void *)42;
+
+    int max_bytes = (HDR_SIZE + TAGS_SIZE) + HDR_SIZE + PWR_SIZE;
+    lgtd_opts.lifx_queue_max_bytes = max_bytes;
+
+    if (!enqueue(&gw, LGTD_LIFX_GET_TAG_LABELS)
+        || !enqueue(&gw, LGTD_LIFX_GET_LIGHT_STATE)) {
+        errx(1, "the low priority packets should have been enqueued");
+    }
+    gw.pending_refresh_req = true;
+
+    if (enqueue(&gw, LGTD_LIFX_GET_LIGHT_STATE)) {
+        errx(1, "a low priority packet can't evict another one");
+    }
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW) != 2) {
+        errx(1, "the low priority queue shouldn't have been touched");
+    }
+
+    // an high priority packet evicts the oldest low priority packet:
+    if (!enqueue(&gw, LGTD_LIFX_SET_POWER_STATE)) {
+        errx(1, "SET_POWER_STATE should have been enqueued");
+    }
+    const struct lgtd_lifx_message *msg;
+    msg = TAILQ_FIRST(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_LOW]);
+    if (!msg || msg->type != LGTD_LIFX_GET_LIGHT_STATE
+        || TAILQ_NEXT(msg, link)) {
+        errx(1, "only GET_TAG_LABELS should have been evicted");
+    }
+    if (gw.pending_refresh_req) {
+        errx(1, "the evicted refresh request isn't pending anymore");
+    }
+    if (gw.pkt_queues_bytes != 2 * HDR_SIZE + PWR_SIZE) {
+        errx(
+            1, "pkt_queues_bytes = %d (expected %d)",
+            gw.pkt_queues_bytes, 2 * HDR_SIZE + PWR_SIZE
+        );
+    }
+
+    // evicting GET_LIGHT_STATE wouldn't make enough room for this one:
+    if (enqueue(&gw, LGTD_LIFX_SET_LIGHT_COLOR)) {
+        errx(1, "SET_LIGHT_COLOR should have been dropped");
+    }
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW) != 1
+        || count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH) != 1) {
+        errx(1, "nothing should have been evicted for a dropped packet");
+    }
+
+    return 0;
+}
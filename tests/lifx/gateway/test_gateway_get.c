@@ -0,0 +1,97 @@
+#include "gateway.c"
+
+#include <arpa/inet.h>
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+enum { GW_COUNT = LGTD_LIFX_GATEWAY_PEERS_MIN_BUCKETS * 4 };
+
+static struct lgtd_lifx_gateway gws[GW_COUNT];
+static struct sockaddr_in peers[GW_COUNT];
+
+static struct sockaddr_in
+make_peer(int i)
+{
+    struct sockaddr_in peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+    peer.sin_addr.s_addr = htonl(0x0a000000 + i);
+    peer.sin_port = htons(LGTD_LIFX_PROTOCOL_PORT);
+    return peer;
+}
+
+int
+main(void)
+{
+    struct sockaddr_in unknown = make_peer(GW_COUNT + 1);
+
+    if (lgtd_lifx_gateway_get((struct sockaddr *)&unknown, sizeof(unknown))) {
+        errx(1, "no gateway should be returned from an empty table");
+    }
+
+    for (int i = 0; i != GW_COUNT; i++) {
+        peers[i] = make_peer(i);
+        gws[i].peer = (struct sockaddr *)&peers[i];
+        gws[i].peerlen = sizeof(peers[i]);
+        if (!lgtd_lifx_gateway_index_peer(&gws[i])) {
+            errx(1, "couldn't index gateway %d", i);
+        }
+    }
+
+    if (lgtd_lifx_gateway_peers.count != GW_COUNT) {
+        errx(
+            1, "the table should have %d entries (got %d)",
+            GW_COUNT, lgtd_lifx_gateway_peers.count
+        );
+    }
+    if (lgtd_lifx_gateway_peers.nbuckets < GW_COUNT) {
+        errx(
+            1, "the table should have grown to at least %d buckets (got %d)",
+            GW_COUNT, lgtd_lifx_gateway_peers.nbuckets
+        );
+    }
+
+    for (int i = 0; i != GW_COUNT; i++) {
+        // use a copy to make sure we don't just compare pointers:
+        struct sockaddr_in peer = make_peer(i);
+        struct lgtd_lifx_gateway *gw = lgtd_lifx_gateway_get(
+            (struct sockaddr *)&peer, sizeof(peer)
+        );
+        if (gw != &gws[i]) {
+            errx(1, "got gateway %p for peer %d (expected %p)", gw, i, &gws[i]);
+        }
+    }
+
+    if (lgtd_lifx_gateway_get((struct sockaddr *)&unknown, sizeof(unknown))) {
+        errx(1, "no gateway should be returned for an unknown peer");
+    }
+
+    struct sockaddr_in other_port = make_peer(0);
+    other_port.sin_port = htons(LGTD_LIFX_PROTOCOL_PORT + 1);
+    if (lgtd_lifx_gateway_get((struct sockaddr *)&other_port, sizeof(other_port))) {
+        errx(1, "no gateway should be returned for a different port");
+    }
+
+    lgtd_lifx_gateway_unindex_peer(&gws[1]);
+    if (lgtd_lifx_gateway_get((struct sockaddr *)&peers[1], sizeof(peers[1]))) {
+        errx(1, "gateway 1 should have been removed");
+    }
+    if (lgtd_lifx_gateway_get((struct sockaddr *)&peers[2], sizeof(peers[2])) != &gws[2]) {
+        errx(1, "gateway 2 should still be there");
+    }
+
+    for (int i = 0; i != GW_COUNT; i++) {
+        if (i != 1) {
+            lgtd_lifx_gateway_unindex_peer(&gws[i]);
+        }
+    }
+    if (lgtd_lifx_gateway_peers.buckets || lgtd_lifx_gateway_peers.count) {
+        errx(1, "the table should have been freed");
+    }
+
+    return 0;
+}
@@ -4,6 +4,7 @@
 
 #include "test_gateway_utils.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #include "mock_wire_proto.h"
 
@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "gateway.c"
+
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "test_gateway_utils.h"
+#include "tests_utils.h"
+#include "mock_wire_proto.h"
+
+static void
+check_clock_offset(const struct lgtd_lifx_bulb *bulb, int64_t expected)
+{
+    if (bulb->clock_offset != expected) {
+        errx(
+            1, "bulb->clock_offset = %jd (expected %jd)",
+            (intmax_t)bulb->clock_offset, (intmax_t)expected
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    gw.last_pkt_at = 10000;
+    gw.rtt.srtt_x8 = 20 << 3;
+    gw.rtt.samples = 1;
+
+    struct lgtd_lifx_bulb *bulb = lgtd_tests_insert_mock_bulb(&gw, 42);
+
+    struct lgtd_lifx_packet_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(
+        &hdr.target.device_addr, &bulb->addr, sizeof(hdr.target.device_addr)
+    );
+
+    // the bulb read its clock half a round-trip before we got the response:
+    struct lgtd_lifx_packet_time_state pkt = {
+        .time = UINT64_C(50000) * 1000 * 1000
+    };
+    lgtd_lifx_gateway_handle_time_state(&gw, &hdr, &pkt);
+    check_clock_offset(bulb, 50000 - (10000 - 10));
+    if (bulb->clock_offset_updated_at != gw.last_pkt_at) {
+        errx(1, "clock_offset_updated_at wasn't updated");
+    }
+
+    // the next samples are smoothed:
+    pkt.time += UINT64_C(20) * 1000 * 1000;
+    lgtd_lifx_gateway_handle_time_state(&gw, &hdr, &pkt);
+    check_clock_offset(bulb, 50000 - (10000 - 10) + 5);
+
+    // unless the bulb clock jumped:
+    pkt.time += UINT64_C(3600) * 1000 * 1000 * 1000;
+    lgtd_lifx_gateway_handle_time_state(&gw, &hdr, &pkt);
+    check_clock_offset(bulb, 50000 + 20 + 3600 * 1000 - (10000 - 10));
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+struct mmsghdr;
+struct timespec;
+
+int mock_recvmmsg(int, struct mmsghdr *, unsigned int, int, struct timespec *);
+ssize_t mock_recvfrom(int, void *, size_t, int, struct sockaddr *, socklen_t *);
+
+#define recvmmsg(socket, msgvec, vlen, flags, timeout) \
+    mock_recvmmsg(socket, msgvec, vlen, flags, timeout)
+#define recvfrom(socket, buffer, length, flags, addr, addrlen) \
+    mock_recvfrom(socket, buffer, length, flags, addr, addrlen)
+
+// Go through the actual decoding of the datagrams, the tests shims already
+// define the sequence wire_proto.c defines:
+#define LGTD_LIFX_DEBRUIJN_SEQUENCE test_wire_proto_debruijn_sequence
+#include "gateway.c"
+#include "wire_proto.c"
+
+#include "test_gateway_utils.h"
+#define MOCKED_DAEMON_UPDATE_PROCTITLE
+#include "mock_daemon.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+
+enum { MOCK_SHARED_SOCKET = 25 };
+
+static struct sockaddr_in gw_1_peer = {
+    .sin_family = AF_INET,
+    .sin_addr = { .s_addr = 0x0100007f },
+    .sin_port = 0xbcdd
+};
+static struct sockaddr_in gw_2_peer = {
+    .sin_family = AF_INET,
+    .sin_addr = { .s_addr = 0x0200007f },
+    .sin_port = 0xbcdd
+};
+static struct sockaddr_in lan_host_peer = {
+    .sin_family = AF_INET,
+    .sin_addr = { .s_addr = 0x0300007f },
+    .sin_port = 0xbcdd
+};
+
+struct mock_datagram {
+    const struct sockaddr_in    *peer;
+    int                         size;
+};
+
+enum { PAN_GATEWAY_SIZE = (
+    sizeof(struct lgtd_lifx_packet_header)
+    + sizeof(struct lgtd_lifx_packet_pan_gateway)
+) };
+
+// a truncated datagram from some random host sandwiched between two valid
+// datagrams from the gateways:
+static const struct mock_datagram mock_datagrams[] = {
+    { &gw_1_peer, PAN_GATEWAY_SIZE },
+    { &lan_host_peer, 10 },
+    { &gw_2_peer, PAN_GATEWAY_SIZE },
+};
+static int mock_datagrams_read = 0;
+static int mock_recv_error = 0;
+
+static int
+mock_recv_one(void *buf, struct sockaddr *addr, socklen_t *addrlen)
+{
+    const struct mock_datagram *datagram = &mock_datagrams[mock_datagrams_read];
+    mock_datagrams_read++;
+
+    struct lgtd_lifx_packet_header hdr = {
+        .size = htole16(PAN_GATEWAY_SIZE),
+        .protocol = htole16(LGTD_LIFX_PROTOCOL_V1)
+            | LGTD_LIFX_PROTOCOL_ADDRESSABLE,
+        .packet_type = htole16(LGTD_LIFX_PAN_GATEWAY)
+    };
+    memset(buf, 0, PAN_GATEWAY_SIZE);
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(addr, datagram->peer, sizeof(*datagram->peer));
+    *addrlen = sizeof(*datagram->peer);
+    return datagram->size;
+}
+
+int
+mock_recvmmsg(int socket,
+              struct mmsghdr *msgvec,
+              unsigned int vlen,
+              int flags,
+              struct timespec *timeout)
+{
+    (void)flags;
+    (void)timeout;
+
+    if (socket != MOCK_SHARED_SOCKET) {
+        errx(1, "got socket %d (expected %d)", socket, MOCK_SHARED_SOCKET);
+    }
+
+    if (mock_recv_error) {
+        errno = mock_recv_error;
+        return -1;
+    }
+
+    int n = 0;
+    while ((unsigned int)n != vlen
+           && mock_datagrams_read != LGTD_ARRAY_SIZE(mock_datagrams)) {
+        struct msghdr *hdr = &msgvec[n].msg_hdr;
+        msgvec[n].msg_len = mock_recv_one(
+            hdr->msg_iov->iov_base, hdr->msg_name, &hdr->msg_namelen
+        );
+        n++;
+    }
+
+    if (!n) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return n;
+}
+
+ssize_t
+mock_recvfrom(int socket,
+              void *buffer,
+              size_t length,
+              int flags,
+              struct sockaddr *addr,
+              socklen_t *addrlen)
+{
+    (void)length;
+    (void)flags;
+
+    if (socket != MOCK_SHARED_SOCKET) {
+        errx(1, "got socket %d (expected %d)", socket, MOCK_SHARED_SOCKET);
+    }
+
+    if (mock_recv_error) {
+        errno = mock_recv_error;
+        return -1;
+    }
+
+    if (mock_datagrams_read == LGTD_ARRAY_SIZE(mock_datagrams)) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return mock_recv_one(buffer, addr, addrlen);
+}
+
+static int broadcast_discovery_call_count = 0;
+
+bool
+lgtd_lifx_broadcast_discovery(void)
+{
+    broadcast_discovery_call_count++;
+    return true;
+}
+
+static struct lgtd_lifx_gateway *
+setup_shared_gw(const struct sockaddr_in *peer)
+{
+    struct lgtd_lifx_gateway *gw = calloc(1, sizeof(*gw));
+    init_gw_pkt_queues(gw);
+    gw->shared_socket = true;
+    gw->socket = MOCK_SHARED_SOCKET;
+    gw->peer = malloc(sizeof(*peer));
+    memcpy(gw->peer, peer, sizeof(*peer));
+    gw->peerlen = sizeof(*peer);
+    lgtd_lifx_gateway_index_peer(gw);
+    LIST_INSERT_HEAD(&lgtd_lifx_gateways, gw, link);
+    TAILQ_INSERT_TAIL(&lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt);
+    lgtd_lifx_gateway_shared_endpoint.refcount++;
+    lgtd_lifx_gateway_count_refresh_reason(gw->refresh_reason, 1);
+    LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(gateways, 1);
+
+    return gw;
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    lgtd_lifx_gateway_shared_endpoint.socket = MOCK_SHARED_SOCKET;
+
+    struct lgtd_lifx_gateway *gw_1 = setup_shared_gw(&gw_1_peer);
+    struct lgtd_lifx_gateway *gw_2 = setup_shared_gw(&gw_2_peer);
+
+    lgtd_lifx_gateway_shared_socket_event_callback(-1, EV_READ, NULL);
+
+    if (mock_datagrams_read != LGTD_ARRAY_SIZE(mock_datagrams)) {
+        errx(
+            1, "only %d datagrams were read (expected %d)",
+            mock_datagrams_read, (int)LGTD_ARRAY_SIZE(mock_datagrams)
+        );
+    }
+    if (LIST_FIRST(&lgtd_lifx_gateways) != gw_2
+        || LIST_NEXT(gw_2, link) != gw_1
+        || LIST_NEXT(gw_1, link) != NULL) {
+        errx(1, "the gateways shouldn't have been closed");
+    }
+    if (!gw_1->last_pkt_at || !gw_2->last_pkt_at) {
+        errx(
+            1, "the datagrams around the truncated one weren't handled "
+            "(last_pkt_at = %ju, %ju)",
+            (uintmax_t)gw_1->last_pkt_at, (uintmax_t)gw_2->last_pkt_at
+        );
+    }
+    if (broadcast_discovery_call_count) {
+        errx(1, "the discovery shouldn't have been restarted");
+    }
+
+    // a transient error doesn't close the gateways either:
+    mock_recv_error = ENOMEM;
+    lgtd_lifx_gateway_shared_socket_event_callback(-1, EV_READ, NULL);
+    if (LIST_FIRST(&lgtd_lifx_gateways) != gw_2 || broadcast_discovery_call_count) {
+        errx(1, "the gateways shouldn't have been closed on ENOMEM");
+    }
+
+    // but they are if the socket itself is unusable:
+    mock_recv_error = EBADF;
+    lgtd_lifx_gateway_shared_socket_event_callback(-1, EV_READ, NULL);
+    if (!LIST_EMPTY(&lgtd_lifx_gateways)) {
+        errx(1, "all the gateways should have been closed on EBADF");
+    }
+    if (broadcast_discovery_call_count != 1) {
+        errx(1, "the discovery should have been restarted once");
+    }
+
+    return 0;
+}
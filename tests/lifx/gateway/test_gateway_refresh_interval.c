@@ -0,0 +1,108 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+static void
+check_refresh_interval(const struct lgtd_lifx_gateway *gw,
+                       enum lgtd_lifx_gateway_refresh_reason reason,
+                       int interval)
+{
+    if (gw->refresh_reason != reason) {
+        errx(
+            1, "refresh_reason = %d (expected %d)", gw->refresh_reason, reason
+        );
+    }
+    if (gw->refresh_interval != interval) {
+        errx(
+            1, "refresh_interval = %d (expected %d)",
+            gw->refresh_interval, interval
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    struct lgtd_timer refresh_timer;
+    memset(&refresh_timer, 0, sizeof(refresh_timer));
+    gw.refresh_timer = &refresh_timer;
+
+    lgtd_time_mono_t now = 3600 * 1000;
+
+    // nothing happens, back off up to the maximum interval:
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_IDLE, 3200);
+    if (LGTD_STATS_GET(gateways_refresh_idle) != 1) {
+        errx(1, "the gateway should be counted as idle");
+    }
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_IDLE, 6400);
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_IDLE, 10000);
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_IDLE, 10000);
+
+    // a bulb changed on its own:
+    gw.last_change_at = now;
+    if (!lgtd_lifx_gateway_update_refresh_interval(&gw, now + 100)) {
+        errx(1, "the refresh interval should have been shortened");
+    }
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_CHURN, 1600);
+    if (LGTD_STATS_GET(gateways_refresh_idle) != 0
+        || LGTD_STATS_GET(gateways_refresh_churn) != 1) {
+        errx(1, "the gateway should be counted as churning");
+    }
+
+    // a client reads the state of the bulbs, the next refresh is pulled in:
+    lgtd_lifx_gateway_mark_client_read(&gw);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_CLIENT, 800);
+    if (last_timer_passed_to_timer_reschedule != &refresh_timer) {
+        errx(1, "the refresh timer should have been re-scheduled");
+    }
+    if (LGTD_STATS_GET(gateways_refresh_churn) != 0
+        || LGTD_STATS_GET(gateways_refresh_client) != 1) {
+        errx(1, "the gateway should be counted as read by a client");
+    }
+
+    // a command takes precedence:
+    now = gw.last_client_read_at;
+    gw.last_command_at = now;
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_COMMAND, 800);
+
+    // but a slow gateway isn't polled faster than its retransmission timeout
+    // (srtt = 1000ms, rttvar = 500ms):
+    lgtd_lifx_gateway_add_rtt_sample(&gw, 1000);
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_COMMAND, 3000);
+
+    // the command is old news, the client read is still recent:
+    now += LGTD_LIFX_GATEWAY_REFRESH_COMMAND_MSECS;
+    memset(&gw.rtt, 0, sizeof(gw.rtt));
+    lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    check_refresh_interval(&gw, LGTD_LIFX_GATEWAY_REFRESH_CLIENT, 800);
+
+    // an idle gateway is still refreshed within the watchdog timeout, even
+    // with a larger maximum interval:
+    lgtd_opts.lifx_refresh_max_msecs = 2 * LGTD_LIFX_DISCOVERY_DEVICE_TIMEOUT_MSECS;
+    now += LGTD_LIFX_GATEWAY_REFRESH_CLIENT_MSECS;
+    for (int i = 0; i != 8; i++) {
+        lgtd_lifx_gateway_update_refresh_interval(&gw, now);
+    }
+    check_refresh_interval(
+        &gw,
+        LGTD_LIFX_GATEWAY_REFRESH_IDLE,
+        LGTD_LIFX_DISCOVERY_DEVICE_MAX_REFRESH_INTERVAL_MSECS
+    );
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+static void
+check_rtt(const struct lgtd_lifx_gateway *gw, int samples, int srtt, int rto)
+{
+    if (gw->rtt.samples != samples) {
+        errx(1, "samples = %d (expected %d)", gw->rtt.samples, samples);
+    }
+    if ((int)lgtd_lifx_gateway_latency(gw) != srtt) {
+        errx(
+            1, "latency = %d (expected %d)",
+            (int)lgtd_lifx_gateway_latency(gw), srtt
+        );
+    }
+    if ((int)lgtd_lifx_gateway_rto(gw) != rto) {
+        errx(
+            1, "rto = %d (expected %d)", (int)lgtd_lifx_gateway_rto(gw), rto
+        );
+    }
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    strcpy(gw.peeraddr, "[127.0.0.1]:56700");
+
+    check_rtt(&gw, 0, 0, LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS);
+
+    enum { HDR_SIZE = sizeof(struct lgtd_lifx_packet_header) };
+    struct lgtd_lifx_message *msgs[2];
+    msgs[0] = enqueue_mock_message(
+        &gw, LGTD_LIFX_GATEWAY_PRIORITY_HIGH, LGTD_LIFX_SET_POWER_STATE, HDR_SIZE
+    );
+    msgs[1] = enqueue_mock_message(
+        &gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW, LGTD_LIFX_GET_LIGHT_STATE, HDR_SIZE
+    );
+    for (int i = 0; i != LGTD_ARRAY_SIZE(msgs); i++) {
+        lgtd_lifx_gateway_stamp_seqn(&gw, msgs[i]);
+        struct lgtd_lifx_packet_header *hdr =
+            (struct lgtd_lifx_packet_header *)msgs[i]->data;
+        if (hdr->seqn != i) {
+            errx(1, "seqn = %d (expected %d)", hdr->seqn, i);
+        }
+    }
+    lgtd_lifx_gateway_consume_pkt_queues(&gw, 2);
+
+    if (gw.rtt.next_seqn != 2) {
+        errx(1, "next_seqn = %d (expected 2)", gw.rtt.next_seqn);
+    }
+    lgtd_time_mono_t sent_at = gw.rtt.sent_at[0];
+    if (!sent_at || gw.rtt.sent_at[1] != sent_at) {
+        errx(1, "the send times weren't recorded");
+    }
+
+    struct lgtd_lifx_packet_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    // another client's traffic isn't a sample:
+    hdr.source = lgtd_lifx_wire_get_client_id() + 1;
+    lgtd_lifx_gateway_match_response(&gw, &hdr, sent_at + 20);
+    check_rtt(&gw, 0, 0, LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS);
+
+    // first sample: srtt = 20ms, rttvar = 10ms:
+    hdr.source = lgtd_lifx_wire_get_client_id();
+    lgtd_lifx_gateway_match_response(&gw, &hdr, sent_at + 20);
+    check_rtt(&gw, 1, 20, 60);
+
+    // only the first response to a request is a sample:
+    lgtd_lifx_gateway_match_response(&gw, &hdr, sent_at + 500);
+    check_rtt(&gw, 1, 20, 60);
+
+    // srtt = 20 + 16 / 8, rttvar = 10 + (16 - 10) / 4:
+    hdr.seqn = 1;
+    lgtd_lifx_gateway_match_response(&gw, &hdr, sent_at + 36);
+    check_rtt(&gw, 2, 22, 68);
+
+    if (gw.rtt.histogram[5] != 1 || gw.rtt.histogram[6] != 1) {
+        errx(
+            1, "histogram[5] = %d, histogram[6] = %d (expected 1, 1)",
+            gw.rtt.histogram[5], gw.rtt.histogram[6]
+        );
+    }
+
+    // a response that comes back way too late is dropped:
+    hdr.seqn = 7;
+    gw.rtt.sent_at[hdr.seqn] = sent_at;
+    lgtd_lifx_gateway_match_response(
+        &gw, &hdr, sent_at + LGTD_LIFX_GATEWAY_MAX_RTT_SAMPLE_MSECS + 1
+    );
+    check_rtt(&gw, 2, 22, 68);
+    if (gw.rtt.sent_at[hdr.seqn]) {
+        errx(1, "the request should have been forgotten");
+    }
+
+    // huge samples end up in the last bucket:
+    lgtd_lifx_gateway_add_rtt_sample(&gw, LGTD_LIFX_GATEWAY_MAX_RTT_SAMPLE_MSECS);
+    if (gw.rtt.histogram[LGTD_LIFX_GATEWAY_RTT_HISTOGRAM_SIZE - 1] != 1) {
+        errx(1, "the sample should be in the last bucket");
+    }
+
+    return 0;
+}
@@ -2,6 +2,7 @@
 
 #include "test_gateway_utils.h"
 #include "mock_log.h"
+#include "mock_subscription.h"
 #include "mock_timer.h"
 #define MOCKED_LGTD_LIFX_WIRE_ENCODE_TAG_LABELS
 #include "mock_wire_proto.h"
@@ -23,6 +24,7 @@ main(void)
 
     struct lgtd_lifx_gateway gw;
     memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
 
     lgtd_lifx_gateway_update_tag_refcounts(&gw, 0, 0);
     for (int i = 0; i != LGTD_LIFX_GATEWAY_MAX_TAGS; i++) {
@@ -78,12 +80,14 @@ main(void)
             }
         }
     }
-    if (gw.pkt_ring[0].type != LGTD_LIFX_SET_TAG_LABELS) {
+    struct lgtd_lifx_message *msg;
+    msg = TAILQ_FIRST(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH]);
+    if (!msg || msg->type != LGTD_LIFX_SET_TAG_LABELS) {
         errx(1, "SET_TAG_LABELS should have been enqueued on the gateway");
     }
 
     struct lgtd_lifx_packet_tag_labels *pkt =
-        (void *)&gw_write_buf[sizeof(struct lgtd_lifx_packet_header)];
+        (void *)&msg->data[sizeof(struct lgtd_lifx_packet_header)];
     if (lifx_wire_encode_tag_labels_call_count != 1) {
         errx(
             1, "lifx_wire_encode_tag_labels_call_count == %d (expected 1)",
@@ -1,48 +1,52 @@
 #pragma once
 
-static char gw_write_buf[4096] = { 0 };
-static int gw_write_buf_idx = 0;
-
 static inline void
-reset_gw_write_buf(void)
+init_gw_pkt_queues(struct lgtd_lifx_gateway *gw)
 {
-    memset(gw_write_buf, 0, sizeof(gw_write_buf));
-    gw_write_buf_idx = 0;
+    for (int prio = 0; prio != LGTD_LIFX_GATEWAY_PRIORITY_COUNT; prio++) {
+        TAILQ_INIT(&gw->pkt_queues[prio]);
+    }
+    TAILQ_INIT(&gw->unacked_msgs);
 }
 
-int
-evbuffer_add(struct evbuffer *buf, const void *data, size_t datlen)
-{
-    (void)buf;
-    int to_write = LGTD_MIN(
-        datlen, sizeof(gw_write_buf) - gw_write_buf_idx
-    );
-    memcpy(&gw_write_buf[gw_write_buf_idx], data, to_write);
-    gw_write_buf_idx += to_write;
-    return 0;
+static inline struct lgtd_lifx_message *
+enqueue_mock_message(struct lgtd_lifx_gateway *gw,
+                     enum lgtd_lifx_gateway_priority prio,
+                     enum lgtd_lifx_packet_type type,
+                     int size)
+{
+    struct lgtd_lifx_message *msg = calloc(1, sizeof(*msg) + size);
+    msg->type = type;
+    msg->size = size;
+    TAILQ_INSERT_TAIL(&gw->pkt_queues[prio], msg, link);
+    gw->pkt_queues_bytes += size;
+    return msg;
 }
 
-struct lgtd_lifx_tag_list lgtd_lifx_tags = LIST_HEAD_INITIALIZER(&lgtd_lifx_tags);
-
-#ifndef MOCKED_EVBUFFER_GET_LENGTH
-size_t
-evbuffer_get_length(const struct evbuffer *buf)
+static inline int
+count_gw_pkt_queue(const struct lgtd_lifx_gateway *gw,
+                   enum lgtd_lifx_gateway_priority prio)
 {
-    (void)buf;
-    return gw_write_buf_idx + 1;
+    int count = 0;
+    const struct lgtd_lifx_message *msg;
+    TAILQ_FOREACH(msg, &gw->pkt_queues[prio], link) {
+        count++;
+    }
+    return count;
 }
-#endif
 
-#ifndef MOCKED_EVBUFFER_WRITE_ATMOST
+struct lgtd_lifx_tag_list lgtd_lifx_tags = LIST_HEAD_INITIALIZER(&lgtd_lifx_tags);
+
+#if LGTD_HAVE_SENDMMSG && !defined(MOCKED_SENDMMSG)
 int
-evbuffer_write_atmost(struct evbuffer *buf,
-                      evutil_socket_t fd,
-                      ev_ssize_t howmuch)
+sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
 {
-    (void)buf;
     (void)fd;
-    (void)howmuch;
-    return howmuch;
+    (void)flags;
+    for (unsigned int i = 0; i != vlen; i++) {
+        msgvec[i].msg_len = msgvec[i].msg_hdr.msg_iov->iov_len;
+    }
+    return vlen;
 }
 #endif
 
@@ -55,10 +59,10 @@ lgtd_lifx_tagging_incref(const char *label,
     struct lgtd_lifx_tag *tag = calloc(1, sizeof(*tag));
     strcpy(tag->label, label);
     LIST_INSERT_HEAD(&lgtd_lifx_tags, tag, link);
-    struct lgtd_lifx_site *site = calloc(1, sizeof(*site));
-    site->gw = gw;
-    site->tag_id = tag_id;
-    LIST_INSERT_HEAD(&tag->sites, site, link);
+    tag->sites = calloc(1, sizeof(*tag->sites));
+    tag->sites->gw = gw;
+    tag->sites->tag_id = tag_id;
+    tag->nsites = tag->sites_capacity = 1;
     return tag;
 }
 #endif
@@ -73,18 +77,6 @@ lgtd_lifx_tagging_decref(struct lgtd_lifx_tag *tag,
 }
 #endif
 
-struct evbuffer *
-evbuffer_new(void)
-{
-    return NULL;
-}
-
-void
-evbuffer_free(struct evbuffer *buf)
-{
-    (void)buf;
-}
-
 struct lgtd_lifx_tag *
 lgtd_lifx_tagging_find_tag(const char *tag_label)
 {
@@ -97,6 +89,15 @@ lgtd_lifx_tagging_find_tag(const char *tag_label)
     return tag;
 }
 
+struct lgtd_lifx_tag *
+lgtd_lifx_tagging_allocate_tag(const char *tag_label)
+{
+    struct lgtd_lifx_tag *tag = calloc(1, sizeof(*tag));
+    strcpy(tag->label, tag_label);
+    LIST_INSERT_HEAD(&lgtd_lifx_tags, tag, link);
+    return tag;
+}
+
 static struct event *last_event_passed_to_event_add = NULL;
 
 int
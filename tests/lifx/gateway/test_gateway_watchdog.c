@@ -0,0 +1,101 @@
+#include "gateway.c"
+
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#define MOCKED_LGTD_TIMER_ACTIVATE
+#define MOCKED_LGTD_TIMER_RESCHEDULE
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+static struct lgtd_timer *last_timer_passed_to_timer_activate = NULL;
+
+void
+lgtd_timer_activate(struct lgtd_timer *timer)
+{
+    last_timer_passed_to_timer_activate = timer;
+}
+
+static struct lgtd_timer refresh_timer, watchdog_timer;
+static int refresh_timer_msecs = -1, watchdog_timer_msecs = -1;
+
+bool
+lgtd_timer_reschedule(struct lgtd_timer *timer, const struct timeval *tv)
+{
+    if (timer == &refresh_timer) {
+        refresh_timer_msecs = LGTD_TIMEVAL_TO_MSECS(tv);
+    } else if (timer == &watchdog_timer) {
+        watchdog_timer_msecs = LGTD_TIMEVAL_TO_MSECS(tv);
+    } else {
+        errx(1, "unexpected timer %p", (void *)timer);
+    }
+    return true;
+}
+
+static void
+check_rescheduled(int *msecs, int min_msecs, int max_msecs)
+{
+    if (*msecs < min_msecs || *msecs > max_msecs) {
+        errx(
+            1, "the timer was re-scheduled in %dms (expected [%d, %d])",
+            *msecs, min_msecs, max_msecs
+        );
+    }
+    *msecs = -1;
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    struct lgtd_lifx_gateway gw;
+    memset(&gw, 0, sizeof(gw));
+    init_gw_pkt_queues(&gw);
+    strcpy(gw.peeraddr, "[127.0.0.1]:56700");
+    gw.refresh_timer = &refresh_timer;
+    gw.watchdog_timer = &watchdog_timer;
+    gw.refresh_interval = 5000;
+    union lgtd_timer_ctx ctx = { .as_ptr = &gw };
+
+    // the gateway answered in the meantime, wait until the new deadline:
+    int timeout = lgtd_lifx_gateway_watchdog_timeout(&gw);
+    if (timeout != 5000 + LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS) {
+        errx(1, "got timeout %d", timeout);
+    }
+    gw.last_pkt_at = lgtd_time_monotonic_msecs() - 1000;
+    lgtd_lifx_gateway_watchdog_callback(&watchdog_timer, ctx);
+    if (last_timer_passed_to_timer_activate) {
+        errx(1, "the refresh shouldn't have been forced");
+    }
+    check_rescheduled(&watchdog_timer_msecs, timeout - 1000 - 100, timeout - 1000);
+
+    // the gateway is silent, force a refresh and check again soon:
+    gw.last_pkt_at = lgtd_time_monotonic_msecs() - timeout;
+    lgtd_lifx_gateway_watchdog_callback(&watchdog_timer, ctx);
+    if (last_timer_passed_to_timer_activate != &refresh_timer) {
+        errx(1, "the refresh should have been forced");
+    }
+    check_rescheduled(
+        &watchdog_timer_msecs,
+        LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_RETRY_MSECS,
+        LGTD_MAX(
+            (int)LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_RETRY_MSECS,
+            (int)LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS
+        )
+    );
+
+    // the deadline moves closer with the refresh interval:
+    gw.last_pkt_at = lgtd_time_monotonic_msecs();
+    gw.last_command_at = gw.last_pkt_at;
+    lgtd_lifx_gateway_speed_up_refresh(&gw);
+    int min_interval = lgtd_opts.lifx_refresh_min_msecs;
+    check_rescheduled(&refresh_timer_msecs, min_interval, min_interval);
+    timeout = LGTD_MAX(
+        min_interval + LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS,
+        LGTD_LIFX_DISCOVERY_DEVICE_FORCE_REFRESH_MSECS
+    );
+    check_rescheduled(&watchdog_timer_msecs, timeout - 100, timeout);
+
+    return 0;
+}
@@ -1,79 +1,75 @@
 #include "gateway.c"
 
-#define MOCKED_EVBUFFER_WRITE_ATMOST
-#define MOCKED_EVBUFFER_GET_LENGTH
-#include "test_gateway_utils.h"
-#include "mock_log.h"
-#include "mock_timer.h"
-#include "mock_wire_proto.h"
-
-size_t
-evbuffer_get_length(const struct evbuffer *buf)
-{
-    if (buf != (void *)42) {
-        errx(1, "didn't get the expected evbuffer");
-    }
+#include "mock_gateway_write.h"
 
-    // fake another packet to write:
-    return sizeof(struct lgtd_lifx_packet_header);
-}
+static struct lgtd_lifx_message *expected_msg = NULL;
+
+static int sendmmsg_call_count = 0;
 
 int
-evbuffer_write_atmost(struct evbuffer *buf,
-                      evutil_socket_t fd,
-                      ev_ssize_t howmuch)
+sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
 {
-    if (fd != 25) {
-        errx(1, "evbuffer_write_atmost didn't get the expected socket");
+    if (fd != MOCK_WRITE_GW_SOCKET) {
+        errx(1, "sendmmsg didn't get the expected socket");
     }
 
-    if (buf != (void *)42) {
-        errx(1, "evbuffer_write_atmost didn't get the expected evbuffer");
+    if (flags != 0) {
+        errx(1, "sendmmsg got unexpected flags %#x", flags);
     }
 
-    int expected = sizeof(struct lgtd_lifx_packet_header);
-    expected += sizeof(struct lgtd_lifx_packet_power_state);
-    if (howmuch != expected) {
+    if (vlen != 1) {
+        errx(1, "sendmmsg expected %d messages but got %u", 1, vlen);
+    }
+
+    const struct msghdr *hdr = &msgvec[0].msg_hdr;
+    if (hdr->msg_name || hdr->msg_iovlen != 1) {
+        errx(1, "the message isn't setup correctly");
+    }
+    if (hdr->msg_iov->iov_base != expected_msg->data) {
+        errx(1, "the message doesn't point to the right data");
+    }
+    if (hdr->msg_iov->iov_len != PKT_SIZE) {
         errx(
-            1, "evbuffer_write_atmost expected %d but got %jd",
-            expected, (intmax_t)howmuch
+            1, "the message expected %d bytes but got %ju",
+            PKT_SIZE, (uintmax_t)hdr->msg_iov->iov_len
         );
     }
 
-    return howmuch;
+    msgvec[0].msg_len = PKT_SIZE;
+
+    sendmmsg_call_count++;
+    return 1;
 }
 
 int
 main(void)
 {
-    lgtd_lifx_wire_setup();
-
     struct lgtd_lifx_gateway gw;
-    memset(&gw, 0, sizeof(gw));
+    setup_mock_write_gw(&gw);
 
-    // fake some values:
-    gw.socket = 25;
-    gw.socket_ev = (void *)21;
-    gw.write_buf = (void *)42;
-
-    gw.pkt_ring[0].size += sizeof(struct lgtd_lifx_packet_header);
-    gw.pkt_ring[0].size += sizeof(struct lgtd_lifx_packet_power_state);
-    gw.pkt_ring[0].type = LGTD_LIFX_SET_POWER_STATE;
-    gw.pkt_ring_head++;
-    gw.pkt_ring_head++;
+    expected_msg = enqueue_mock_message(
+        &gw,
+        LGTD_LIFX_GATEWAY_PRIORITY_HIGH,
+        LGTD_LIFX_SET_POWER_STATE,
+        PKT_SIZE
+    );
 
     lgtd_lifx_gateway_socket_event_callback(-1, EV_WRITE, &gw);
 
-    if (gw.pkt_ring[0].size != 0 || gw.pkt_ring[0].type != 0) {
-        errx(1, "the ring entry should have been reset");
+    if (sendmmsg_call_count != 1) {
+        errx(1, "the packet should have been sent once");
+    }
+
+    if (!TAILQ_EMPTY(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH])) {
+        errx(1, "the packet should have been dequeued");
     }
 
-    if (gw.pkt_ring_tail != 1) {
-        errx(1, "the tail shoud have been moved by one");
+    if (gw.pkt_queues_bytes != 0) {
+        errx(1, "pkt_queues_bytes = %d (expected 0)", gw.pkt_queues_bytes);
     }
 
-    if (last_event_passed_to_event_del != NULL) {
-        errx(1, "event_del shouldn't have ben called");
+    if (last_event_passed_to_event_del != gw.socket_ev) {
+        errx(1, "event_del should have been called on gw.socket_ev");
     }
 
     return 0;
@@ -0,0 +1,99 @@
+#include "gateway.c"
+
+#include "mock_gateway_write.h"
+
+enum { NPKTS = LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE + 4 };
+
+static struct lgtd_lifx_message *queued_msgs[NPKTS];
+
+static int sendmmsg_call_count = 0;
+
+int
+sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+    (void)fd;
+    (void)flags;
+
+    int offset = sendmmsg_call_count * LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE;
+    int expected = LGTD_MIN(
+        NPKTS - offset, LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE
+    );
+    if ((int)vlen != expected) {
+        errx(1, "sendmmsg expected %d messages but got %u", expected, vlen);
+    }
+
+    for (unsigned int i = 0; i != vlen; i++) {
+        const struct msghdr *hdr = &msgvec[i].msg_hdr;
+        if (hdr->msg_iov->iov_base != queued_msgs[offset + i]->data) {
+            errx(1, "message %u isn't in the right order", i);
+        }
+        const struct lgtd_lifx_packet_header *pkt_hdr =
+            (const struct lgtd_lifx_packet_header *)hdr->msg_iov->iov_base;
+        if (pkt_hdr->seqn != offset + i) {
+            errx(
+                1, "message %u has seqn %d (expected %d)",
+                i, pkt_hdr->seqn, offset + i
+            );
+        }
+        msgvec[i].msg_len = hdr->msg_iov->iov_len;
+    }
+
+    sendmmsg_call_count++;
+    return vlen;
+}
+
+int
+main(void)
+{
+    struct lgtd_lifx_gateway gw;
+    setup_mock_write_gw(&gw);
+
+    // the high priority packets are enqueued last but sent first:
+    for (int i = NPKTS / 2; i != NPKTS; i++) {
+        queued_msgs[i] = enqueue_mock_message(
+            &gw,
+            LGTD_LIFX_GATEWAY_PRIORITY_LOW,
+            LGTD_LIFX_GET_LIGHT_STATE,
+            PKT_SIZE
+        );
+    }
+    for (int i = 0; i != NPKTS / 2; i++) {
+        queued_msgs[i] = enqueue_mock_message(
+            &gw,
+            LGTD_LIFX_GATEWAY_PRIORITY_HIGH,
+            LGTD_LIFX_SET_POWER_STATE,
+            PKT_SIZE
+        );
+    }
+
+    lgtd_lifx_gateway_socket_event_callback(-1, EV_WRITE, &gw);
+
+    if (sendmmsg_call_count != 1) {
+        errx(1, "sendmmsg should have been called once");
+    }
+
+    int left = NPKTS - LGTD_LIFX_GATEWAY_WRITE_BATCH_SIZE;
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW) != left) {
+        errx(1, "%d packets should be left to send", left);
+    }
+
+    if (last_event_passed_to_event_del != NULL) {
+        errx(1, "event_del shouldn't have ben called");
+    }
+
+    lgtd_lifx_gateway_socket_event_callback(-1, EV_WRITE, &gw);
+
+    if (sendmmsg_call_count != 2) {
+        errx(1, "sendmmsg should have been called twice");
+    }
+
+    if (gw.pkt_queues_bytes != 0) {
+        errx(1, "pkt_queues_bytes = %d (expected 0)", gw.pkt_queues_bytes);
+    }
+
+    if (last_event_passed_to_event_del != gw.socket_ev) {
+        errx(1, "event_del should have been called on gw.socket_ev");
+    }
+
+    return 0;
+}
@@ -1,85 +1,78 @@
 #include "gateway.c"
 
-#define MOCKED_EVBUFFER_WRITE_ATMOST
-#define MOCKED_EVBUFFER_GET_LENGTH
-#include "test_gateway_utils.h"
-#include "mock_log.h"
-#include "mock_timer.h"
-#include "mock_wire_proto.h"
-
-size_t
-evbuffer_get_length(const struct evbuffer *buf)
-{
-    if (buf != (void *)42) {
-        errx(1, "didn't get the expected evbuffer");
-    }
+#include "mock_gateway_write.h"
+
+// The first sendmmsg call only sends the first of the two queued packets,
+// the second call sends the remaining one:
+static int sendmmsg_call_count = 0;
 
-    // fake another packet to write:
-    return sizeof(struct lgtd_lifx_packet_header);
+static int
+expected_npkts(void)
+{
+    return sendmmsg_call_count ? 1 : 2;
 }
 
 int
-evbuffer_write_atmost(struct evbuffer *buf,
-                      evutil_socket_t fd,
-                      ev_ssize_t howmuch)
+sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
 {
-    if (fd != 25) {
-        errx(1, "evbuffer_write_atmost didn't get the expected socket");
-    }
+    (void)flags;
 
-    if (buf != (void *)42) {
-        errx(1, "evbuffer_write_atmost didn't get the expected evbuffer");
+    if (fd != MOCK_WRITE_GW_SOCKET) {
+        errx(1, "sendmmsg didn't get the expected socket");
     }
 
-    static int expected = (
-        sizeof(struct lgtd_lifx_packet_header)
-        + sizeof(struct lgtd_lifx_packet_power_state)
-    );
-    if (howmuch != expected) {
+    if ((int)vlen != expected_npkts()) {
         errx(
-            1, "evbuffer_write_atmost expected %d but got %jd",
-            expected, (intmax_t)howmuch
+            1, "sendmmsg expected %d messages but got %u",
+            expected_npkts(), vlen
         );
     }
 
-    if (expected != sizeof(struct lgtd_lifx_packet_power_state)) {
-        expected -= sizeof(struct lgtd_lifx_packet_header);
-        return sizeof(struct lgtd_lifx_packet_header);
-    }
+    sendmmsg_call_count++;
 
-    return howmuch;
+    msgvec[0].msg_len = msgvec[0].msg_hdr.msg_iov->iov_len;
+    return 1;
 }
 
 int
 main(void)
 {
-    lgtd_lifx_wire_setup();
-
     struct lgtd_lifx_gateway gw;
-    memset(&gw, 0, sizeof(gw));
-
-    // fake some values:
-    gw.socket = 25;
-    gw.write_buf = (void *)42;
+    setup_mock_write_gw(&gw);
 
-    gw.pkt_ring[0].size += sizeof(struct lgtd_lifx_packet_header);
-    gw.pkt_ring[0].size += sizeof(struct lgtd_lifx_packet_power_state);
-    gw.pkt_ring[0].type = LGTD_LIFX_SET_POWER_STATE;
-    gw.pkt_ring_head++;
-    gw.pkt_ring_head++;
+    enqueue_mock_message(
+        &gw,
+        LGTD_LIFX_GATEWAY_PRIORITY_LOW,
+        LGTD_LIFX_GET_TAG_LABELS,
+        PKT_SIZE
+    );
+    enqueue_mock_message(
+        &gw,
+        LGTD_LIFX_GATEWAY_PRIORITY_HIGH,
+        LGTD_LIFX_SET_POWER_STATE,
+        PKT_SIZE
+    );
+    gw.pending_refresh_req = true;
 
     lgtd_lifx_gateway_socket_event_callback(-1, EV_WRITE, &gw);
 
-    if (gw.pkt_ring[0].type != LGTD_LIFX_SET_POWER_STATE) {
-        errx(1, "the ring entry doesn't have the right packet type");
+    if (!TAILQ_EMPTY(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_HIGH])) {
+        errx(1, "the high priority packet should have been sent first");
+    }
+
+    if (count_gw_pkt_queue(&gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW) != 1) {
+        errx(1, "the low priority packet shouldn't have been touched");
     }
 
-    if (gw.pkt_ring[0].size != sizeof(struct lgtd_lifx_packet_power_state)) {
-        errx(1, "the ring entry doesn't have the right size value");
+    if (gw.pkt_queues_bytes != PKT_SIZE) {
+        errx(
+            1, "pkt_queues_bytes = %d (expected %d)",
+            gw.pkt_queues_bytes, PKT_SIZE
+        );
     }
 
-    if (gw.pkt_ring_tail != 0) {
-        errx(1, "the tail shoudn't have been moved by one");
+    if (!gw.pending_refresh_req) {
+        errx(1, "the refresh request hasn't been sent yet");
     }
 
     if (last_event_passed_to_event_del != NULL) {
@@ -88,16 +81,16 @@ main(void)
 
     lgtd_lifx_gateway_socket_event_callback(-1, EV_WRITE, &gw);
 
-    if (gw.pkt_ring[0].size != 0 || gw.pkt_ring[0].type != 0) {
-        errx(1, "the ring entry should have been reset");
+    if (!TAILQ_EMPTY(&gw.pkt_queues[LGTD_LIFX_GATEWAY_PRIORITY_LOW])) {
+        errx(1, "the low priority packet should have been sent");
     }
 
-    if (gw.pkt_ring_tail != 1) {
-        errx(1, "the tail shoud have been moved by one");
+    if (gw.pending_refresh_req) {
+        errx(1, "the refresh request has been sent");
     }
 
-    if (last_event_passed_to_event_del != NULL) {
-        errx(1, "event_del shouldn't have ben called");
+    if (last_event_passed_to_event_del != gw.socket_ev) {
+        errx(1, "event_del should have been called on gw.socket_ev");
     }
 
     return 0;
@@ -0,0 +1,121 @@
+#include "gateway.c"
+
+#include "mock_gateway_write.h"
+
+static struct sockaddr_in unreachable_peer = {
+    .sin_family = AF_INET,
+    .sin_addr = { .s_addr = 0x0100007f },
+    .sin_port = 0xbcdd
+};
+
+static int sendmmsg_call_count = 0;
+
+int
+sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+    (void)flags;
+
+    if (fd != MOCK_WRITE_GW_SOCKET) {
+        errx(1, "sendmmsg didn't get the expected socket");
+    }
+
+    sendmmsg_call_count++;
+
+    const struct sockaddr_in *peer = msgvec[0].msg_hdr.msg_name;
+    if (peer->sin_addr.s_addr == unreachable_peer.sin_addr.s_addr) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    for (unsigned int i = 0; i != vlen; i++) {
+        msgvec[i].msg_len = msgvec[i].msg_hdr.msg_iov->iov_len;
+    }
+    return vlen;
+}
+
+static int broadcast_discovery_call_count = 0;
+
+bool
+lgtd_lifx_broadcast_discovery(void)
+{
+    broadcast_discovery_call_count++;
+    return true;
+}
+
+static struct lgtd_lifx_gateway *
+setup_shared_gw(const struct sockaddr_in *peer)
+{
+    struct lgtd_lifx_gateway *gw = calloc(1, sizeof(*gw));
+    init_gw_pkt_queues(gw);
+    gw->shared_socket = true;
+    gw->socket = MOCK_WRITE_GW_SOCKET;
+    gw->peer = malloc(sizeof(*peer));
+    memcpy(gw->peer, peer, sizeof(*peer));
+    gw->peerlen = sizeof(*peer);
+    lgtd_lifx_gateway_index_peer(gw);
+    LIST_INSERT_HEAD(&lgtd_lifx_gateways, gw, link);
+    TAILQ_INSERT_TAIL(&lgtd_lifx_gateways_by_last_pkt, gw, link_by_last_pkt);
+    lgtd_lifx_gateway_shared_endpoint.refcount++;
+    lgtd_lifx_gateway_count_refresh_reason(gw->refresh_reason, 1);
+    LGTD_STATS_ADD_AND_UPDATE_PROCTITLE(gateways, 1);
+
+    enqueue_mock_message(
+        gw, LGTD_LIFX_GATEWAY_PRIORITY_LOW, LGTD_LIFX_GET_LIGHT_STATE, PKT_SIZE
+    );
+    TAILQ_INSERT_TAIL(
+        &lgtd_lifx_gateway_shared_endpoint.pending_writes,
+        gw,
+        link_by_pending_write
+    );
+    gw->pending_write = true;
+
+    return gw;
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    lgtd_lifx_gateway_shared_endpoint.socket = MOCK_WRITE_GW_SOCKET;
+    lgtd_lifx_gateway_shared_endpoint.write_ev = (void *)21;
+
+    struct sockaddr_in reachable_peer = unreachable_peer;
+    reachable_peer.sin_addr.s_addr = 0x0200007f;
+
+    setup_shared_gw(&unreachable_peer);
+    struct lgtd_lifx_gateway *gw = setup_shared_gw(&reachable_peer);
+
+    lgtd_lifx_gateway_shared_socket_event_callback(-1, EV_WRITE, NULL);
+
+    if (sendmmsg_call_count != 2) {
+        errx(1, "sendmmsg should have been called for both gateways");
+    }
+
+    if (LIST_FIRST(&lgtd_lifx_gateways) != gw
+        || LIST_NEXT(gw, link) != NULL) {
+        errx(1, "only the unreachable gateway should have been closed");
+    }
+
+    if (lgtd_lifx_gateway_shared_endpoint.refcount != 1) {
+        errx(
+            1, "the shared endpoint refcount is %d (expected 1)",
+            lgtd_lifx_gateway_shared_endpoint.refcount
+        );
+    }
+
+    if (gw->pending_write || gw->pkt_queues_bytes) {
+        errx(1, "the reachable gateway should have been flushed");
+    }
+
+    if (last_event_passed_to_event_del
+        != lgtd_lifx_gateway_shared_endpoint.write_ev) {
+        errx(1, "event_del should have been called on the write event");
+    }
+
+    if (broadcast_discovery_call_count != 1) {
+        errx(1, "the discovery should have been restarted once");
+    }
+
+    return 0;
+}
@@ -9,6 +9,9 @@ struct lgtd_lifx_tag;
 struct lgtd_lifx_gateway_list lgtd_lifx_gateways =
     LIST_HEAD_INITIALIZER(&lgtd_lifx_gateways);
 
+struct lgtd_lifx_gateway_queue lgtd_lifx_gateways_by_last_pkt =
+    TAILQ_HEAD_INITIALIZER(lgtd_lifx_gateways_by_last_pkt);
+
 #ifndef MOCKED_LGTD_LIFX_GATEWAY_LATENCY
 lgtd_time_mono_t
 lgtd_lifx_gateway_latency(const struct lgtd_lifx_gateway *gw)
@@ -18,6 +21,43 @@ lgtd_lifx_gateway_latency(const struct lgtd_lifx_gateway *gw)
 }
 #endif
 
+#ifndef MOCKED_LGTD_LIFX_GATEWAY_RTO
+lgtd_time_mono_t
+lgtd_lifx_gateway_rto(const struct lgtd_lifx_gateway *gw)
+{
+    (void)gw;
+    return LGTD_LIFX_GATEWAY_DEFAULT_RTO_MSECS;
+}
+#endif
+
+#ifndef MOCKED_LGTD_LIFX_GATEWAY_SYNC_LEAD_TIME
+lgtd_time_mono_t
+lgtd_lifx_gateway_sync_lead_time(void)
+{
+    return LGTD_LIFX_GATEWAY_MIN_SYNC_LEAD_MSECS;
+}
+#endif
+
+#ifndef MOCKED_LGTD_LIFX_GATEWAY_HANDLE_ACK
+void
+lgtd_lifx_gateway_handle_ack(struct lgtd_lifx_gateway *gw,
+                             const struct lgtd_lifx_packet_header *hdr,
+                             const void *pkt)
+{
+    (void)gw;
+    (void)hdr;
+    (void)pkt;
+}
+#endif
+
+#ifndef MOCKED_LGTD_LIFX_GATEWAY_MARK_CLIENT_READ
+void
+lgtd_lifx_gateway_mark_client_read(struct lgtd_lifx_gateway *gw)
+{
+    (void)gw;
+}
+#endif
+
 #ifndef MOCKED_LGTD_LIFX_GATEWAY_HANDLE_PACKET
 void
 lgtd_lifx_gateway_handle_packet(struct lgtd_lifx_gateway *gw,
@@ -232,3 +272,15 @@ lgtd_lifx_gateway_handle_ambient_light(struct lgtd_lifx_gateway *gw,
     (void)pkt;
 }
 #endif
+
+#ifndef MOCKED_LGTD_LIFX_GATEWAY_HANDLE_TIME_STATE
+void
+lgtd_lifx_gateway_handle_time_state(struct lgtd_lifx_gateway *gw,
+                                    const struct lgtd_lifx_packet_header *hdr,
+                                    const struct lgtd_lifx_packet_time_state *pkt)
+{
+    (void)gw;
+    (void)hdr;
+    (void)pkt;
+}
+#endif
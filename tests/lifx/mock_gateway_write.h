@@ -0,0 +1,32 @@
+#pragma once
+
+// Fixture shared by the tests of the gateway write callback, each test
+// defines its own sendmmsg to look at the packets flushed from the gateway
+// returned by setup_mock_write_gw:
+
+#define MOCKED_SENDMMSG
+#include "test_gateway_utils.h"
+#include "mock_log.h"
+#include "mock_subscription.h"
+#include "mock_timer.h"
+#include "mock_wire_proto.h"
+
+enum { MOCK_WRITE_GW_SOCKET = 25 };
+
+enum { PKT_SIZE = (
+    sizeof(struct lgtd_lifx_packet_header)
+    + sizeof(struct lgtd_lifx_packet_power_state)
+) };
+
+static inline void
+setup_mock_write_gw(struct lgtd_lifx_gateway *gw)
+{
+    lgtd_lifx_wire_setup();
+
+    memset(gw, 0, sizeof(*gw));
+    init_gw_pkt_queues(gw);
+
+    // fake some values:
+    gw->socket = MOCK_WRITE_GW_SOCKET;
+    gw->socket_ev = (void *)21;
+}
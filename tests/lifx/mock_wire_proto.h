@@ -9,6 +9,14 @@ lgtd_lifx_wire_setup(void)
 }
 #endif
 
+#ifndef MOCKED_LGTD_LIFX_WIRE_GET_CLIENT_ID
+uint32_t
+lgtd_lifx_wire_get_client_id(void)
+{
+    return 0x2a2a2a2a;
+}
+#endif
+
 #ifndef MOCKED_LGTD_LIFX_WIRE_WAVEFORM_STRING_ID_TO_TYPE
 enum lgtd_lifx_waveform_type
 lgtd_lifx_wire_waveform_string_id_to_type(const char *s, int len)
@@ -61,7 +69,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_PAN_GATEWAY",
-            .type = LGTD_LIFX_GET_PAN_GATEWAY
+            .type = LGTD_LIFX_GET_PAN_GATEWAY,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -74,11 +83,13 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             .name = "SET_TAG_LABELS",
             .type = LGTD_LIFX_SET_TAG_LABELS,
             .size = sizeof(struct lgtd_lifx_packet_tag_labels),
+            .ack_required = true,
         },
         {
             UNIMPLEMENTED,
             .name = "GET_TAG_LABELS",
             .type = LGTD_LIFX_GET_TAG_LABELS,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW,
             .size = sizeof(struct lgtd_lifx_packet_tags),
         },
         {
@@ -92,18 +103,22 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             UNIMPLEMENTED,
             .name = "SET_LIGHT_COLOR",
             .type = LGTD_LIFX_SET_LIGHT_COLOR,
-            .size = sizeof(struct lgtd_lifx_packet_light_color)
+            .size = sizeof(struct lgtd_lifx_packet_light_color),
+            .ack_required = true,
+            .last_write_wins = true
         },
         {
             UNIMPLEMENTED,
             .name = "SET_WAVEFORM",
             .type = LGTD_LIFX_SET_WAVEFORM,
             .size = sizeof(struct lgtd_lifx_packet_waveform),
+            .ack_required = true,
         },
         {
             UNIMPLEMENTED,
             .name = "GET_LIGHT_STATUS",
-            .type = LGTD_LIFX_GET_LIGHT_STATE
+            .type = LGTD_LIFX_GET_LIGHT_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -116,6 +131,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             .size = sizeof(struct lgtd_lifx_packet_power_state),
             .name = "SET_POWER_STATE",
             .type = LGTD_LIFX_SET_POWER_STATE,
+            .ack_required = true,
+            .last_write_wins = true
         },
         {
             UNIMPLEMENTED,
@@ -128,6 +145,7 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             .name = "SET_TAGS",
             .type = LGTD_LIFX_SET_TAGS,
             .size = sizeof(struct lgtd_lifx_packet_tags),
+            .ack_required = true,
         },
         {
             UNIMPLEMENTED,
@@ -138,7 +156,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_MESH_INFO",
-            .type = LGTD_LIFX_GET_MESH_INFO
+            .type = LGTD_LIFX_GET_MESH_INFO,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -149,7 +168,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_MESH_FIRMWARE",
-            .type = LGTD_LIFX_GET_MESH_FIRMWARE
+            .type = LGTD_LIFX_GET_MESH_FIRMWARE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -161,6 +181,7 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             UNIMPLEMENTED,
             .name = "GET_WIFI_INFO",
             .type = LGTD_LIFX_GET_WIFI_INFO,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW,
         },
         {
             UNIMPLEMENTED,
@@ -171,7 +192,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_WIFI_FIRMWARE_STATE",
-            .type = LGTD_LIFX_GET_WIFI_FIRMWARE_STATE
+            .type = LGTD_LIFX_GET_WIFI_FIRMWARE_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -182,7 +204,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_VERSION",
-            .type = LGTD_LIFX_GET_VERSION
+            .type = LGTD_LIFX_GET_VERSION,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -193,7 +216,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_INFO",
-            .type = LGTD_LIFX_GET_INFO
+            .type = LGTD_LIFX_GET_INFO,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -205,7 +229,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             UNIMPLEMENTED,
             .name = "SET_BULB_LABEL",
             .type = LGTD_LIFX_SET_BULB_LABEL,
-            .size = sizeof(struct lgtd_lifx_packet_label)
+            .size = sizeof(struct lgtd_lifx_packet_label),
+            .ack_required = true
         },
         {
             UNIMPLEMENTED,
@@ -216,7 +241,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_AMBIENT_LIGHT",
-            .type = LGTD_LIFX_GET_AMBIENT_LIGHT
+            .type = LGTD_LIFX_GET_AMBIENT_LIGHT,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -224,26 +250,29 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
             .type = LGTD_LIFX_STATE_AMBIENT_LIGHT,
             .size = sizeof(struct lgtd_lifx_packet_ambient_light),
         },
-        // Unimplemented but "known" packets
         {
             UNIMPLEMENTED,
             .name = "GET_TIME",
-            .type = LGTD_LIFX_GET_TIME
+            .type = LGTD_LIFX_GET_TIME,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
-            .name = "SET_TIME",
-            .type = LGTD_LIFX_SET_TIME
+            .name = "TIME_STATE",
+            .type = LGTD_LIFX_TIME_STATE,
+            .size = sizeof(struct lgtd_lifx_packet_time_state),
         },
+        // Unimplemented but "known" packets
         {
             UNIMPLEMENTED,
-            .name = "TIME_STATE",
-            .type = LGTD_LIFX_TIME_STATE
+            .name = "SET_TIME",
+            .type = LGTD_LIFX_SET_TIME
         },
         {
             UNIMPLEMENTED,
             .name = "GET_RESET_SWITCH_STATE",
-            .type = LGTD_LIFX_GET_RESET_SWITCH_STATE
+            .type = LGTD_LIFX_GET_RESET_SWITCH_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -253,7 +282,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_DUMMY_PAYLOAD",
-            .type = LGTD_LIFX_GET_DUMMY_PAYLOAD
+            .type = LGTD_LIFX_GET_DUMMY_PAYLOAD,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -268,12 +298,14 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_BULB_LABEL",
-            .type = LGTD_LIFX_GET_BULB_LABEL
+            .type = LGTD_LIFX_GET_BULB_LABEL,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
             .name = "GET_MCU_RAIL_VOLTAGE",
-            .type = LGTD_LIFX_GET_MCU_RAIL_VOLTAGE
+            .type = LGTD_LIFX_GET_MCU_RAIL_VOLTAGE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -333,7 +365,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_LOCATION",
-            .type = LGTD_LIFX_GET_LOCATION
+            .type = LGTD_LIFX_GET_LOCATION,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -348,7 +381,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_GROUP",
-            .type = LGTD_LIFX_GET_GROUP
+            .type = LGTD_LIFX_GET_GROUP,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -363,7 +397,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_OWNER",
-            .type = LGTD_LIFX_GET_OWNER
+            .type = LGTD_LIFX_GET_OWNER,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -378,7 +413,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_FACTORY_TEST_MODE",
-            .type = LGTD_LIFX_GET_FACTORY_TEST_MODE
+            .type = LGTD_LIFX_GET_FACTORY_TEST_MODE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -408,7 +444,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_RAIL_VOLTAGE",
-            .type = LGTD_LIFX_GET_RAIL_VOLTAGE
+            .type = LGTD_LIFX_GET_RAIL_VOLTAGE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -418,7 +455,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_TEMPERATURE",
-            .type = LGTD_LIFX_GET_TEMPERATURE
+            .type = LGTD_LIFX_GET_TEMPERATURE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -438,7 +476,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_SIMPLE_EVENT",
-            .type = LGTD_LIFX_GET_SIMPLE_EVENT
+            .type = LGTD_LIFX_GET_SIMPLE_EVENT,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -448,7 +487,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_POWER",
-            .type = LGTD_LIFX_GET_POWER
+            .type = LGTD_LIFX_GET_POWER,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -483,7 +523,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_AUTH_KEY",
-            .type = LGTD_LIFX_GET_AUTH_KEY
+            .type = LGTD_LIFX_GET_AUTH_KEY,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -513,7 +554,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_HOST",
-            .type = LGTD_LIFX_GET_HOST
+            .type = LGTD_LIFX_GET_HOST,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -523,7 +565,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_WIFI_STATE",
-            .type = LGTD_LIFX_GET_WIFI_STATE
+            .type = LGTD_LIFX_GET_WIFI_STATE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -538,7 +581,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_ACCESS_POINTS",
-            .type = LGTD_LIFX_GET_ACCESS_POINTS
+            .type = LGTD_LIFX_GET_ACCESS_POINTS,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -553,7 +597,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_ACCESS_POINT",
-            .type = LGTD_LIFX_GET_ACCESS_POINT
+            .type = LGTD_LIFX_GET_ACCESS_POINT,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
@@ -568,7 +613,8 @@ lgtd_lifx_wire_get_packet_info(enum lgtd_lifx_packet_type packet_type)
         {
             UNIMPLEMENTED,
             .name = "GET_DIMMER_VOLTAGE",
-            .type = LGTD_LIFX_GET_DIMMER_VOLTAGE
+            .type = LGTD_LIFX_GET_DIMMER_VOLTAGE,
+            .priority = LGTD_LIFX_GATEWAY_PRIORITY_LOW
         },
         {
             UNIMPLEMENTED,
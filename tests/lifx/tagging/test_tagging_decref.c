@@ -16,11 +16,11 @@ count_tag(const char *tag_label)
 }
 
 static int
-count_site(struct lgtd_lifx_site_list *list, const struct lgtd_lifx_gateway *gw)
+count_site(struct lgtd_lifx_tag *tag, const struct lgtd_lifx_gateway *gw)
 {
     int count = 0;
     struct lgtd_lifx_site *site;
-    LIST_FOREACH(site, list, link) {
+    LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
         if (site->gw == gw) {
             count++;
         }
@@ -35,24 +35,17 @@ main(void)
     memset(&gw1, 0, sizeof(gw1));
     memset(&gw2, 0, sizeof(gw2));
 
-    struct lgtd_lifx_site *site_gw1 = calloc(1, sizeof(*site_gw1));
-    site_gw1->gw = &gw1;
-    struct lgtd_lifx_site *site_gw2 = calloc(1, sizeof(*site_gw2));
-    site_gw2->gw = &gw2;
-
     const char *rawr = "rawr";
-    struct lgtd_lifx_tag *tag = calloc(1, sizeof(*tag));
-    strcpy(tag->label, rawr);
-    LIST_INSERT_HEAD(&tag->sites, site_gw1, link);
-    LIST_INSERT_HEAD(&tag->sites, site_gw2, link);
-    LIST_INSERT_HEAD(&lgtd_lifx_tags, tag, link);
+    struct lgtd_lifx_tag *tag = lgtd_lifx_tagging_allocate_tag(rawr);
+    lgtd_lifx_tagging_incref(rawr, &gw1, 0);
+    lgtd_lifx_tagging_incref(rawr, &gw2, 0);
 
     for (int i = 0; i != 2; i++) {
         lgtd_lifx_tagging_decref(tag, &gw2);
-        if (count_site(&tag->sites, &gw2) != 0) {
+        if (count_site(tag, &gw2) != 0) {
             errx(1, "gw2 shouldn't be in the sites list");
         }
-        if (count_site(&tag->sites, &gw1) != 1) {
+        if (count_site(tag, &gw1) != 1) {
             errx(1, "gw1 wasn't found once in the sites list");
         }
         if (count_tag(rawr) != 1) {
@@ -64,6 +57,9 @@ main(void)
     if (count_tag(rawr)) {
         errx(1, "the tags list should be empty");
     }
+    if (lgtd_lifx_tagging_find_tag(rawr)) {
+        errx(1, "%s shouldn't be found in the labels index", rawr);
+    }
 
     return 0;
 }
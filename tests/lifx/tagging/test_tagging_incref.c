@@ -16,11 +16,11 @@ count_tag(const char *tag_label)
 }
 
 static int
-count_site(struct lgtd_lifx_site_list *list, const struct lgtd_lifx_gateway *gw)
+count_site(struct lgtd_lifx_tag *tag, const struct lgtd_lifx_gateway *gw)
 {
     int count = 0;
     struct lgtd_lifx_site *site;
-    LIST_FOREACH(site, list, link) {
+    LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
         if (site->gw == gw) {
             count++;
         }
@@ -43,14 +43,14 @@ main(void)
         if (count_tag(rawr) != 1) {
             errx(1, "%s wasn't found once the list of tags", rawr);
         }
-        if (count_site(&LIST_FIRST(&lgtd_lifx_tags)->sites, &gw1) != 1) {
+        if (count_site(LIST_FIRST(&lgtd_lifx_tags), &gw1) != 1) {
             errx(1, "site %p wasn't found once in the list of sites", &gw1);
         }
     }
 
     lgtd_lifx_tagging_incref(rawr, &gw2, 1);
     struct lgtd_lifx_tag *tag = lgtd_lifx_tagging_find_tag(rawr);
-    if (count_site(&tag->sites, &gw2) != 1) {
+    if (count_site(tag, &gw2) != 1) {
         errx(1, "gw2 wasn't found once in the sites of tag %s", tag->label);
     }
 
@@ -59,13 +59,13 @@ main(void)
         errx(1, "%s wasn't found once in the list of tags", awww);
     }
     tag = lgtd_lifx_tagging_find_tag(awww);
-    if (count_site(&tag->sites, &gw1) != 1) {
+    if (count_site(tag, &gw1) != 1) {
         errx(1, "gw1 wasn't found once in the sites of tag %s", awww);
     }
 
     LIST_FOREACH(tag, &lgtd_lifx_tags, link) {
         struct lgtd_lifx_site *site;
-        LIST_FOREACH(site, &tag->sites, link) {
+        LGTD_LIFX_TAGGING_FOREACH_SITE(site, tag) {
             if (site->tag_id != 1) {
                 lgtd_errx(1, "site->tag_id = %d (expected 1)", site->tag_id);
             }
@@ -10,7 +10,10 @@
 struct lgtd_opts lgtd_opts = {
     .foreground = false,
     .log_timestamps = false,
-    .verbosity = LGTD_DEBUG
+    .verbosity = LGTD_DEBUG,
+    .lifx_queue_max_bytes = 64 * 1024,
+    .lifx_refresh_min_msecs = 800,
+    .lifx_refresh_max_msecs = 10000
 };
 
 struct event_base *lgtd_ev_base = NULL;
@@ -0,0 +1,238 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+struct mmsghdr;
+struct timespec;
+
+int mock_recvmmsg(int, struct mmsghdr *, unsigned int, int, struct timespec *);
+ssize_t mock_recvfrom(int, void *, size_t, int, struct sockaddr *, socklen_t *);
+
+#define recvmmsg(socket, msgvec, vlen, flags, timeout) \
+    mock_recvmmsg(socket, msgvec, vlen, flags, timeout)
+#define recvfrom(socket, buffer, length, flags, addr, addrlen) \
+    mock_recvfrom(socket, buffer, length, flags, addr, addrlen)
+
+#include "wire_proto.c"
+
+#include "mock_daemon.h"
+#define MOCKED_LGTD_LIFX_GATEWAY_HANDLE_PACKET
+#include "mock_gateway.h"
+#include "mock_log.h"
+
+enum { MOCK_SOCKET_FD = 42 };
+enum { MOCK_DATAGRAMS_COUNT = 4 };
+
+static struct lgtd_lifx_packet_header mock_datagrams[MOCK_DATAGRAMS_COUNT];
+static int mock_datagrams_read = 0;
+static int mock_recv_call_count = 0;
+
+static const struct sockaddr_in mock_peer = {
+    .sin_family = AF_INET,
+    .sin_addr = { LGTD_STATIC_HTONL(INADDR_LOOPBACK) },
+    .sin_port = LGTD_STATIC_HTONS(LGTD_LIFX_PROTOCOL_PORT),
+    .sin_zero = { 0 }
+};
+
+static int
+mock_recv_one(void *buf, size_t length, struct sockaddr *addr, socklen_t *addrlen)
+{
+    if (length != LGTD_LIFX_MAX_PACKET_SIZE) {
+        lgtd_errx(
+            1, "got a %ju bytes buffer (expected %d)",
+            (uintmax_t)length, LGTD_LIFX_MAX_PACKET_SIZE
+        );
+    }
+    if (*addrlen < (socklen_t)sizeof(mock_peer)) {
+        lgtd_errx(1, "addrlen is too small (%d)", (int)*addrlen);
+    }
+
+    memcpy(
+        buf, &mock_datagrams[mock_datagrams_read], sizeof(mock_datagrams[0])
+    );
+    mock_datagrams_read++;
+    memcpy(addr, &mock_peer, sizeof(mock_peer));
+    *addrlen = sizeof(mock_peer);
+    return sizeof(mock_datagrams[0]);
+}
+
+int
+mock_recvmmsg(int socket,
+              struct mmsghdr *msgvec,
+              unsigned int vlen,
+              int flags,
+              struct timespec *timeout)
+{
+    (void)flags;
+    (void)timeout;
+
+    mock_recv_call_count++;
+
+    if (socket != MOCK_SOCKET_FD) {
+        lgtd_errx(1, "got socket %d (expected %d)", socket, MOCK_SOCKET_FD);
+    }
+    if (vlen != LGTD_LIFX_WIRE_RECV_BATCH_SIZE) {
+        lgtd_errx(
+            1, "got vlen %u (expected %d)", vlen, LGTD_LIFX_WIRE_RECV_BATCH_SIZE
+        );
+    }
+
+    int n = 0;
+    while ((unsigned int)n != vlen && mock_datagrams_read != MOCK_DATAGRAMS_COUNT) {
+        struct msghdr *hdr = &msgvec[n].msg_hdr;
+        if (hdr->msg_iovlen != 1) {
+            lgtd_errx(1, "got %d iovecs (expected 1)", (int)hdr->msg_iovlen);
+        }
+        msgvec[n].msg_len = mock_recv_one(
+            hdr->msg_iov->iov_base,
+            hdr->msg_iov->iov_len,
+            hdr->msg_name,
+            &hdr->msg_namelen
+        );
+        n++;
+    }
+
+    if (!n) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return n;
+}
+
+ssize_t
+mock_recvfrom(int socket,
+              void *buffer,
+              size_t length,
+              int flags,
+              struct sockaddr *addr,
+              socklen_t *addrlen)
+{
+    (void)flags;
+
+    mock_recv_call_count++;
+
+    if (socket != MOCK_SOCKET_FD) {
+        lgtd_errx(1, "got socket %d (expected %d)", socket, MOCK_SOCKET_FD);
+    }
+
+    if (mock_datagrams_read == MOCK_DATAGRAMS_COUNT) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return mock_recv_one(buffer, length, addr, addrlen);
+}
+
+static int mock_handle_packet_call_count = 0;
+
+void
+lgtd_lifx_gateway_handle_packet(struct lgtd_lifx_gateway *gw,
+                                const struct sockaddr *peer,
+                                ev_socklen_t addrlen,
+                                const struct lgtd_lifx_packet_info *pkt_info,
+                                const struct lgtd_lifx_packet_header *hdr,
+                                const void *pkt,
+                                lgtd_time_mono_t received_at)
+{
+    if (gw != (void *)0xdeadbeef) {
+        lgtd_errx(1, "got gw %p (expected 0xdeadbeef)", gw);
+    }
+    if (addrlen != sizeof(mock_peer) || memcmp(peer, &mock_peer, addrlen)) {
+        lgtd_errx(1, "got an unexpected peer address");
+    }
+    if (!received_at) {
+        lgtd_errx(1, "received_at isn't set");
+    }
+    if (pkt != (const char *)hdr + sizeof(*hdr)) {
+        lgtd_errx(1, "pkt doesn't follow the header");
+    }
+
+    // The GET_PAN_GATEWAY we slipped in the middle should have been skipped:
+    enum lgtd_lifx_packet_type expected[] = {
+        LGTD_LIFX_GET_LIGHT_STATE, LGTD_LIFX_GET_TAG_LABELS, LGTD_LIFX_GET_INFO
+    };
+    if (mock_handle_packet_call_count >= (int)LGTD_ARRAY_SIZE(expected)) {
+        lgtd_errx(1, "lgtd_lifx_gateway_handle_packet called too many times");
+    }
+    if (hdr->packet_type != expected[mock_handle_packet_call_count]) {
+        lgtd_errx(
+            1, "got packet type %#x (expected %#x)",
+            hdr->packet_type, expected[mock_handle_packet_call_count]
+        );
+    }
+    if (pkt_info->type != hdr->packet_type) {
+        lgtd_errx(1, "pkt_info doesn't match the header");
+    }
+    if (hdr->size != sizeof(*hdr)) {
+        lgtd_errx(1, "the header hasn't been decoded");
+    }
+
+    mock_handle_packet_call_count++;
+}
+
+int
+main(void)
+{
+    lgtd_lifx_wire_setup();
+
+    enum lgtd_lifx_packet_type types[MOCK_DATAGRAMS_COUNT] = {
+        LGTD_LIFX_GET_LIGHT_STATE,
+        LGTD_LIFX_GET_PAN_GATEWAY,
+        LGTD_LIFX_GET_TAG_LABELS,
+        LGTD_LIFX_GET_INFO
+    };
+    for (int i = 0; i != MOCK_DATAGRAMS_COUNT; i++) {
+        uint8_t site[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, 6 };
+        uint8_t addr[LGTD_LIFX_ADDR_LENGTH] = { 1, 2, 3, 4, 5, 6 };
+        union lgtd_lifx_target target = { .addr = addr };
+        // GET_TAG_LABELS has a payload but we don't want one here, the size
+        // gets fixed up below:
+        lgtd_lifx_wire_setup_header(
+            &mock_datagrams[i], LGTD_LIFX_TARGET_DEVICE, target, site, types[i]
+        );
+        mock_datagrams[i].size = htole16(sizeof(mock_datagrams[i]));
+    }
+
+    bool ok = lgtd_lifx_wire_handle_receive(
+        MOCK_SOCKET_FD, (struct lgtd_lifx_gateway *)0xdeadbeef
+    );
+    if (!ok) {
+        lgtd_errx(1, "lgtd_lifx_wire_handle_receive returned false");
+    }
+
+    if (mock_handle_packet_call_count != 3) {
+        lgtd_errx(
+            1, "lgtd_lifx_gateway_handle_packet called %d times (expected 3)",
+            mock_handle_packet_call_count
+        );
+    }
+
+#if LGTD_HAVE_RECVMMSG
+    // everything fits in one batch and a short batch means we are done:
+    int expected_recv_call_count = 1;
+#else
+    int expected_recv_call_count = MOCK_DATAGRAMS_COUNT + 1;
+#endif
+    if (mock_recv_call_count != expected_recv_call_count) {
+        lgtd_errx(
+            1, "recv called %d times (expected %d)",
+            mock_recv_call_count, expected_recv_call_count
+        );
+    }
+
+    // a truncated datagram should reset the socket:
+    mock_datagrams_read = 0;
+    mock_handle_packet_call_count = 0;
+    mock_datagrams[0].size = htole16(sizeof(mock_datagrams[0]) + 1);
+    ok = lgtd_lifx_wire_handle_receive(
+        MOCK_SOCKET_FD, (struct lgtd_lifx_gateway *)0xdeadbeef
+    );
+    if (ok) {
+        lgtd_errx(1, "lgtd_lifx_wire_handle_receive should have failed");
+    }
+    if (mock_handle_packet_call_count) {
+        lgtd_errx(1, "the truncated packet shouldn't have been handled");
+    }
+
+    return 0;
+}